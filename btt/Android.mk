@@ -3,10 +3,29 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES :=  btt_daemon_adapter.c \
+                    btt_daemon_capture.c \
+                    btt_daemon_clients.c \
+                    btt_daemon_connections.c \
+                    btt_daemon_discovery.c \
+                    btt_daemon_events.c \
+                    btt_daemon_gatt_cache.c \
                     btt_daemon_gatt_client.c \
                     btt_daemon_gatt_server.c \
+                    btt_daemon_inject.c \
+                    btt_daemon_long_write.c \
                     btt_daemon_main.c \
+                    btt_daemon_read_multi.c \
+                    btt_daemon_record.c \
+                    btt_daemon_registry.c \
+                    btt_daemon_requests.c \
+                    btt_daemon_scan.c \
+                    btt_framing.c \
                     btt_main.c \
+                    btt_shm.c \
+                    btt_sim_hal.c \
+                    btt_ad_parser.c \
+                    btt_scan_filter.c \
+                    btt_timer_wheel.c \
                     btt_adapter.c \
                     btt_utils.c \
                     btt_gatt_client.c \
@@ -25,3 +44,31 @@ LOCAL_CFLAGS += -Wall -Wextra -Wno-unused -Werror -O0 -g -DDEVELOPMENT_VERSION=1
 LOCAL_STRIP_MODULE := false
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES :=  btt_bench_ad.c \
+                    btt_ad_parser.c
+
+LOCAL_MODULE := btt_bench_ad
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Wextra -Wno-unused -Werror -O2
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES :=  btt_bench_ipc.c \
+                    btt_framing.c \
+                    btt_shm.c \
+                    btt_utils.c
+
+LOCAL_MODULE := btt_bench_ipc
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SHARED_LIBRARIES := libcutils
+
+LOCAL_CFLAGS += -Wall -Wextra -Wno-unused -Werror -O2
+
+include $(BUILD_EXECUTABLE)
@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
@@ -68,11 +69,12 @@
 #define BTT_LOG_D(args...) printf("D " args)
 #define BTT_LOG_V(args...) printf("V " args)
 #else
-#define BTT_LOG_E(args...)
-#define BTT_LOG_W(args...)
-#define BTT_LOG_I(args...)
-#define BTT_LOG_D(args...)
-#define BTT_LOG_V(args...)
+/* statements, so that an if with only a log call still has a body */
+#define BTT_LOG_E(args...) do {} while (0)
+#define BTT_LOG_W(args...) do {} while (0)
+#define BTT_LOG_I(args...) do {} while (0)
+#define BTT_LOG_D(args...) do {} while (0)
+#define BTT_LOG_V(args...) do {} while (0)
 #endif
 #define BTT_LOG_S(args...) printf(args)
 #endif
@@ -106,6 +108,9 @@ struct extended_command {
 struct btt_message {
 	unsigned int command;
 	unsigned int length;
+	/* chosen by the client, echoed in the status and completion
+	 * callbacks of the request, 0 means no correlation */
+	unsigned int request_id;
 };
 
 struct version {
@@ -120,6 +125,136 @@ struct btt_msg_rsp_daemon_check {
 	struct version     version;
 };
 
+/* event classes a client can watch regardless of the owner,
+ * see BTT_CMD_DAEMON_SUBSCRIBE */
+#define BTT_EVENT_ADAPTER (1 << 0)
+#define BTT_EVENT_SCAN    (1 << 1)
+#define BTT_EVENT_GATTC   (1 << 2)
+#define BTT_EVENT_GATTS   (1 << 3)
+#define BTT_EVENT_SCAN_SNAPSHOT (1 << 4)
+#define BTT_EVENT_ALL     (BTT_EVENT_ADAPTER | BTT_EVENT_SCAN | \
+		BTT_EVENT_GATTC | BTT_EVENT_GATTS | BTT_EVENT_SCAN_SNAPSHOT)
+
+struct btt_msg_cmd_daemon_subscribe {
+	struct btt_message hdr;
+	unsigned int       events;
+};
+
+struct btt_msg_rsp_daemon_stats {
+	struct btt_message hdr;
+	/* taken from the event ring */
+	uint64_t events;
+	/* lost because the ring was full */
+	uint64_t dropped;
+	/* events sent to clients, one per recipient */
+	uint64_t messages;
+	/* socket writes carrying them */
+	uint64_t writes;
+	/* events put into shared rings instead */
+	uint64_t shared;
+	/* batching set by "daemon start" */
+	unsigned int capacity;
+	unsigned int batch_events;
+	unsigned int batch_delay_us;
+};
+
+/* Scan results and notifications are then put into a shared memory ring
+ * instead of the socket. Memory and eventfd descriptors come with
+ * the response (SCM_RIGHTS), see btt_shm.h */
+struct btt_msg_cmd_daemon_shm_open {
+	struct btt_message hdr;
+	/* in bytes, 0 for default */
+	unsigned int       size;
+};
+
+struct btt_msg_rsp_daemon_shm_open {
+	struct btt_message hdr;
+	unsigned int       size;
+};
+
+#define BTT_CAPTURE_PATH_LEN 256
+
+/* HAL callbacks are written to an absolute path until the capture
+ * is stopped, see btt_daemon_capture.h */
+struct btt_msg_cmd_daemon_capture {
+	struct btt_message hdr;
+	unsigned int       start;
+	char               path[BTT_CAPTURE_PATH_LEN];
+};
+
+/* captured callbacks are fed to the daemon again, BTT_RSP_DAEMON_REPLAY
+ * comes when all of them are replayed */
+struct btt_msg_cmd_daemon_replay {
+	struct btt_message hdr;
+	/* do not keep the original pace */
+	unsigned int       max_speed;
+	char               path[BTT_CAPTURE_PATH_LEN];
+};
+
+struct btt_msg_rsp_daemon_replay {
+	struct btt_message hdr;
+	uint64_t records;
+	/* malformed or unknown records */
+	uint64_t skipped;
+	uint64_t duration_ns;
+};
+
+#define BTT_ECHO_MAX_LEN 4096
+
+/* data are sent back in BTT_RSP_DAEMON_ECHO, cost of the IPC alone */
+struct btt_msg_cmd_daemon_echo {
+	struct btt_message hdr;
+	uint8_t            data[BTT_ECHO_MAX_LEN];
+};
+
+enum btt_inject_kind {
+	BTT_INJECT_SCAN_RESULT = 1,
+	BTT_INJECT_NOTIFY,
+	/* notifications not waiting for room, the event ring overflows */
+	BTT_INJECT_NOTIFY_FLOOD
+};
+
+/* Synthetic HAL callbacks, every one a distinct device or a notification
+ * of size bytes, see btt_daemon_inject.h. BTT_RSP_DAEMON_INJECT comes
+ * after the last one. */
+struct btt_msg_cmd_daemon_inject {
+	struct btt_message hdr;
+	unsigned int       kind;
+	unsigned int       count;
+	unsigned int       size;
+};
+
+struct btt_msg_rsp_daemon_inject {
+	struct btt_message hdr;
+	uint64_t injected;
+	/* times the event ring was full and the injector waited */
+	uint64_t waits;
+	uint64_t duration_ns;
+};
+
+/* notifications are written into a memory mapped file instead of being
+ * delivered, see btt_daemon_record.h. BTT_RSP_DAEMON_RECORD comes every
+ * sync_ms and when the recording stops. */
+struct btt_msg_cmd_daemon_record {
+	struct btt_message hdr;
+	unsigned int       start;
+	/* 0 for the defaults */
+	unsigned int       size_mb;
+	unsigned int       sync_ms;
+	char               path[BTT_CAPTURE_PATH_LEN];
+};
+
+struct btt_msg_rsp_daemon_record {
+	struct btt_message hdr;
+	uint64_t records;
+	/* did not fit into the file */
+	uint64_t dropped;
+	uint64_t bytes;
+	/* notifications per second since the previous one */
+	uint32_t rate;
+	uint32_t stopped;
+};
+
 enum btt_command {
 	/* TODO: Sort and use explicit values - 0, 1, 2, etc. */
 	BTT_STATUS_START = 1,
@@ -134,6 +269,20 @@ enum btt_command {
 	BTT_CMD_DAEMON_CHECK,
 	BTT_RSP_DAEMON_CHECK,
 	BTT_CMD_DAEMON_STOP,
+	BTT_CMD_DAEMON_SUBSCRIBE,
+	BTT_CMD_DAEMON_STATS,
+	BTT_RSP_DAEMON_STATS,
+	BTT_CMD_DAEMON_SHM_OPEN,
+	BTT_RSP_DAEMON_SHM_OPEN,
+	BTT_CMD_DAEMON_CAPTURE,
+	BTT_CMD_DAEMON_REPLAY,
+	BTT_RSP_DAEMON_REPLAY,
+	BTT_CMD_DAEMON_ECHO,
+	BTT_RSP_DAEMON_ECHO,
+	BTT_CMD_DAEMON_INJECT,
+	BTT_RSP_DAEMON_INJECT,
+	BTT_CMD_DAEMON_RECORD,
+	BTT_RSP_DAEMON_RECORD,
 	BTT_DAEMON_END,
 	BTT_DAEMON_CMD_RSP_END,
 
@@ -176,6 +325,20 @@ enum btt_command {
 	BTT_CMD_GATT_CLIENT_GET_DEVICE_TYPE,
 	BTT_CMD_GATT_CLIENT_SET_ADV_DATA,
 	BTT_CMD_GATT_CLIENT_TEST_COMMAND,
+	BTT_CMD_GATT_CLIENT_SCAN_RESET,
+	BTT_CMD_GATT_CLIENT_SCAN_SNAPSHOTS,
+	BTT_CMD_GATT_CLIENT_SCAN_FILTER,
+	BTT_CMD_GATT_CLIENT_SCAN_REPORT,
+	BTT_CMD_GATT_CLIENT_CACHE,
+	BTT_CMD_GATT_CLIENT_DISCOVER_ALL,
+	BTT_CMD_GATT_CLIENT_LONG_WRITE,
+	BTT_CMD_GATT_CLIENT_LONG_WRITE_DATA,
+	BTT_CMD_GATT_CLIENT_READ_MULTI,
+	BTT_CMD_GATT_CLIENT_CONNECTIONS,
+	BTT_CMD_GATT_CLIENT_AUTO_RECONNECT,
+	BTT_CMD_GATT_CLIENT_READ_HANDLE,
+	BTT_CMD_GATT_CLIENT_WRITE_HANDLE,
+	BTT_CMD_GATT_CLIENT_NOTIFY_HANDLE,
 	BTT_GATT_CLIENT_CMD_RSP_END,
 
 	BTT_GATT_SERVER_CMD_RSP_START = 1300,
@@ -288,6 +451,14 @@ enum btt_callback {
 	BTT_GATT_CLIENT_CB_LISTEN,
 	BTT_GATT_CLIENT_CB_BT_STATUS,
 	BTT_GATT_CLIENT_CB_GET_DEVICE_TYPE,
+	BTT_GATT_CLIENT_CB_SCAN_SNAPSHOT,
+	BTT_GATT_CLIENT_CB_CACHE,
+	BTT_GATT_CLIENT_CB_DISCOVER_ALL,
+	BTT_GATT_CLIENT_CB_DISCOVER_ALL_COMPLETE,
+	BTT_GATT_CLIENT_CB_LONG_WRITE,
+	BTT_GATT_CLIENT_CB_READ_MULTI,
+	BTT_GATT_CLIENT_CB_READ_MULTI_COMPLETE,
+	BTT_GATT_CLIENT_CB_CONNECTIONS,
 	BTT_GATT_CLIENT_CB_END,
 
 	BTT_GATT_SERVER_CB_START,
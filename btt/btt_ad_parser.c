@@ -0,0 +1,263 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_eir_data_types.h"
+#include "btt_ad_parser.h"
+
+/* BASE_UUID 00000000-0000-1000-8000-00805F9B34FB, little endian
+ * like bt_uuid_t, short UUIDs go to the last 4 bytes */
+static const uint8_t base_uuid[16] = { 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00,
+		0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/* Walk AD structures of data once, every length is checked against len.
+ * Zero length bytes are padding: scan response may start at a fixed
+ * offset after zero padded advertising data. Return FALSE if an AD
+ * structure does not fit, fields before it are still valid. */
+bool btt_ad_parse(struct btt_ad *ad, const uint8_t *data, size_t len)
+{
+	size_t pos = 0;
+
+	ad->fields_num = 0;
+	ad->types = 0;
+	ad->truncated = FALSE;
+
+	while (pos < len) {
+		struct btt_ad_field *field;
+		uint8_t field_len = data[pos];
+
+		if (!field_len) {
+			pos++;
+			continue;
+		}
+
+		if (field_len > len - pos - 1 ||
+				ad->fields_num >= BTT_AD_MAX_FIELDS) {
+			ad->truncated = TRUE;
+			return FALSE;
+		}
+
+		field = &ad->fields[ad->fields_num++];
+		field->type = data[pos + 1];
+		field->len = field_len - 1;
+		field->data = &data[pos + 2];
+
+		if (field->type < 64)
+			ad->types |= 1ull << field->type;
+
+		pos += field_len + 1;
+	}
+
+	return TRUE;
+}
+
+static const struct btt_ad_field *find_from(const struct btt_ad *ad,
+		unsigned int i, uint8_t type)
+{
+	for (; i < ad->fields_num; i++) {
+		if (ad->fields[i].type == type)
+			return &ad->fields[i];
+	}
+
+	return NULL;
+}
+
+/* first AD structure of type, NULL if there is none */
+const struct btt_ad_field *btt_ad_find(const struct btt_ad *ad, uint8_t type)
+{
+	if (type < 64 && !(ad->types & (1ull << type)))
+		return NULL;
+
+	return find_from(ad, 0, type);
+}
+
+/* next AD structure of the same type, types like service data repeat */
+const struct btt_ad_field *btt_ad_next(const struct btt_ad *ad,
+		const struct btt_ad_field *field)
+{
+	return find_from(ad, field - ad->fields + 1, field->type);
+}
+
+bool btt_ad_flags(const struct btt_ad *ad, uint8_t *flags)
+{
+	const struct btt_ad_field *field = btt_ad_find(ad, FLAGS);
+
+	if (!field || field->len < 1)
+		return FALSE;
+
+	*flags = field->data[0];
+	return TRUE;
+}
+
+/* name is not terminated, complete one is preferred */
+bool btt_ad_name(const struct btt_ad *ad, const char **name, uint8_t *len,
+		bool *complete)
+{
+	const struct btt_ad_field *field;
+
+	*complete = TRUE;
+	field = btt_ad_find(ad, COMPLETE_LOCAL_NAME);
+
+	if (!field) {
+		*complete = FALSE;
+		field = btt_ad_find(ad, SHORTENED_LOCAL_NAME);
+	}
+
+	if (!field)
+		return FALSE;
+
+	*name = (const char *) field->data;
+	*len = field->len;
+	return TRUE;
+}
+
+bool btt_ad_tx_power(const struct btt_ad *ad, int8_t *tx_power)
+{
+	const struct btt_ad_field *field = btt_ad_find(ad, TX_POWER_LEVEL);
+
+	if (!field || field->len != 1)
+		return FALSE;
+
+	*tx_power = (int8_t) field->data[0];
+	return TRUE;
+}
+
+bool btt_ad_appearance(const struct btt_ad *ad, uint16_t *appearance)
+{
+	const struct btt_ad_field *field = btt_ad_find(ad, APPEARANCE);
+
+	if (!field || field->len != 2)
+		return FALSE;
+
+	*appearance = get_le16(field->data);
+	return TRUE;
+}
+
+/* in units of 1.25 ms */
+bool btt_ad_conn_interval(const struct btt_ad *ad, uint16_t *min,
+		uint16_t *max)
+{
+	const struct btt_ad_field *field;
+
+	field = btt_ad_find(ad, SLAVE_CONNECTION_INTERVAL_RANGE);
+
+	if (!field || field->len != 4)
+		return FALSE;
+
+	*min = get_le16(field->data);
+	*max = get_le16(field->data + 2);
+	return TRUE;
+}
+
+bool btt_ad_manufacturer(const struct btt_ad *ad, uint16_t *company,
+		const uint8_t **data, uint8_t *len)
+{
+	const struct btt_ad_field *field;
+
+	field = btt_ad_find(ad, MANUFACTURER_SPECIFIC_DATA);
+
+	if (!field || field->len < 2)
+		return FALSE;
+
+	*company = get_le16(field->data);
+	*data = field->data + 2;
+	*len = field->len - 2;
+	return TRUE;
+}
+
+/* bytes per UUID of UUID list or service data type, 0 for other types */
+unsigned int btt_ad_uuid_width(uint8_t type)
+{
+	switch (type) {
+	case INCOMPLETE_LIST_OF_16_BIT_SERVICE_CLASS_UUIDS:
+	case COMPLETE_LIST_OF_16_BIT_SERVICE_CLASS_UUIDS:
+	case LIST_OF_16_BIT_SERVICE_SOLICITATION_UUIDS:
+	case SERVICE_DATA_16_BIT_UUID:
+		return 2;
+	case INCOMPLETE_LIST_OF_32_BIT_SERVICE_CLASS_UUIDS:
+	case COMPLETE_LIST_OF_32_BIT_SERVICE_CLASS_UUIDS:
+	case LIST_OF_32_BIT_SERVICE_SOLICITATION_UUIDS:
+	case SERVICE_DATA_32_BIT_UUID:
+		return 4;
+	case INCOMPLETE_LIST_OF_128_BIT_SERVICE_CLASS_UUIDS:
+	case COMPLETE_LIST_OF_128_BIT_SERVICE_CLASS_UUIDS:
+	case LIST_OF_128_BIT_SERVICE_SOLICITATION_UUIDS:
+	case SERVICE_DATA_128_BIT_UUID:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+/* number of whole UUIDs in a UUID list */
+unsigned int btt_ad_uuid_count(const struct btt_ad_field *field)
+{
+	unsigned int width = btt_ad_uuid_width(field->type);
+
+	return width ? field->len / width : 0;
+}
+
+static void expand_uuid(const uint8_t *src, unsigned int width,
+		bt_uuid_t *uuid)
+{
+	if (width == 16) {
+		memcpy(uuid->uu, src, 16);
+		return;
+	}
+
+	memcpy(uuid->uu, base_uuid, 16);
+	memcpy(&uuid->uu[12], src, width);
+}
+
+/* i-th UUID of a UUID list, expanded to 128 bits */
+bool btt_ad_uuid(const struct btt_ad_field *field, unsigned int i,
+		bt_uuid_t *uuid)
+{
+	unsigned int width = btt_ad_uuid_width(field->type);
+
+	if (!width || i >= field->len / width)
+		return FALSE;
+
+	expand_uuid(field->data + i * width, width, uuid);
+	return TRUE;
+}
+
+/* UUID and data of a service data AD structure */
+bool btt_ad_service_data(const struct btt_ad_field *field, bt_uuid_t *uuid,
+		const uint8_t **data, uint8_t *len)
+{
+	unsigned int width;
+
+	if (field->type != SERVICE_DATA_16_BIT_UUID &&
+			field->type != SERVICE_DATA_32_BIT_UUID &&
+			field->type != SERVICE_DATA_128_BIT_UUID)
+		return FALSE;
+
+	width = btt_ad_uuid_width(field->type);
+
+	if (field->len < width)
+		return FALSE;
+
+	expand_uuid(field->data, width, uuid);
+	*data = field->data + width;
+	*len = field->len - width;
+	return TRUE;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_AD_PARSER_H
+#error Included twice
+#endif
+#define BTT_AD_PARSER_H
+
+/* requires btt_eir_data_types.h */
+
+/* advertising data followed by scan response, as given by scan_result_cb */
+#define BTT_AD_DATA_LEN   62
+/* every AD structure takes at least 2 bytes */
+#define BTT_AD_MAX_FIELDS (BTT_AD_DATA_LEN / 2)
+
+/* one AD structure, data points into the parsed buffer */
+struct btt_ad_field {
+	uint8_t type;
+	uint8_t len;
+	const uint8_t *data;
+};
+
+/* Result of a single walk over AD structures. Nothing is copied, views
+ * are valid as long as the parsed buffer is. */
+struct btt_ad {
+	unsigned int fields_num;
+	struct btt_ad_field fields[BTT_AD_MAX_FIELDS];
+	/* bit per type below 64, lets absent types be skipped quickly */
+	uint64_t types;
+	/* last AD structure went past the end of the buffer */
+	bool truncated;
+};
+
+extern bool btt_ad_parse(struct btt_ad *ad, const uint8_t *data, size_t len);
+extern const struct btt_ad_field *btt_ad_find(const struct btt_ad *ad,
+		uint8_t type);
+extern const struct btt_ad_field *btt_ad_next(const struct btt_ad *ad,
+		const struct btt_ad_field *field);
+
+/* typed views, FALSE if the type is absent or malformed */
+extern bool btt_ad_flags(const struct btt_ad *ad, uint8_t *flags);
+extern bool btt_ad_name(const struct btt_ad *ad, const char **name,
+		uint8_t *len, bool *complete);
+extern bool btt_ad_tx_power(const struct btt_ad *ad, int8_t *tx_power);
+extern bool btt_ad_appearance(const struct btt_ad *ad, uint16_t *appearance);
+extern bool btt_ad_conn_interval(const struct btt_ad *ad, uint16_t *min,
+		uint16_t *max);
+extern bool btt_ad_manufacturer(const struct btt_ad *ad, uint16_t *company,
+		const uint8_t **data, uint8_t *len);
+
+/* UUID lists (service class and solicitation) and service data */
+extern unsigned int btt_ad_uuid_width(uint8_t type);
+extern unsigned int btt_ad_uuid_count(const struct btt_ad_field *field);
+extern bool btt_ad_uuid(const struct btt_ad_field *field, unsigned int i,
+		bt_uuid_t *uuid);
+extern bool btt_ad_service_data(const struct btt_ad_field *field,
+		bt_uuid_t *uuid, const uint8_t **data, uint8_t *len);
@@ -89,90 +89,58 @@ void run_adapter_help(int argc, char **argv) {
 static void process_request(enum reguest_type_t type, void *data)
 {
 	struct btt_message msg;
-	struct timeval     tv;
-	struct btt_message  btt_cb;
 
 	errno = 0;
 
 	switch (type) {
 	case BTT_REQ_ADDRESS:
-		tv.tv_sec  = 1;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		msg.command = BTT_CMD_ADAPTER_ADDRESS;
 		msg.length  = 0;
-		if (send(app_socket, (const char *)&msg,
-				sizeof(struct btt_message) + msg.length, 0) == -1)
+		if (send_request(app_socket, &msg,
+				sizeof(struct btt_message) + msg.length) == -1)
 			return;
 
 		break;
 	case BTT_REQ_NAME:
-		tv.tv_sec  = 1;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		msg.command = BTT_CMD_ADAPTER_NAME;
 		msg.length  = 0;
-		if (send(app_socket, (const char *)&msg,
-				sizeof(struct btt_message) + msg.length, 0) == -1)
+		if (send_request(app_socket, &msg,
+				sizeof(struct btt_message) + msg.length) == -1)
 			return;
 
 		break;
 	case BTT_REQ_UP:
-		tv.tv_sec  = 3;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		msg.command = BTT_CMD_ADAPTER_UP;
 		msg.length  = 0;
-		if (send(app_socket, (const char *)&msg,
-				sizeof(struct btt_message) + msg.length, 0) == -1)
+		if (send_request(app_socket, &msg,
+				sizeof(struct btt_message) + msg.length) == -1)
 			return;
 
 		break;
 	case BTT_REQ_DOWN:
-		tv.tv_sec  = 3;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		msg.command = BTT_CMD_ADAPTER_DOWN;
 		msg.length  = 0;
-		if (send(app_socket, (const char *)&msg,
-				sizeof(struct btt_message) + msg.length, 0) == -1)
+		if (send_request(app_socket, &msg,
+				sizeof(struct btt_message) + msg.length) == -1)
 			return;
 
 		break;
 	case BTT_REQ_SCAN:
-		tv.tv_sec  = 15;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		msg.command = BTT_CMD_ADAPTER_SCAN;
 		msg.length  = 0;
-		if (send(app_socket, (const char *)&msg,
-				sizeof(struct btt_message) + msg.length, 0) == -1)
+		if (send_request(app_socket, &msg,
+				sizeof(struct btt_message) + msg.length) == -1)
 			return;
 
 		break;
 	case BTT_REQ_SSP_REPLY: {
 		struct btt_msg_cmd_ssp *cmd_ssp;
 
-		tv.tv_sec  = 4;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		FILL_MSG_P(data, cmd_ssp, BTT_RSP_SSP_REPLY);
 
-		if (send(app_socket, (const char *) cmd_ssp,
-				sizeof(struct btt_msg_cmd_ssp)
-				+ cmd_ssp->hdr.length, 0) == -1)
+		if (send_request(app_socket, cmd_ssp,
+				sizeof(struct btt_message)
+				+ cmd_ssp->hdr.length) == -1)
 			return;
 
 		break;
@@ -180,16 +148,11 @@ static void process_request(enum reguest_type_t type, void *data)
 	case BTT_REQ_PIN_REPLY: {
 		struct btt_msg_cmd_pin *cmd_pin;
 
-		tv.tv_sec  = 4;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *) &tv, sizeof(struct timeval));
-
 		FILL_MSG_P(data, cmd_pin, BTT_RSP_PIN_REPLY);
 
-		if (send(app_socket, (const char *) cmd_pin,
-				sizeof(struct btt_msg_cmd_pin)
-				+ cmd_pin->hdr.length, 0) == -1)
+		if (send_request(app_socket, cmd_pin,
+				sizeof(struct btt_message)
+				+ cmd_pin->hdr.length) == -1)
 			return;
 
 		break;
@@ -197,16 +160,11 @@ static void process_request(enum reguest_type_t type, void *data)
 	case BTT_REQ_SCAN_MODE: {
 		struct btt_msg_cmd_adapter_scan_mode cmd_scan;
 
-		tv.tv_sec  = 3;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		cmd_scan.mode = *(unsigned int *)data;
 		FILL_HDR(cmd_scan, BTT_CMD_ADAPTER_SCAN_MODE);
 
-		if (send(app_socket, (const char *)&cmd_scan,
-				sizeof(struct btt_message) + cmd_scan.hdr.length, 0) == -1)
+		if (send_request(app_socket, &cmd_scan,
+				sizeof(struct btt_message) + cmd_scan.hdr.length) == -1)
 			return;
 
 		break;
@@ -215,16 +173,11 @@ static void process_request(enum reguest_type_t type, void *data)
 		struct btt_msg_cmd_adapter_pair cmd_pair;
 		struct btt_req_pair *req_pair;
 
-		tv.tv_sec  = 15;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		req_pair = (struct btt_req_pair *)data;
 		FILL_HDR(cmd_pair, BTT_CMD_ADAPTER_PAIR);
 		memcpy(cmd_pair.addr, req_pair->addr, sizeof(req_pair->addr));
-		if (send(app_socket, (const char *)&cmd_pair,
-				sizeof(struct btt_message) + cmd_pair.hdr.length, 0) == -1)
+		if (send_request(app_socket, &cmd_pair,
+				sizeof(struct btt_message) + cmd_pair.hdr.length) == -1)
 			return;
 
 		break;
@@ -233,16 +186,11 @@ static void process_request(enum reguest_type_t type, void *data)
 		struct btt_msg_cmd_adapter_pair cmd_unpair;
 		struct btt_req_pair *req_unpair;
 
-		tv.tv_sec  = 15;
-		tv.tv_usec = 0;
-		setsockopt(app_socket, SOL_SOCKET, SO_RCVTIMEO,
-				(char *)&tv,sizeof(struct timeval));
-
 		req_unpair = (struct btt_req_pair *)data;
 		FILL_HDR(cmd_unpair, BTT_CMD_ADAPTER_UNPAIR);
 		memcpy(cmd_unpair.addr, req_unpair->addr, sizeof(req_unpair->addr));
-		if (send(app_socket, (const char *)&cmd_unpair,
-				sizeof(struct btt_message) + cmd_unpair.hdr.length, 0) == -1)
+		if (send_request(app_socket, &cmd_unpair,
+				sizeof(struct btt_message) + cmd_unpair.hdr.length) == -1)
 			return;
 
 		break;
@@ -254,13 +202,11 @@ static void process_request(enum reguest_type_t type, void *data)
 
 void handle_adapter_cb(const struct btt_message *btt_cb)
 {
-	char *buffer;
-
 	switch (btt_cb->command) {
 	case BTT_ADAPTER_CB_BT_STATUS: {
 		struct btt_cb_adapter_bt_status status;
 
-		if (!RECV(&status, app_socket)) {
+		if (!MSG_COPY(&status, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -273,7 +219,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_PIN_REQUEST: {
 		struct btt_cb_adapter_pin_request pin_req;
 
-		if (!RECV(&pin_req, app_socket)) {
+		if (!MSG_COPY(&pin_req, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -289,7 +235,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_SSP_REQUEST: {
 		struct btt_cb_adapter_ssp_request ssp_request;
 
-		if (!RECV(&ssp_request, app_socket)) {
+		if (!MSG_COPY(&ssp_request, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -307,7 +253,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_BOND_STATE_CHANGED: {
 		struct btt_cb_adapter_bond_state_changed state;
 
-		if (!RECV(&state, app_socket)) {
+		if (!MSG_COPY(&state, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -335,7 +281,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_DEVICE_FOUND: {
 		struct btt_cb_adapter_device_found device;
 
-		if (!RECV(&device, app_socket)) {
+		if (!MSG_COPY(&device, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -349,7 +295,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_DISCOVERY: {
 		struct btt_cb_adapter_discovery discovery;
 
-		if (!RECV(&discovery, app_socket)) {
+		if (!MSG_COPY(&discovery, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -362,7 +308,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_ADDRESS: {
 		struct btt_cb_adapter_addr address;
 
-		if (!RECV(&address, app_socket)) {
+		if (!MSG_COPY(&address, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -376,7 +322,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_STATE_CHANGED: {
 		struct btt_cb_adapter_state state;
 
-		if (!RECV(&state, app_socket)) {
+		if (!MSG_COPY(&state, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -388,7 +334,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_SCAN_MODE_CHANGED: {
 		struct btt_cb_adapter_scan_mode_changed scan_mode;
 
-		if (!RECV(&scan_mode, app_socket)) {
+		if (!MSG_COPY(&scan_mode, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -414,7 +360,7 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 	case BTT_ADAPTER_NAME: {
 		struct btt_cb_adapter_name name;
 
-		if (!RECV(&name, app_socket)) {
+		if (!MSG_COPY(&name, btt_cb)) {
 			BTT_LOG_E("ERROR: Incorrect size of received structure.");
 			return;
 		}
@@ -425,13 +371,6 @@ void handle_adapter_cb(const struct btt_message *btt_cb)
 		break;
 	}
 	default:
-		buffer = malloc(btt_cb->length);
-
-		if (buffer) {
-			recv(app_socket, buffer, btt_cb->length, 0);
-			free(buffer);
-		}
-
 		break;
 	}
 }
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Microbenchmark of the advertising data parser: parses typical
+ * advertisements and reads every view the daemon could report.
+ * Usage: btt_bench_ad [iterations] */
+
+#include "btt.h"
+#include "btt_eir_data_types.h"
+#include "btt_ad_parser.h"
+
+#define DEFAULT_ITERATIONS 2000000
+
+struct bench_case {
+	const char *name;
+	uint8_t data[BTT_AD_DATA_LEN];
+};
+
+static const struct bench_case cases[] = {
+	{ "flags_name", {
+		0x02, FLAGS, 0x06,
+		0x09, COMPLETE_LOCAL_NAME, 'b', 't', 't', '-', 't', 'e', 's', 't' } },
+	{ "ibeacon", {
+		0x02, FLAGS, 0x06,
+		0x1A, MANUFACTURER_SPECIFIC_DATA, 0x4C, 0x00, 0x02, 0x15,
+		0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB, 0x48, 0xD2,
+		0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0,
+		0x00, 0x01, 0x00, 0x02, 0xC5 } },
+	{ "eddystone", {
+		0x02, FLAGS, 0x06,
+		0x03, COMPLETE_LIST_OF_16_BIT_SERVICE_CLASS_UUIDS, 0xAA, 0xFE,
+		0x11, SERVICE_DATA_16_BIT_UUID, 0xAA, 0xFE, 0x10, 0xEB, 0x03,
+		'e', 'x', 'a', 'm', 'p', 'l', 'e', 0x07, 0x00, 0x00, 0x00 } },
+	/* advertising data padded to 31 bytes, then scan response */
+	{ "adv_scan_rsp", {
+		0x02, FLAGS, 0x05,
+		0x05, COMPLETE_LIST_OF_16_BIT_SERVICE_CLASS_UUIDS,
+			0x0D, 0x18, 0x0F, 0x18,
+		0x02, TX_POWER_LEVEL, 0xF4,
+		0x03, APPEARANCE, 0x41, 0x03,
+		0x05, SLAVE_CONNECTION_INTERVAL_RANGE, 0x06, 0x00, 0x0C, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x11, COMPLETE_LIST_OF_128_BIT_SERVICE_CLASS_UUIDS,
+		0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0,
+		0x93, 0xF3, 0xA3, 0xB5, 0x01, 0x00, 0x40, 0x6E,
+		0x0B, SHORTENED_LOCAL_NAME, 'h', 'e', 'a', 'r', 't', '-', 'r',
+			'a', 't', 'e' } },
+	/* last AD structure claims more than there is */
+	{ "truncated", {
+		0x02, FLAGS, 0x06,
+		0x40, MANUFACTURER_SPECIFIC_DATA, 0x59, 0x00 } },
+};
+
+#define CASES_NUM (sizeof(cases) / sizeof(cases[0]))
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* everything scan result reporting could ask for */
+static unsigned int read_views(const struct btt_ad *ad)
+{
+	const struct btt_ad_field *field;
+	const uint8_t *data;
+	const char *name;
+	bt_uuid_t uuid;
+	uint16_t u16, max;
+	uint8_t flags, len;
+	int8_t tx_power;
+	bool complete;
+	unsigned int sum = 0;
+	unsigned int i, j;
+
+	if (btt_ad_flags(ad, &flags))
+		sum += flags;
+
+	if (btt_ad_name(ad, &name, &len, &complete))
+		sum += len;
+
+	if (btt_ad_tx_power(ad, &tx_power))
+		sum += tx_power;
+
+	if (btt_ad_appearance(ad, &u16))
+		sum += u16;
+
+	if (btt_ad_conn_interval(ad, &u16, &max))
+		sum += u16 + max;
+
+	if (btt_ad_manufacturer(ad, &u16, &data, &len))
+		sum += u16 + len;
+
+	for (i = 0; i < ad->fields_num; i++) {
+		field = &ad->fields[i];
+
+		if (btt_ad_service_data(field, &uuid, &data, &len)) {
+			sum += uuid.uu[12] + len;
+			continue;
+		}
+
+		for (j = 0; j < btt_ad_uuid_count(field); j++)
+			if (btt_ad_uuid(field, j, &uuid))
+				sum += uuid.uu[12];
+	}
+
+	return sum;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = DEFAULT_ITERATIONS;
+	struct btt_ad ad;
+	unsigned int c;
+
+	if (argc > 1)
+		iterations = strtoul(argv[1], NULL, 10);
+
+	if (!iterations)
+		iterations = DEFAULT_ITERATIONS;
+
+	for (c = 0; c < CASES_NUM; c++) {
+		volatile unsigned int sink = 0;
+		unsigned long i;
+		uint64_t start;
+		uint64_t elapsed;
+
+		start = now_ns();
+
+		for (i = 0; i < iterations; i++) {
+			btt_ad_parse(&ad, cases[c].data, BTT_AD_DATA_LEN);
+			sink += read_views(&ad);
+		}
+
+		elapsed = now_ns() - start;
+
+		if (!elapsed)
+			elapsed = 1;
+
+		/* one line per case, easy to grep and compare */
+		BTT_LOG_S("ad_parse case=%s fields=%u truncated=%d "
+				"iterations=%lu ns_per_adv=%.1f advs_per_sec=%.0f\n",
+				cases[c].name, ad.fields_num, ad.truncated, iterations,
+				(double) elapsed / iterations,
+				iterations * 1e9 / elapsed);
+	}
+
+	return EXIT_SUCCESS;
+}
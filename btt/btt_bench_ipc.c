@@ -0,0 +1,430 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Benchmark of the daemon IPC: round trips of request/status pairs and
+ * rates of scan result and notification streams, fed by callbacks the
+ * daemon injects itself. Batching is set by "daemon start ring= batch=
+ * delay=", every result line carries it, so runs can be compared.
+ * Usage: btt_bench_ipc [requests] [events] */
+
+#include "btt.h"
+#include <poll.h>
+
+#include "btt_utils.h"
+#include "btt_framing.h"
+#include "btt_shm.h"
+
+#define DEFAULT_REQUESTS 20000
+#define DEFAULT_EVENTS   100000
+/* daemon is considered stuck when nothing comes for this long */
+#define IDLE_TIMEOUT_MS  2000
+
+static const unsigned int echo_sizes[] = { 0, 64, 512, BTT_ECHO_MAX_LEN };
+/* requests in flight at once */
+static const unsigned int windows[] = { 1, 16 };
+static const unsigned int notify_sizes[] = { 20, 244, 600 };
+
+#define ARRAY_NUM(a) (sizeof(a) / sizeof((a)[0]))
+
+static int bench_socket = -1;
+static struct btt_framing rx;
+static struct btt_shm shm = { .mem_fd = -1, .event_fd = -1 };
+/* daemon batching, printed with every result */
+static char setup[64];
+
+/* next message from the socket, NULL if none comes in time */
+static struct btt_message *receive(void)
+{
+	struct pollfd pfd = { bench_socket, POLLIN, 0 };
+	struct btt_message *msg;
+
+	while ((msg = btt_framing_next(&rx)) == NULL) {
+		if (rx.closed || poll(&pfd, 1, IDLE_TIMEOUT_MS) <= 0)
+			return NULL;
+
+		btt_framing_fill(&rx, MSG_DONTWAIT);
+	}
+
+	return msg;
+}
+
+/* send the request and skip everything up to its status or response */
+static struct btt_message *request(void *msg, size_t length)
+{
+	struct btt_message *reply;
+	unsigned int request_id;
+
+	if (send_request(bench_socket, msg, length) == -1)
+		return NULL;
+
+	request_id = ((struct btt_message *) msg)->request_id;
+
+	while ((reply = receive()) != NULL)
+		if (reply->request_id == request_id)
+			return reply;
+
+	return NULL;
+}
+
+static bool get_stats(struct btt_msg_rsp_daemon_stats *stats)
+{
+	struct btt_message msg;
+	struct btt_message *reply;
+
+	msg.command = BTT_CMD_DAEMON_STATS;
+	msg.length = 0;
+	reply = request(&msg, sizeof(msg));
+
+	return reply && reply->command == BTT_RSP_DAEMON_STATS &&
+			MSG_COPY(stats, reply);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const uint64_t *sorted, unsigned int num,
+		double fraction)
+{
+	return sorted[(unsigned int) ((num - 1) * fraction)] / 1000.0;
+}
+
+/* Keep window echo requests in flight, latency of each one is measured
+ * from its send to its response. */
+static bool bench_rtt(unsigned int size, unsigned int window,
+		unsigned int requests, uint64_t *latency)
+{
+	struct btt_msg_cmd_daemon_echo echo;
+	struct btt_message *msg;
+	unsigned int first_id = 0;
+	unsigned int sent = 0;
+	unsigned int done = 0;
+	unsigned int i;
+	uint64_t start;
+	uint64_t elapsed;
+
+	echo.hdr.command = BTT_CMD_DAEMON_ECHO;
+	echo.hdr.length = size;
+	memset(echo.data, 0xA5, size);
+
+	start = monotonic_ns();
+
+	while (done < requests) {
+		while (sent < requests && sent - done < window) {
+			latency[sent] = monotonic_ns();
+
+			if (send_request(bench_socket, &echo,
+					sizeof(struct btt_message) + size) == -1) {
+				BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+				return FALSE;
+			}
+
+			if (!sent)
+				first_id = echo.hdr.request_id;
+
+			sent++;
+		}
+
+		if (!(msg = receive())) {
+			BTT_LOG_E("Daemon does not answer echo requests\n");
+			return FALSE;
+		}
+
+		i = msg->request_id - first_id;
+
+		if (msg->command != BTT_RSP_DAEMON_ECHO || i >= sent)
+			continue;
+
+		latency[i] = monotonic_ns() - latency[i];
+		done++;
+	}
+
+	elapsed = monotonic_ns() - start;
+	qsort(latency, requests, sizeof(*latency), compare_u64);
+
+	/* one line per case, easy to grep and compare */
+	BTT_LOG_S("ipc_rtt %s size=%zu window=%u requests=%u p50_us=%.1f "
+			"p90_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f "
+			"requests_per_sec=%.0f\n", setup,
+			sizeof(struct btt_message) + size, window, requests,
+			percentile_us(latency, requests, 0.5),
+			percentile_us(latency, requests, 0.9),
+			percentile_us(latency, requests, 0.99),
+			percentile_us(latency, requests, 0.999),
+			latency[requests - 1] / 1000.0,
+			requests * 1e9 / (elapsed ? elapsed : 1));
+
+	return TRUE;
+}
+
+struct stream {
+	unsigned int command;
+	unsigned int received;
+	uint64_t bytes;
+	uint64_t last_ns;
+};
+
+static void count_event(struct stream *stream, const struct btt_message *msg)
+{
+	if (msg->command != stream->command)
+		return;
+
+	stream->received++;
+	stream->bytes += sizeof(struct btt_message) + msg->length;
+	stream->last_ns = monotonic_ns();
+}
+
+static void drain_shm(struct stream *stream)
+{
+	struct btt_message *msg;
+
+	while ((msg = btt_shm_next(&shm)) != NULL) {
+		count_event(stream, msg);
+		btt_shm_consume(&shm, msg);
+	}
+}
+
+/* Let the daemon inject count callbacks and take the events they make,
+ * from the socket or the shared ring. Rate is measured from the request
+ * to the last event. A flood loses events, only its answer must come. */
+static bool bench_stream(unsigned int kind, unsigned int size,
+		unsigned int count)
+{
+	struct btt_msg_cmd_daemon_inject inject;
+	struct btt_msg_rsp_daemon_inject done;
+	struct btt_msg_rsp_daemon_stats before;
+	struct btt_msg_rsp_daemon_stats after;
+	struct btt_message *msg;
+	struct pollfd pfds[2];
+	struct stream stream;
+	bool completed = FALSE;
+	uint64_t shm_dropped = shm.ring ? shm.ring->dropped : 0;
+	uint64_t start;
+	uint64_t elapsed;
+	uint64_t writes;
+
+	if (!get_stats(&before))
+		return FALSE;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.command = kind == BTT_INJECT_SCAN_RESULT ?
+			BTT_GATT_CLIENT_CB_SCAN_RESULT : BTT_GATT_CLIENT_CB_NOTIFY;
+
+	FILL_HDR(inject, BTT_CMD_DAEMON_INJECT);
+	inject.kind = kind;
+	inject.count = count;
+	inject.size = size;
+
+	pfds[0].fd = bench_socket;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = shm.event_fd;
+	pfds[1].events = POLLIN;
+
+	start = monotonic_ns();
+	stream.last_ns = start;
+
+	if (send_request(bench_socket, &inject, sizeof(inject)) == -1) {
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+		return FALSE;
+	}
+
+	while ((kind != BTT_INJECT_NOTIFY_FLOOD && stream.received < count) ||
+			!completed) {
+		if (shm.ring) {
+			drain_shm(&stream);
+
+			/* messages came meanwhile */
+			if (!btt_shm_arm(&shm))
+				continue;
+		}
+
+		if (poll(pfds, shm.ring ? 2 : 1, IDLE_TIMEOUT_MS) <= 0)
+			break;
+
+		if (shm.ring && (pfds[1].revents & POLLIN))
+			btt_shm_clear_wakeup(&shm);
+
+		if (!(pfds[0].revents & POLLIN))
+			continue;
+
+		btt_framing_fill(&rx, MSG_DONTWAIT);
+
+		while ((msg = btt_framing_next(&rx)) != NULL) {
+			count_event(&stream, msg);
+
+			if (msg->request_id != inject.hdr.request_id)
+				continue;
+
+			if (msg->command == BTT_RSP_DAEMON_INJECT &&
+					MSG_COPY(&done, msg)) {
+				completed = TRUE;
+			} else if (msg->command != BTT_RSP_OK) {
+				BTT_LOG_E("Daemon refused to inject callbacks\n");
+				return FALSE;
+			}
+		}
+
+		if (rx.closed)
+			return FALSE;
+	}
+
+	if (!completed) {
+		BTT_LOG_E("Injection did not complete\n");
+		return FALSE;
+	}
+
+	elapsed = stream.last_ns - start;
+
+	if (!get_stats(&after))
+		return FALSE;
+
+	writes = after.writes - before.writes;
+
+	BTT_LOG_S("ipc_stream %s kind=%s delivery=%s size=%" PRIu64
+			" events=%u received=%u dropped_ring=%" PRIu64
+			" dropped_shm=%" PRIu64 " injector_waits=%" PRIu64
+			" messages_per_write=%.2f seconds=%.3f events_per_sec=%.0f"
+			" mb_per_sec=%.1f\n", setup,
+			kind == BTT_INJECT_SCAN_RESULT ? "scan" :
+			kind == BTT_INJECT_NOTIFY ? "notify" : "flood",
+			shm.ring ? "shm" : "socket",
+			stream.received ? stream.bytes / stream.received : 0,
+			count, stream.received, after.dropped - before.dropped,
+			shm.ring ? shm.ring->dropped - shm_dropped : 0, done.waits,
+			writes ? (double) (after.messages - before.messages) / writes :
+			0, elapsed / 1e9, stream.received * 1e9 / (elapsed ? elapsed : 1),
+			stream.bytes * 1e3 / (elapsed ? elapsed : 1));
+
+	return TRUE;
+}
+
+static bool bench_streams(unsigned int events)
+{
+	unsigned int i;
+
+	if (!bench_stream(BTT_INJECT_SCAN_RESULT, 0, events))
+		return FALSE;
+
+	for (i = 0; i < ARRAY_NUM(notify_sizes); i++)
+		if (!bench_stream(BTT_INJECT_NOTIFY, notify_sizes[i], events))
+			return FALSE;
+
+	/* request answered even when the event ring overflows */
+	return bench_stream(BTT_INJECT_NOTIFY_FLOOD, notify_sizes[0], events);
+}
+
+static bool subscribe(void)
+{
+	struct btt_msg_cmd_daemon_subscribe msg;
+	struct btt_message *reply;
+
+	FILL_HDR(msg, BTT_CMD_DAEMON_SUBSCRIBE);
+	msg.events = BTT_EVENT_SCAN | BTT_EVENT_GATTC;
+	reply = request(&msg, sizeof(msg));
+
+	return reply && reply->command == BTT_RSP_OK;
+}
+
+/* streams go to the shared ring from now on */
+static bool open_shm(void)
+{
+	struct btt_msg_cmd_daemon_shm_open msg;
+	struct btt_message *reply;
+	int mem_fd;
+	int event_fd;
+
+	FILL_HDR(msg, BTT_CMD_DAEMON_SHM_OPEN);
+	msg.size = BTT_SHM_MAX_SIZE;
+	reply = request(&msg, sizeof(msg));
+
+	if (!reply || reply->command != BTT_RSP_DAEMON_SHM_OPEN)
+		return FALSE;
+
+	mem_fd = btt_framing_take_fd(&rx);
+	event_fd = btt_framing_take_fd(&rx);
+
+	return btt_shm_attach(&shm, mem_fd, event_fd);
+}
+
+int main(int argc, char **argv)
+{
+	struct btt_msg_rsp_daemon_stats stats;
+	unsigned int requests = DEFAULT_REQUESTS;
+	unsigned int events = DEFAULT_EVENTS;
+	uint64_t *latency;
+	unsigned int i;
+	unsigned int j;
+
+	if (argc > 1)
+		requests = strtoul(argv[1], NULL, 10);
+
+	if (argc > 2)
+		events = strtoul(argv[2], NULL, 10);
+
+	if (!requests)
+		requests = DEFAULT_REQUESTS;
+
+	if (!events)
+		events = DEFAULT_EVENTS;
+
+	bench_socket = connect_to_daemon_socket();
+
+	if (bench_socket == -1) {
+		BTT_LOG_S("Daemon is not running\n");
+		return EXIT_FAILURE;
+	}
+
+	btt_framing_init(&rx, bench_socket);
+
+	if (!get_stats(&stats)) {
+		BTT_LOG_S("Daemon does not answer\n");
+		return EXIT_FAILURE;
+	}
+
+	snprintf(setup, sizeof(setup), "ring=%u batch=%u delay_us=%u",
+			stats.capacity, stats.batch_events, stats.batch_delay_us);
+
+	latency = malloc(requests * sizeof(*latency));
+
+	if (!latency)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < ARRAY_NUM(echo_sizes); i++)
+		for (j = 0; j < ARRAY_NUM(windows); j++)
+			if (!bench_rtt(echo_sizes[i], windows[j], requests, latency))
+				return EXIT_FAILURE;
+
+	free(latency);
+
+	if (!subscribe() || !bench_streams(events)) {
+		BTT_LOG_S("Stream benchmark over the socket failed\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!open_shm() || !bench_streams(events)) {
+		BTT_LOG_S("Stream benchmark over the shared ring failed\n");
+		return EXIT_FAILURE;
+	}
+
+	btt_shm_close(&shm);
+	close(bench_socket);
+
+	return EXIT_SUCCESS;
+}
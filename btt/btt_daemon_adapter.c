@@ -15,99 +15,137 @@
  */
 
 #include "btt.h"
+#include <sys/uio.h>
 #include "btt_utils.h"
 #include "btt_adapter.h"
+#include "btt_framing.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_requests.h"
+#include "btt_daemon_events.h"
+
+#include <hardware/bt_gatt.h>
+#include "btt_daemon_capture.h"
+#include "btt_daemon_connections.h"
 
 extern const bt_interface_t *bluetooth_if;
-extern int socket_remote;
 
 void handle_adapter_cmd(const struct btt_message *btt_msg,
 		const int socket_remote)
 {
-	bool do_recv = FALSE;
 	struct btt_cb_adapter_bt_status cb;
 	bt_status_t status = BT_STATUS_FAIL;
 
+	/* adapter events are not owned by anybody, everyone who uses
+	 * the adapter gets them */
+	btt_daemon_registry_watch(socket_remote, BTT_EVENT_ADAPTER);
+
 	switch (btt_msg->command) {
 	case BTT_CMD_ADAPTER_UP:
 		/* TODO: detect status of adapter and fix reply*/
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_STATE_CHANGED);
 		status = bluetooth_if->enable();
-		do_recv = TRUE;
 		break;
 	case BTT_CMD_ADAPTER_DOWN:
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_STATE_CHANGED);
 		status = bluetooth_if->disable();
-		do_recv = TRUE;
 		break;
 	case BTT_CMD_ADAPTER_NAME:
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_NAME);
 		status = bluetooth_if->get_adapter_property(BT_PROPERTY_BDNAME);
-		do_recv = TRUE;
 		break;
 	case BTT_CMD_ADAPTER_ADDRESS:
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_ADDRESS);
 		status = bluetooth_if->get_adapter_property(BT_PROPERTY_BDADDR);
-		do_recv = TRUE;
 		break;
 	case BTT_CMD_ADAPTER_SCAN:
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_DISCOVERY);
 		status = bluetooth_if->start_discovery();
-		do_recv = TRUE;
 		break;
 	case BTT_CMD_ADAPTER_SCAN_MODE: {
-		struct btt_msg_cmd_adapter_scan_mode msg;
+		struct btt_msg_cmd_adapter_scan_mode *msg;
 		bt_property_t  prop;
 		bt_scan_mode_t scan_mode;
 
 		prop.type = BT_PROPERTY_ADAPTER_SCAN_MODE;
 		prop.len  = sizeof(bt_scan_mode_t);
 
-		recv(socket_remote, &msg, sizeof(msg), 0);
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			break;
+		}
 
-		if (msg.mode == 0)
+		if (msg->mode == 0)
 			scan_mode = BT_SCAN_MODE_NONE;
-		else if (msg.mode == 1)
+		else if (msg->mode == 1)
 			scan_mode = BT_SCAN_MODE_CONNECTABLE;
-		else if (msg.mode == 2)
+		else if (msg->mode == 2)
 			scan_mode = BT_SCAN_MODE_CONNECTABLE_DISCOVERABLE;
 		else
 			scan_mode = BT_SCAN_MODE_NONE;
 
 		prop.val = &scan_mode;
 
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_SCAN_MODE_CHANGED);
 		status = bluetooth_if->set_adapter_property(&prop);
 		break;
 	}
 	case BTT_CMD_ADAPTER_PAIR: {
-		struct btt_msg_cmd_adapter_pair msg;
+		struct btt_msg_cmd_adapter_pair *msg;
 
-		recv(socket_remote, &msg, sizeof(msg), 0);
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			break;
+		}
 
-		status = bluetooth_if->create_bond((bt_bdaddr_t *)msg.addr);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_BOND_STATE_CHANGED);
+		status = bluetooth_if->create_bond((bt_bdaddr_t *)msg->addr);
 		break;
 	}
 	case BTT_CMD_ADAPTER_UNPAIR: {
-		struct btt_msg_cmd_adapter_pair msg;
+		struct btt_msg_cmd_adapter_pair *msg;
 
-		recv(socket_remote, &msg, sizeof(msg), 0);
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			break;
+		}
 
-		status = bluetooth_if->remove_bond((bt_bdaddr_t *)msg.addr);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_NONE, 0, BTT_ADAPTER_BOND_STATE_CHANGED);
+		status = bluetooth_if->remove_bond((bt_bdaddr_t *)msg->addr);
 		break;
 	}
 	case BTT_RSP_PIN_REPLY: {
-		struct btt_msg_cmd_pin msg;
+		struct btt_msg_cmd_pin *msg;
 
-		recv(socket_remote, &msg, sizeof(msg), 0);
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			break;
+		}
 
-		status = bluetooth_if->pin_reply((bt_bdaddr_t const *)msg.addr,
-				msg.accept, msg.pin_len,
-				(bt_pin_code_t *)msg.pin_code);
+		status = bluetooth_if->pin_reply((bt_bdaddr_t const *)msg->addr,
+				msg->accept, msg->pin_len,
+				(bt_pin_code_t *)msg->pin_code);
 		break;
 	}
 	case BTT_RSP_SSP_REPLY: {
-		struct btt_msg_cmd_ssp msg;
+		struct btt_msg_cmd_ssp *msg;
 
-		recv(socket_remote, &msg, sizeof(msg), 0);
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			break;
+		}
 
-		status = bluetooth_if->ssp_reply((bt_bdaddr_t const *)msg.addr,
-				(bt_ssp_variant_t)msg.variant,
-				msg.accept, msg.passkey);
+		status = bluetooth_if->ssp_reply((bt_bdaddr_t const *)msg->addr,
+				(bt_ssp_variant_t)msg->variant,
+				msg->accept, msg->passkey);
 		break;
 	}
 	default:
@@ -115,25 +153,22 @@ void handle_adapter_cmd(const struct btt_message *btt_msg,
 		break;
 	}
 
-	if (do_recv)
-		recv(socket_remote, &btt_msg,
-						sizeof(struct btt_message), 0);
+	if (status != BT_STATUS_SUCCESS)
+		btt_daemon_requests_cancel(socket_remote, btt_msg);
 
 	FILL_HDR(cb, BTT_ADAPTER_CB_BT_STATUS);
+	cb.hdr.request_id = btt_msg->request_id;
 	cb.status = status;
 
-	if (send(socket_remote, (const char *) &cb,
-			sizeof(struct btt_cb_adapter_bt_status), 0) == -1) {
+	if (!btt_daemon_client_send(socket_remote, &cb,
+			sizeof(struct btt_cb_adapter_bt_status))) {
 		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
 	}
 }
 
 /*
- * Be careful to close socket in the callback functions below.
- * Some of commands, like BTT_CMD_ADAPTER_UP, trigger calling
- * several callback fucntions in succession. You must make
- * sure that the socket is only be closed in the last callback
- * function which uses the socket to send message to client.
+ * Callbacks below are delivered to every client watching
+ * BTT_EVENT_ADAPTER, see btt_daemon_deliver.
  */
 
 static void btt_cb_adapter_state_changed(bt_state_t state)
@@ -142,6 +177,8 @@ static void btt_cb_adapter_state_changed(bt_state_t state)
 
 	BTT_LOG_I("Callback Adapter State Changed");
 
+	btt_daemon_capture_state(BTT_CAPTURE_ADAPTER_STATE, state);
+
 	FILL_HDR(btt_cb, BTT_ADAPTER_STATE_CHANGED);
 
 	if (state == BT_STATE_OFF)
@@ -149,16 +186,18 @@ static void btt_cb_adapter_state_changed(bt_state_t state)
 	else
 		btt_cb.state = true;
 
-	if (send(socket_remote, (const char *)&btt_cb,
-			sizeof(struct btt_cb_adapter_state), 0) == -1) {
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
-	}
+	btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void btt_cb_adapter_properties(bt_status_t status,
 		int num_properties, bt_property_t *properties)
 {
 	int i = num_properties;
+	int len;
+
+	btt_daemon_capture_properties(BTT_CAPTURE_ADAPTER_PROPERTIES, status,
+			num_properties, properties);
 
 	while (i-- > 0) {
 		switch (properties[i].type) {
@@ -167,17 +206,15 @@ static void btt_cb_adapter_properties(bt_status_t status,
 
 			BTT_LOG_I("Callback Adapter Name");
 
-			btt_cb.hdr.command   = BTT_ADAPTER_NAME;
-			btt_cb.hdr.length = properties[i].len;
+			FILL_HDR(btt_cb, BTT_ADAPTER_NAME);
+			len = properties[i].len < NAME_MAX_LEN ?
+					properties[i].len : NAME_MAX_LEN - 1;
 
-			strncpy(btt_cb.name,
-					(const char *)properties[i].val, properties[i].len);
-			btt_cb.name[btt_cb.hdr.length + 1] = '\0';
+			strncpy(btt_cb.name, (const char *)properties[i].val, len);
+			btt_cb.name[len] = '\0';
 
-			if (send(socket_remote, (const char *)&btt_cb,
-					sizeof(struct btt_cb_adapter_name), 0) == -1) {
-				BTT_LOG_E("%s:System Socket Error 1\n", __FUNCTION__);
-			}
+			btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+					&btt_cb, sizeof(btt_cb));
 
 			break;
 		}
@@ -186,15 +223,12 @@ static void btt_cb_adapter_properties(bt_status_t status,
 
 			BTT_LOG_I("Callback Adapter Address");
 
-			btt_cb.hdr.command   = BTT_ADAPTER_ADDRESS;
-			btt_cb.hdr.length = properties[i].len;
+			FILL_HDR(btt_cb, BTT_ADAPTER_ADDRESS);
 
 			memcpy(btt_cb.bd_addr, properties[i].val, sizeof(bt_bdaddr_t));
 
-			if (send(socket_remote, (const char *)&btt_cb,
-					sizeof(struct btt_cb_adapter_addr), 0) == -1) {
-				BTT_LOG_E("%s:System Socket Error 2\n", __FUNCTION__);
-			}
+			btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+					&btt_cb, sizeof(btt_cb));
 
 			break;
 		}
@@ -225,10 +259,8 @@ static void btt_cb_adapter_properties(bt_status_t status,
 				break;
 			}
 
-			if (send(socket_remote, (const char *)&btt_cb,
-					sizeof(struct btt_cb_adapter_addr), 0) == -1) {
-				BTT_LOG_E("%s:System Socket Error 3\n", __FUNCTION__);
-			}
+			btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+					&btt_cb, sizeof(btt_cb));
 
 			break;
 		}
@@ -257,6 +289,9 @@ static void btt_cb_device_found(int num_properties, bt_property_t *properties)
 
 	BTT_LOG_I("Callback Device Found Properties");
 
+	btt_daemon_capture_properties(BTT_CAPTURE_DEVICE_FOUND,
+			BT_STATUS_SUCCESS, num_properties, properties);
+
 	while (i-- > 0) {
 		switch (properties[i].type) {
 		case BT_PROPERTY_BDNAME:
@@ -275,15 +310,8 @@ static void btt_cb_device_found(int num_properties, bt_property_t *properties)
 		}
 	}
 
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
-
-	if (send(socket_remote, (const char *)&btt_cb,
-			sizeof(struct btt_cb_adapter_device_found), 0) == -1) {
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
-	}
-	/* do NOT close(socket_remote) here,
-	 * we will continue sending the found device info to client one by one
-	 */
+	btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void btt_cb_discovery_state_changed(bt_discovery_state_t state)
@@ -294,15 +322,15 @@ static void btt_cb_discovery_state_changed(bt_discovery_state_t state)
 
 	BTT_LOG_I("Callback Discovery State Changed");
 
+	btt_daemon_capture_state(BTT_CAPTURE_DISCOVERY_STATE, state);
+
 	if (state == BT_DISCOVERY_STOPPED)
 		btt_cb.state = false;
 	else
 		btt_cb.state = true;
 
-	if (send(socket_remote, (const char *)&btt_cb,
-			sizeof(struct btt_cb_adapter_discovery), 0) == -1) {
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
-	}
+	btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void btt_cb_pin_request(bt_bdaddr_t *remote_bd_addr,
@@ -312,15 +340,16 @@ static void btt_cb_pin_request(bt_bdaddr_t *remote_bd_addr,
 
 	BTT_LOG_I("Callback Pin Request");
 
+	btt_daemon_capture_pairing(BTT_CAPTURE_PIN_REQUEST, remote_bd_addr,
+			bd_name, cod, 0, 0);
+
 	FILL_HDR(btt_cb, BTT_ADAPTER_PIN_REQUEST);
 	btt_cb.cod = cod;
 	memcpy(btt_cb.bd_addr, remote_bd_addr->address, BD_ADDR_LEN);
 	strcpy(btt_cb.name, (char *)bd_name->name);
 
-	if (send(socket_remote, (const char *)&btt_cb,
-			sizeof(struct btt_cb_adapter_pin_request), 0) == -1) {
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
-	}
+	btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void btt_cb_ssp_request(bt_bdaddr_t *remote_bd_addr,
@@ -331,6 +360,9 @@ static void btt_cb_ssp_request(bt_bdaddr_t *remote_bd_addr,
 
 	BTT_LOG_I("Callback SSP Request");
 
+	btt_daemon_capture_pairing(BTT_CAPTURE_SSP_REQUEST, remote_bd_addr,
+			bd_name, cod, pairing_variant, pass_key);
+
 	FILL_HDR(btt_cb, BTT_ADAPTER_SSP_REQUEST);
 	btt_cb.cod     = cod;
 	btt_cb.passkey = pass_key;
@@ -341,10 +373,8 @@ static void btt_cb_ssp_request(bt_bdaddr_t *remote_bd_addr,
 
 	btt_cb.variant = pairing_variant;
 
-	if (send(socket_remote, (const char *) &btt_cb,
-			sizeof(struct btt_cb_adapter_ssp_request), 0) == -1) {
-		BTT_LOG_E("%s:System Socket Error 1\n", __FUNCTION__);
-	}
+	btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void btt_cb_bond_state_changed(bt_status_t status,
@@ -354,15 +384,16 @@ static void btt_cb_bond_state_changed(bt_status_t status,
 
 	BTT_LOG_I("Callback Bond State Changed");
 
+	btt_daemon_capture_bond_state(status, remote_bd_addr, state);
+	btt_daemon_connections_bond_state(remote_bd_addr, state);
+
 	FILL_HDR(btt_cb, BTT_ADAPTER_BOND_STATE_CHANGED);
 	btt_cb.status   = status;
 	btt_cb.state    = state;
 	memcpy(btt_cb.bd_addr, remote_bd_addr->address, BD_ADDR_LEN);
 
-	if (send(socket_remote, (const char *)&btt_cb,
-			sizeof(struct btt_cb_adapter_bond_state_changed), 0) == -1) {
-		BTT_LOG_E("%s:System Socket Error 1\n", __FUNCTION__);
-	}
+	btt_daemon_deliver(BTT_EVENT_ADAPTER, BTT_DAEMON_KEY_NONE, 0,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void btt_cb_acl_state_changed(bt_status_t status,
@@ -0,0 +1,747 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/uio.h>
+#include <hardware/bt_gatt.h>
+
+#include "btt_utils.h"
+#include "btt_ad_parser.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_requests.h"
+#include "btt_daemon_adapter.h"
+#include "btt_daemon_gatt_client.h"
+#include "btt_daemon_gatt_server.h"
+#include "btt_daemon_capture.h"
+
+/* Capture: HAL callbacks copy their arguments into one buffer while
+ * the writer thread appends the other one to the file, so callbacks
+ * never wait for the disk. Records which do not fit are dropped.
+ * Replay reads the file on its own thread and calls the same callbacks
+ * the HAL does, at the original pace or as fast as possible. */
+
+#define CAPTURE_BUFFER_SIZE (256 * 1024)
+/* buffer is written at least this often, so the file stays current */
+#define CAPTURE_FLUSH_NS 100000000ull
+#define CAPTURE_MAX_PROPERTIES 16
+
+/* callback arguments as stored in the records, some are followed
+ * by a value or properties */
+struct capture_scan_result {
+	bt_bdaddr_t bda;
+	int8_t rssi;
+	uint8_t adv_data[BTT_AD_DATA_LEN];
+} __attribute__((packed));
+
+/* followed by len bytes of value */
+struct capture_notify {
+	int32_t conn_id;
+	bt_bdaddr_t bda;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+	uint16_t len;
+	uint8_t is_notify;
+} __attribute__((packed));
+
+/* followed by length bytes of value, if the length is valid */
+struct capture_request_write {
+	int32_t conn_id;
+	int32_t trans_id;
+	int32_t attr_handle;
+	int32_t offset;
+	int32_t length;
+	bt_bdaddr_t bda;
+	uint8_t need_rsp;
+	uint8_t is_prep;
+} __attribute__((packed));
+
+struct capture_state {
+	int32_t state;
+};
+
+/* followed by num of capture_property, each with len bytes of value */
+struct capture_properties {
+	int32_t status;
+	int32_t num;
+};
+
+struct capture_property {
+	uint32_t type;
+	uint32_t len;
+};
+
+struct capture_pairing {
+	bt_bdaddr_t bda;
+	bt_bdname_t name;
+	uint32_t cod;
+	int32_t variant;
+	uint32_t pass_key;
+} __attribute__((packed));
+
+struct capture_bond_state {
+	int32_t status;
+	bt_bdaddr_t bda;
+	int32_t state;
+} __attribute__((packed));
+
+struct replay {
+	FILE *file;
+	bool max_speed;
+};
+
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+/* wakes the writer up, uses CLOCK_MONOTONIC */
+static pthread_cond_t capture_cond;
+static pthread_t capture_thread;
+/* start and stop come from the main thread only */
+static int capture_fd = -1;
+static bool capturing;
+static bool capture_stopping;
+static uint8_t *buffers[2];
+static uint8_t *filling;
+static size_t filled;
+static unsigned long captured;
+static unsigned long capture_dropped;
+
+static bool replaying;
+
+static bool write_all(int fd, const uint8_t *data, size_t length)
+{
+	ssize_t ret;
+
+	while (length) {
+		ret = write(fd, data, length);
+
+		if (ret == -1 && errno == EINTR)
+			continue;
+
+		if (ret <= 0)
+			return FALSE;
+
+		data += ret;
+		length -= ret;
+	}
+
+	return TRUE;
+}
+
+static void *capture_writer(void *arg)
+{
+	struct timespec deadline;
+	uint64_t wake_ns;
+	uint8_t *data;
+	size_t length;
+	bool stopping;
+
+	pthread_mutex_lock(&capture_lock);
+
+	do {
+		if (!capture_stopping && filled < CAPTURE_BUFFER_SIZE / 2) {
+			wake_ns = monotonic_ns() + CAPTURE_FLUSH_NS;
+			deadline.tv_sec = wake_ns / 1000000000;
+			deadline.tv_nsec = wake_ns % 1000000000;
+			pthread_cond_timedwait(&capture_cond, &capture_lock, &deadline);
+		}
+
+		stopping = capture_stopping;
+		data = filling;
+		length = filled;
+		filling = filling == buffers[0] ? buffers[1] : buffers[0];
+		filled = 0;
+
+		pthread_mutex_unlock(&capture_lock);
+
+		if (length && !write_all(capture_fd, data, length))
+			BTT_LOG_E("%s: write error %s\n", __FUNCTION__, strerror(errno));
+
+		pthread_mutex_lock(&capture_lock);
+	} while (!stopping);
+
+	pthread_mutex_unlock(&capture_lock);
+
+	return arg;
+}
+
+/* Previous capture is stopped. The file is truncated, path has to be
+ * absolute as the daemon runs in /. */
+bool btt_daemon_capture_start(const char *path)
+{
+	struct btt_capture_header header;
+	pthread_condattr_t attr;
+	int fd;
+
+	btt_daemon_capture_stop();
+
+	if (!buffers[0]) {
+		buffers[0] = malloc(2 * CAPTURE_BUFFER_SIZE);
+
+		if (!buffers[0]) {
+			BTT_LOG_E("Cannot allocate capture buffers\n");
+			return FALSE;
+		}
+
+		buffers[1] = buffers[0] + CAPTURE_BUFFER_SIZE;
+	}
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	header.magic = BTT_CAPTURE_MAGIC;
+	header.version = BTT_CAPTURE_VERSION;
+
+	if (fd == -1 || !write_all(fd, (const uint8_t *) &header,
+			sizeof(header))) {
+		BTT_LOG_E("Cannot create capture %s: %s\n", path, strerror(errno));
+
+		if (fd != -1)
+			close(fd);
+
+		return FALSE;
+	}
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&capture_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	filling = buffers[0];
+	filled = 0;
+	captured = 0;
+	capture_dropped = 0;
+	capture_stopping = FALSE;
+	capture_fd = fd;
+
+	if (pthread_create(&capture_thread, NULL, capture_writer, NULL)) {
+		BTT_LOG_E("Cannot start capture writer thread\n");
+		pthread_cond_destroy(&capture_cond);
+		close(fd);
+		capture_fd = -1;
+		return FALSE;
+	}
+
+	__atomic_store_n(&capturing, TRUE, __ATOMIC_RELEASE);
+	BTT_LOG_I("Capturing HAL callbacks into %s\n", path);
+
+	return TRUE;
+}
+
+/* whatever was captured is written before it returns */
+void btt_daemon_capture_stop(void)
+{
+	if (capture_fd == -1)
+		return;
+
+	pthread_mutex_lock(&capture_lock);
+	__atomic_store_n(&capturing, FALSE, __ATOMIC_RELAXED);
+	capture_stopping = TRUE;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_lock);
+
+	pthread_join(capture_thread, NULL);
+	pthread_cond_destroy(&capture_cond);
+	close(capture_fd);
+	capture_fd = -1;
+
+	BTT_LOG_I("Capture stopped, %lu records, %lu dropped\n", captured,
+			capture_dropped);
+}
+
+/* append record made of iovcnt parts, called from HAL callbacks */
+static void put_record(enum btt_capture_type type, const struct iovec *iov,
+		int iovcnt)
+{
+	struct btt_capture_record record;
+	size_t length = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		length += iov[i].iov_len;
+
+	record.length = length;
+	record.type = type;
+	record.time_ns = monotonic_ns();
+
+	pthread_mutex_lock(&capture_lock);
+
+	if (!capturing) {
+		pthread_mutex_unlock(&capture_lock);
+		return;
+	}
+
+	if (length > BTT_CAPTURE_MAX_RECORD ||
+			filled + sizeof(record) + length > CAPTURE_BUFFER_SIZE) {
+		capture_dropped++;
+		pthread_mutex_unlock(&capture_lock);
+		return;
+	}
+
+	memcpy(filling + filled, &record, sizeof(record));
+	filled += sizeof(record);
+
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(filling + filled, iov[i].iov_base, iov[i].iov_len);
+		filled += iov[i].iov_len;
+	}
+
+	captured++;
+
+	if (filled >= CAPTURE_BUFFER_SIZE / 2)
+		pthread_cond_signal(&capture_cond);
+
+	pthread_mutex_unlock(&capture_lock);
+}
+
+static bool is_capturing(void)
+{
+	return __atomic_load_n(&capturing, __ATOMIC_RELAXED);
+}
+
+void btt_daemon_capture_scan_result(const bt_bdaddr_t *bda, int rssi,
+		const uint8_t *adv_data)
+{
+	struct capture_scan_result rec;
+	struct iovec iov;
+
+	if (!is_capturing())
+		return;
+
+	rec.bda = *bda;
+	rec.rssi = rssi;
+	memcpy(rec.adv_data, adv_data, BTT_AD_DATA_LEN);
+
+	iov.iov_base = &rec;
+	iov.iov_len = sizeof(rec);
+	put_record(BTT_CAPTURE_SCAN_RESULT, &iov, 1);
+}
+
+void btt_daemon_capture_notify(int conn_id,
+		const btgatt_notify_params_t *p_data)
+{
+	struct capture_notify rec;
+	struct iovec iov[2];
+
+	if (!is_capturing() || p_data->len > BTGATT_MAX_ATTR_LEN)
+		return;
+
+	rec.conn_id = conn_id;
+	rec.bda = p_data->bda;
+	rec.srvc_id = p_data->srvc_id;
+	rec.char_id = p_data->char_id;
+	rec.len = p_data->len;
+	rec.is_notify = p_data->is_notify;
+
+	iov[0].iov_base = &rec;
+	iov[0].iov_len = sizeof(rec);
+	iov[1].iov_base = (void *) p_data->value;
+	iov[1].iov_len = p_data->len;
+	put_record(BTT_CAPTURE_NOTIFY, iov, 2);
+}
+
+void btt_daemon_capture_request_write(int conn_id, int trans_id,
+		const bt_bdaddr_t *bda, int attr_handle, int offset, int length,
+		bool need_rsp, bool is_prep, const uint8_t *value)
+{
+	struct capture_request_write rec;
+	struct iovec iov[2];
+
+	if (!is_capturing())
+		return;
+
+	rec.conn_id = conn_id;
+	rec.trans_id = trans_id;
+	rec.attr_handle = attr_handle;
+	rec.offset = offset;
+	rec.length = length;
+	rec.bda = *bda;
+	rec.need_rsp = need_rsp;
+	rec.is_prep = is_prep;
+
+	iov[0].iov_base = &rec;
+	iov[0].iov_len = sizeof(rec);
+	iov[1].iov_base = (void *) value;
+	iov[1].iov_len = length < 0 || length > BTGATT_MAX_ATTR_LEN ? 0 : length;
+	put_record(BTT_CAPTURE_REQUEST_WRITE, iov, 2);
+}
+
+/* adapter or discovery state */
+void btt_daemon_capture_state(enum btt_capture_type type, int state)
+{
+	struct capture_state rec;
+	struct iovec iov;
+
+	if (!is_capturing())
+		return;
+
+	rec.state = state;
+
+	iov.iov_base = &rec;
+	iov.iov_len = sizeof(rec);
+	put_record(type, &iov, 1);
+}
+
+/* adapter properties or found device, at most CAPTURE_MAX_PROPERTIES */
+void btt_daemon_capture_properties(enum btt_capture_type type,
+		bt_status_t status, int num_properties,
+		const bt_property_t *properties)
+{
+	struct capture_properties rec;
+	struct capture_property property[CAPTURE_MAX_PROPERTIES];
+	struct iovec iov[1 + 2 * CAPTURE_MAX_PROPERTIES];
+	int i;
+
+	if (!is_capturing())
+		return;
+
+	if (num_properties > CAPTURE_MAX_PROPERTIES)
+		num_properties = CAPTURE_MAX_PROPERTIES;
+
+	rec.status = status;
+	rec.num = num_properties > 0 ? num_properties : 0;
+
+	iov[0].iov_base = &rec;
+	iov[0].iov_len = sizeof(rec);
+
+	for (i = 0; i < rec.num; i++) {
+		property[i].type = properties[i].type;
+		property[i].len = properties[i].val && properties[i].len > 0 ?
+				properties[i].len : 0;
+
+		iov[1 + 2 * i].iov_base = &property[i];
+		iov[1 + 2 * i].iov_len = sizeof(property[i]);
+		iov[2 + 2 * i].iov_base = properties[i].val;
+		iov[2 + 2 * i].iov_len = property[i].len;
+	}
+
+	put_record(type, iov, 1 + 2 * rec.num);
+}
+
+/* pin or SSP request, variant and pass_key are 0 for pin */
+void btt_daemon_capture_pairing(enum btt_capture_type type,
+		const bt_bdaddr_t *bda, const bt_bdname_t *bd_name, uint32_t cod,
+		bt_ssp_variant_t variant, uint32_t pass_key)
+{
+	struct capture_pairing rec;
+	struct iovec iov;
+
+	if (!is_capturing())
+		return;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.bda = *bda;
+
+	if (bd_name)
+		rec.name = *bd_name;
+
+	rec.cod = cod;
+	rec.variant = variant;
+	rec.pass_key = pass_key;
+
+	iov.iov_base = &rec;
+	iov.iov_len = sizeof(rec);
+	put_record(type, &iov, 1);
+}
+
+void btt_daemon_capture_bond_state(bt_status_t status,
+		const bt_bdaddr_t *bda, bt_bond_state_t state)
+{
+	struct capture_bond_state rec;
+	struct iovec iov;
+
+	if (!is_capturing())
+		return;
+
+	rec.status = status;
+	rec.bda = *bda;
+	rec.state = state;
+
+	iov.iov_base = &rec;
+	iov.iov_len = sizeof(rec);
+	put_record(BTT_CAPTURE_BOND_STATE, &iov, 1);
+}
+
+/* point properties into data, FALSE if they do not fill it exactly */
+static bool replay_properties(uint8_t *data, uint32_t length,
+		bt_property_t *properties, int *num)
+{
+	struct capture_properties rec;
+	struct capture_property property;
+	uint32_t offset = sizeof(rec);
+	int i;
+
+	memcpy(&rec, data, sizeof(rec));
+
+	if (rec.num < 0 || rec.num > CAPTURE_MAX_PROPERTIES)
+		return FALSE;
+
+	for (i = 0; i < rec.num; i++) {
+		if (length - offset < sizeof(property))
+			return FALSE;
+
+		memcpy(&property, data + offset, sizeof(property));
+		offset += sizeof(property);
+
+		if (length - offset < property.len)
+			return FALSE;
+
+		properties[i].type = property.type;
+		properties[i].len = property.len;
+		properties[i].val = property.len ? data + offset : NULL;
+		offset += property.len;
+	}
+
+	*num = rec.num;
+	return offset == length;
+}
+
+/* call the HAL callback of the record, FALSE if it is malformed */
+static bool replay_record(uint32_t type, uint8_t *data, uint32_t length)
+{
+	bt_callbacks_t *adapter = getBluetoothCallbacks();
+	bt_property_t properties[CAPTURE_MAX_PROPERTIES];
+	int num;
+
+	switch (type) {
+	case BTT_CAPTURE_SCAN_RESULT: {
+		struct capture_scan_result rec;
+
+		if (length != sizeof(rec))
+			return FALSE;
+
+		memcpy(&rec, data, sizeof(rec));
+		getGattClientCallbacks()->scan_result_cb(&rec.bda, rec.rssi,
+				rec.adv_data);
+		return TRUE;
+	}
+	case BTT_CAPTURE_NOTIFY: {
+		struct capture_notify rec;
+		btgatt_notify_params_t params;
+
+		if (length < sizeof(rec))
+			return FALSE;
+
+		memcpy(&rec, data, sizeof(rec));
+
+		if (rec.len > BTGATT_MAX_ATTR_LEN || length != sizeof(rec) + rec.len)
+			return FALSE;
+
+		params.bda = rec.bda;
+		params.srvc_id = rec.srvc_id;
+		params.char_id = rec.char_id;
+		params.len = rec.len;
+		params.is_notify = rec.is_notify;
+		memcpy(params.value, data + sizeof(rec), rec.len);
+
+		getGattClientCallbacks()->notify_cb(rec.conn_id, &params);
+		return TRUE;
+	}
+	case BTT_CAPTURE_REQUEST_WRITE: {
+		struct capture_request_write rec;
+
+		if (length < sizeof(rec))
+			return FALSE;
+
+		memcpy(&rec, data, sizeof(rec));
+
+		/* invalid length was captured without the value */
+		if (length != sizeof(rec) + (rec.length < 0 ||
+				rec.length > BTGATT_MAX_ATTR_LEN ? 0 : rec.length))
+			return FALSE;
+
+		getGattServerCallbacks()->request_write_cb(rec.conn_id,
+				rec.trans_id, &rec.bda, rec.attr_handle, rec.offset,
+				rec.length, rec.need_rsp, rec.is_prep, data + sizeof(rec));
+		return TRUE;
+	}
+	case BTT_CAPTURE_ADAPTER_STATE:
+	case BTT_CAPTURE_DISCOVERY_STATE: {
+		struct capture_state rec;
+
+		if (length != sizeof(rec))
+			return FALSE;
+
+		memcpy(&rec, data, sizeof(rec));
+
+		if (type == BTT_CAPTURE_ADAPTER_STATE)
+			adapter->adapter_state_changed_cb(rec.state);
+		else
+			adapter->discovery_state_changed_cb(rec.state);
+
+		return TRUE;
+	}
+	case BTT_CAPTURE_ADAPTER_PROPERTIES:
+	case BTT_CAPTURE_DEVICE_FOUND: {
+		struct capture_properties rec;
+
+		if (length < sizeof(rec) ||
+				!replay_properties(data, length, properties, &num))
+			return FALSE;
+
+		memcpy(&rec, data, sizeof(rec));
+
+		if (type == BTT_CAPTURE_ADAPTER_PROPERTIES)
+			adapter->adapter_properties_cb(rec.status, num, properties);
+		else
+			adapter->device_found_cb(num, properties);
+
+		return TRUE;
+	}
+	case BTT_CAPTURE_PIN_REQUEST:
+	case BTT_CAPTURE_SSP_REQUEST: {
+		struct capture_pairing rec;
+
+		if (length != sizeof(rec))
+			return FALSE;
+
+		memcpy(&rec, data, sizeof(rec));
+		/* callbacks copy it with strcpy */
+		rec.name.name[sizeof(rec.name.name) - 1] = '\0';
+
+		if (type == BTT_CAPTURE_PIN_REQUEST)
+			adapter->pin_request_cb(&rec.bda, &rec.name, rec.cod);
+		else
+			adapter->ssp_request_cb(&rec.bda, &rec.name, rec.cod,
+					rec.variant, rec.pass_key);
+
+		return TRUE;
+	}
+	case BTT_CAPTURE_BOND_STATE: {
+		struct capture_bond_state rec;
+
+		if (length != sizeof(rec))
+			return FALSE;
+
+		memcpy(&rec, data, sizeof(rec));
+		adapter->bond_state_changed_cb(rec.status, &rec.bda, rec.state);
+		return TRUE;
+	}
+	default:
+		return FALSE;
+	}
+}
+
+static void *replay_thread(void *arg)
+{
+	struct replay *replay = arg;
+	struct btt_capture_record record;
+	struct btt_msg_rsp_daemon_replay rsp;
+	/* aligned for the callbacks */
+	uint64_t data[BTT_CAPTURE_MAX_RECORD / sizeof(uint64_t)];
+	struct timespec at;
+	uint64_t start_ns = monotonic_ns();
+	uint64_t first_ns = 0;
+	uint64_t wake_ns;
+
+	FILL_HDR(rsp, BTT_RSP_DAEMON_REPLAY);
+	rsp.records = 0;
+	rsp.skipped = 0;
+
+	while (fread(&record, sizeof(record), 1, replay->file) == 1) {
+		if (record.length > BTT_CAPTURE_MAX_RECORD ||
+				fread(data, 1, record.length, replay->file) !=
+				record.length) {
+			BTT_LOG_W("Capture is truncated or corrupted\n");
+			break;
+		}
+
+		if (!rsp.records && !rsp.skipped)
+			first_ns = record.time_ns;
+
+		/* records of concurrent callbacks may be slightly reordered */
+		if (!replay->max_speed && record.time_ns > first_ns) {
+			wake_ns = start_ns + record.time_ns - first_ns;
+			at.tv_sec = wake_ns / 1000000000;
+			at.tv_nsec = wake_ns % 1000000000;
+
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at,
+					NULL) == EINTR)
+				;
+		}
+
+		if (replay_record(record.type, (uint8_t *) data, record.length))
+			rsp.records++;
+		else
+			rsp.skipped++;
+	}
+
+	rsp.duration_ns = monotonic_ns() - start_ns;
+	fclose(replay->file);
+	free(replay);
+
+	BTT_LOG_I("Replayed %" PRIu64 " callbacks, %" PRIu64 " skipped, in %"
+			PRIu64 " ms\n", rsp.records, rsp.skipped,
+			rsp.duration_ns / 1000000);
+
+	btt_daemon_deliver(0, BTT_DAEMON_KEY_NONE, 0, &rsp, sizeof(rsp));
+	__atomic_store_n(&replaying, FALSE, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+/* Only one replay runs at a time. BTT_RSP_DAEMON_REPLAY completes
+ * the request when the whole capture is replayed. */
+bool btt_daemon_replay_start(const char *path, bool max_speed, int socket,
+		const struct btt_message *msg)
+{
+	struct btt_capture_header header;
+	struct replay *replay;
+	pthread_t thread;
+
+	if (__atomic_exchange_n(&replaying, TRUE, __ATOMIC_ACQUIRE)) {
+		BTT_LOG_W("Replay is running already\n");
+		return FALSE;
+	}
+
+	replay = malloc(sizeof(*replay));
+
+	if (!replay)
+		goto error;
+
+	replay->max_speed = max_speed;
+	replay->file = fopen(path, "rb");
+
+	if (!replay->file) {
+		BTT_LOG_E("Cannot open capture %s: %s\n", path, strerror(errno));
+		goto error;
+	}
+
+	setvbuf(replay->file, NULL, _IOFBF, 64 * 1024);
+
+	if (fread(&header, sizeof(header), 1, replay->file) != 1 ||
+			header.magic != BTT_CAPTURE_MAGIC ||
+			header.version != BTT_CAPTURE_VERSION) {
+		BTT_LOG_E("%s is not a capture\n", path);
+		goto error;
+	}
+
+	btt_daemon_requests_expect(socket, msg, BTT_DAEMON_KEY_NONE, 0,
+			BTT_RSP_DAEMON_REPLAY);
+
+	if (pthread_create(&thread, NULL, replay_thread, replay)) {
+		BTT_LOG_E("Cannot start replay thread\n");
+		btt_daemon_requests_cancel(socket, msg);
+		goto error;
+	}
+
+	pthread_detach(thread);
+	return TRUE;
+
+error:
+	if (replay && replay->file)
+		fclose(replay->file);
+
+	free(replay);
+	__atomic_store_n(&replaying, FALSE, __ATOMIC_RELEASE);
+	return FALSE;
+}
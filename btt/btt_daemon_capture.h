@@ -0,0 +1,77 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_CAPTURE_H
+#error Included twice
+#endif
+#define BTT_DAEMON_CAPTURE_H
+
+/* requires hardware/bt_gatt.h */
+
+/* "BCAP", file starts with btt_capture_header, records follow */
+#define BTT_CAPTURE_MAGIC 0x50414342
+#define BTT_CAPTURE_VERSION 1
+/* longer records are not captured */
+#define BTT_CAPTURE_MAX_RECORD 4096
+
+enum btt_capture_type {
+	BTT_CAPTURE_SCAN_RESULT = 1,
+	BTT_CAPTURE_NOTIFY,
+	BTT_CAPTURE_REQUEST_WRITE,
+	BTT_CAPTURE_ADAPTER_STATE,
+	BTT_CAPTURE_ADAPTER_PROPERTIES,
+	BTT_CAPTURE_DEVICE_FOUND,
+	BTT_CAPTURE_DISCOVERY_STATE,
+	BTT_CAPTURE_PIN_REQUEST,
+	BTT_CAPTURE_SSP_REQUEST,
+	BTT_CAPTURE_BOND_STATE
+};
+
+struct btt_capture_header {
+	uint32_t magic;
+	uint32_t version;
+};
+
+/* followed by length bytes of the callback arguments */
+struct btt_capture_record {
+	uint32_t length;
+	uint32_t type;
+	/* CLOCK_MONOTONIC of the callback */
+	uint64_t time_ns;
+};
+
+extern bool btt_daemon_capture_start(const char *path);
+extern void btt_daemon_capture_stop(void);
+extern bool btt_daemon_replay_start(const char *path, bool max_speed,
+		int socket, const struct btt_message *msg);
+
+/* called first thing by the HAL callbacks */
+extern void btt_daemon_capture_scan_result(const bt_bdaddr_t *bda, int rssi,
+		const uint8_t *adv_data);
+extern void btt_daemon_capture_notify(int conn_id,
+		const btgatt_notify_params_t *p_data);
+extern void btt_daemon_capture_request_write(int conn_id, int trans_id,
+		const bt_bdaddr_t *bda, int attr_handle, int offset, int length,
+		bool need_rsp, bool is_prep, const uint8_t *value);
+extern void btt_daemon_capture_state(enum btt_capture_type type, int state);
+extern void btt_daemon_capture_properties(enum btt_capture_type type,
+		bt_status_t status, int num_properties,
+		const bt_property_t *properties);
+extern void btt_daemon_capture_pairing(enum btt_capture_type type,
+		const bt_bdaddr_t *bda, const bt_bdname_t *bd_name, uint32_t cod,
+		bt_ssp_variant_t variant, uint32_t pass_key);
+extern void btt_daemon_capture_bond_state(bt_status_t status,
+		const bt_bdaddr_t *bda, bt_bond_state_t state);
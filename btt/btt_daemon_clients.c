@@ -0,0 +1,352 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#include "btt_utils.h"
+#include "btt_framing.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_requests.h"
+
+/* Output of a client is written in order: while anything is pending,
+ * new messages are appended behind it and the main loop writes it out
+ * when the socket becomes writable. Sockets are non-blocking and this is
+ * their only writer. A message is never cut, the client is dropped
+ * instead, also when too much output waits for it.
+ * clients_lock is taken before registry_lock and requests_lock, and
+ * after cache_lock. */
+
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct btt_daemon_client clients[BTT_DAEMON_MAX_CLIENTS];
+static int clients_epoll_fd = -1;
+
+void btt_daemon_clients_init(int epoll_fd)
+{
+	unsigned int i;
+
+	clients_epoll_fd = epoll_fd;
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++)
+		clients[i].socket = -1;
+}
+
+void btt_daemon_clients_lock(void)
+{
+	pthread_mutex_lock(&clients_lock);
+}
+
+void btt_daemon_clients_unlock(void)
+{
+	pthread_mutex_unlock(&clients_lock);
+}
+
+/* must be called under clients_lock */
+static struct btt_daemon_client *find_client(int socket)
+{
+	unsigned int i;
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++)
+		if (clients[i].socket == socket)
+			return &clients[i];
+
+	return NULL;
+}
+
+/* must be called under clients_lock */
+static void want_output(struct btt_daemon_client *client, bool writable)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN | (writable ? EPOLLOUT : 0);
+	ev.data.ptr = client;
+
+	if (epoll_ctl(clients_epoll_fd, EPOLL_CTL_MOD, client->socket, &ev))
+		BTT_LOG_E("%s:epoll_ctl error\n", __FUNCTION__);
+}
+
+/* Must be called under clients_lock. Nothing more is sent to the client,
+ * the main loop sees the socket closed and removes it. */
+static void break_client(struct btt_daemon_client *client, const char *why)
+{
+	if (client->broken)
+		return;
+
+	BTT_LOG_W("Dropping client socket=%d: %s\n", client->socket, why);
+	client->broken = TRUE;
+	client->out_len = 0;
+	shutdown(client->socket, SHUT_RDWR);
+}
+
+/* must be called under clients_lock, skip bytes of iov were sent */
+static bool queue_output(struct btt_daemon_client *client,
+		const struct iovec *iov, int iovcnt, size_t skip)
+{
+	size_t need = client->out_len;
+	size_t alloc;
+	uint8_t *out;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		need += iov[i].iov_len;
+
+	need -= skip;
+
+	if (need > BTT_DAEMON_CLIENT_MAX_OUTPUT)
+		return FALSE;
+
+	if (need > client->out_alloc) {
+		alloc = client->out_alloc ? client->out_alloc : 4096;
+
+		while (alloc < need)
+			alloc *= 2;
+
+		out = realloc(client->out, alloc);
+
+		if (!out)
+			return FALSE;
+
+		client->out = out;
+		client->out_alloc = alloc;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		if (skip >= iov[i].iov_len) {
+			skip -= iov[i].iov_len;
+			continue;
+		}
+
+		memcpy(client->out + client->out_len,
+				(const uint8_t *) iov[i].iov_base + skip,
+				iov[i].iov_len - skip);
+		client->out_len += iov[i].iov_len - skip;
+		skip = 0;
+	}
+
+	return TRUE;
+}
+
+/* must be called under clients_lock */
+static void write_client(struct btt_daemon_client *client,
+		const struct iovec *iov, int iovcnt)
+{
+	struct msghdr hdr;
+	ssize_t ret = 0;
+	size_t total = 0;
+	int i;
+
+	if (client->broken)
+		return;
+
+	for (i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	if (!client->out_len) {
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.msg_iov = (struct iovec *) iov;
+		hdr.msg_iovlen = iovcnt;
+		ret = sendmsg(client->socket, &hdr, MSG_NOSIGNAL);
+
+		if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+				errno != EINTR) {
+			break_client(client, strerror(errno));
+			return;
+		}
+
+		if (ret == -1)
+			ret = 0;
+
+		if ((size_t) ret == total)
+			return;
+	}
+
+	/* rest of a message cut by a short write is kept too */
+	if (!queue_output(client, iov, iovcnt, ret)) {
+		break_client(client, "too much output pending");
+		return;
+	}
+
+	want_output(client, TRUE);
+}
+
+void btt_daemon_client_sendv_locked(int socket, const struct iovec *iov,
+		int iovcnt)
+{
+	struct btt_daemon_client *client = find_client(socket);
+
+	if (client)
+		write_client(client, iov, iovcnt);
+}
+
+bool btt_daemon_client_send(int socket, const void *data, size_t len)
+{
+	struct btt_daemon_client *client;
+	struct iovec iov;
+	bool sent = FALSE;
+
+	iov.iov_base = (void *) data;
+	iov.iov_len = len;
+
+	pthread_mutex_lock(&clients_lock);
+
+	if ((client = find_client(socket)) != NULL) {
+		write_client(client, &iov, 1);
+		sent = !client->broken;
+	}
+
+	pthread_mutex_unlock(&clients_lock);
+
+	return sent;
+}
+
+bool btt_daemon_client_send_fds(int socket, const void *data, size_t len,
+		const int *fds, unsigned int fds_num)
+{
+	struct btt_daemon_client *client;
+	struct iovec iov;
+	ssize_t ret = -1;
+
+	pthread_mutex_lock(&clients_lock);
+
+	client = find_client(socket);
+
+	/* descriptors can not wait in the buffer */
+	if (client && !client->broken && !client->out_len)
+		ret = send_with_fds(socket, data, len, fds, fds_num);
+
+	/* they went with the first byte, the rest may wait */
+	if (ret > 0 && (size_t) ret < len) {
+		iov.iov_base = (uint8_t *) data + ret;
+		iov.iov_len = len - ret;
+
+		if (queue_output(client, &iov, 1, 0))
+			want_output(client, TRUE);
+		else
+			break_client(client, "too much output pending");
+	}
+
+	pthread_mutex_unlock(&clients_lock);
+
+	return ret > 0;
+}
+
+/* socket became writable */
+void btt_daemon_client_flush(struct btt_daemon_client *client)
+{
+	ssize_t ret;
+
+	pthread_mutex_lock(&clients_lock);
+
+	if (client->socket == -1 || client->broken || !client->out_len) {
+		pthread_mutex_unlock(&clients_lock);
+		return;
+	}
+
+	ret = send(client->socket, client->out, client->out_len, MSG_NOSIGNAL);
+
+	if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK &&
+			errno != EINTR) {
+		break_client(client, strerror(errno));
+	} else if (ret > 0) {
+		memmove(client->out, client->out + ret, client->out_len - ret);
+		client->out_len -= ret;
+	}
+
+	if (!client->out_len)
+		want_output(client, FALSE);
+
+	pthread_mutex_unlock(&clients_lock);
+}
+
+struct btt_daemon_client *btt_daemon_client_add(int socket)
+{
+	unsigned int i;
+
+	/* replies and events are written without blocking */
+	if (fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK) == -1) {
+		BTT_LOG_E("%s:fcntl error, socket=%d\n", __FUNCTION__, socket);
+		return NULL;
+	}
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+		if (clients[i].socket != -1)
+			continue;
+
+		pthread_mutex_lock(&clients_lock);
+		clients[i].socket = socket;
+		clients[i].out = NULL;
+		clients[i].out_len = 0;
+		clients[i].out_alloc = 0;
+		clients[i].broken = FALSE;
+		pthread_mutex_unlock(&clients_lock);
+		clients[i].commands = 0;
+		clients[i].dispatch_ns_total = 0;
+		clients[i].dispatch_ns_max = 0;
+		btt_framing_init(&clients[i].rx, socket);
+
+		BTT_LOG_D("Client connected, socket=%d\n", socket);
+		return &clients[i];
+	}
+
+	BTT_LOG_W("Too many clients, rejecting socket=%d\n", socket);
+	return NULL;
+}
+
+void btt_daemon_client_remove(struct btt_daemon_client *client)
+{
+	if (client->socket == -1)
+		return;
+
+	BTT_LOG_I("Client disconnected, socket=%d commands=%" PRIu64
+			" avg dispatch=%" PRIu64 "us max dispatch=%" PRIu64 "us\n",
+			client->socket, client->commands,
+			client->commands ?
+					client->dispatch_ns_total / client->commands / 1000 : 0,
+			client->dispatch_ns_max / 1000);
+
+	/* event writer must not see the socket once it can be reused */
+	pthread_mutex_lock(&clients_lock);
+	btt_daemon_registry_drop(client->socket);
+	btt_daemon_requests_drop(client->socket);
+	btt_framing_close_fds(&client->rx);
+	close(client->socket);
+	client->socket = -1;
+	free(client->out);
+	client->out = NULL;
+	client->out_len = 0;
+	pthread_mutex_unlock(&clients_lock);
+}
+
+void btt_daemon_clients_close_all(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++)
+		btt_daemon_client_remove(&clients[i]);
+}
+
+/* message was handled, account its dispatch time */
+void btt_daemon_client_done(struct btt_daemon_client *client,
+		uint64_t dispatch_ns)
+{
+	client->commands += 1;
+	client->dispatch_ns_total += dispatch_ns;
+
+	if (dispatch_ns > client->dispatch_ns_max)
+		client->dispatch_ns_max = dispatch_ns;
+}
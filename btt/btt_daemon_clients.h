@@ -0,0 +1,65 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_CLIENTS_H
+#error Included twice
+#endif
+#define BTT_DAEMON_CLIENTS_H
+
+#define BTT_DAEMON_MAX_CLIENTS 16
+/* output kept for a client which does not read, it is dropped above it */
+#define BTT_DAEMON_CLIENT_MAX_OUTPUT (1024 * 1024)
+
+/* requires sys/uio.h, btt_framing.h */
+
+struct btt_daemon_client {
+	int socket;
+	struct btt_framing rx;
+
+	/* output the socket did not take yet, written on EPOLLOUT */
+	uint8_t *out;
+	size_t out_len;
+	size_t out_alloc;
+	/* output was lost, the client is shut down and removed */
+	bool broken;
+
+	/* dispatch statistics, time in nanoseconds */
+	uint64_t commands;
+	uint64_t dispatch_ns_total;
+	uint64_t dispatch_ns_max;
+};
+
+extern void btt_daemon_clients_init(int epoll_fd);
+extern struct btt_daemon_client *btt_daemon_client_add(int socket);
+extern void btt_daemon_client_remove(struct btt_daemon_client *client);
+extern void btt_daemon_clients_close_all(void);
+extern void btt_daemon_client_done(struct btt_daemon_client *client,
+		uint64_t dispatch_ns);
+extern void btt_daemon_client_flush(struct btt_daemon_client *client);
+
+/* Replies of the main thread, written in order with the events, FALSE
+ * if the client is gone. Descriptors can be passed only while nothing
+ * is pending for the client. */
+extern bool btt_daemon_client_send(int socket, const void *data, size_t len);
+extern bool btt_daemon_client_send_fds(int socket, const void *data,
+		size_t len, const int *fds, unsigned int fds_num);
+
+/* Sockets of the clients stay valid between lock and unlock, the event
+ * writer sends its batch under it. */
+extern void btt_daemon_clients_lock(void);
+extern void btt_daemon_clients_unlock(void);
+extern void btt_daemon_client_sendv_locked(int socket,
+		const struct iovec *iov, int iovcnt);
@@ -0,0 +1,622 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/uio.h>
+#include "btt_utils.h"
+#include "btt_gatt_client.h"
+#include "btt_framing.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_gatt_client.h"
+#include "btt_daemon_connections.h"
+
+extern const btgatt_client_interface_t *gatt_client_if;
+
+/* Connection table: every connection opened by a client is followed
+ * from the connect command to its disconnection. ATT operations of
+ * clients are queued per connection and sent to the HAL one at a time,
+ * the next one by the callback of the previous one, so the stack never
+ * refuses them as busy while connections run in parallel. The daemon's
+ * own engines (discover_all, long_write, read_multi) hold the connection
+ * for their whole run, operations of clients wait in the queue meanwhile
+ * and no callback of the engine is taken for theirs.
+ * Lost connection may be opened again by the reconnect thread after
+ * 250 ms, 500 ms, ... up to 32 s. */
+
+#define CONN_QUEUE_MAX 64
+/* no MTU exchange in this HAL, ATT default is used all the time */
+#define CONN_DEFAULT_MTU 23
+#define RECONNECT_MIN_MS 250
+#define RECONNECT_MAX_MS 32000
+
+/* followed by the message */
+struct queued_op {
+	struct queued_op *next;
+	struct btt_message msg;
+};
+
+struct connection {
+	enum btt_gatt_connection_state state;
+	int client_if;
+	bt_bdaddr_t addr;
+	bool is_direct;
+	int conn_id;
+	bool bonded;
+	uint64_t connected_ns;
+	/* operation sent to the HAL */
+	bool in_flight;
+	/* an engine runs on the connection */
+	bool held;
+	struct queued_op *head;
+	struct queued_op *tail;
+	unsigned int queued;
+	uint32_t operations;
+	/* queue is being run, callbacks during its HAL call only mark it */
+	bool in_call;
+	bool user_disconnect;
+	unsigned int max_attempts;
+	unsigned int attempts;
+	uint16_t reconnects;
+	uint64_t reconnect_ns;
+};
+
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+/* wakes the reconnect thread up, uses CLOCK_MONOTONIC */
+static pthread_cond_t reconnect_cond;
+static bool reconnect_started;
+static struct connection connections[BTT_GATT_MAX_CONNECTIONS];
+
+/* must be called under connections_lock */
+static struct connection *find_conn_id(int conn_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < BTT_GATT_MAX_CONNECTIONS; i++)
+		if ((connections[i].state == BTT_GATT_CONNECTION_CONNECTED ||
+				connections[i].state ==
+				BTT_GATT_CONNECTION_DISCONNECTING) &&
+				connections[i].conn_id == conn_id)
+			return &connections[i];
+
+	return NULL;
+}
+
+/* must be called under connections_lock */
+static struct connection *find_addr(int client_if, const bt_bdaddr_t *bda)
+{
+	unsigned int i;
+
+	for (i = 0; i < BTT_GATT_MAX_CONNECTIONS; i++)
+		if (connections[i].state && connections[i].client_if == client_if &&
+				!memcmp(&connections[i].addr, bda, sizeof(*bda)))
+			return &connections[i];
+
+	return NULL;
+}
+
+/* must be called under connections_lock */
+static struct connection *new_connection(int client_if,
+		const bt_bdaddr_t *bda)
+{
+	unsigned int i;
+
+	for (i = 0; i < BTT_GATT_MAX_CONNECTIONS; i++) {
+		if (connections[i].state)
+			continue;
+
+		memset(&connections[i], 0, sizeof(connections[i]));
+		connections[i].client_if = client_if;
+		connections[i].addr = *bda;
+		connections[i].conn_id = -1;
+		connections[i].is_direct = TRUE;
+
+		return &connections[i];
+	}
+
+	BTT_LOG_W("Too many connections, client_if=%d is not followed\n",
+			client_if);
+	return NULL;
+}
+
+/* must be called under connections_lock, requests of the dropped
+ * operations are forgotten with the conn_id */
+static void drop_queue(struct connection *conn)
+{
+	struct queued_op *op;
+
+	while ((op = conn->head) != NULL) {
+		conn->head = op->next;
+		free(op);
+	}
+
+	conn->tail = NULL;
+	conn->queued = 0;
+	conn->in_flight = FALSE;
+	conn->held = FALSE;
+}
+
+static uint64_t backoff_ms(unsigned int attempt)
+{
+	uint64_t ms = RECONNECT_MIN_MS;
+
+	while (--attempt && ms < RECONNECT_MAX_MS)
+		ms *= 2;
+
+	return ms < RECONNECT_MAX_MS ? ms : RECONNECT_MAX_MS;
+}
+
+/* Must be called under connections_lock, FALSE if the connection
+ * is given up. */
+static bool schedule_reconnect(struct connection *conn)
+{
+	if (conn->attempts >= conn->max_attempts) {
+		if (conn->max_attempts)
+			BTT_LOG_W("Giving up reconnecting client_if=%d after %u "
+					"attempts\n", conn->client_if, conn->attempts);
+
+		return FALSE;
+	}
+
+	conn->attempts++;
+	conn->state = BTT_GATT_CONNECTION_BACKOFF;
+	conn->reconnect_ns = monotonic_ns() +
+			backoff_ms(conn->attempts) * 1000000;
+	pthread_cond_signal(&reconnect_cond);
+
+	return TRUE;
+}
+
+static void *reconnect_thread(void *arg)
+{
+	struct timespec deadline;
+	struct connection *due;
+	bt_bdaddr_t addr;
+	uint64_t wake_ns;
+	uint64_t now_ns;
+	bt_status_t status;
+	unsigned int i;
+	int client_if;
+	bool is_direct;
+
+	pthread_mutex_lock(&connections_lock);
+
+	while (1) {
+		now_ns = monotonic_ns();
+		wake_ns = now_ns + 60000000000ull;
+		due = NULL;
+
+		for (i = 0; i < BTT_GATT_MAX_CONNECTIONS && !due; i++) {
+			if (connections[i].state != BTT_GATT_CONNECTION_BACKOFF)
+				continue;
+
+			if (connections[i].reconnect_ns <= now_ns)
+				due = &connections[i];
+			else if (connections[i].reconnect_ns < wake_ns)
+				wake_ns = connections[i].reconnect_ns;
+		}
+
+		if (!due) {
+			deadline.tv_sec = wake_ns / 1000000000;
+			deadline.tv_nsec = wake_ns % 1000000000;
+			pthread_cond_timedwait(&reconnect_cond, &connections_lock,
+					&deadline);
+			continue;
+		}
+
+		due->state = BTT_GATT_CONNECTION_CONNECTING;
+		due->reconnects++;
+		client_if = due->client_if;
+		addr = due->addr;
+		is_direct = due->is_direct;
+
+		BTT_LOG_I("Reconnecting client_if=%d, attempt %u\n", client_if,
+				due->attempts);
+
+		pthread_mutex_unlock(&connections_lock);
+		status = gatt_client_if->connect(client_if, &addr, is_direct);
+		pthread_mutex_lock(&connections_lock);
+
+		if (status != BT_STATUS_SUCCESS &&
+				(due = find_addr(client_if, &addr)) != NULL &&
+				due->state == BTT_GATT_CONNECTION_CONNECTING &&
+				!schedule_reconnect(due))
+			due->state = 0;
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+
+	return arg;
+}
+
+void btt_daemon_connections_connecting(int client_if,
+		const bt_bdaddr_t *bda, bool is_direct)
+{
+	struct connection *conn;
+
+	pthread_mutex_lock(&connections_lock);
+
+	conn = find_addr(client_if, bda);
+
+	if (!conn)
+		conn = new_connection(client_if, bda);
+
+	if (conn && conn->state != BTT_GATT_CONNECTION_CONNECTED) {
+		conn->state = BTT_GATT_CONNECTION_CONNECTING;
+		conn->is_direct = is_direct;
+		conn->attempts = 0;
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+void btt_daemon_connections_connected(int conn_id, int status,
+		int client_if, const bt_bdaddr_t *bda)
+{
+	struct connection *conn;
+
+	pthread_mutex_lock(&connections_lock);
+
+	conn = find_addr(client_if, bda);
+
+	if (status != BT_STATUS_SUCCESS) {
+		if (conn && conn->state == BTT_GATT_CONNECTION_CONNECTING &&
+				(!conn->attempts || !schedule_reconnect(conn)))
+			conn->state = 0;
+
+		pthread_mutex_unlock(&connections_lock);
+		return;
+	}
+
+	/* opened by the stack itself, e.g. background connection */
+	if (!conn)
+		conn = new_connection(client_if, bda);
+
+	if (conn) {
+		drop_queue(conn);
+		conn->state = BTT_GATT_CONNECTION_CONNECTED;
+		conn->conn_id = conn_id;
+		conn->connected_ns = monotonic_ns();
+		conn->user_disconnect = FALSE;
+		conn->attempts = 0;
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+void btt_daemon_connections_disconnecting(int conn_id)
+{
+	struct connection *conn;
+
+	pthread_mutex_lock(&connections_lock);
+
+	if ((conn = find_conn_id(conn_id)) != NULL) {
+		conn->state = BTT_GATT_CONNECTION_DISCONNECTING;
+		conn->user_disconnect = TRUE;
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+void btt_daemon_connections_disconnected(int conn_id)
+{
+	struct connection *conn;
+
+	pthread_mutex_lock(&connections_lock);
+
+	if ((conn = find_conn_id(conn_id)) == NULL) {
+		pthread_mutex_unlock(&connections_lock);
+		return;
+	}
+
+	drop_queue(conn);
+	conn->conn_id = -1;
+
+	if (conn->user_disconnect || !schedule_reconnect(conn))
+		conn->state = 0;
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+void btt_daemon_connections_bond_state(const bt_bdaddr_t *bda,
+		bt_bond_state_t state)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&connections_lock);
+
+	for (i = 0; i < BTT_GATT_MAX_CONNECTIONS; i++)
+		if (connections[i].state &&
+				!memcmp(&connections[i].addr, bda, sizeof(*bda)))
+			connections[i].bonded = state == BT_BOND_STATE_BONDED;
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+void btt_daemon_connections_forget_client(int client_if)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&connections_lock);
+
+	for (i = 0; i < BTT_GATT_MAX_CONNECTIONS; i++) {
+		if (!connections[i].state || connections[i].client_if != client_if)
+			continue;
+
+		drop_queue(&connections[i]);
+		connections[i].state = 0;
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+/* Must be called under connections_lock, the lock is released during
+ * the HAL calls. Operation refused by the HAL gets its callback with
+ * the error, so the request is completed anyway. */
+static void run_queue(struct connection *conn)
+{
+	struct queued_op *op;
+	bt_status_t status;
+
+	/* the running loop sees the change after its HAL call */
+	if (conn->in_call)
+		return;
+
+	conn->in_call = TRUE;
+
+	while (!conn->in_flight && !conn->held && (op = conn->head) != NULL) {
+		conn->head = op->next;
+
+		if (!conn->head)
+			conn->tail = NULL;
+
+		conn->queued--;
+		conn->in_flight = TRUE;
+		conn->operations++;
+
+		pthread_mutex_unlock(&connections_lock);
+
+		status = btt_daemon_gatt_client_issue(&op->msg);
+
+		if (status != BT_STATUS_SUCCESS)
+			btt_daemon_gatt_client_fail(&op->msg, status);
+
+		free(op);
+
+		/* queue is emptied if the connection was lost meanwhile */
+		pthread_mutex_lock(&connections_lock);
+	}
+
+	conn->in_call = FALSE;
+}
+
+bt_status_t btt_daemon_connections_submit(int conn_id,
+		const struct btt_message *msg)
+{
+	struct connection *conn;
+	struct queued_op *op;
+	size_t len = sizeof(*msg) + msg->length;
+	bt_status_t status;
+
+	pthread_mutex_lock(&connections_lock);
+
+	conn = find_conn_id(conn_id);
+
+	/* nothing to wait for, error is the request status */
+	if (!conn || (!conn->in_flight && !conn->held && !conn->head &&
+			!conn->in_call)) {
+		if (conn) {
+			conn->in_flight = TRUE;
+			conn->operations++;
+		}
+
+		pthread_mutex_unlock(&connections_lock);
+
+		status = btt_daemon_gatt_client_issue(msg);
+
+		if (status != BT_STATUS_SUCCESS) {
+			pthread_mutex_lock(&connections_lock);
+
+			if (conn && find_conn_id(conn_id) == conn) {
+				conn->in_flight = FALSE;
+				run_queue(conn);
+			}
+
+			pthread_mutex_unlock(&connections_lock);
+		}
+
+		return status;
+	}
+
+	if (conn->queued == CONN_QUEUE_MAX) {
+		pthread_mutex_unlock(&connections_lock);
+		return BT_STATUS_BUSY;
+	}
+
+	op = malloc(offsetof(struct queued_op, msg) + len);
+
+	if (!op) {
+		pthread_mutex_unlock(&connections_lock);
+		return BT_STATUS_NOMEM;
+	}
+
+	memcpy(&op->msg, msg, len);
+	op->next = NULL;
+
+	if (conn->tail)
+		conn->tail->next = op;
+	else
+		conn->head = op;
+
+	conn->tail = op;
+	conn->queued++;
+
+	pthread_mutex_unlock(&connections_lock);
+
+	return BT_STATUS_SUCCESS;
+}
+
+/* conn_id of the open connection of client_if to bda, -1 if none */
+int btt_daemon_connections_conn_id(int client_if, const bt_bdaddr_t *bda)
+{
+	struct connection *conn;
+	int conn_id = -1;
+
+	pthread_mutex_lock(&connections_lock);
+
+	if ((conn = find_addr(client_if, bda)) != NULL &&
+			conn->state == BTT_GATT_CONNECTION_CONNECTED)
+		conn_id = conn->conn_id;
+
+	pthread_mutex_unlock(&connections_lock);
+
+	return conn_id;
+}
+
+void btt_daemon_connections_done(int conn_id)
+{
+	struct connection *conn;
+
+	pthread_mutex_lock(&connections_lock);
+
+	if ((conn = find_conn_id(conn_id)) != NULL && conn->in_flight) {
+		conn->in_flight = FALSE;
+		run_queue(conn);
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+bt_status_t btt_daemon_connections_hold(int conn_id)
+{
+	struct connection *conn;
+	bt_status_t status = BT_STATUS_SUCCESS;
+
+	pthread_mutex_lock(&connections_lock);
+
+	/* connection not followed has no queue to wait for */
+	if ((conn = find_conn_id(conn_id)) != NULL) {
+		if (conn->in_flight || conn->held || conn->head)
+			status = BT_STATUS_BUSY;
+		else
+			conn->held = TRUE;
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+
+	if (status != BT_STATUS_SUCCESS)
+		BTT_LOG_W("Connection conn_id=%d is busy\n", conn_id);
+
+	return status;
+}
+
+void btt_daemon_connections_release(int conn_id)
+{
+	struct connection *conn;
+
+	pthread_mutex_lock(&connections_lock);
+
+	if ((conn = find_conn_id(conn_id)) != NULL && conn->held) {
+		conn->held = FALSE;
+		run_queue(conn);
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+}
+
+bt_status_t btt_daemon_connections_auto_reconnect(int client_if,
+		const bt_bdaddr_t *bda, unsigned int max_attempts)
+{
+	pthread_condattr_t attr;
+	pthread_t thread;
+	struct connection *conn;
+
+	pthread_mutex_lock(&connections_lock);
+
+	if (max_attempts && !reconnect_started) {
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&reconnect_cond, &attr);
+		pthread_condattr_destroy(&attr);
+
+		if (pthread_create(&thread, NULL, reconnect_thread, NULL)) {
+			pthread_cond_destroy(&reconnect_cond);
+			pthread_mutex_unlock(&connections_lock);
+			BTT_LOG_E("Cannot start reconnect thread\n");
+			return BT_STATUS_NOMEM;
+		}
+
+		pthread_detach(thread);
+		reconnect_started = TRUE;
+	}
+
+	/* policy belongs to a connection being opened or opened already */
+	if ((conn = find_addr(client_if, bda)) == NULL) {
+		pthread_mutex_unlock(&connections_lock);
+		return BT_STATUS_NOT_READY;
+	}
+
+	conn->max_attempts = max_attempts;
+
+	if (!max_attempts && conn->state == BTT_GATT_CONNECTION_BACKOFF)
+		conn->state = 0;
+
+	pthread_mutex_unlock(&connections_lock);
+
+	return BT_STATUS_SUCCESS;
+}
+
+void btt_daemon_connections_send(int socket, unsigned int request_id)
+{
+	struct btt_gatt_client_cb_connections cb;
+	struct btt_gatt_connection_info *info;
+	struct connection *conn;
+	uint64_t now_ns = monotonic_ns();
+	unsigned int i;
+
+	FILL_HDR(cb, BTT_GATT_CLIENT_CB_CONNECTIONS);
+	cb.hdr.request_id = request_id;
+	cb.num = 0;
+
+	pthread_mutex_lock(&connections_lock);
+
+	for (i = 0; i < BTT_GATT_MAX_CONNECTIONS; i++) {
+		conn = &connections[i];
+
+		if (!conn->state)
+			continue;
+
+		info = &cb.entry[cb.num++];
+		info->addr = conn->addr;
+		info->state = conn->state;
+		info->bonded = conn->bonded;
+		info->client_if = conn->client_if;
+		info->conn_id = conn->conn_id;
+		info->mtu = CONN_DEFAULT_MTU;
+		info->in_flight = conn->in_flight;
+		info->queued = conn->queued;
+		info->reconnects = conn->reconnects;
+		info->operations = conn->operations;
+		info->connected_ms = conn->state == BTT_GATT_CONNECTION_CONNECTED ?
+				(now_ns - conn->connected_ns) / 1000000 : 0;
+	}
+
+	pthread_mutex_unlock(&connections_lock);
+
+	TRIM_TRAILER(cb, entry, cb.num * sizeof(cb.entry[0]));
+
+	if (!btt_daemon_client_send(socket, &cb, MSG_SIZE(cb)))
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_CONNECTIONS_H
+#error Included twice
+#endif
+#define BTT_DAEMON_CONNECTIONS_H
+
+/* requires btt.h */
+
+/* called by the commands and the HAL callbacks */
+extern void btt_daemon_connections_connecting(int client_if,
+		const bt_bdaddr_t *bda, bool is_direct);
+extern void btt_daemon_connections_connected(int conn_id, int status,
+		int client_if, const bt_bdaddr_t *bda);
+extern void btt_daemon_connections_disconnecting(int conn_id);
+extern void btt_daemon_connections_disconnected(int conn_id);
+extern void btt_daemon_connections_bond_state(const bt_bdaddr_t *bda,
+		bt_bond_state_t state);
+extern void btt_daemon_connections_forget_client(int client_if);
+
+/* ATT operation of a client, sent to the HAL when the previous one
+ * on the connection is done */
+extern bt_status_t btt_daemon_connections_submit(int conn_id,
+		const struct btt_message *msg);
+extern void btt_daemon_connections_done(int conn_id);
+extern int btt_daemon_connections_conn_id(int client_if,
+		const bt_bdaddr_t *bda);
+
+/* Engine run on the connection, BT_STATUS_BUSY if an operation is
+ * waiting or another engine runs. Release must not be called under
+ * the engine's lock, queued operations are sent by it. */
+extern bt_status_t btt_daemon_connections_hold(int conn_id);
+extern void btt_daemon_connections_release(int conn_id);
+
+extern bt_status_t btt_daemon_connections_auto_reconnect(int client_if,
+		const bt_bdaddr_t *bda, unsigned int max_attempts);
+extern void btt_daemon_connections_send(int socket, unsigned int request_id);
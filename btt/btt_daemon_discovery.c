@@ -0,0 +1,482 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_utils.h"
+#include "btt_gatt_client.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_connections.h"
+#include "btt_daemon_discovery.h"
+
+extern const btgatt_client_interface_t *gatt_client_if;
+
+/* discover_all: services are searched, then characteristics of every
+ * service are enumerated, then descriptors of every characteristic,
+ * each step started by the callback of the previous one. Intermediate
+ * callbacks are not delivered, the whole tree is sent at the end.
+ * HAL may call the callback before its call returns, the next step is
+ * then only marked pending and made by the loop in run_discovery, so
+ * the stack does not grow with the number of attributes. */
+
+#define DISCOVERY_SESSIONS 8
+/* of one type, parents are 16 bits */
+#define DISCOVERY_MAX_ENTRIES 1024
+
+enum discovery_state {
+	DISCOVERY_IDLE,
+	DISCOVERY_SERVICES,
+	DISCOVERY_CHARACTERISTICS,
+	DISCOVERY_DESCRIPTORS
+};
+
+struct discovery_list {
+	struct btt_gatt_cache_entry *entries;
+	unsigned int num;
+	unsigned int alloc;
+};
+
+struct discovery {
+	enum discovery_state state;
+	int conn_id;
+	uint64_t start_ns;
+	struct discovery_list services;
+	struct discovery_list characteristics;
+	struct discovery_list descriptors;
+	/* service or characteristic being enumerated */
+	unsigned int cursor;
+	/* continue after the last found attribute */
+	bool has_start;
+	btgatt_gatt_id_t start;
+	/* step was sent, its callback is still to come */
+	bool waiting;
+	/* HAL call of this session is in progress */
+	bool in_call;
+	bool pending;
+};
+
+static pthread_mutex_t discovery_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct discovery sessions[DISCOVERY_SESSIONS];
+/* connections of the finished sessions, held until the lock is left */
+static int finished[DISCOVERY_SESSIONS];
+static unsigned int finished_num;
+
+/* must be called under discovery_lock */
+static struct discovery *find_session(int conn_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < DISCOVERY_SESSIONS; i++)
+		if (sessions[i].state != DISCOVERY_IDLE &&
+				sessions[i].conn_id == conn_id)
+			return &sessions[i];
+
+	return NULL;
+}
+
+/* Connections of the sessions finished under the lock are given back
+ * after it is left, operations queued on them are sent then and their
+ * callbacks may come before the HAL call returns. */
+static void unlock_and_release(void)
+{
+	int conn_ids[DISCOVERY_SESSIONS];
+	unsigned int num = finished_num;
+	unsigned int i;
+
+	memcpy(conn_ids, finished, num * sizeof(conn_ids[0]));
+	finished_num = 0;
+	pthread_mutex_unlock(&discovery_lock);
+
+	for (i = 0; i < num; i++)
+		btt_daemon_connections_release(conn_ids[i]);
+}
+
+static bool add_entry(struct discovery_list *list,
+		enum btt_gatt_cache_type type, unsigned int parent,
+		const btgatt_gatt_id_t *id, uint8_t flags, uint16_t handle)
+{
+	struct btt_gatt_cache_entry *entries;
+	struct btt_gatt_cache_entry *entry;
+	unsigned int alloc;
+
+	if (list->num == list->alloc) {
+		if (list->num == DISCOVERY_MAX_ENTRIES)
+			return FALSE;
+
+		alloc = list->alloc ? list->alloc * 2 : 16;
+		entries = realloc(list->entries, alloc * sizeof(*entries));
+
+		if (!entries)
+			return FALSE;
+
+		list->entries = entries;
+		list->alloc = alloc;
+	}
+
+	entry = &list->entries[list->num++];
+	entry->type = type;
+	entry->flags = flags;
+	entry->parent = parent;
+	entry->handle = handle;
+	entry->id = *id;
+
+	return TRUE;
+}
+
+static void srvc_id_of(const struct btt_gatt_cache_entry *service,
+		btgatt_srvc_id_t *srvc_id)
+{
+	srvc_id->id = service->id;
+	srvc_id->is_primary = service->flags;
+}
+
+static bool is_service(const struct discovery *session, unsigned int index,
+		const btgatt_srvc_id_t *srvc_id)
+{
+	btgatt_srvc_id_t id;
+
+	srvc_id_of(&session->services.entries[index], &id);
+
+	return !memcmp(&id, srvc_id, sizeof(id));
+}
+
+/* Must be called under discovery_lock, NULL unless the callback is
+ * of the step sent in this state, not e.g. of a search of a client. */
+static struct discovery *waiting_session(int conn_id,
+		enum discovery_state state)
+{
+	struct discovery *session = find_session(conn_id);
+
+	if (!session || !session->waiting || session->state != state)
+		return NULL;
+
+	return session;
+}
+
+static void send_part(struct btt_gatt_client_cb_discover_all *cb)
+{
+	TRIM_TRAILER(*cb, entry, cb->num * sizeof(cb->entry[0]));
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			cb->conn_id, cb, MSG_SIZE(*cb));
+	cb->num = 0;
+}
+
+/* full parts are sent, the rest waits for the next list */
+static void send_list(struct btt_gatt_client_cb_discover_all *cb,
+		const struct discovery_list *list)
+{
+	unsigned int i;
+
+	for (i = 0; i < list->num; i++) {
+		cb->entry[cb->num++] = list->entries[i];
+
+		if (cb->num == BTT_GATT_DISCOVER_MSG_ENTRIES)
+			send_part(cb);
+	}
+}
+
+/* must be called under discovery_lock, sends the tree and frees
+ * the session */
+static void finish(struct discovery *session, int status)
+{
+	struct btt_gatt_client_cb_discover_all cb;
+	struct btt_gatt_client_cb_discover_all_complete complete;
+
+	FILL_HDR(cb, BTT_GATT_CLIENT_CB_DISCOVER_ALL);
+	cb.conn_id = session->conn_id;
+	cb.num = 0;
+
+	send_list(&cb, &session->services);
+	send_list(&cb, &session->characteristics);
+	send_list(&cb, &session->descriptors);
+
+	if (cb.num)
+		send_part(&cb);
+
+	FILL_HDR(complete, BTT_GATT_CLIENT_CB_DISCOVER_ALL_COMPLETE);
+	complete.conn_id = session->conn_id;
+	complete.status = status;
+	complete.services = session->services.num;
+	complete.characteristics = session->characteristics.num;
+	complete.descriptors = session->descriptors.num;
+	complete.duration_ms = (monotonic_ns() - session->start_ns) / 1000000;
+
+	BTT_LOG_I("Discovered conn_id=%d in %u ms, status=%d\n",
+			session->conn_id, complete.duration_ms, status);
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			session->conn_id, &complete, sizeof(complete));
+
+	if (finished_num < DISCOVERY_SESSIONS)
+		finished[finished_num++] = session->conn_id;
+
+	free(session->services.entries);
+	free(session->characteristics.entries);
+	free(session->descriptors.entries);
+	memset(session, 0, sizeof(*session));
+}
+
+/* Must be called under discovery_lock, the lock is released during
+ * the HAL call. Steps made pending meanwhile are made here too. */
+static void run_discovery(struct discovery *session)
+{
+	const struct btt_gatt_cache_entry *characteristic;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+	btgatt_gatt_id_t start;
+	enum discovery_state state;
+	bool has_start;
+	int conn_id = session->conn_id;
+	bt_status_t status;
+
+	do {
+		session->pending = FALSE;
+
+		/* the enumerated service or characteristic is done */
+		if (session->state == DISCOVERY_CHARACTERISTICS &&
+				session->cursor == session->services.num) {
+			session->state = DISCOVERY_DESCRIPTORS;
+			session->cursor = 0;
+		}
+
+		if (session->state == DISCOVERY_DESCRIPTORS &&
+				session->cursor == session->characteristics.num) {
+			finish(session, BT_STATUS_SUCCESS);
+			return;
+		}
+
+		state = session->state;
+		has_start = session->has_start;
+		start = session->start;
+
+		if (state == DISCOVERY_CHARACTERISTICS) {
+			srvc_id_of(&session->services.entries[session->cursor],
+					&srvc_id);
+		} else if (state == DISCOVERY_DESCRIPTORS) {
+			characteristic =
+					&session->characteristics.entries[session->cursor];
+			char_id = characteristic->id;
+			srvc_id_of(&session->services.entries[characteristic->parent],
+					&srvc_id);
+		}
+
+		session->waiting = TRUE;
+		session->in_call = TRUE;
+		pthread_mutex_unlock(&discovery_lock);
+
+		if (state == DISCOVERY_SERVICES)
+			status = gatt_client_if->search_service(conn_id, NULL);
+		else if (state == DISCOVERY_CHARACTERISTICS)
+			status = gatt_client_if->get_characteristic(conn_id, &srvc_id,
+					has_start ? &start : NULL);
+		else
+			status = gatt_client_if->get_descriptor(conn_id, &srvc_id,
+					&char_id, has_start ? &start : NULL);
+
+		pthread_mutex_lock(&discovery_lock);
+
+		/* disconnected meanwhile */
+		if (session->state == DISCOVERY_IDLE || session->conn_id != conn_id)
+			return;
+
+		session->in_call = FALSE;
+
+		if (status != BT_STATUS_SUCCESS) {
+			finish(session, status);
+			return;
+		}
+	} while (session->pending);
+}
+
+/* must be called under discovery_lock */
+static void advance(struct discovery *session)
+{
+	if (session->in_call)
+		session->pending = TRUE;
+	else
+		run_discovery(session);
+}
+
+bt_status_t btt_daemon_discovery_start(int conn_id)
+{
+	struct discovery *session = NULL;
+	unsigned int i;
+	bt_status_t status;
+
+	/* operations of clients wait until the tree is sent */
+	if ((status = btt_daemon_connections_hold(conn_id)) != BT_STATUS_SUCCESS)
+		return status;
+
+	pthread_mutex_lock(&discovery_lock);
+
+	if (find_session(conn_id)) {
+		pthread_mutex_unlock(&discovery_lock);
+		btt_daemon_connections_release(conn_id);
+		BTT_LOG_W("Discovery of conn_id=%d is running already\n", conn_id);
+		return BT_STATUS_BUSY;
+	}
+
+	for (i = 0; i < DISCOVERY_SESSIONS && !session; i++)
+		if (sessions[i].state == DISCOVERY_IDLE)
+			session = &sessions[i];
+
+	if (!session) {
+		pthread_mutex_unlock(&discovery_lock);
+		btt_daemon_connections_release(conn_id);
+		return BT_STATUS_NOMEM;
+	}
+
+	session->state = DISCOVERY_SERVICES;
+	session->conn_id = conn_id;
+	session->start_ns = monotonic_ns();
+	run_discovery(session);
+
+	unlock_and_release();
+
+	return BT_STATUS_SUCCESS;
+}
+
+bool btt_daemon_discovery_search_result(int conn_id,
+		const btgatt_srvc_id_t *srvc_id, uint16_t handle)
+{
+	struct discovery *session;
+
+	pthread_mutex_lock(&discovery_lock);
+
+	session = waiting_session(conn_id, DISCOVERY_SERVICES);
+
+	if (session && !add_entry(&session->services, BTT_GATT_CACHE_SERVICE, 0,
+					&srvc_id->id, srvc_id->is_primary, handle))
+		BTT_LOG_W("Too many services of conn_id=%d\n", conn_id);
+
+	unlock_and_release();
+
+	return session ? TRUE : FALSE;
+}
+
+bool btt_daemon_discovery_search_complete(int conn_id, int status)
+{
+	struct discovery *session;
+
+	pthread_mutex_lock(&discovery_lock);
+
+	session = waiting_session(conn_id, DISCOVERY_SERVICES);
+
+	if (!session) {
+		unlock_and_release();
+		return FALSE;
+	}
+
+	session->waiting = FALSE;
+
+	if (status != BT_STATUS_SUCCESS) {
+		finish(session, status);
+	} else {
+		session->state = DISCOVERY_CHARACTERISTICS;
+		session->cursor = 0;
+		session->has_start = FALSE;
+		advance(session);
+	}
+
+	unlock_and_release();
+
+	return TRUE;
+}
+
+/* Error status ends the enumeration of the attribute under cursor.
+ * Must be called under discovery_lock. */
+static void found(struct discovery *session, int status,
+		struct discovery_list *list, enum btt_gatt_cache_type type,
+		const btgatt_gatt_id_t *id, uint8_t flags, uint16_t handle)
+{
+	session->waiting = FALSE;
+
+	if (status == BT_STATUS_SUCCESS &&
+			add_entry(list, type, session->cursor, id, flags, handle)) {
+		session->has_start = TRUE;
+		session->start = *id;
+	} else {
+		session->cursor++;
+		session->has_start = FALSE;
+	}
+
+	advance(session);
+}
+
+bool btt_daemon_discovery_characteristic(int conn_id, int status,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		int char_prop, uint16_t handle)
+{
+	struct discovery *session;
+
+	pthread_mutex_lock(&discovery_lock);
+
+	session = waiting_session(conn_id, DISCOVERY_CHARACTERISTICS);
+
+	/* of the service being enumerated */
+	if (session && !is_service(session, session->cursor, srvc_id))
+		session = NULL;
+
+	if (session)
+		found(session, status, &session->characteristics,
+				BTT_GATT_CACHE_CHARACTERISTIC, char_id, char_prop, handle);
+
+	unlock_and_release();
+
+	return session ? TRUE : FALSE;
+}
+
+bool btt_daemon_discovery_descriptor(int conn_id, int status,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		const btgatt_gatt_id_t *descr_id, uint16_t handle)
+{
+	const struct btt_gatt_cache_entry *characteristic;
+	struct discovery *session;
+
+	pthread_mutex_lock(&discovery_lock);
+
+	session = waiting_session(conn_id, DISCOVERY_DESCRIPTORS);
+
+	/* of the characteristic being enumerated */
+	if (session) {
+		characteristic = &session->characteristics.entries[session->cursor];
+
+		if (memcmp(&characteristic->id, char_id, sizeof(*char_id)) ||
+				!is_service(session, characteristic->parent, srvc_id))
+			session = NULL;
+	}
+
+	if (session)
+		found(session, status, &session->descriptors,
+				BTT_GATT_CACHE_DESCRIPTOR, descr_id, 0, handle);
+
+	unlock_and_release();
+
+	return session ? TRUE : FALSE;
+}
+
+/* tree found so far is sent with the error */
+void btt_daemon_discovery_disconnect(int conn_id)
+{
+	struct discovery *session;
+
+	pthread_mutex_lock(&discovery_lock);
+
+	if ((session = find_session(conn_id)) != NULL)
+		finish(session, BT_STATUS_FAIL);
+
+	unlock_and_release();
+}
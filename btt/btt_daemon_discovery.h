@@ -0,0 +1,38 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_DISCOVERY_H
+#error Included twice
+#endif
+#define BTT_DAEMON_DISCOVERY_H
+
+/* requires btt_gatt_client.h */
+
+extern bt_status_t btt_daemon_discovery_start(int conn_id);
+
+/* Called by the HAL callbacks with the handle given to the attribute
+ * by the GATT cache, return TRUE if the callback belongs to a discovery
+ * and must not be delivered to clients. */
+extern bool btt_daemon_discovery_search_result(int conn_id,
+		const btgatt_srvc_id_t *srvc_id, uint16_t handle);
+extern bool btt_daemon_discovery_search_complete(int conn_id, int status);
+extern bool btt_daemon_discovery_characteristic(int conn_id, int status,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		int char_prop, uint16_t handle);
+extern bool btt_daemon_discovery_descriptor(int conn_id, int status,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		const btgatt_gatt_id_t *descr_id, uint16_t handle);
+extern void btt_daemon_discovery_disconnect(int conn_id);
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/eventfd.h>
+
+#include "btt_utils.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_requests.h"
+#include "btt_daemon_events.h"
+
+/* HAL callbacks (producers) put encoded events into a bounded lock-free
+ * ring, one writer thread (consumer) sends them to the subscribers.
+ * Every slot carries a sequence number: slot is free for the producer
+ * at position pos when seq == pos and ready for the consumer when
+ * seq == pos + 1. A full ring never blocks the HAL, the event is dropped
+ * and counted instead. The last reserve slots are kept for events which
+ * complete a request, a flood of other events can not take its answer.
+ * The writer sends events in batches, one writev per client, and keeps
+ * their slots until the batch is flushed, so nothing is copied again. */
+
+static struct btt_daemon_event *ring;
+static unsigned long ring_mask;
+static unsigned long reserve;
+static unsigned long enqueue_pos;
+static unsigned long dequeue_pos;
+static uint64_t overflows;
+static uint64_t delivered;
+/* writer is about to sleep on wakeup_fd */
+static int writer_idle;
+static int wakeup_fd = -1;
+
+static struct btt_daemon_event **batch;
+static unsigned int batch_max;
+static uint64_t batch_delay_ns;
+
+static void wakeup_writer(void)
+{
+	uint64_t one = 1;
+
+	if (__atomic_exchange_n(&writer_idle, 0, __ATOMIC_SEQ_CST))
+		if (write(wakeup_fd, &one, sizeof(one)) == -1)
+			BTT_LOG_E("%s:eventfd write error\n", __FUNCTION__);
+}
+
+static bool slot_free(unsigned long pos)
+{
+	return __atomic_load_n(&ring[pos & ring_mask].seq, __ATOMIC_ACQUIRE) ==
+			pos;
+}
+
+void btt_daemon_deliver(unsigned int events, enum btt_daemon_key key,
+		int id, const void *data, size_t length)
+{
+	unsigned int command = ((const struct btt_message *) data)->command;
+	struct btt_daemon_event *slot;
+	unsigned long pos;
+	long diff;
+	int origin = -1;
+	unsigned int request_id;
+	bool answer;
+
+	if (length > BTT_DAEMON_EVENT_MAX_LEN) {
+		BTT_LOG_E("Event too long, command=%u length=%zu\n", command,
+				length);
+		return;
+	}
+
+	answer = btt_daemon_requests_expected(key, id, command);
+	pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+
+	while (1) {
+		slot = &ring[pos & ring_mask];
+		diff = (long) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+
+		/* other events leave the reserve free */
+		if (diff == 0 && (answer || slot_free(pos + reserve))) {
+			if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1,
+					TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff <= 0) {
+			/* request, if any, stays until its answer fits */
+			__atomic_add_fetch(&overflows, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	/* only now the slot is ours, the request can be completed */
+	request_id = btt_daemon_requests_complete(key, id, command, &origin);
+
+	slot->events = events;
+	slot->key = key;
+	slot->id = id;
+	slot->origin = origin;
+	slot->length = length;
+	memcpy(slot->data, data, length);
+	memcpy(&slot->origin_hdr, data, sizeof(slot->origin_hdr));
+	slot->origin_hdr.request_id = request_id;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	wakeup_writer();
+}
+
+/* n-th event waiting for the writer */
+static struct btt_daemon_event *peek_event(unsigned int n)
+{
+	struct btt_daemon_event *slot = &ring[(dequeue_pos + n) & ring_mask];
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != dequeue_pos + n + 1)
+		return NULL;
+
+	return slot;
+}
+
+/* Sleep until the n-th event comes or timeout_ns passes,
+ * negative timeout_ns waits forever. */
+static void wait_event(unsigned int n, int64_t timeout_ns)
+{
+	struct timeval tv;
+	uint64_t counter;
+	fd_set set;
+	int ret;
+
+	__atomic_store_n(&writer_idle, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	/* producer might have missed the idle flag */
+	if (peek_event(n)) {
+		__atomic_store_n(&writer_idle, 0, __ATOMIC_SEQ_CST);
+		return;
+	}
+
+	FD_ZERO(&set);
+	FD_SET(wakeup_fd, &set);
+	tv.tv_sec = timeout_ns / 1000000000;
+	tv.tv_usec = (timeout_ns % 1000000000) / 1000;
+
+	ret = select(wakeup_fd + 1, &set, NULL, NULL, timeout_ns < 0 ? NULL : &tv);
+
+	if (ret > 0 && read(wakeup_fd, &counter, sizeof(counter)) == -1)
+		BTT_LOG_E("%s:eventfd read error\n", __FUNCTION__);
+	else if (ret == -1 && errno != EINTR)
+		BTT_LOG_E("%s:select error\n", __FUNCTION__);
+
+	__atomic_store_n(&writer_idle, 0, __ATOMIC_SEQ_CST);
+}
+
+static void *writer_thread(void *arg)
+{
+	struct btt_daemon_event *slot;
+	uint64_t reported = 0;
+	uint64_t deadline = 0;
+	uint64_t dropped;
+	uint64_t now;
+	unsigned int num;
+	unsigned int i;
+
+	while (1) {
+		num = 0;
+
+		while (num < batch_max) {
+			if ((slot = peek_event(num)) != NULL) {
+				if (!num)
+					deadline = monotonic_ns() + batch_delay_ns;
+
+				batch[num++] = slot;
+				continue;
+			}
+
+			if (!num)
+				break;
+
+			now = monotonic_ns();
+
+			if (now >= deadline)
+				break;
+
+			wait_event(num, deadline - now);
+		}
+
+		if (num) {
+			btt_daemon_registry_deliver(batch, num);
+
+			/* give the slots back to producers for the next lap */
+			for (i = 0; i < num; i++) {
+				__atomic_store_n(&batch[i]->seq,
+						dequeue_pos + ring_mask + 1, __ATOMIC_RELEASE);
+				dequeue_pos += 1;
+			}
+
+			__atomic_add_fetch(&delivered, num, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		dropped = btt_daemon_events_overflows();
+
+		if (dropped != reported) {
+			BTT_LOG_W("Event ring full, %" PRIu64 " events dropped so far\n",
+					dropped);
+			reported = dropped;
+		}
+
+		wait_event(0, -1);
+	}
+
+	return NULL;
+}
+
+/* capacity is rounded up to the power of two, batch_events is limited
+ * by it, batch_delay_us 0 sends whatever is ready without waiting */
+bool btt_daemon_events_init(unsigned int capacity,
+		unsigned int batch_events, unsigned int batch_delay_us)
+{
+	pthread_t thread;
+	unsigned long size = 2;
+	unsigned long i;
+
+	while (size < capacity)
+		size <<= 1;
+
+	batch_max = batch_events < size ? batch_events : size;
+
+	if (!batch_max)
+		batch_max = 1;
+	batch_delay_ns = (uint64_t) batch_delay_us * 1000;
+
+	ring = calloc(size, sizeof(*ring));
+	batch = calloc(batch_max, sizeof(*batch));
+	wakeup_fd = eventfd(0, 0);
+
+	if (!ring || !batch || wakeup_fd == -1) {
+		BTT_LOG_E("Cannot allocate event ring of %lu events\n", size);
+		return FALSE;
+	}
+
+	for (i = 0; i < size; i++)
+		ring[i].seq = i;
+
+	ring_mask = size - 1;
+	reserve = size / 4 < BTT_DAEMON_MAX_REQUESTS ? size / 4 :
+			BTT_DAEMON_MAX_REQUESTS;
+
+	if (pthread_create(&thread, NULL, writer_thread, NULL)) {
+		BTT_LOG_E("Cannot start event writer thread\n");
+		return FALSE;
+	}
+
+	pthread_detach(thread);
+	BTT_LOG_I("Event ring capacity=%lu batch=%u delay=%uus\n", size,
+			batch_max, batch_delay_us);
+	return TRUE;
+}
+
+uint64_t btt_daemon_events_overflows(void)
+{
+	return __atomic_load_n(&overflows, __ATOMIC_RELAXED);
+}
+
+/* events taken from the ring and handed to the registry */
+uint64_t btt_daemon_events_delivered(void)
+{
+	return __atomic_load_n(&delivered, __ATOMIC_RELAXED);
+}
+
+void btt_daemon_events_config(unsigned int *capacity,
+		unsigned int *batch_events, unsigned int *batch_delay_us)
+{
+	*capacity = ring_mask + 1;
+	*batch_events = batch_max;
+	*batch_delay_us = batch_delay_ns / 1000;
+}
+
+/* next btt_daemon_deliver would not be dropped, unless another producer
+ * takes the slot first */
+bool btt_daemon_events_room(void)
+{
+	unsigned long pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+
+	return slot_free(pos) && slot_free(pos + reserve);
+}
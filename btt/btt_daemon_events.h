@@ -0,0 +1,53 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_EVENTS_H
+#error Included twice
+#endif
+#define BTT_DAEMON_EVENTS_H
+
+#define BTT_DAEMON_EVENTS_DEFAULT_CAPACITY 256
+/* must hold the biggest callback structure */
+#define BTT_DAEMON_EVENT_MAX_LEN 1024
+/* events are flushed once this many are collected ... */
+#define BTT_DAEMON_BATCH_DEFAULT_EVENTS 64
+/* ... or the oldest of them waits this long */
+#define BTT_DAEMON_BATCH_DEFAULT_DELAY_US 2000
+/* high rate event, put into the shared ring of a client if it has one */
+#define BTT_DAEMON_EVENT_STREAM (1u << 31)
+
+struct btt_daemon_event {
+	unsigned long seq;
+	unsigned int events;
+	enum btt_daemon_key key;
+	int id;
+	/* client whose request is completed by this event */
+	int origin;
+	/* header sent to origin, it carries its request_id */
+	struct btt_message origin_hdr;
+	unsigned int length;
+	uint8_t data[BTT_DAEMON_EVENT_MAX_LEN];
+};
+
+extern bool btt_daemon_events_init(unsigned int capacity,
+		unsigned int batch_events, unsigned int batch_delay_us);
+extern uint64_t btt_daemon_events_overflows(void);
+extern uint64_t btt_daemon_events_delivered(void);
+extern void btt_daemon_events_config(unsigned int *capacity,
+		unsigned int *batch_events, unsigned int *batch_delay_us);
+extern bool btt_daemon_events_room(void);
+extern void btt_daemon_deliver(unsigned int events, enum btt_daemon_key key,
+		int id, const void *data, size_t length);
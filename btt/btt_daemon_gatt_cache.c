@@ -0,0 +1,628 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/uio.h>
+#include "btt_utils.h"
+#include "btt_gatt_client.h"
+#include "btt_framing.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_gatt_cache.h"
+
+/* Attribute database of remote devices, learnt from the results of
+ * search_service, get_characteristic and get_descriptor, so a client can
+ * have it at once after reconnect. Every device is kept in its own file
+ * in BTT_DIRECTORY, written when discovery of a connection finishes or
+ * the connection goes down. Only the recently used devices stay
+ * in memory, the rest is loaded from the file when needed. */
+
+#define CACHE_DEVICES 32
+#define CACHE_CONNECTIONS 16
+#define CACHE_TYPES 3
+/* of one type per device, parents are 16 bits */
+#define CACHE_MAX_ENTRIES 1024
+#define CACHE_PATH_LEN 64
+
+struct cache_list {
+	struct btt_gatt_cache_entry *entries;
+	unsigned int num;
+	unsigned int alloc;
+};
+
+struct cache_device {
+	bool used;
+	/* changed since it was written */
+	bool dirty;
+	bt_bdaddr_t bda;
+	unsigned int connections;
+	/* for eviction, the lowest one goes first */
+	unsigned long last_use;
+	/* indexed by type - BTT_GATT_CACHE_SERVICE */
+	struct cache_list lists[CACHE_TYPES];
+};
+
+struct cache_connection {
+	int conn_id;
+	struct cache_device *device;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cache_device devices[CACHE_DEVICES];
+static struct cache_connection connections[CACHE_CONNECTIONS];
+static unsigned long use_counter;
+
+static struct cache_list *list_of(struct cache_device *device,
+		enum btt_gatt_cache_type type)
+{
+	return &device->lists[type - BTT_GATT_CACHE_SERVICE];
+}
+
+static void cache_path(const bt_bdaddr_t *bda, char *path)
+{
+	const uint8_t *a = bda->address;
+
+	snprintf(path, CACHE_PATH_LEN,
+			BTT_DIRECTORY"/gattc-%02X%02X%02X%02X%02X%02X.cache",
+			a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static void clear_device(struct cache_device *device)
+{
+	unsigned int i;
+
+	for (i = 0; i < CACHE_TYPES; i++)
+		device->lists[i].num = 0;
+
+	device->dirty = FALSE;
+}
+
+static void free_device(struct cache_device *device)
+{
+	unsigned int i;
+
+	for (i = 0; i < CACHE_TYPES; i++)
+		free(device->lists[i].entries);
+
+	memset(device, 0, sizeof(*device));
+}
+
+/* must be called under cache_lock, written to a temporary file first
+ * so a crash never leaves a half written cache behind */
+static void save_device(struct cache_device *device)
+{
+	struct btt_gatt_cache_header header;
+	char path[CACHE_PATH_LEN];
+	char tmp[CACHE_PATH_LEN + 4];
+	FILE *file;
+	unsigned int i;
+	bool ok;
+
+	if (!device->dirty)
+		return;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = BTT_GATT_CACHE_MAGIC;
+	header.version = BTT_GATT_CACHE_VERSION;
+	header.bda = device->bda;
+	header.services = list_of(device, BTT_GATT_CACHE_SERVICE)->num;
+	header.characteristics =
+			list_of(device, BTT_GATT_CACHE_CHARACTERISTIC)->num;
+	header.descriptors = list_of(device, BTT_GATT_CACHE_DESCRIPTOR)->num;
+
+	cache_path(&device->bda, path);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	file = fopen(tmp, "wb");
+
+	if (!file) {
+		BTT_LOG_E("Cannot write %s: %s\n", tmp, strerror(errno));
+		return;
+	}
+
+	ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+	for (i = 0; i < CACHE_TYPES && ok; i++)
+		ok = fwrite(device->lists[i].entries, sizeof(struct
+				btt_gatt_cache_entry), device->lists[i].num, file) ==
+				device->lists[i].num;
+
+	if (fclose(file) || !ok || rename(tmp, path)) {
+		BTT_LOG_E("Cannot write %s: %s\n", path, strerror(errno));
+		unlink(tmp);
+		return;
+	}
+
+	device->dirty = FALSE;
+}
+
+static bool reserve(struct cache_list *list, unsigned int num)
+{
+	struct btt_gatt_cache_entry *entries;
+	unsigned int alloc = list->alloc ? list->alloc : 16;
+
+	if (num <= list->alloc)
+		return TRUE;
+
+	if (num > CACHE_MAX_ENTRIES)
+		return FALSE;
+
+	while (alloc < num)
+		alloc <<= 1;
+
+	entries = realloc(list->entries, alloc * sizeof(*entries));
+
+	if (!entries)
+		return FALSE;
+
+	list->entries = entries;
+	list->alloc = alloc;
+
+	return TRUE;
+}
+
+/* must be called under cache_lock, the cache is dropped if the file
+ * is not consistent */
+static void load_device(struct cache_device *device)
+{
+	struct btt_gatt_cache_header header;
+	struct btt_gatt_cache_entry *entry;
+	char path[CACHE_PATH_LEN];
+	unsigned int parents[CACHE_TYPES];
+	unsigned int i;
+	unsigned int j;
+	FILE *file;
+
+	cache_path(&device->bda, path);
+	file = fopen(path, "rb");
+
+	if (!file)
+		return;
+
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+			header.magic != BTT_GATT_CACHE_MAGIC ||
+			header.version != BTT_GATT_CACHE_VERSION ||
+			memcmp(&header.bda, &device->bda, sizeof(header.bda)))
+		goto error;
+
+	parents[0] = 0;
+	parents[1] = header.services;
+	parents[2] = header.characteristics;
+	list_of(device, BTT_GATT_CACHE_SERVICE)->num = header.services;
+	list_of(device, BTT_GATT_CACHE_CHARACTERISTIC)->num =
+			header.characteristics;
+	list_of(device, BTT_GATT_CACHE_DESCRIPTOR)->num = header.descriptors;
+
+	for (i = 0; i < CACHE_TYPES; i++) {
+		struct cache_list *list = &device->lists[i];
+
+		if (!reserve(list, list->num) || fread(list->entries,
+				sizeof(*entry), list->num, file) != list->num)
+			goto error;
+
+		for (j = 0; j < list->num; j++) {
+			entry = &list->entries[j];
+
+			if (entry->type != BTT_GATT_CACHE_SERVICE + i ||
+					entry->handle != BTT_GATT_HANDLE(entry->type, j) ||
+					(i && entry->parent >= parents[i]))
+				goto error;
+		}
+	}
+
+	fclose(file);
+	return;
+
+error:
+	BTT_LOG_W("Ignoring invalid GATT cache %s\n", path);
+	fclose(file);
+	clear_device(device);
+}
+
+/* must be called under cache_lock, loads the device if it is not in
+ * memory, NULL if there is no free slot */
+static struct cache_device *get_device(const bt_bdaddr_t *bda, bool load)
+{
+	struct cache_device *free_slot = NULL;
+	struct cache_device *oldest = NULL;
+	struct cache_device *device;
+	unsigned int i;
+
+	for (i = 0; i < CACHE_DEVICES; i++) {
+		device = &devices[i];
+
+		if (!device->used) {
+			free_slot = free_slot ? free_slot : device;
+			continue;
+		}
+
+		if (!memcmp(&device->bda, bda, sizeof(*bda))) {
+			device->last_use = ++use_counter;
+			return device;
+		}
+
+		if (!device->connections &&
+				(!oldest || device->last_use < oldest->last_use))
+			oldest = device;
+	}
+
+	if (!load)
+		return NULL;
+
+	if (!free_slot && oldest) {
+		save_device(oldest);
+		free_device(oldest);
+		free_slot = oldest;
+	}
+
+	if (!free_slot)
+		return NULL;
+
+	free_slot->used = TRUE;
+	free_slot->bda = *bda;
+	free_slot->last_use = ++use_counter;
+	load_device(free_slot);
+
+	return free_slot;
+}
+
+/* must be called under cache_lock */
+static struct cache_device *connection_device(int conn_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < CACHE_CONNECTIONS; i++)
+		if (connections[i].device && connections[i].conn_id == conn_id)
+			return connections[i].device;
+
+	return NULL;
+}
+
+static bool same_id(const btgatt_gatt_id_t *a, const btgatt_gatt_id_t *b)
+{
+	return a->inst_id == b->inst_id &&
+			!memcmp(&a->uuid, &b->uuid, sizeof(a->uuid));
+}
+
+/* Return number of the entry, it is added if the device does not have
+ * it yet, -1 if there is no room. Must be called under cache_lock. */
+static int add_entry(struct cache_device *device,
+		enum btt_gatt_cache_type type, unsigned int parent,
+		const btgatt_gatt_id_t *id, uint8_t flags)
+{
+	struct cache_list *list = list_of(device, type);
+	struct btt_gatt_cache_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < list->num; i++) {
+		entry = &list->entries[i];
+
+		if (entry->parent != parent || !same_id(&entry->id, id) ||
+				(type == BTT_GATT_CACHE_SERVICE && entry->flags != flags))
+			continue;
+
+		if (entry->flags != flags) {
+			entry->flags = flags;
+			device->dirty = TRUE;
+		}
+
+		return i;
+	}
+
+	if (!reserve(list, list->num + 1)) {
+		BTT_LOG_W("GATT cache of the device is full\n");
+		return -1;
+	}
+
+	entry = &list->entries[list->num];
+	entry->type = type;
+	entry->flags = flags;
+	entry->parent = parent;
+	entry->handle = BTT_GATT_HANDLE(type, list->num);
+	entry->id = *id;
+	device->dirty = TRUE;
+
+	return list->num++;
+}
+
+static int add_service(struct cache_device *device,
+		const btgatt_srvc_id_t *srvc_id)
+{
+	return add_entry(device, BTT_GATT_CACHE_SERVICE, 0, &srvc_id->id,
+			srvc_id->is_primary);
+}
+
+/* characteristic of a service which was not searched for adds it too,
+ * properties of a characteristic known only from a descriptor are 0 */
+static int add_characteristic(struct cache_device *device,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		int char_prop, bool update_prop)
+{
+	struct cache_list *list;
+	int service = add_service(device, srvc_id);
+	unsigned int i;
+
+	if (service < 0)
+		return -1;
+
+	list = list_of(device, BTT_GATT_CACHE_CHARACTERISTIC);
+
+	if (!update_prop)
+		for (i = 0; i < list->num; i++)
+			if (list->entries[i].parent == service &&
+					same_id(&list->entries[i].id, char_id))
+				return i;
+
+	return add_entry(device, BTT_GATT_CACHE_CHARACTERISTIC, service,
+			char_id, char_prop);
+}
+
+void btt_daemon_gatt_cache_connect(int conn_id, const bt_bdaddr_t *bda)
+{
+	struct cache_connection *free_slot = NULL;
+	struct cache_device *device;
+	unsigned int i;
+
+	pthread_mutex_lock(&cache_lock);
+
+	/* disconnection of the same conn_id was missed */
+	for (i = 0; i < CACHE_CONNECTIONS; i++) {
+		if (connections[i].device && connections[i].conn_id == conn_id) {
+			connections[i].device->connections--;
+			connections[i].device = NULL;
+		}
+
+		if (!free_slot && !connections[i].device)
+			free_slot = &connections[i];
+	}
+
+	device = get_device(bda, TRUE);
+
+	if (!free_slot || !device) {
+		BTT_LOG_W("No room to cache attributes of conn_id=%d\n", conn_id);
+		pthread_mutex_unlock(&cache_lock);
+		return;
+	}
+
+	free_slot->conn_id = conn_id;
+	free_slot->device = device;
+	device->connections++;
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void btt_daemon_gatt_cache_disconnect(int conn_id)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&cache_lock);
+
+	for (i = 0; i < CACHE_CONNECTIONS; i++) {
+		if (!connections[i].device || connections[i].conn_id != conn_id)
+			continue;
+
+		save_device(connections[i].device);
+		connections[i].device->connections--;
+		connections[i].device = NULL;
+	}
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+static uint16_t handle_of(enum btt_gatt_cache_type type, int number)
+{
+	return number < 0 ? 0 : BTT_GATT_HANDLE(type, number);
+}
+
+uint16_t btt_daemon_gatt_cache_service(int conn_id,
+		const btgatt_srvc_id_t *srvc_id)
+{
+	struct cache_device *device;
+	int service = -1;
+
+	pthread_mutex_lock(&cache_lock);
+
+	if ((device = connection_device(conn_id)) != NULL)
+		service = add_service(device, srvc_id);
+
+	pthread_mutex_unlock(&cache_lock);
+
+	return handle_of(BTT_GATT_CACHE_SERVICE, service);
+}
+
+uint16_t btt_daemon_gatt_cache_characteristic(int conn_id,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		int char_prop)
+{
+	struct cache_device *device;
+	int characteristic = -1;
+
+	pthread_mutex_lock(&cache_lock);
+
+	if ((device = connection_device(conn_id)) != NULL)
+		characteristic = add_characteristic(device, srvc_id, char_id,
+				char_prop, TRUE);
+
+	pthread_mutex_unlock(&cache_lock);
+
+	return handle_of(BTT_GATT_CACHE_CHARACTERISTIC, characteristic);
+}
+
+uint16_t btt_daemon_gatt_cache_descriptor(int conn_id,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		const btgatt_gatt_id_t *descr_id)
+{
+	struct cache_device *device;
+	int characteristic;
+	int descriptor = -1;
+
+	pthread_mutex_lock(&cache_lock);
+
+	if ((device = connection_device(conn_id)) != NULL) {
+		characteristic = add_characteristic(device, srvc_id, char_id, 0,
+				FALSE);
+
+		if (characteristic >= 0)
+			descriptor = add_entry(device, BTT_GATT_CACHE_DESCRIPTOR,
+					characteristic, descr_id, 0);
+	}
+
+	pthread_mutex_unlock(&cache_lock);
+
+	return handle_of(BTT_GATT_CACHE_DESCRIPTOR, descriptor);
+}
+
+/* a search or an enumeration is over */
+void btt_daemon_gatt_cache_save(int conn_id)
+{
+	struct cache_device *device;
+
+	pthread_mutex_lock(&cache_lock);
+
+	if ((device = connection_device(conn_id)) != NULL)
+		save_device(device);
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/* must be called under cache_lock, NULL if there is no such entry */
+static struct btt_gatt_cache_entry *entry_of(struct cache_device *device,
+		enum btt_gatt_cache_type type, unsigned int number)
+{
+	struct cache_list *list = list_of(device, type);
+
+	return number < list->num ? &list->entries[number] : NULL;
+}
+
+int btt_daemon_gatt_cache_resolve(int conn_id, uint16_t handle,
+		bt_bdaddr_t *bda, btgatt_srvc_id_t *srvc_id,
+		btgatt_gatt_id_t *char_id, btgatt_gatt_id_t *descr_id)
+{
+	struct btt_gatt_cache_entry *entry = NULL;
+	struct cache_device *device;
+	int type = BTT_GATT_HANDLE_TYPE(handle);
+
+	if (type < BTT_GATT_CACHE_SERVICE || type > BTT_GATT_CACHE_DESCRIPTOR)
+		return 0;
+
+	pthread_mutex_lock(&cache_lock);
+
+	if ((device = connection_device(conn_id)) != NULL)
+		entry = entry_of(device, type, BTT_GATT_HANDLE_NUMBER(handle));
+
+	if (!entry) {
+		pthread_mutex_unlock(&cache_lock);
+		return 0;
+	}
+
+	*bda = device->bda;
+
+	/* parents are checked when the entries are added or loaded */
+	if (type == BTT_GATT_CACHE_DESCRIPTOR) {
+		*descr_id = entry->id;
+		entry = entry_of(device, BTT_GATT_CACHE_CHARACTERISTIC,
+				entry->parent);
+	}
+
+	if (type >= BTT_GATT_CACHE_CHARACTERISTIC) {
+		*char_id = entry->id;
+		entry = entry_of(device, BTT_GATT_CACHE_SERVICE, entry->parent);
+	}
+
+	srvc_id->id = entry->id;
+	srvc_id->is_primary = entry->flags;
+
+	pthread_mutex_unlock(&cache_lock);
+
+	return type;
+}
+
+/* remote database changed, it is learnt again by the next discovery */
+void btt_daemon_gatt_cache_invalidate(const bt_bdaddr_t *bda)
+{
+	struct cache_device *device;
+	char path[CACHE_PATH_LEN];
+
+	pthread_mutex_lock(&cache_lock);
+
+	if ((device = get_device(bda, FALSE)) != NULL)
+		clear_device(device);
+
+	cache_path(bda, path);
+
+	if (unlink(path) && errno != ENOENT)
+		BTT_LOG_E("Cannot remove %s: %s\n", path, strerror(errno));
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+static void send_part(int socket, struct btt_gatt_client_cb_cache *cb)
+{
+	TRIM_TRAILER(*cb, entry, cb->num * sizeof(cb->entry[0]));
+
+	if (!btt_daemon_client_send(socket, cb, MSG_SIZE(*cb)))
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+
+	cb->num = 0;
+}
+
+void btt_daemon_gatt_cache_send(int socket, unsigned int request_id,
+		const bt_bdaddr_t *bda)
+{
+	struct btt_gatt_client_cb_cache cb;
+	struct cache_device *device;
+	struct cache_list *list;
+	unsigned int total = 0;
+	unsigned int sent = 0;
+	unsigned int i;
+	unsigned int j;
+
+	FILL_HDR(cb, BTT_GATT_CLIENT_CB_CACHE);
+	cb.hdr.request_id = request_id;
+	cb.addr = *bda;
+	cb.num = 0;
+	cb.more = 0;
+
+	pthread_mutex_lock(&cache_lock);
+
+	device = get_device(bda, TRUE);
+
+	for (i = 0; device && i < CACHE_TYPES; i++)
+		total += device->lists[i].num;
+
+	cb.found = total ? 1 : 0;
+
+	/* nothing known about it, do not keep the slot */
+	if (device && !total && !device->connections)
+		free_device(device);
+
+	for (i = 0; i < CACHE_TYPES && total; i++) {
+		list = &device->lists[i];
+
+		for (j = 0; j < list->num; j++) {
+			cb.entry[cb.num++] = list->entries[j];
+			sent++;
+
+			if (cb.num == BTT_GATT_CACHE_MSG_ENTRIES && sent < total) {
+				cb.more = 1;
+				send_part(socket, &cb);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&cache_lock);
+
+	cb.more = 0;
+	send_part(socket, &cb);
+}
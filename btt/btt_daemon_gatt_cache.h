@@ -0,0 +1,61 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_GATT_CACHE_H
+#error Included twice
+#endif
+#define BTT_DAEMON_GATT_CACHE_H
+
+/* requires btt_gatt_client.h */
+
+/* "BGAC", file of one device starts with btt_gatt_cache_header,
+ * btt_gatt_cache_entries of all services, characteristics and
+ * descriptors follow */
+#define BTT_GATT_CACHE_MAGIC 0x43414742
+#define BTT_GATT_CACHE_VERSION 2
+
+struct btt_gatt_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	bt_bdaddr_t bda;
+	uint16_t services;
+	uint16_t characteristics;
+	uint16_t descriptors;
+};
+
+/* Called by the HAL callbacks, the attribute functions return handle
+ * of the attribute, 0 if it is not cached. */
+extern void btt_daemon_gatt_cache_connect(int conn_id, const bt_bdaddr_t *bda);
+extern void btt_daemon_gatt_cache_disconnect(int conn_id);
+extern uint16_t btt_daemon_gatt_cache_service(int conn_id,
+		const btgatt_srvc_id_t *srvc_id);
+extern uint16_t btt_daemon_gatt_cache_characteristic(int conn_id,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		int char_prop);
+extern uint16_t btt_daemon_gatt_cache_descriptor(int conn_id,
+		const btgatt_srvc_id_t *srvc_id, const btgatt_gatt_id_t *char_id,
+		const btgatt_gatt_id_t *descr_id);
+extern void btt_daemon_gatt_cache_save(int conn_id);
+
+/* Attribute of the connection by its handle, type of the attribute
+ * or 0 if the handle is unknown. IDs of its parents are filled too. */
+extern int btt_daemon_gatt_cache_resolve(int conn_id, uint16_t handle,
+		bt_bdaddr_t *bda, btgatt_srvc_id_t *srvc_id,
+		btgatt_gatt_id_t *char_id, btgatt_gatt_id_t *descr_id);
+
+extern void btt_daemon_gatt_cache_invalidate(const bt_bdaddr_t *bda);
+extern void btt_daemon_gatt_cache_send(int socket, unsigned int request_id,
+		const bt_bdaddr_t *bda);
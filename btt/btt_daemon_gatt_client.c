@@ -15,17 +15,155 @@
  */
 
 #include "btt.h"
+#include <sys/uio.h>
 #include "btt_utils.h"
 #include "btt_gatt_client.h"
 #include "btt_eir_data_types.h"
+#include "btt_framing.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_requests.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_scan.h"
 
 #include <hardware/bt_gatt.h>
+#include "btt_daemon_capture.h"
+#include "btt_daemon_record.h"
+#include "btt_daemon_gatt_cache.h"
+#include "btt_daemon_discovery.h"
+#include "btt_daemon_long_write.h"
+#include "btt_daemon_read_multi.h"
+#include "btt_daemon_connections.h"
+#include "btt_daemon_gatt_client.h"
 
 extern const bt_interface_t *bluetooth_if;
 extern const btgatt_client_interface_t *gatt_client_if;
 extern const btgatt_interface_t *gatt_if;
-extern struct list_element *list;
-extern int socket_remote;
+
+/* Handle addressed operations are turned into the messages of the full
+ * ones, so they are queued and answered in the same way. */
+static bt_status_t read_handle(int socket, const struct btt_message *btt_msg,
+		const struct btt_gatt_client_read_handle *msg)
+{
+	struct btt_gatt_client_read_characteristic read_char;
+	struct btt_gatt_client_read_descriptor read_descr;
+	struct btt_message *full;
+	unsigned int cb_command;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+	btgatt_gatt_id_t descr_id;
+	bt_bdaddr_t bda;
+
+	switch (btt_daemon_gatt_cache_resolve(msg->conn_id, msg->handle, &bda,
+			&srvc_id, &char_id, &descr_id)) {
+	case BTT_GATT_CACHE_CHARACTERISTIC:
+		FILL_HDR(read_char, BTT_CMD_GATT_CLIENT_READ_CHARACTERISTIC);
+		read_char.conn_id = msg->conn_id;
+		read_char.srvc_id = srvc_id;
+		read_char.char_id = char_id;
+		read_char.auth_req = msg->auth_req;
+		full = &read_char.hdr;
+		cb_command = BTT_GATT_CLIENT_CB_READ_CHARACTERISTIC;
+		break;
+	case BTT_GATT_CACHE_DESCRIPTOR:
+		FILL_HDR(read_descr, BTT_CMD_GATT_CLIENT_READ_DESCRIPTOR);
+		read_descr.conn_id = msg->conn_id;
+		read_descr.srvc_id = srvc_id;
+		read_descr.char_id = char_id;
+		read_descr.descr_id = descr_id;
+		read_descr.auth_req = msg->auth_req;
+		full = &read_descr.hdr;
+		cb_command = BTT_GATT_CLIENT_CB_READ_DESCRIPTOR;
+		break;
+	default:
+		return BT_STATUS_PARM_INVALID;
+	}
+
+	full->request_id = btt_msg->request_id;
+	btt_daemon_registry_claim(socket, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			msg->conn_id);
+	btt_daemon_requests_expect(socket, btt_msg, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			msg->conn_id, cb_command);
+
+	return btt_daemon_connections_submit(msg->conn_id, full);
+}
+
+static bt_status_t write_handle(int socket, const struct btt_message *btt_msg,
+		const struct btt_gatt_client_write_handle *msg)
+{
+	struct btt_gatt_client_write_characteristic write_char;
+	struct btt_gatt_client_write_descriptor write_descr;
+	struct btt_message *full;
+	unsigned int cb_command;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+	btgatt_gatt_id_t descr_id;
+	bt_bdaddr_t bda;
+
+	switch (btt_daemon_gatt_cache_resolve(msg->conn_id, msg->handle, &bda,
+			&srvc_id, &char_id, &descr_id)) {
+	case BTT_GATT_CACHE_CHARACTERISTIC:
+		FILL_HDR(write_char, BTT_CMD_GATT_CLIENT_WRITE_CHARACTERISTIC);
+		write_char.conn_id = msg->conn_id;
+		write_char.srvc_id = srvc_id;
+		write_char.char_id = char_id;
+		write_char.write_type = msg->write_type;
+		write_char.len = msg->len;
+		write_char.auth_req = msg->auth_req;
+		memcpy(write_char.p_value, msg->value, msg->len);
+		TRIM_TRAILER(write_char, p_value, msg->len);
+		full = &write_char.hdr;
+		cb_command = BTT_GATT_CLIENT_CB_WRITE_CHARACTERISTIC;
+		break;
+	case BTT_GATT_CACHE_DESCRIPTOR:
+		FILL_HDR(write_descr, BTT_CMD_GATT_CLIENT_WRITE_DESCRIPTOR);
+		write_descr.conn_id = msg->conn_id;
+		write_descr.srvc_id = srvc_id;
+		write_descr.char_id = char_id;
+		write_descr.descr_id = descr_id;
+		write_descr.write_type = msg->write_type;
+		write_descr.len = msg->len;
+		write_descr.auth_req = msg->auth_req;
+		memcpy(write_descr.p_value, msg->value, msg->len);
+		TRIM_TRAILER(write_descr, p_value, msg->len);
+		full = &write_descr.hdr;
+		cb_command = BTT_GATT_CLIENT_CB_WRITE_DESCRIPTOR;
+		break;
+	default:
+		return BT_STATUS_PARM_INVALID;
+	}
+
+	full->request_id = btt_msg->request_id;
+	btt_daemon_registry_claim(socket, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			msg->conn_id);
+	btt_daemon_requests_expect(socket, btt_msg, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			msg->conn_id, cb_command);
+
+	return btt_daemon_connections_submit(msg->conn_id, full);
+}
+
+static bt_status_t notify_handle(int socket,
+		const struct btt_gatt_client_notify_handle *msg)
+{
+	struct btt_gatt_client_reg_for_notification reg;
+	btgatt_gatt_id_t descr_id;
+
+	if (btt_daemon_gatt_cache_resolve(msg->conn_id, msg->handle, &reg.addr,
+			&reg.srvc_id, &reg.char_id, &descr_id) !=
+			BTT_GATT_CACHE_CHARACTERISTIC)
+		return BT_STATUS_PARM_INVALID;
+
+	/* deregistration message has the same layout */
+	FILL_HDR(reg, msg->registered ?
+			BTT_CMD_GATT_CLIENT_REGISTER_FOR_NOTIFICATION :
+			BTT_CMD_GATT_CLIENT_DEREGISTER_FOR_NOTIFICATION);
+	reg.client_if = msg->client_if;
+
+	btt_daemon_registry_claim(socket, BTT_DAEMON_KEY_CLIENT_IF,
+			msg->client_if);
+
+	return btt_daemon_connections_submit(msg->conn_id, &reg.hdr);
+}
 
 /*TODO: add checking condition, like adapter status*/
 void handle_gatt_client_cmd(const struct btt_message *btt_msg,
@@ -34,6 +172,8 @@ void handle_gatt_client_cmd(const struct btt_message *btt_msg,
 	struct btt_gatt_client_cb_bt_status bt_stat;
 	struct btt_gatt_client_cb_get_device_type get_dev_type_cb;
 	bt_status_t status = BT_STATUS_SUCCESS;
+	const bt_bdaddr_t *cache_addr = NULL;
+	bool connections = FALSE;
 
 	get_dev_type_cb.hdr.command = BTT_GATT_CLIENT_CB_END;
 	FILL_HDR(bt_stat, BTT_GATT_CLIENT_CB_BT_STATUS);
@@ -42,337 +182,629 @@ void handle_gatt_client_cmd(const struct btt_message *btt_msg,
 	switch (btt_msg->command) {
 	case BTT_CMD_GATT_CLIENT_REGISTER_CLIENT:
 	{
-		struct btt_gatt_client_register_client msg;
+		struct btt_gatt_client_register_client *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		gatt_client_if->register_client(&msg.UUID);
+		btt_daemon_registry_claim_uuid(socket_remote,
+				BTT_DAEMON_KEY_CLIENT_UUID, &msg->UUID);
+		btt_daemon_requests_expect_uuid(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_CLIENT_UUID, &msg->UUID,
+				BTT_GATT_CLIENT_CB_REGISTER_CLIENT);
+		gatt_client_if->register_client(&msg->UUID);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_SCAN:
 	{
-		struct btt_gatt_client_scan msg;
+		struct btt_gatt_client_scan *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		if (msg->start) {
+			btt_daemon_registry_watch(socket_remote, BTT_EVENT_SCAN);
+			btt_daemon_scan_start(msg->client_if);
+		} else {
+			btt_daemon_registry_unwatch(socket_remote, BTT_EVENT_SCAN);
+		}
+
+		status = gatt_client_if->scan(msg->client_if, msg->start);
+
+		if (!msg->start || status != BT_STATUS_SUCCESS)
+			btt_daemon_scan_stop();
+
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_SCAN_RESET:
+	{
+		struct btt_gatt_client_scan_reset *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		status = btt_daemon_scan_reset(msg->client_if);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_SCAN_SNAPSHOTS:
+	{
+		struct btt_gatt_client_scan_snapshots *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		if (msg->interval_ms)
+			btt_daemon_registry_watch(socket_remote,
+					BTT_EVENT_SCAN_SNAPSHOT);
+		else
+			btt_daemon_registry_unwatch(socket_remote,
+					BTT_EVENT_SCAN_SNAPSHOT);
+
+		btt_daemon_scan_snapshots(msg->interval_ms);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_SCAN_FILTER:
+	{
+		struct btt_gatt_client_scan_filter *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		status = btt_daemon_scan_filter(msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_SCAN_REPORT:
+	{
+		struct btt_gatt_client_scan_report *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->scan(msg.client_if, msg.start);
+		status = btt_daemon_scan_report(msg->client_if, msg->interval_ms,
+				msg->rssi_delta, msg->payload ? TRUE : FALSE);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_UNREGISTER_CLIENT:
 	{
-		struct btt_gatt_client_unregister_client msg;
+		struct btt_gatt_client_unregister_client *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->unregister_client((msg.client_if));
+		status = gatt_client_if->unregister_client((msg->client_if));
+
+		if (status == BT_STATUS_SUCCESS) {
+			btt_daemon_registry_forget(BTT_DAEMON_KEY_CLIENT_IF,
+					msg->client_if);
+			btt_daemon_requests_forget(BTT_DAEMON_KEY_CLIENT_IF,
+					msg->client_if);
+			btt_daemon_connections_forget_client(msg->client_if);
+			btt_daemon_scan_forget_client(msg->client_if);
+		}
+
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_CONNECT:
 	{
-		struct btt_gatt_client_connect msg;
+		struct btt_gatt_client_connect *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->connect(msg.client_if, &msg.addr,
-				(bool) msg.is_direct);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_CLIENT_IF,
+				msg->client_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_CLIENT_IF, msg->client_if,
+				BTT_GATT_CLIENT_CB_CONNECT);
+		btt_daemon_connections_connecting(msg->client_if, &msg->addr,
+				(bool) msg->is_direct);
+		status = gatt_client_if->connect(msg->client_if, &msg->addr,
+				(bool) msg->is_direct);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_DISCONNECT:
 	{
-		struct btt_gatt_client_disconnect msg;
+		struct btt_gatt_client_disconnect *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->disconnect(msg.client_if, &msg.addr,
-				msg.conn_id);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_CLIENT_IF,
+				msg->client_if);
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_CLIENT_IF, msg->client_if,
+				BTT_GATT_CLIENT_CB_DISCONNECT);
+		btt_daemon_connections_disconnecting(msg->conn_id);
+		status = gatt_client_if->disconnect(msg->client_if, &msg->addr,
+				msg->conn_id);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_CONNECTIONS:
+	{
+		struct btt_gatt_client_connections *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		connections = TRUE;
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_AUTO_RECONNECT:
+	{
+		struct btt_gatt_client_auto_reconnect *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		status = btt_daemon_connections_auto_reconnect(msg->client_if,
+				&msg->addr, msg->max_attempts);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_READ_REMOTE_RSSI:
 	{
-		struct btt_gatt_client_read_remote_rssi msg;
+		struct btt_gatt_client_read_remote_rssi *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->read_remote_rssi(msg.client_if, &msg.addr);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_CLIENT_IF,
+				msg->client_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_CLIENT_IF, msg->client_if,
+				BTT_GATT_CLIENT_CB_READ_REMOTE_RSSI);
+		status = gatt_client_if->read_remote_rssi(msg->client_if, &msg->addr);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_LISTEN:
 	{
-		struct btt_gatt_client_listen msg;
+		struct btt_gatt_client_listen *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->listen(msg.client_if, msg.start);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_CLIENT_IF,
+				msg->client_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_CLIENT_IF, msg->client_if,
+				BTT_GATT_CLIENT_CB_LISTEN);
+		status = gatt_client_if->listen(msg->client_if, msg->start);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_SET_ADV_DATA:
 	{
-		struct btt_gatt_client_set_adv_data msg;
+		struct btt_gatt_client_set_adv_data *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->set_adv_data(msg.server_if, msg.set_scan_rsp,
-				msg.include_name, msg.include_txpower, msg.min_interval,
-				msg.max_interval, msg.appearance, msg.manufacturer_len,
-				msg.manufacturer_data, msg.service_data_len, msg.service_data,
-				msg.service_uuid_len, msg.service_uuid);
+		status = gatt_client_if->set_adv_data(msg->server_if, msg->set_scan_rsp,
+				msg->include_name, msg->include_txpower, msg->min_interval,
+				msg->max_interval, msg->appearance, msg->manufacturer_len,
+				msg->manufacturer_data, msg->service_data_len, msg->service_data,
+				msg->service_uuid_len, msg->service_uuid);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_GET_DEVICE_TYPE:
 	{
-		struct btt_gatt_client_get_device_type msg;
+		struct btt_gatt_client_get_device_type *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
 		FILL_HDR(get_dev_type_cb, BTT_GATT_CLIENT_CB_GET_DEVICE_TYPE);
-		get_dev_type_cb.type = gatt_client_if->get_device_type(&msg.addr);
+		get_dev_type_cb.hdr.request_id = btt_msg->request_id;
+		get_dev_type_cb.type = gatt_client_if->get_device_type(&msg->addr);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_REFRESH:
 	{
-		struct btt_gatt_client_refresh msg;
+		struct btt_gatt_client_refresh *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->refresh(msg.client_if, &msg.addr);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_CLIENT_IF,
+				msg->client_if);
+		btt_daemon_gatt_cache_invalidate(&msg->addr);
+		status = gatt_client_if->refresh(msg->client_if, &msg->addr);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_CACHE:
+	{
+		struct btt_gatt_client_cache *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		/* sent after the status */
+		cache_addr = &msg->addr;
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_SEARCH_SERVICE:
 	{
-		struct btt_gatt_client_search_service msg;
+		struct btt_gatt_client_search_service *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		if (!msg.is_filter)
-			status = gatt_client_if->search_service(msg.conn_id, NULL);
-		else
-			status = gatt_client_if->search_service(msg.conn_id,
-					&msg.filter_uuid);
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_SEARCH_COMPLETE);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_DISCOVER_ALL:
+	{
+		struct btt_gatt_client_discover_all *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
 
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_DISCOVER_ALL_COMPLETE);
+		status = btt_daemon_discovery_start(msg->conn_id);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_GET_INCLUDE_SERVICE:
 	{
-		struct btt_gatt_client_get_included_service msg;
+		struct btt_gatt_client_get_included_service *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		if (!msg.is_start)
-			status = gatt_client_if->get_included_service(msg.conn_id,
-					&msg.srvc_id, NULL);
-		else
-			status = gatt_client_if->get_included_service(msg.conn_id,
-					&msg.srvc_id, &msg.start_incl_srvc_id);
-
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_GET_INCLUDED_SERVICE);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_GET_CHARACTERISTIC:
 	{
-		struct btt_gatt_client_get_characteristic msg;
+		struct btt_gatt_client_get_characteristic *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		if (!msg.is_start)
-			status = gatt_client_if->get_characteristic(msg.conn_id,
-					&msg.srvc_id, NULL);
-		else
-			status = gatt_client_if->get_characteristic(msg.conn_id,
-					&msg.srvc_id, &msg.start_char_id);
-
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_GET_CHARACTERISTIC);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_GET_DESCRIPTOR:
 	{
-		struct btt_gatt_client_get_descriptor msg;
+		struct btt_gatt_client_get_descriptor *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		if (!msg.is_start)
-			status = gatt_client_if->get_descriptor(msg.conn_id,
-					&msg.srvc_id, &msg.char_id, NULL);
-		else
-			status = gatt_client_if->get_descriptor(msg.conn_id,
-					&msg.srvc_id, &msg.char_id, &msg.start_descr_id);
-
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_GET_DESCRIPTOR);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_READ_CHARACTERISTIC:
 	{
-		struct btt_gatt_client_read_characteristic msg;
+		struct btt_gatt_client_read_characteristic *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->read_characteristic(msg.conn_id,
-				&msg.srvc_id, &msg.char_id, msg.auth_req);
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_READ_CHARACTERISTIC);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_READ_DESCRIPTOR:
 	{
-		struct btt_gatt_client_read_descriptor msg;
+		struct btt_gatt_client_read_descriptor *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->read_descriptor(msg.conn_id,
-				&msg.srvc_id, &msg.char_id, &msg.descr_id, msg.auth_req);
-
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_READ_DESCRIPTOR);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_WRITE_CHARACTERISTIC:
 	{
-		struct btt_gatt_client_write_characteristic msg;
+		struct btt_gatt_client_write_characteristic *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST_TRAILER(msg, btt_msg, p_value) || msg->len < 0 ||
+				(size_t) msg->len != TRAILER_LEN(*msg, p_value)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->write_characteristic(msg.conn_id,
-				&msg.srvc_id, &msg.char_id, msg.write_type, msg.len,
-				msg.auth_req, msg.p_value);
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_WRITE_CHARACTERISTIC);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_READ_MULTI:
+	{
+		struct btt_gatt_client_read_multi *msg;
+
+		if (!MSG_CAST_TRAILER(msg, btt_msg, entry) || TRAILER_LEN(*msg,
+				entry) != msg->num * sizeof(msg->entry[0])) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_READ_MULTI_COMPLETE);
+		status = btt_daemon_read_multi_start(msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_LONG_WRITE:
+	{
+		struct btt_gatt_client_long_write *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_LONG_WRITE);
+		status = btt_daemon_long_write_start(msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_LONG_WRITE_DATA:
+	{
+		struct btt_gatt_client_long_write_data *msg;
+
+		if (!MSG_CAST_TRAILER(msg, btt_msg, data) ||
+				msg->len != TRAILER_LEN(*msg, data)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		status = btt_daemon_long_write_data(msg->conn_id, msg->data,
+				msg->len);
+
+		/* value is streamed, only the first error is answered */
+		if (status == BT_STATUS_SUCCESS)
+			return;
 
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_EXECUTE_WRITE:
 	{
-		struct btt_gatt_client_execute_write msg;
+		struct btt_gatt_client_execute_write *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->execute_write(msg.conn_id, msg.execute);
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_EXECUTE_WRITE);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_WRITE_DESCRIPTOR:
 	{
-		struct btt_gatt_client_write_descriptor msg;
+		struct btt_gatt_client_write_descriptor *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST_TRAILER(msg, btt_msg, p_value) || msg->len < 0 ||
+				(size_t) msg->len != TRAILER_LEN(*msg, p_value)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->write_descriptor(msg.conn_id, &msg.srvc_id,
-				&msg.char_id, &msg.descr_id, msg.write_type, msg.len,
-				msg.auth_req, msg.p_value);
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_GATTC_CONN_ID, msg->conn_id,
+				BTT_GATT_CLIENT_CB_WRITE_DESCRIPTOR);
+		status = btt_daemon_connections_submit(msg->conn_id, btt_msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_READ_HANDLE:
+	{
+		struct btt_gatt_client_read_handle *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		status = read_handle(socket_remote, btt_msg, msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_WRITE_HANDLE:
+	{
+		struct btt_gatt_client_write_handle *msg;
+
+		if (!MSG_CAST_TRAILER(msg, btt_msg, value) ||
+				msg->len != TRAILER_LEN(*msg, value)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
+
+		status = write_handle(socket_remote, btt_msg, msg);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_NOTIFY_HANDLE:
+	{
+		struct btt_gatt_client_notify_handle *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			status = BT_STATUS_FAIL;
+			break;
+		}
 
+		status = notify_handle(socket_remote, msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_REGISTER_FOR_NOTIFICATION:
 	{
-		struct btt_gatt_client_reg_for_notification msg;
+		struct btt_gatt_client_reg_for_notification *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->register_for_notification(msg.client_if,
-				&msg.addr, &msg.srvc_id, &msg.char_id);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_CLIENT_IF,
+				msg->client_if);
+		status = btt_daemon_connections_submit(
+				btt_daemon_connections_conn_id(msg->client_if,
+				&msg->addr), btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_DEREGISTER_FOR_NOTIFICATION:
 	{
-		struct btt_gatt_client_dereg_for_notification msg;
+		struct btt_gatt_client_dereg_for_notification *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		status = gatt_client_if->deregister_for_notification(msg.client_if,
-				&msg.addr, &msg.srvc_id, &msg.char_id);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_CLIENT_IF,
+				msg->client_if);
+		status = btt_daemon_connections_submit(
+				btt_daemon_connections_conn_id(msg->client_if,
+				&msg->addr), btt_msg);
 		break;
 	}
 	case BTT_CMD_GATT_CLIENT_TEST_COMMAND:
 	{
-		struct btt_gatt_client_test_command msg;
+		struct btt_gatt_client_test_command *msg;
 		btgatt_test_params_t params;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Error: incorrect size of received structure.\n");
 			status = BT_STATUS_FAIL;
 			break;
 		}
 
-		memcpy(params.bda1->address, msg.bda1.address, BD_ADDR_LEN);
-		memcpy(&params.uuid1, &msg.uuid1, sizeof(msg.uuid1));
-		params.u1 = msg.u1;
-		params.u2 = msg.u2;
-		params.u3 = msg.u3;
-		params.u4 = msg.u4;
-		params.u5 = msg.u5;BTT_LOG_I("D\n");
-		status = gatt_client_if->test_command(msg.command, &params);
+		params.bda1 = &msg->bda1;
+		params.uuid1 = &msg->uuid1;
+		params.u1 = msg->u1;
+		params.u2 = msg->u2;
+		params.u3 = msg->u3;
+		params.u4 = msg->u4;
+		params.u5 = msg->u5;BTT_LOG_I("D\n");
+		status = gatt_client_if->test_command(msg->command, &params);
 		break;
 	}
 	default:
@@ -380,108 +812,33 @@ void handle_gatt_client_cmd(const struct btt_message *btt_msg,
 		break;
 	}
 
-	bt_stat.status = status;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
+	if (status != BT_STATUS_SUCCESS)
+		btt_daemon_requests_cancel(socket_remote, btt_msg);
 
-	if (send(socket_remote, &bt_stat,
-			sizeof(struct btt_gatt_client_cb_bt_status), 0) == -1) {
+	bt_stat.hdr.request_id = btt_msg->request_id;
+	bt_stat.status = status;
+	if (!btt_daemon_client_send(socket_remote, &bt_stat,
+			sizeof(struct btt_gatt_client_cb_bt_status))) {
 		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
 	}
 
 	if (get_dev_type_cb.hdr.command == BTT_GATT_CLIENT_CB_GET_DEVICE_TYPE)
-		if (send(socket_remote, &get_dev_type_cb,
-				sizeof(struct btt_gatt_client_cb_scan_result), 0) == -1)
+		if (!btt_daemon_client_send(socket_remote, &get_dev_type_cb,
+				sizeof(get_dev_type_cb)))
 			BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+
+	if (cache_addr)
+		btt_daemon_gatt_cache_send(socket_remote, btt_msg->request_id,
+				cache_addr);
+
+	if (connections)
+		btt_daemon_connections_send(socket_remote, btt_msg->request_id);
 }
 
 /************************************************************/
 /* Gatt client: callbacks, necessary functions and structure */
 /************************************************************/
 
-/*Search Complete or Shortened Local Name in adv_data
- * by type, function return length of name*/
-static uint8_t name_searcher( uint8_t *adv_data, char *name)
-{
-	uint8_t temp_len = adv_data[0];
-	uint8_t temp_type = adv_data[1];
-	uint8_t *temp_ptr = adv_data;
-	uint8_t name_len;
-
-	while (1) {
-		if (temp_type == COMPLETE_LOCAL_NAME ||
-				temp_type == SHORTENED_LOCAL_NAME) {
-			if (temp_len > 1) {
-				name_len = temp_len;
-				strncpy(name, (char *) (temp_ptr + sizeof(uint8_t) * 2),
-						temp_len - 1);
-				name[temp_len - 1] = '\0';
-				return name_len;
-			} else {
-				name = "";
-				return 1;
-			}
-		}
-
-		if (temp_len == 0) {
-			name = "N/A";
-			return 4;
-		}
-
-		temp_ptr += sizeof(uint8_t) * (temp_len + 1);
-		temp_len = temp_ptr[0];
-		temp_type = temp_ptr[1];
-	}
-}
-
-/*Search Flags in adv_data by type,
- * function return discoverable mode of device*/
-static uint8_t discoverable_mode_searcher(uint8_t *adv_data)
-{
-	uint8_t temp_len = adv_data[0];
-	uint8_t temp_type = adv_data[1];
-	uint8_t *temp_ptr = adv_data;
-
-	while (1) {
-		if (temp_type == FLAGS) {
-			if (temp_len == 2)
-				return *(temp_ptr + sizeof(uint8_t) * 2) & 0x03;
-			else
-				return 0x00;
-		}
-
-		if (temp_len == 0) {
-			return 0x00;
-		}
-
-		temp_ptr += sizeof(uint8_t) * (temp_len + 1);
-		temp_len = temp_ptr[0];
-		temp_type = temp_ptr[1];
-
-	}
-}
-
-bool equal_BD_ADDR(void *first, void *second)
-{
-	if (!memcmp(first, second, BD_ADDR_LEN))
-		return TRUE;
-	else
-		return FALSE;
-}
-
-/*adding address bda to list of scanned address*/
-static bool add_address(uint8_t *bda)
-{
-	if (!bda)
-		return FALSE;
-
-	if (!list_contains(list, bda, equal_BD_ADDR)) {
-		list = list_append(list, bda);
-		return TRUE;
-	}
-
-	return FALSE;
-}
-
 static void register_client_cb(int status, int client_if,
 		bt_uuid_t *app_uuid)
 {
@@ -494,45 +851,22 @@ static void register_client_cb(int status, int client_if,
 
 	BTT_LOG_D("Callback_GC Client Register");
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_register_client), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_registry_bind_uuid(BTT_DAEMON_KEY_CLIENT_UUID, app_uuid,
+			BTT_DAEMON_KEY_CLIENT_IF, client_if);
+	btt_daemon_requests_bind_uuid(BTT_DAEMON_KEY_CLIENT_UUID, app_uuid,
+			BTT_DAEMON_KEY_CLIENT_IF, client_if);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_CLIENT_IF, client_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void scan_result_cb(bt_bdaddr_t *bda, int rssi, uint8_t *adv_data)
 {
-	struct btt_gatt_client_cb_scan_result btt_cb;
-	char name[256];
-	char tekst[adv_data[0]];
-	uint8_t *bt_address = (bda->address);
-	uint8_t name_len;
-	uint8_t *bdacpy;
-
-	memset(name, 0, sizeof(name));
-
-	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_SCAN_RESULT);
-	bdacpy = malloc(BD_ADDR_LEN);
-	memcpy(bdacpy, bda->address, BD_ADDR_LEN);
-	name_len = 0;
-
 	BTT_LOG_D("Callback_GC Scan Result");
 
-	if (!list || !list_contains(list, bda, equal_BD_ADDR)) {
-		add_address(bdacpy);
-		name_len = name_searcher(adv_data, &name[0]);
-		strncpy(btt_cb.name, (const char *) name, name_len);
-		memcpy(btt_cb.bd_addr, bda, BD_ADDR_LEN);
-		btt_cb.discoverable_mode = discoverable_mode_searcher(adv_data);
-		BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
+	btt_daemon_capture_scan_result(bda, rssi, adv_data);
 
-		if (send(socket_remote, &btt_cb,
-				sizeof(struct btt_gatt_client_cb_scan_result), 0) == -1) {
-			BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
-		}
-	}
-	/* do NOT close(socket_remote) here,
-	 * we will continue sending the found device info to client one by one
-	 */
+	/* session decides whether it is reported */
+	btt_daemon_scan_seen(bda->address, rssi, adv_data);
 }
 
 static void connect_cb(int conn_id, int status, int client_if,
@@ -547,11 +881,18 @@ static void connect_cb(int conn_id, int status, int client_if,
 	btt_cb.status = status;
 	btt_cb.client_if = client_if;
 	memcpy(&btt_cb.bda, bda, 6);
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_connect), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	/* connection belongs to whoever owns the client_if */
+	if (status == BT_STATUS_SUCCESS) {
+		btt_daemon_registry_inherit(BTT_DAEMON_KEY_GATTC_CONN_ID, conn_id,
+				BTT_DAEMON_KEY_CLIENT_IF, client_if);
+		btt_daemon_gatt_cache_connect(conn_id, bda);
+	}
+
+	btt_daemon_connections_connected(conn_id, status, client_if, bda);
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_CLIENT_IF, client_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void disconnect_cb(int conn_id, int status, int client_if,
@@ -566,11 +907,17 @@ static void disconnect_cb(int conn_id, int status, int client_if,
 	btt_cb.status = status;
 	btt_cb.client_if = client_if;
 	memcpy(&btt_cb.bda, bda, 6);
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_disconnect), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	/* queued operations are dropped before the engines let them go */
+	btt_daemon_connections_disconnected(conn_id);
+	btt_daemon_discovery_disconnect(conn_id);
+	btt_daemon_long_write_disconnect(conn_id);
+	btt_daemon_read_multi_disconnect(conn_id);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_CLIENT_IF, client_if,
+			&btt_cb, sizeof(btt_cb));
+	btt_daemon_registry_forget(BTT_DAEMON_KEY_GATTC_CONN_ID, conn_id);
+	btt_daemon_requests_forget(BTT_DAEMON_KEY_GATTC_CONN_ID, conn_id);
+	btt_daemon_gatt_cache_disconnect(conn_id);
 }
 
 static void search_complete_cb(int conn_id, int status)
@@ -582,27 +929,37 @@ static void search_complete_cb(int conn_id, int status)
 	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_SEARCH_COMPLETE);
 	btt_cb.conn_id = conn_id;
 	btt_cb.status = status;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_search_complete), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_gatt_cache_save(conn_id);
+
+	if (btt_daemon_discovery_search_complete(conn_id, status))
+		return;
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void search_result_cb(int conn_id, btgatt_srvc_id_t *srvc_id)
 {
 	struct btt_gatt_client_cb_search_result btt_cb;
+	uint16_t handle;
 
 	BTT_LOG_D("Callback_GC Search Result");
 
 	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_SEARCH_RESULT);
 	btt_cb.conn_id = conn_id;
 	btt_cb.srvc_id = *srvc_id;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_search_result), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	handle = btt_daemon_gatt_cache_service(conn_id, srvc_id);
+
+	/* discovery sends the whole tree when it is done */
+	if (btt_daemon_discovery_search_result(conn_id, srvc_id, handle))
+		return;
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
 
 }
 
@@ -610,6 +967,7 @@ static void get_characteristic_cb(int conn_id, int status,
 		btgatt_srvc_id_t *srvc_id, btgatt_gatt_id_t *char_id, int char_prop)
 {
 	struct btt_gatt_client_cb_get_characteristic btt_cb;
+	uint16_t handle = 0;
 
 	BTT_LOG_D("Callback_GC Get Charakteristic");
 
@@ -619,17 +977,29 @@ static void get_characteristic_cb(int conn_id, int status,
 	btt_cb.srvc_id = *srvc_id;
 	btt_cb.char_id = *char_id;
 	btt_cb.char_prop = char_prop;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_get_characteristic), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	/* enumeration ends with an error status */
+	if (status == BT_STATUS_SUCCESS)
+		handle = btt_daemon_gatt_cache_characteristic(conn_id, srvc_id,
+				char_id, char_prop);
+	else
+		btt_daemon_gatt_cache_save(conn_id);
+
+	if (btt_daemon_discovery_characteristic(conn_id, status, srvc_id,
+			char_id, char_prop, handle))
+		return;
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void get_descriptor_cb(int conn_id, int status, btgatt_srvc_id_t
 		*srvc_id, btgatt_gatt_id_t *char_id, btgatt_gatt_id_t *descr_id)
 {
 	struct btt_gatt_client_cb_get_descriptor btt_cb;
+	uint16_t handle = 0;
 
 	BTT_LOG_D("Callback_GC Get Descriptor");
 
@@ -640,11 +1010,20 @@ static void get_descriptor_cb(int conn_id, int status, btgatt_srvc_id_t
 	btt_cb.char_id = *char_id;
 	btt_cb.descr_id = *descr_id;
 
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
+	if (status == BT_STATUS_SUCCESS)
+		handle = btt_daemon_gatt_cache_descriptor(conn_id, srvc_id,
+				char_id, descr_id);
+	else
+		btt_daemon_gatt_cache_save(conn_id);
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_get_descriptor), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	if (btt_daemon_discovery_descriptor(conn_id, status, srvc_id, char_id,
+			descr_id, handle))
+		return;
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void get_included_service_cb(int conn_id, int status,
@@ -658,11 +1037,11 @@ static void get_included_service_cb(int conn_id, int status,
 	btt_cb.conn_id = conn_id;
 	btt_cb.srvc_id = *srvc_id;
 	btt_cb.incl_srvc_id = *incl_srvc_id;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_get_included_service), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void register_for_notification_cb(int conn_id, int registered,
@@ -678,11 +1057,11 @@ static void register_for_notification_cb(int conn_id, int registered,
 	btt_cb.status = status;
 	btt_cb.srvc_id = *srvc_id;
 	btt_cb.char_id = *char_id;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_reg_for_notification), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void notify_cb(int conn_id, btgatt_notify_params_t *p_data)
@@ -691,14 +1070,29 @@ static void notify_cb(int conn_id, btgatt_notify_params_t *p_data)
 
 	BTT_LOG_D("Callback_GC Notify");
 
+	btt_daemon_capture_notify(conn_id, p_data);
+
+	if (p_data->len > BTGATT_MAX_ATTR_LEN) {
+		BTT_LOG_E("%s: invalid length=%u\n", __FUNCTION__, p_data->len);
+		return;
+	}
+
+	/* only the rate is reported while recording */
+	if (btt_daemon_record_notify(conn_id, p_data))
+		return;
+
 	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_NOTIFY);
 	btt_cb.conn_id = conn_id;
-	btt_cb.p_data = *p_data;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
-
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_notify), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_cb.bda = p_data->bda;
+	btt_cb.srvc_id = p_data->srvc_id;
+	btt_cb.char_id = p_data->char_id;
+	btt_cb.is_notify = p_data->is_notify;
+	btt_cb.len = p_data->len;
+	memcpy(btt_cb.value, p_data->value, p_data->len);
+	TRIM_TRAILER(btt_cb, value, p_data->len);
+
+	btt_daemon_deliver(BTT_EVENT_GATTC | BTT_DAEMON_EVENT_STREAM,
+			BTT_DAEMON_KEY_GATTC_CONN_ID, conn_id, &btt_cb, MSG_SIZE(btt_cb));
 }
 
 static void read_characteristic_cb(int conn_id, int status,
@@ -708,15 +1102,20 @@ static void read_characteristic_cb(int conn_id, int status,
 
 	BTT_LOG_D("Callback_GC Read Charakteristic");
 
+	/* read_multi sends all values at once */
+	if (btt_daemon_read_multi_read(conn_id, status, p_data))
+		return;
+
 	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_READ_CHARACTERISTIC);
 	btt_cb.conn_id = conn_id;
 	btt_cb.status = status;
 	btt_cb.p_data = *p_data;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_read_characteristic), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	/* next queued operation of the connection */
+	btt_daemon_connections_done(conn_id);
 }
 
 static void write_characteristic_cb(int conn_id, int status,
@@ -726,15 +1125,19 @@ static void write_characteristic_cb(int conn_id, int status,
 
 	BTT_LOG_D("Callback_GC Write Charakteristic");
 
+	/* long write reports once when it is done */
+	if (btt_daemon_long_write_written(conn_id, status, p_data))
+		return;
+
 	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_WRITE_CHARACTERISTIC);
 	btt_cb.conn_id = conn_id;
 	btt_cb.status = status;
 	btt_cb.p_data = *p_data;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_write_characteristic), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void execute_write_cb(int conn_id, int status)
@@ -746,11 +1149,11 @@ static void execute_write_cb(int conn_id, int status)
 	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_EXECUTE_WRITE);
 	btt_cb.conn_id = conn_id;
 	btt_cb.status = status;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_execute_write), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void read_descriptor_cb(int conn_id, int status,
@@ -764,11 +1167,11 @@ static void read_descriptor_cb(int conn_id, int status,
 	btt_cb.conn_id = conn_id;
 	btt_cb.status = status;
 	btt_cb.p_data = *p_data;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_read_descriptor), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void write_descriptor_cb(int conn_id, int status,
@@ -782,11 +1185,11 @@ static void write_descriptor_cb(int conn_id, int status,
 	btt_cb.conn_id = conn_id;
 	btt_cb.status = status;
 	btt_cb.p_data = *p_data;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_write_descriptor), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
+
+	btt_daemon_connections_done(conn_id);
 }
 
 static void read_remote_rssi_cb(int client_if, bt_bdaddr_t* bda,
@@ -801,11 +1204,9 @@ static void read_remote_rssi_cb(int client_if, bt_bdaddr_t* bda,
 	btt_cb.status = status;
 	btt_cb.client_if = client_if;
 	memcpy(&btt_cb.addr.address, bda, 6);
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_register_client), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_CLIENT_IF, client_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void listen_cb(int status, int server_if)
@@ -817,11 +1218,206 @@ static void listen_cb(int status, int server_if)
 	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_LISTEN);
 	btt_cb.status = status;
 	btt_cb.server_if = server_if;
-	BTT_LOG_E("%d\n", fcntl(socket_remote, F_GETFL));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_client_cb_listen), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_CLIENT_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
+}
+
+/* message was checked when it was received */
+bt_status_t btt_daemon_gatt_client_issue(const struct btt_message *msg)
+{
+	switch (msg->command) {
+	case BTT_CMD_GATT_CLIENT_READ_CHARACTERISTIC:
+	{
+		const struct btt_gatt_client_read_characteristic *m =
+				(const void *) msg;
+
+		return gatt_client_if->read_characteristic(m->conn_id,
+				(btgatt_srvc_id_t *) &m->srvc_id,
+				(btgatt_gatt_id_t *) &m->char_id, m->auth_req);
+	}
+	case BTT_CMD_GATT_CLIENT_READ_DESCRIPTOR:
+	{
+		const struct btt_gatt_client_read_descriptor *m = (const void *) msg;
+
+		return gatt_client_if->read_descriptor(m->conn_id,
+				(btgatt_srvc_id_t *) &m->srvc_id,
+				(btgatt_gatt_id_t *) &m->char_id,
+				(btgatt_gatt_id_t *) &m->descr_id, m->auth_req);
+	}
+	case BTT_CMD_GATT_CLIENT_WRITE_CHARACTERISTIC:
+	{
+		const struct btt_gatt_client_write_characteristic *m =
+				(const void *) msg;
+
+		return gatt_client_if->write_characteristic(m->conn_id,
+				(btgatt_srvc_id_t *) &m->srvc_id,
+				(btgatt_gatt_id_t *) &m->char_id, m->write_type, m->len,
+				m->auth_req, (char *) m->p_value);
+	}
+	case BTT_CMD_GATT_CLIENT_WRITE_DESCRIPTOR:
+	{
+		const struct btt_gatt_client_write_descriptor *m =
+				(const void *) msg;
+
+		return gatt_client_if->write_descriptor(m->conn_id,
+				(btgatt_srvc_id_t *) &m->srvc_id,
+				(btgatt_gatt_id_t *) &m->char_id,
+				(btgatt_gatt_id_t *) &m->descr_id, m->write_type, m->len,
+				m->auth_req, (char *) m->p_value);
+	}
+	case BTT_CMD_GATT_CLIENT_EXECUTE_WRITE:
+	{
+		const struct btt_gatt_client_execute_write *m = (const void *) msg;
+
+		return gatt_client_if->execute_write(m->conn_id, m->execute);
+	}
+	case BTT_CMD_GATT_CLIENT_SEARCH_SERVICE:
+	{
+		const struct btt_gatt_client_search_service *m = (const void *) msg;
+
+		return gatt_client_if->search_service(m->conn_id, m->is_filter ?
+				(bt_uuid_t *) &m->filter_uuid : NULL);
+	}
+	case BTT_CMD_GATT_CLIENT_GET_INCLUDE_SERVICE:
+	{
+		const struct btt_gatt_client_get_included_service *m =
+				(const void *) msg;
+
+		return gatt_client_if->get_included_service(m->conn_id,
+				(btgatt_srvc_id_t *) &m->srvc_id, m->is_start ?
+				(btgatt_srvc_id_t *) &m->start_incl_srvc_id :
+				NULL);
+	}
+	case BTT_CMD_GATT_CLIENT_GET_CHARACTERISTIC:
+	{
+		const struct btt_gatt_client_get_characteristic *m =
+				(const void *) msg;
+
+		return gatt_client_if->get_characteristic(m->conn_id,
+				(btgatt_srvc_id_t *) &m->srvc_id, m->is_start ?
+				(btgatt_gatt_id_t *) &m->start_char_id : NULL);
+	}
+	case BTT_CMD_GATT_CLIENT_GET_DESCRIPTOR:
+	{
+		const struct btt_gatt_client_get_descriptor *m = (const void *) msg;
+
+		return gatt_client_if->get_descriptor(m->conn_id,
+				(btgatt_srvc_id_t *) &m->srvc_id,
+				(btgatt_gatt_id_t *) &m->char_id, m->is_start ?
+				(btgatt_gatt_id_t *) &m->start_descr_id : NULL);
+	}
+	case BTT_CMD_GATT_CLIENT_REGISTER_FOR_NOTIFICATION:
+	{
+		const struct btt_gatt_client_reg_for_notification *m =
+				(const void *) msg;
+
+		return gatt_client_if->register_for_notification(m->client_if,
+				(bt_bdaddr_t *) &m->addr,
+				(btgatt_srvc_id_t *) &m->srvc_id,
+				(btgatt_gatt_id_t *) &m->char_id);
+	}
+	case BTT_CMD_GATT_CLIENT_DEREGISTER_FOR_NOTIFICATION:
+	{
+		const struct btt_gatt_client_dereg_for_notification *m =
+				(const void *) msg;
+
+		return gatt_client_if->deregister_for_notification(m->client_if,
+				(bt_bdaddr_t *) &m->addr,
+				(btgatt_srvc_id_t *) &m->srvc_id,
+				(btgatt_gatt_id_t *) &m->char_id);
+	}
+	default:
+		return BT_STATUS_UNSUPPORTED;
+	}
+}
+
+/* queued operation the HAL refused, its request is completed with
+ * the error as if the operation was answered */
+void btt_daemon_gatt_client_fail(const struct btt_message *msg, int status)
+{
+	btgatt_read_params_t read_params;
+	btgatt_write_params_t write_params;
+	int conn_id;
+
+	memset(&read_params, 0, sizeof(read_params));
+	memset(&write_params, 0, sizeof(write_params));
+
+	switch (msg->command) {
+	case BTT_CMD_GATT_CLIENT_READ_CHARACTERISTIC:
+		conn_id = ((const struct btt_gatt_client_read_characteristic *)
+				msg)->conn_id;
+		read_characteristic_cb(conn_id, status, &read_params);
+		break;
+	case BTT_CMD_GATT_CLIENT_READ_DESCRIPTOR:
+		conn_id = ((const struct btt_gatt_client_read_descriptor *)
+				msg)->conn_id;
+		read_descriptor_cb(conn_id, status, &read_params);
+		break;
+	case BTT_CMD_GATT_CLIENT_WRITE_CHARACTERISTIC:
+		conn_id = ((const struct btt_gatt_client_write_characteristic *)
+				msg)->conn_id;
+		write_characteristic_cb(conn_id, status, &write_params);
+		break;
+	case BTT_CMD_GATT_CLIENT_WRITE_DESCRIPTOR:
+		conn_id = ((const struct btt_gatt_client_write_descriptor *)
+				msg)->conn_id;
+		write_descriptor_cb(conn_id, status, &write_params);
+		break;
+	case BTT_CMD_GATT_CLIENT_EXECUTE_WRITE:
+		conn_id = ((const struct btt_gatt_client_execute_write *)
+				msg)->conn_id;
+		execute_write_cb(conn_id, status);
+		break;
+	case BTT_CMD_GATT_CLIENT_SEARCH_SERVICE:
+		conn_id = ((const struct btt_gatt_client_search_service *)
+				msg)->conn_id;
+		search_complete_cb(conn_id, status);
+		break;
+	case BTT_CMD_GATT_CLIENT_GET_INCLUDE_SERVICE:
+	{
+		struct btt_gatt_client_get_included_service m;
+
+		memcpy(&m, msg, sizeof(m));
+		memset(&m.start_incl_srvc_id, 0, sizeof(m.start_incl_srvc_id));
+		get_included_service_cb(m.conn_id, status, &m.srvc_id,
+				&m.start_incl_srvc_id);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_GET_CHARACTERISTIC:
+	{
+		struct btt_gatt_client_get_characteristic m;
+
+		memcpy(&m, msg, sizeof(m));
+		memset(&m.start_char_id, 0, sizeof(m.start_char_id));
+		get_characteristic_cb(m.conn_id, status, &m.srvc_id,
+				&m.start_char_id, 0);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_GET_DESCRIPTOR:
+	{
+		struct btt_gatt_client_get_descriptor m;
+
+		memcpy(&m, msg, sizeof(m));
+		memset(&m.start_descr_id, 0, sizeof(m.start_descr_id));
+		get_descriptor_cb(m.conn_id, status, &m.srvc_id, &m.char_id,
+				&m.start_descr_id);
+		break;
+	}
+	case BTT_CMD_GATT_CLIENT_REGISTER_FOR_NOTIFICATION:
+	case BTT_CMD_GATT_CLIENT_DEREGISTER_FOR_NOTIFICATION:
+	{
+		struct btt_gatt_client_reg_for_notification m;
+
+		/* both messages have the same layout */
+		memcpy(&m, msg, sizeof(m));
+		register_for_notification_cb(btt_daemon_connections_conn_id(
+				m.client_if, &m.addr), msg->command ==
+				BTT_CMD_GATT_CLIENT_REGISTER_FOR_NOTIFICATION,
+				status, &m.srvc_id, &m.char_id);
+		break;
+	}
+	}
 }
 
 static btgatt_client_callbacks_t sGattClientCallbacks = {
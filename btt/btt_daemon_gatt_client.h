@@ -24,4 +24,8 @@
 extern void handle_gatt_client_cmd(const struct btt_message *btt_msg_adapter,
 		const int socket_remote);
 extern btgatt_client_callbacks_t *getGattClientCallbacks(void);
-extern bool equal_BD_ADDR(void *first, void *second);
+
+/* HAL call of a queued ATT operation and the callback reporting it failed */
+extern bt_status_t btt_daemon_gatt_client_issue(const struct btt_message *msg);
+extern void btt_daemon_gatt_client_fail(const struct btt_message *msg,
+		int status);
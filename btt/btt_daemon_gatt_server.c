@@ -15,14 +15,20 @@
  */
 
 #include "btt.h"
+#include <sys/uio.h>
 #include "btt_daemon_gatt_server.h"
 #include "btt_gatt_server.h"
 #include "btt_utils.h"
+#include "btt_framing.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_requests.h"
+#include "btt_daemon_events.h"
 
 #include <hardware/bt_gatt.h>
+#include "btt_daemon_capture.h"
 
 extern const btgatt_server_interface_t *gatt_server_if;
-extern int socket_remote;
 
 void handle_gatt_server_cmd(const struct btt_message *btt_msg,
 		const int socket_remote)
@@ -33,166 +39,227 @@ void handle_gatt_server_cmd(const struct btt_message *btt_msg,
 	switch (btt_msg->command) {
 	case BTT_GATT_SERVER_CMD_REGISTER_SERVER:
 	{
-		struct btt_gatt_server_reg msg;
+		struct btt_gatt_server_reg *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_reg\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->register_server(&msg.UUID);
+		btt_daemon_registry_claim_uuid(socket_remote,
+				BTT_DAEMON_KEY_SERVER_UUID, &msg->UUID);
+		btt_daemon_requests_expect_uuid(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_UUID, &msg->UUID,
+				BTT_GATT_SERVER_CB_REGISTER_SERVER);
+		status = gatt_server_if->register_server(&msg->UUID);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_UNREGISTER_SERVER:
 	{
-		struct btt_gatt_server_unreg msg;
+		struct btt_gatt_server_unreg *msg;
 
-		if (!RECV(&msg,socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_unreg\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->unregister_server(msg.server_if);
+		status = gatt_server_if->unregister_server(msg->server_if);
+
+		if (status == BT_STATUS_SUCCESS) {
+			btt_daemon_registry_forget(BTT_DAEMON_KEY_SERVER_IF,
+					msg->server_if);
+			btt_daemon_requests_forget(BTT_DAEMON_KEY_SERVER_IF,
+					msg->server_if);
+		}
 
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_CONNECT:
 	{
-		struct btt_gatt_server_connect msg;
+		struct btt_gatt_server_connect *msg;
 
-		if (!RECV(&msg,socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_connect\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->connect(msg.server_if, &msg.bd_addr, msg.is_direct);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_CONNECT);
+		status = gatt_server_if->connect(msg->server_if, &msg->bd_addr, msg->is_direct);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_DISCONNECT:
 	{
-		struct btt_gatt_server_disconnect msg;
+		struct btt_gatt_server_disconnect *msg;
 
-		if (!RECV(&msg,socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_disconnect\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->disconnect(msg.server_if, &msg.bd_addr, msg.conn_id);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_CONNECT);
+		status = gatt_server_if->disconnect(msg->server_if, &msg->bd_addr, msg->conn_id);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_ADD_SERVICE:
 	{
-		struct btt_gatt_server_add_service msg;
+		struct btt_gatt_server_add_service *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_add_service\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->add_service(msg.server_if, &msg.srvc_id, msg.num_handles);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_ADD_SERVICE);
+		status = gatt_server_if->add_service(msg->server_if, &msg->srvc_id, msg->num_handles);
 		break;
 	}
 	case BTT_GATT_SERVER_REQ_ADD_INCLUDED_SERVICE:
 	{
-		struct btt_gatt_server_add_included_srvc msg;
+		struct btt_gatt_server_add_included_srvc *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_add_included_srvc\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->add_included_service( msg.server_if, msg.service_handle,
-				msg.included_handle);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_ADD_INCLUDED_SERVICE);
+		status = gatt_server_if->add_included_service( msg->server_if, msg->service_handle,
+				msg->included_handle);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_ADD_CHARACTERISTIC:
 	{
-		struct btt_gatt_server_add_characteristic msg;
+		struct btt_gatt_server_add_characteristic *msg;
 
-		if (!RECV(&msg,socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_add_characteristic\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->add_characteristic(msg.server_if, msg.service_handle, &msg.uuid,
-				msg.properties, msg.permissions);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_ADD_CHARACTERISTIC);
+		status = gatt_server_if->add_characteristic(msg->server_if, msg->service_handle, &msg->uuid,
+				msg->properties, msg->permissions);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_ADD_DESCRIPTOR:
 	{
-		struct btt_gatt_server_add_descriptor msg;
+		struct btt_gatt_server_add_descriptor *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_add_descriptor\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->add_descriptor(msg.server_if, msg.service_handle,
-				&msg.uuid, msg.permissions);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_ADD_DESCRIPTOR);
+		status = gatt_server_if->add_descriptor(msg->server_if, msg->service_handle,
+				&msg->uuid, msg->permissions);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_START_SERVICE:
 	{
-		struct btt_gatt_server_start_service msg;
+		struct btt_gatt_server_start_service *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_start_service\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->start_service(msg.server_if, msg.service_handle,
-				msg.transport);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_START_SERVICE);
+		status = gatt_server_if->start_service(msg->server_if, msg->service_handle,
+				msg->transport);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_STOP_SERVICE:
 	{
-		struct btt_gatt_server_stop_service msg;
+		struct btt_gatt_server_stop_service *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_stop_service\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->stop_service(msg.server_if, msg.service_handle);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_STOP_SERVICE);
+		status = gatt_server_if->stop_service(msg->server_if, msg->service_handle);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_DELETE_SERVICE:
 	{
-		struct btt_gatt_server_delete_service msg;
+		struct btt_gatt_server_delete_service *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_delete_service\n");
-			return;
+			break;
 		}
 
-		gatt_server_if->delete_service(msg.server_if, msg.service_handle);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		btt_daemon_requests_expect(socket_remote, btt_msg,
+				BTT_DAEMON_KEY_SERVER_IF, msg->server_if,
+				BTT_GATT_SERVER_CB_DELETE_SERVICE);
+		status = gatt_server_if->delete_service(msg->server_if, msg->service_handle);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_SEND_INDICATION:
 	{
-		struct btt_gatt_server_send_indication msg;
-
+		struct btt_gatt_server_send_indication *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST_TRAILER(msg, btt_msg, p_value) || msg->len < 0 ||
+				(size_t) msg->len != TRAILER_LEN(*msg, p_value)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_send_indication\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->send_indication(msg.server_if, msg.attribute_handle,
-				msg.conn_id, msg.len, msg.confirm, &msg.p_value[0]);
+		btt_daemon_registry_claim(socket_remote, BTT_DAEMON_KEY_SERVER_IF,
+				msg->server_if);
+		status = gatt_server_if->send_indication(msg->server_if, msg->attribute_handle,
+				msg->conn_id, msg->len, msg->confirm, &msg->p_value[0]);
 		break;
 	}
 	case BTT_GATT_SERVER_CMD_SEND_RESPONSE:
 	{
-		struct btt_gatt_server_send_response msg;
+		struct btt_gatt_server_send_response *msg;
 
-		if (!RECV(&msg, socket_remote)) {
+		if (!MSG_CAST(msg, btt_msg)) {
 			BTT_LOG_E("Received invalid btt_gatt_server_send_response\n");
-			return;
+			break;
 		}
 
-		status = gatt_server_if->send_response(msg.conn_id, msg.trans_id, msg.status,
-				&msg.response);
+		btt_daemon_registry_claim(socket_remote,
+				BTT_DAEMON_KEY_GATTS_CONN_ID, msg->conn_id);
+		status = gatt_server_if->send_response(msg->conn_id, msg->trans_id, msg->status,
+				&msg->response);
 		break;
 	}
 	default:
@@ -200,11 +267,15 @@ void handle_gatt_server_cmd(const struct btt_message *btt_msg,
 		break;
 	}
 
+	if (status != BT_STATUS_SUCCESS)
+		btt_daemon_requests_cancel(socket_remote, btt_msg);
+
 	FILL_HDR(cb, BTT_GATT_SERVER_CB_BT_STATUS);
+	cb.hdr.request_id = btt_msg->request_id;
 	cb.status = status;
 
-	if (send(socket_remote, &cb,
-			sizeof(struct btt_gatt_server_cb_bt_status), 0) == -1)
+	if (!btt_daemon_client_send(socket_remote, &cb,
+			sizeof(struct btt_gatt_server_cb_bt_status)))
 		 BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
 }
 
@@ -223,9 +294,12 @@ static void register_server_cb(int status, int server_if, bt_uuid_t *app_uuid)
 
 	BTT_LOG_D("Callback_GS Server Register");
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_reg_result), 0) == -1)
-		 BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	btt_daemon_registry_bind_uuid(BTT_DAEMON_KEY_SERVER_UUID, app_uuid,
+			BTT_DAEMON_KEY_SERVER_IF, server_if);
+	btt_daemon_requests_bind_uuid(BTT_DAEMON_KEY_SERVER_UUID, app_uuid,
+			BTT_DAEMON_KEY_SERVER_IF, server_if);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void connect_cb(int conn_id, int server_if, int connected,
@@ -238,11 +312,19 @@ static void connect_cb(int conn_id, int server_if, int connected,
 	FILL_HDR(btt_cb, BTT_GATT_SERVER_CB_CONNECT);
 	btt_cb.conn_id = conn_id;
 	btt_cb.server_if = server_if;
+	btt_cb.connected = connected;
 	memcpy(&btt_cb.bda, bda, sizeof(bt_bdaddr_t));
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_connect), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+	/* connection belongs to whoever owns the server_if */
+	if (connected)
+		btt_daemon_registry_inherit(BTT_DAEMON_KEY_GATTS_CONN_ID, conn_id,
+				BTT_DAEMON_KEY_SERVER_IF, server_if);
+
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
+
+	if (!connected)
+		btt_daemon_registry_forget(BTT_DAEMON_KEY_GATTS_CONN_ID, conn_id);
 }
 
 static void add_service_cb(int status, int server_if,
@@ -258,9 +340,8 @@ static void add_service_cb(int status, int server_if,
 	memcpy(&btt_cb.srvc_id, srvc_id, sizeof(btgatt_srvc_id_t));
 	btt_cb.srvc_handle = srvc_handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_add_service), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void add_included_srvc_cb(int status, int server_if, int srvc_handle, int incl_srvc_handle)
@@ -275,9 +356,8 @@ static void add_included_srvc_cb(int status, int server_if, int srvc_handle, int
 	btt_cb.srvc_handle = srvc_handle;
 	btt_cb.incl_srvc_handle = incl_srvc_handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_add_included_srvc), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void add_characteristic_cb(int status, int server_if, bt_uuid_t *uuid,
@@ -294,9 +374,8 @@ static void add_characteristic_cb(int status, int server_if, bt_uuid_t *uuid,
 	btt_cb.srvc_handle = srvc_handle;
 	btt_cb.char_handle = char_handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_add_characteristic), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void add_descriptor_cb(int status, int server_if, bt_uuid_t *uuid,
@@ -313,9 +392,8 @@ static void add_descriptor_cb(int status, int server_if, bt_uuid_t *uuid,
 	btt_cb.srvc_handle = srvc_handle;
 	btt_cb.descr_handle = descr_handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_add_descriptor), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void start_service_cb(int status, int server_if, int srvc_handle)
@@ -329,9 +407,8 @@ static void start_service_cb(int status, int server_if, int srvc_handle)
 	btt_cb.server_if = server_if;
 	btt_cb.srvc_handle = srvc_handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_start_service), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void stop_service_cb(int status, int server_if, int srvc_handle)
@@ -345,9 +422,8 @@ static void stop_service_cb(int status, int server_if, int srvc_handle)
 	btt_cb.server_if = server_if;
 	btt_cb.srvc_handle = srvc_handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_start_service), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void delete_service_cb(int status, int server_if, int srvc_handle)
@@ -361,9 +437,8 @@ static void delete_service_cb(int status, int server_if, int srvc_handle)
 	btt_cb.server_if = server_if;
 	btt_cb.srvc_handle = srvc_handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_delete_service), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF, server_if,
+			&btt_cb, sizeof(btt_cb));
 }
 
 static void request_read_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
@@ -381,9 +456,8 @@ static void request_read_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
 	btt_cb.offset = offset;
 	btt_cb.is_long = (int) is_long;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_request_read), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_GATTS_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
 }
 
 static void request_write_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
@@ -394,6 +468,9 @@ static void request_write_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
 
 	BTT_LOG_D("Callback GS Request Write");
 
+	btt_daemon_capture_request_write(conn_id, trans_id, bda, attr_handle,
+			offset, length, need_rsp, is_prep, value);
+
 	FILL_HDR(btt_cb, BTT_GATT_SERVER_CB_REQUEST_WRITE);
 	btt_cb.conn_id = conn_id;
 	btt_cb.trans_id = trans_id;
@@ -403,11 +480,17 @@ static void request_write_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
 	btt_cb.length = length;
 	btt_cb.need_rsp = (int) need_rsp;
 	btt_cb.is_prep = (int) is_prep;
-	memcpy(&btt_cb.value, value, BTGATT_MAX_ATTR_LEN);
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_request_write), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	if (length < 0 || length > BTGATT_MAX_ATTR_LEN) {
+		BTT_LOG_E("%s: invalid length=%d\n", __FUNCTION__, length);
+		return;
+	}
+
+	memcpy(&btt_cb.value, value, length);
+	TRIM_TRAILER(btt_cb, value, length);
+
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_GATTS_CONN_ID,
+			conn_id, &btt_cb, MSG_SIZE(btt_cb));
 }
 
 static void request_exec_write_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
@@ -423,9 +506,8 @@ static void request_exec_write_cb(int conn_id, int trans_id, bt_bdaddr_t *bda,
 	memcpy(&btt_cb.bda, bda, sizeof(bt_bdaddr_t));
 	btt_cb.exec_write = exec_write;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_request_exec_write), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_GATTS_CONN_ID,
+			conn_id, &btt_cb, sizeof(btt_cb));
 }
 
 static void response_confirmation_cb(int status, int handle)
@@ -438,9 +520,9 @@ static void response_confirmation_cb(int status, int handle)
 	btt_cb.status = status;
 	btt_cb.handle = handle;
 
-	if (send(socket_remote, &btt_cb,
-			sizeof(struct btt_gatt_server_cb_response_confirmation), 0) == -1)
-		BTT_LOG_E("%s:System Socket Error\n",__FUNCTION__);
+	/* no key to route by, every server application gets it */
+	btt_daemon_deliver(BTT_EVENT_GATTS, BTT_DAEMON_KEY_SERVER_IF,
+			BTT_DAEMON_ANY_ID, &btt_cb, sizeof(btt_cb));
 }
 
 static btgatt_server_callbacks_t sGattServerCallbacks = {
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <hardware/bt_gatt.h>
+
+#include "btt_utils.h"
+#include "btt_eir_data_types.h"
+#include "btt_ad_parser.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_requests.h"
+#include "btt_daemon_gatt_client.h"
+#include "btt_daemon_inject.h"
+
+/* Callbacks are injected as fast as the event writer takes them: when
+ * the event ring is full the injector sleeps instead of losing events,
+ * so the rate measured by the client is the sustainable one. */
+
+#define INJECT_WAIT_NS 20000
+
+struct inject {
+	unsigned int kind;
+	unsigned int count;
+	unsigned int size;
+};
+
+static bool injecting;
+/* scan results are deduplicated, every injected device is a new one */
+static uint32_t next_device;
+
+static void wait_for_room(uint64_t *waits)
+{
+	struct timespec ts = { 0, INJECT_WAIT_NS };
+
+	if (btt_daemon_events_room())
+		return;
+
+	(*waits)++;
+
+	while (!btt_daemon_events_room())
+		nanosleep(&ts, NULL);
+}
+
+static void inject_scan_result(void)
+{
+	static const char name[] = "btt-inject";
+	uint8_t adv_data[BTT_AD_DATA_LEN];
+	bt_bdaddr_t bda;
+	uint32_t device = next_device++;
+
+	/* locally administered, far from the simulated HAL devices */
+	bda.address[0] = 0xD2;
+	bda.address[1] = 0x1E;
+	bda.address[2] = device >> 24;
+	bda.address[3] = device >> 16;
+	bda.address[4] = device >> 8;
+	bda.address[5] = device;
+
+	memset(adv_data, 0, sizeof(adv_data));
+	adv_data[0] = 2;
+	adv_data[1] = FLAGS;
+	adv_data[2] = 0x06;
+	adv_data[3] = sizeof(name);
+	adv_data[4] = COMPLETE_LOCAL_NAME;
+	memcpy(&adv_data[5], name, sizeof(name) - 1);
+
+	getGattClientCallbacks()->scan_result_cb(&bda, -60, adv_data);
+}
+
+static void inject_notify(btgatt_notify_params_t *params, unsigned int i)
+{
+	params->value[0] = i;
+	getGattClientCallbacks()->notify_cb(0, params);
+}
+
+static void *inject_thread(void *arg)
+{
+	struct inject *inject = arg;
+	bool flood = inject->kind == BTT_INJECT_NOTIFY_FLOOD;
+	struct btt_msg_rsp_daemon_inject rsp;
+	btgatt_notify_params_t params;
+	uint64_t start_ns;
+	unsigned int i;
+
+	FILL_HDR(rsp, BTT_RSP_DAEMON_INJECT);
+	rsp.waits = 0;
+
+	memset(&params, 0, sizeof(params));
+	memset(params.value, 0x5A, inject->size);
+	params.len = inject->size;
+	params.is_notify = 1;
+	params.char_id.uuid.uu[12] = 0x01;
+	params.srvc_id.is_primary = 1;
+	params.srvc_id.id.uuid.uu[12] = 0x01;
+
+	start_ns = monotonic_ns();
+
+	for (i = 0; i < inject->count; i++) {
+		if (!flood)
+			wait_for_room(&rsp.waits);
+
+		if (inject->kind == BTT_INJECT_SCAN_RESULT)
+			inject_scan_result();
+		else
+			inject_notify(&params, i);
+	}
+
+	rsp.injected = inject->count;
+	rsp.duration_ns = monotonic_ns() - start_ns;
+	free(inject);
+
+	BTT_LOG_I("Injected %" PRIu64 " callbacks in %" PRIu64 " us, waited %"
+			PRIu64 " times\n", rsp.injected, rsp.duration_ns / 1000,
+			rsp.waits);
+
+	/* behind the injected events in the ring, it can not overtake them,
+	 * a flood fills the ring first, the answer must get through anyway */
+	if (!flood)
+		wait_for_room(&rsp.waits);
+
+	while (flood && btt_daemon_events_room())
+		inject_notify(&params, i);
+
+	btt_daemon_deliver(0, BTT_DAEMON_KEY_NONE, 0, &rsp, sizeof(rsp));
+	__atomic_store_n(&injecting, FALSE, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+/* Only one injection runs at a time. BTT_RSP_DAEMON_INJECT completes
+ * the request when all callbacks are injected. */
+bool btt_daemon_inject_start(const struct btt_msg_cmd_daemon_inject *cmd,
+		int socket)
+{
+	struct inject *inject;
+	pthread_t thread;
+
+	if (cmd->kind != BTT_INJECT_SCAN_RESULT && cmd->kind != BTT_INJECT_NOTIFY &&
+			cmd->kind != BTT_INJECT_NOTIFY_FLOOD) {
+		BTT_LOG_E("Unknown injected callback %u\n", cmd->kind);
+		return FALSE;
+	}
+
+	if (cmd->kind != BTT_INJECT_SCAN_RESULT && (!cmd->size ||
+			cmd->size > BTGATT_MAX_ATTR_LEN)) {
+		BTT_LOG_E("Notification of %u bytes can not be injected\n",
+				cmd->size);
+		return FALSE;
+	}
+
+	if (__atomic_exchange_n(&injecting, TRUE, __ATOMIC_ACQUIRE)) {
+		BTT_LOG_W("Injection is running already\n");
+		return FALSE;
+	}
+
+	inject = malloc(sizeof(*inject));
+
+	if (!inject) {
+		__atomic_store_n(&injecting, FALSE, __ATOMIC_RELEASE);
+		return FALSE;
+	}
+
+	inject->kind = cmd->kind;
+	inject->count = cmd->count;
+	inject->size = cmd->size;
+
+	btt_daemon_requests_expect(socket, &cmd->hdr, BTT_DAEMON_KEY_NONE, 0,
+			BTT_RSP_DAEMON_INJECT);
+
+	if (pthread_create(&thread, NULL, inject_thread, inject)) {
+		BTT_LOG_E("Cannot start injection thread\n");
+		btt_daemon_requests_cancel(socket, &cmd->hdr);
+		free(inject);
+		__atomic_store_n(&injecting, FALSE, __ATOMIC_RELEASE);
+		return FALSE;
+	}
+
+	pthread_detach(thread);
+	return TRUE;
+}
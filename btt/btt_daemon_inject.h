@@ -0,0 +1,27 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_INJECT_H
+#error Included twice
+#endif
+#define BTT_DAEMON_INJECT_H
+
+/* Synthetic HAL callbacks for benchmarking the path from a callback
+ * to the clients, see btt_bench_ipc. They go through the same callbacks
+ * the HAL calls, so use a daemon nobody else relies on. */
+
+extern bool btt_daemon_inject_start(const struct btt_msg_cmd_daemon_inject *cmd,
+		int socket);
@@ -0,0 +1,636 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_utils.h"
+#include "btt_gatt_client.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_connections.h"
+#include "btt_daemon_long_write.h"
+
+extern const btgatt_client_interface_t *gatt_client_if;
+
+/* long_write: the value is streamed from the client and written in
+ * chunks as soon as they are complete, only the bytes not written yet
+ * are kept. Its length may be unknown until the client ends it with
+ * an empty data message, up to window writes are waiting
+ * for their callback at once. HAL refusing a write because of the queue
+ * being full is not an error, the chunk is retried after the next
+ * callback. Prepared writes are not made here, write_characteristic of
+ * this HAL has no offset, but a value up to BTGATT_MAX_ATTR_LEN written
+ * with response in one chunk is prepared, checked and executed by the
+ * stack itself. Per chunk callbacks are not delivered, only
+ * the latency of each write is kept in a histogram.
+ * Like in discover_all, callbacks coming during the HAL call only
+ * update the counters, the loop in run_long_write makes the next step. */
+
+#define LONG_WRITE_SESSIONS 8
+/* write types of the stack */
+#define LONG_WRITE_TYPE_DEFAULT 2
+#define LONG_WRITE_TYPE_PREPARE 3
+
+/* latency in us, exact below 16, then 8 buckets per power of two */
+#define LATENCY_LINEAR   16
+#define LATENCY_SUB_BITS 3
+#define LATENCY_BUCKETS  (LATENCY_LINEAR + 28 * (1 << LATENCY_SUB_BITS))
+
+struct long_write {
+	bool active;
+	int conn_id;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+	int write_type;
+	int auth_req;
+	/* NULL for the pattern, bytes of the value from value_offset */
+	uint8_t *value;
+	uint32_t value_offset;
+	uint32_t value_alloc;
+	uint32_t len;
+	/* len is not known until the value ends */
+	bool open;
+	uint32_t received;
+	uint32_t sent;
+	/* chunk in the HAL call, kept until it is not refused */
+	uint32_t issuing;
+	uint32_t chunk;
+	unsigned int window;
+	unsigned int in_flight;
+	uint32_t writes;
+	/* chunks acknowledged, all but the last one are full */
+	uint32_t acked;
+	bt_status_t status;
+	uint64_t start_ns;
+	bool in_call;
+	/* times of the writes in flight, oldest first */
+	uint64_t issued_ns[BTT_GATT_LONG_WRITE_MAX_WINDOW];
+	unsigned int issued_first;
+	uint32_t latency[LATENCY_BUCKETS];
+	uint32_t latency_max;
+	uint32_t latencies;
+	/* no credit for the ready chunk since stall_start_ns */
+	bool stalled;
+	uint64_t stall_start_ns;
+	uint64_t stall_ns;
+	uint32_t stalls;
+	uint32_t busy;
+};
+
+static pthread_mutex_t long_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct long_write sessions[LONG_WRITE_SESSIONS];
+/* connections of the finished sessions, held until the lock is left */
+static int finished[LONG_WRITE_SESSIONS];
+static unsigned int finished_num;
+
+/* Rest of a value whose write was refused or ended early, the client
+ * does not wait for answers while streaming it. Its chunks are dropped
+ * quietly, only the first error is answered. */
+struct drain {
+	int conn_id;
+	uint32_t left;
+	/* until the empty data message */
+	bool open;
+};
+
+static struct drain drains[LONG_WRITE_SESSIONS];
+
+/* must be called under long_write_lock, NULL if it is not drained */
+static struct drain *find_drain(int conn_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < LONG_WRITE_SESSIONS; i++)
+		if ((drains[i].left || drains[i].open) &&
+				drains[i].conn_id == conn_id)
+			return &drains[i];
+
+	return NULL;
+}
+
+/* must be called under long_write_lock */
+static void drain(int conn_id, uint32_t left, bool open)
+{
+	struct drain *rest = find_drain(conn_id);
+	unsigned int i;
+
+	for (i = 0; i < LONG_WRITE_SESSIONS && !rest; i++)
+		if (!drains[i].left && !drains[i].open)
+			rest = &drains[i];
+
+	/* no room, the chunks are answered with errors */
+	if (!rest)
+		return;
+
+	rest->conn_id = conn_id;
+	rest->left = left;
+	rest->open = open;
+}
+
+/* must be called under long_write_lock */
+static struct long_write *find_session(int conn_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < LONG_WRITE_SESSIONS; i++)
+		if (sessions[i].active && sessions[i].conn_id == conn_id)
+			return &sessions[i];
+
+	return NULL;
+}
+
+/* Connections of the sessions finished under the lock are given back
+ * after it is left, operations queued on them are sent then and their
+ * callbacks may come before the HAL call returns. */
+static void unlock_and_release(void)
+{
+	int conn_ids[LONG_WRITE_SESSIONS];
+	unsigned int num = finished_num;
+	unsigned int i;
+
+	memcpy(conn_ids, finished, num * sizeof(conn_ids[0]));
+	finished_num = 0;
+	pthread_mutex_unlock(&long_write_lock);
+
+	for (i = 0; i < num; i++)
+		btt_daemon_connections_release(conn_ids[i]);
+}
+
+static unsigned int latency_bucket(uint32_t us)
+{
+	unsigned int msb;
+
+	if (us < LATENCY_LINEAR)
+		return us;
+
+	msb = 31 - __builtin_clz(us);
+
+	return LATENCY_LINEAR + ((msb - 4) << LATENCY_SUB_BITS) +
+			((us >> (msb - LATENCY_SUB_BITS)) &
+			((1 << LATENCY_SUB_BITS) - 1));
+}
+
+/* lowest latency of the bucket */
+static uint32_t bucket_latency(unsigned int bucket)
+{
+	unsigned int msb;
+	unsigned int sub;
+
+	if (bucket < LATENCY_LINEAR)
+		return bucket;
+
+	msb = ((bucket - LATENCY_LINEAR) >> LATENCY_SUB_BITS) + 4;
+	sub = (bucket - LATENCY_LINEAR) & ((1 << LATENCY_SUB_BITS) - 1);
+
+	return ((1 << LATENCY_SUB_BITS) + sub) << (msb - LATENCY_SUB_BITS);
+}
+
+static uint32_t latency_percentile(const struct long_write *session,
+		unsigned int percent)
+{
+	uint64_t rank = ((uint64_t) session->latencies * percent + 99) / 100;
+	uint64_t count = 0;
+	unsigned int i;
+
+	if (!session->latencies)
+		return 0;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		count += session->latency[i];
+
+		if (count >= rank)
+			break;
+	}
+
+	return i < LATENCY_BUCKETS ? bucket_latency(i) : session->latency_max;
+}
+
+/* must be called under long_write_lock, the oldest write is done */
+static void write_done(struct long_write *session)
+{
+	uint64_t latency = (monotonic_ns() -
+			session->issued_ns[session->issued_first]) / 1000;
+	uint32_t us = latency < UINT32_MAX ? latency : UINT32_MAX;
+
+	session->issued_first = (session->issued_first + 1) %
+			BTT_GATT_LONG_WRITE_MAX_WINDOW;
+	session->in_flight--;
+	session->latency[latency_bucket(us)]++;
+	session->latencies++;
+
+	if (us > session->latency_max)
+		session->latency_max = us;
+}
+
+/* must be called under long_write_lock, frees the session */
+static void finish(struct long_write *session, int status)
+{
+	struct btt_gatt_client_cb_long_write cb;
+	uint64_t acked_bytes = (uint64_t) session->acked * session->chunk;
+
+	FILL_HDR(cb, BTT_GATT_CLIENT_CB_LONG_WRITE);
+	cb.conn_id = session->conn_id;
+	cb.status = status;
+	cb.len = acked_bytes < session->sent ? acked_bytes : session->sent;
+	cb.writes = session->writes;
+	cb.duration_ms = (monotonic_ns() - session->start_ns) / 1000000;
+	cb.latency_p50_us = latency_percentile(session, 50);
+	cb.latency_p90_us = latency_percentile(session, 90);
+	cb.latency_p99_us = latency_percentile(session, 99);
+	cb.latency_max_us = session->latency_max;
+	cb.stalls = session->stalls;
+	cb.stall_ms = session->stall_ns / 1000000;
+	cb.busy = session->busy;
+
+	BTT_LOG_I("Long write of conn_id=%d: %u of %u bytes in %u ms, "
+			"p99 %u us, %u stalls, status=%d\n", session->conn_id, cb.len,
+			session->received, cb.duration_ms, cb.latency_p99_us, cb.stalls,
+			status);
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			session->conn_id, &cb, sizeof(cb));
+
+	if (session->open || session->received < session->len)
+		drain(session->conn_id, session->len - session->received,
+				session->open);
+
+	if (finished_num < LONG_WRITE_SESSIONS)
+		finished[finished_num++] = session->conn_id;
+
+	free(session->value);
+	memset(session, 0, sizeof(*session));
+}
+
+/* Must be called under long_write_lock, return FALSE if there is
+ * nothing to do until the next callback or data. The lock is released
+ * during the HAL call. */
+static bool step(struct long_write *session)
+{
+	char value[BTGATT_MAX_ATTR_LEN];
+	btgatt_srvc_id_t srvc_id = session->srvc_id;
+	btgatt_gatt_id_t char_id = session->char_id;
+	int conn_id = session->conn_id;
+	int write_type = session->write_type;
+	int auth_req = session->auth_req;
+	uint32_t available = session->received - session->sent;
+	uint32_t len;
+	uint32_t i;
+	bt_status_t status;
+
+	if (session->status != BT_STATUS_SUCCESS) {
+		if (!session->in_flight)
+			finish(session, session->status);
+
+		return FALSE;
+	}
+
+	if (!session->open && session->sent == session->len &&
+			!session->in_flight) {
+		finish(session, BT_STATUS_SUCCESS);
+		return FALSE;
+	}
+
+	/* the last chunk only may be shorter */
+	if (!available || (available < session->chunk && (session->open ||
+			session->received < session->len)))
+		return FALSE;
+
+	if (session->in_flight >= session->window) {
+		if (!session->stalled) {
+			session->stalled = TRUE;
+			session->stall_start_ns = monotonic_ns();
+			session->stalls++;
+		}
+
+		return FALSE;
+	}
+
+	if (session->stalled) {
+		session->stall_ns += monotonic_ns() - session->stall_start_ns;
+		session->stalled = FALSE;
+	}
+
+	len = available < session->chunk ? available : session->chunk;
+
+	if (session->value)
+		memcpy(value, session->value +
+				(session->sent - session->value_offset), len);
+	else
+		for (i = 0; i < len; i++)
+			value[i] = (session->sent + i) & 0xFF;
+
+	session->sent += len;
+	session->issued_ns[(session->issued_first + session->in_flight) %
+			BTT_GATT_LONG_WRITE_MAX_WINDOW] = monotonic_ns();
+	session->in_flight++;
+	session->writes++;
+	session->issuing = len;
+
+	pthread_mutex_unlock(&long_write_lock);
+	status = gatt_client_if->write_characteristic(conn_id, &srvc_id,
+			&char_id, write_type, len, auth_req, value);
+	pthread_mutex_lock(&long_write_lock);
+
+	/* disconnected meanwhile */
+	if (!session->active || session->conn_id != conn_id)
+		return FALSE;
+
+	session->issuing = 0;
+
+	if (status == BT_STATUS_SUCCESS)
+		return TRUE;
+
+	/* refused write is the newest one */
+	session->in_flight--;
+	session->writes--;
+
+	if (status == BT_STATUS_BUSY && session->in_flight) {
+		session->sent -= len;
+		session->busy++;
+		return FALSE;
+	}
+
+	session->status = status;
+	return TRUE;
+}
+
+/* Must be called under long_write_lock, FALSE if there is no memory.
+ * Bytes sent already are dropped first, but the chunk in the HAL call
+ * is kept, it is written again if it is refused. */
+static bool append(struct long_write *session, const uint8_t *data,
+		uint32_t len)
+{
+	uint32_t keep_from = session->sent - session->issuing;
+	uint32_t kept = session->received - keep_from;
+	uint32_t alloc = session->value_alloc;
+	uint8_t *value;
+
+	if (session->received - session->value_offset + len > alloc) {
+		if (kept)
+			memmove(session->value, session->value +
+					(keep_from - session->value_offset), kept);
+
+		session->value_offset = keep_from;
+
+		while (kept + len > alloc)
+			alloc = alloc ? alloc * 2 : 4 * BTT_GATT_LONG_WRITE_DATA_LEN;
+	}
+
+	if (alloc != session->value_alloc) {
+		if (!(value = realloc(session->value, alloc)))
+			return FALSE;
+
+		session->value = value;
+		session->value_alloc = alloc;
+	}
+
+	memcpy(session->value + (session->received - session->value_offset),
+			data, len);
+	session->received += len;
+
+	return TRUE;
+}
+
+/* must be called under long_write_lock */
+static void run_long_write(struct long_write *session)
+{
+	int conn_id = session->conn_id;
+
+	/* the running loop sees the change after its HAL call */
+	if (session->in_call)
+		return;
+
+	session->in_call = TRUE;
+
+	while (step(session))
+		;
+
+	/* unless it was finished */
+	if (session->active && session->conn_id == conn_id)
+		session->in_call = FALSE;
+}
+
+static bt_status_t start_session(
+		const struct btt_gatt_client_long_write *msg)
+{
+	struct long_write *session = NULL;
+	struct drain *rest;
+	unsigned int i;
+	bt_status_t status;
+
+	if ((!msg->len && msg->pattern) || (!msg->pattern &&
+			msg->len > BTT_GATT_LONG_WRITE_MAX_LEN) ||
+			msg->chunk > BTGATT_MAX_ATTR_LEN ||
+			msg->window > BTT_GATT_LONG_WRITE_MAX_WINDOW)
+		return BT_STATUS_PARM_INVALID;
+
+	/* every chunk would be prepared at offset 0 */
+	if (msg->write_type == LONG_WRITE_TYPE_PREPARE) {
+		BTT_LOG_W("Prepared long write is not supported, the value is "
+				"prepared by the stack when written with response\n");
+		return BT_STATUS_UNSUPPORTED;
+	}
+
+	/* operations of clients wait until the value is written */
+	status = btt_daemon_connections_hold(msg->conn_id);
+
+	if (status != BT_STATUS_SUCCESS)
+		return status;
+
+	pthread_mutex_lock(&long_write_lock);
+
+	if (find_session(msg->conn_id)) {
+		pthread_mutex_unlock(&long_write_lock);
+		btt_daemon_connections_release(msg->conn_id);
+		BTT_LOG_W("Long write of conn_id=%d is running already\n",
+				msg->conn_id);
+		return BT_STATUS_BUSY;
+	}
+
+	for (i = 0; i < LONG_WRITE_SESSIONS && !session; i++)
+		if (!sessions[i].active)
+			session = &sessions[i];
+
+	if (!session) {
+		pthread_mutex_unlock(&long_write_lock);
+		btt_daemon_connections_release(msg->conn_id);
+		return BT_STATUS_NOMEM;
+	}
+
+	/* the previous value of the client has ended */
+	if ((rest = find_drain(msg->conn_id)) != NULL) {
+		rest->left = 0;
+		rest->open = FALSE;
+	}
+
+	session->active = TRUE;
+	session->conn_id = msg->conn_id;
+	session->srvc_id = msg->srvc_id;
+	session->char_id = msg->char_id;
+	session->write_type = msg->write_type;
+	session->auth_req = msg->auth_req;
+	session->len = msg->len;
+	session->open = !msg->len;
+	session->chunk = msg->chunk ? msg->chunk :
+			BTT_GATT_LONG_WRITE_DEFAULT_CHUNK;
+
+	/* the stack splits it into prepared writes and executes them */
+	if (!msg->chunk && msg->write_type == LONG_WRITE_TYPE_DEFAULT &&
+			msg->len && msg->len <= BTGATT_MAX_ATTR_LEN)
+		session->chunk = msg->len;
+
+	session->window = msg->window ? msg->window : 1;
+	session->status = BT_STATUS_SUCCESS;
+	session->start_ns = monotonic_ns();
+
+	if (msg->pattern) {
+		session->received = msg->len;
+		run_long_write(session);
+	}
+
+	unlock_and_release();
+
+	return BT_STATUS_SUCCESS;
+}
+
+/* error ends the session */
+bt_status_t btt_daemon_long_write_start(
+		const struct btt_gatt_client_long_write *msg)
+{
+	bt_status_t status = start_session(msg);
+
+	/* the client streams the value anyway */
+	if (status != BT_STATUS_SUCCESS && !msg->pattern) {
+		pthread_mutex_lock(&long_write_lock);
+		drain(msg->conn_id, msg->len, !msg->len);
+		unlock_and_release();
+	}
+
+	return status;
+}
+
+bt_status_t btt_daemon_long_write_data(int conn_id, const uint8_t *data,
+		uint32_t len)
+{
+	struct long_write *session;
+	struct drain *rest;
+	bt_status_t status;
+
+	pthread_mutex_lock(&long_write_lock);
+
+	session = find_session(conn_id);
+
+	if (!session) {
+		rest = find_drain(conn_id);
+
+		if (rest && rest->open)
+			rest->open = len ? TRUE : FALSE;
+		else if (rest)
+			rest->left -= len < rest->left ? len : rest->left;
+
+		unlock_and_release();
+		return rest ? BT_STATUS_SUCCESS : BT_STATUS_NOT_READY;
+	}
+
+	/* empty message ends the value of unknown length */
+	if (!len && session->open) {
+		session->open = FALSE;
+		session->len = session->received;
+
+		/* reported by the long write callback */
+		if (!session->len && session->status == BT_STATUS_SUCCESS)
+			session->status = BT_STATUS_PARM_INVALID;
+
+		run_long_write(session);
+		unlock_and_release();
+		return BT_STATUS_SUCCESS;
+	}
+
+	/* failed already, waits for the writes in flight */
+	if (session->status != BT_STATUS_SUCCESS) {
+		if (!session->open)
+			session->received += len < session->len - session->received ?
+					len : session->len - session->received;
+
+		unlock_and_release();
+		return BT_STATUS_SUCCESS;
+	}
+
+	if (len > (session->open ? BTT_GATT_LONG_WRITE_MAX_LEN :
+			session->len) - session->received)
+		session->status = BT_STATUS_PARM_INVALID;
+	else if (len && !append(session, data, len))
+		session->status = BT_STATUS_NOMEM;
+
+	run_long_write(session);
+
+	if (session->active && session->conn_id == conn_id &&
+			session->status != BT_STATUS_SUCCESS) {
+		status = session->status;
+		unlock_and_release();
+		return status;
+	}
+
+	unlock_and_release();
+
+	return BT_STATUS_SUCCESS;
+}
+
+bool btt_daemon_long_write_written(int conn_id, int status,
+		const btgatt_write_params_t *p_data)
+{
+	struct long_write *session;
+
+	pthread_mutex_lock(&long_write_lock);
+
+	session = find_session(conn_id);
+
+	/* not one of the chunks, e.g. a write of a client */
+	if (!session || !session->in_flight ||
+			memcmp(&session->char_id, &p_data->char_id,
+					sizeof(p_data->char_id)) ||
+			memcmp(&session->srvc_id, &p_data->srvc_id,
+					sizeof(p_data->srvc_id))) {
+		unlock_and_release();
+		return FALSE;
+	}
+
+	write_done(session);
+
+	if (status != BT_STATUS_SUCCESS) {
+		if (session->status == BT_STATUS_SUCCESS)
+			session->status = BT_STATUS_FAIL;
+	} else {
+		session->acked++;
+	}
+
+	run_long_write(session);
+
+	unlock_and_release();
+
+	return TRUE;
+}
+
+void btt_daemon_long_write_disconnect(int conn_id)
+{
+	struct long_write *session;
+
+	pthread_mutex_lock(&long_write_lock);
+
+	if ((session = find_session(conn_id)) != NULL)
+		finish(session, BT_STATUS_FAIL);
+
+	unlock_and_release();
+}
@@ -18,33 +18,50 @@
 #include <signal.h>
 #include <sys/capability.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <hardware/bt_gatt.h>
 
 #include "btt_utils.h"
+#include "btt_framing.h"
+#include "btt_shm.h"
 
 #include "btt_daemon_main.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
 #include "btt_daemon_adapter.h"
 #include "btt_daemon_gatt_client.h"
 #include "btt_daemon_gatt_server.h"
+#include "btt_daemon_capture.h"
+#include "btt_daemon_inject.h"
+#include "btt_daemon_record.h"
+#include "btt_sim_hal.h"
 #include "btt_adapter.h"
 #include "btt_gatt_client.h"
 
+#define DAEMON_MAX_EVENTS 16
+
 static btgatt_callbacks_t sGattCallbacks;
-int socket_remote;
 extern int app_socket;
+extern struct btt_framing app_rx;
+extern struct btt_shm app_shm;
 
 const bt_interface_t *bluetooth_if = NULL;
 const btgatt_interface_t *gatt_if = NULL;
 const btgatt_client_interface_t *gatt_client_if = NULL;
 const btgatt_server_interface_t *gatt_server_if = NULL;
 
-struct list_element *list = NULL;
-
 static void run_daemon_help(int argc, char **argv);
 static void run_daemon_start(int argc, char **argv) ;
 static void run_daemon_stop(int argc, char **argv);
 static void run_daemon_restart(int argc, char **argv);
 static void run_daemon_status(int argc, char **argv);
+static void run_daemon_stats(int argc, char **argv);
+static void run_daemon_shm(int argc, char **argv);
+static void run_daemon_capture(int argc, char **argv);
+static void run_daemon_replay(int argc, char **argv);
+static void run_daemon_record(int argc, char **argv);
 static void run_daemon_generic_extended(const struct extended_command *commands,
 		unsigned int number_of_commands,
 		void (*help)(int argc, char **argv), int argc, char **argv);
@@ -52,9 +69,16 @@ static void btgatt_callbacks_init();
 
 static struct extended_command daemon_commands[] = {
 		{{"help",   "",            run_daemon_help}, 1, 1},
-		{{"start",  "[nodetach]",  run_daemon_start}, 1, 2},
+		{{"start",  "[nodetach] [ring=<events>] [batch=<events>] [delay=<us>]",
+				run_daemon_start}, 1, 5},
 		{{"stop",   "",            run_daemon_stop}, 1, 1},
-		{{"restart","[nodetach]",  run_daemon_restart}, 1, 2}
+		{{"restart","[nodetach] [ring=<events>] [batch=<events>] [delay=<us>]",
+				run_daemon_restart}, 1, 5},
+		{{"stats",  "",            run_daemon_stats}, 1, 1},
+		{{"shm",    "[size]",      run_daemon_shm}, 1, 2},
+		{{"capture", "<file> | stop", run_daemon_capture}, 2, 2},
+		{{"replay", "<file> [max]", run_daemon_replay}, 2, 3},
+		{{"record", "<file> [size_MB] [sync_ms] | stop", run_daemon_record}, 2, 4}
 };
 
 #define DAEMON_SUPPORTED_COMMANDS sizeof(daemon_commands)/sizeof(struct extended_command)
@@ -125,9 +149,9 @@ static void config_permissions(void)
 
 static int start_bluedroid_hal(void)
 {
+	int          status;
 #ifndef WITHOUT_STACK
 	int          err;
-	int          status;
 	hw_module_t *module;
 	hw_device_t *device;
 
@@ -145,6 +169,11 @@ static int start_bluedroid_hal(void)
 	}
 
 	BTT_LOG_I("HAL library loaded (%s)", strerror(err));
+#else
+	/* host build, commands are served by a simulation */
+	bluetooth_if = btt_sim_hal_interface();
+	BTT_LOG_I("Simulated HAL loaded");
+#endif
 	status = bluetooth_if->init(getBluetoothCallbacks());
 	gatt_if = bluetooth_if->get_profile_interface(BT_PROFILE_GATT_ID);
 
@@ -157,7 +186,6 @@ static int start_bluedroid_hal(void)
 	}
 
 	BTT_LOG_I("HAL Status %i", status);
-#endif
 	return 0;
 }
 
@@ -197,31 +225,317 @@ static void run_daemon_generic_extended(const struct extended_command *commands,
 	}
 }
 
+static void accept_clients(int epoll_fd, int socket_server)
+{
+	struct btt_daemon_client *client;
+	struct epoll_event ev;
+	int socket_client;
+
+	while ((socket_client = accept(socket_server, NULL, NULL)) != -1) {
+		client = btt_daemon_client_add(socket_client);
+
+		if (!client) {
+			close(socket_client);
+			continue;
+		}
+
+		ev.events   = EPOLLIN;
+		ev.data.ptr = client;
+
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_client, &ev) == -1) {
+			BTT_LOG_E("%s:epoll_ctl error\n", __FUNCTION__);
+			btt_daemon_client_remove(client);
+		}
+	}
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
+
+static void handle_daemon_cmd(const struct btt_message *btt_msg,
+		const int socket_remote)
+{
+	struct btt_message btt_rsp;
+
+	btt_rsp.command = BTT_RSP_OK;
+	btt_rsp.length  = 0;
+	btt_rsp.request_id = btt_msg->request_id;
+
+	switch (btt_msg->command) {
+	case BTT_CMD_DAEMON_SUBSCRIBE: {
+		struct btt_msg_cmd_daemon_subscribe *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		btt_daemon_registry_unwatch(socket_remote, BTT_EVENT_ALL);
+		btt_daemon_registry_watch(socket_remote,
+				msg->events & BTT_EVENT_ALL);
+		break;
+	}
+	case BTT_CMD_DAEMON_STATS: {
+		struct btt_msg_rsp_daemon_stats rsp;
+
+		FILL_HDR(rsp, BTT_RSP_DAEMON_STATS);
+		rsp.hdr.request_id = btt_msg->request_id;
+		rsp.events = btt_daemon_events_delivered();
+		rsp.dropped = btt_daemon_events_overflows();
+		rsp.messages = btt_daemon_registry_messages();
+		rsp.writes = btt_daemon_registry_writes();
+		rsp.shared = btt_daemon_registry_shared();
+		btt_daemon_events_config(&rsp.capacity, &rsp.batch_events,
+				&rsp.batch_delay_us);
+
+		if (!btt_daemon_client_send(socket_remote, &rsp, sizeof(rsp)))
+			BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+
+		return;
+	}
+	case BTT_CMD_DAEMON_SHM_OPEN: {
+		struct btt_msg_cmd_daemon_shm_open *msg;
+		struct btt_msg_rsp_daemon_shm_open rsp;
+		struct btt_shm shm;
+		int fds[2];
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		if (!btt_shm_create(&shm, msg->size ? msg->size :
+				BTT_SHM_DEFAULT_SIZE)) {
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		FILL_HDR(rsp, BTT_RSP_DAEMON_SHM_OPEN);
+		rsp.hdr.request_id = btt_msg->request_id;
+		rsp.size = shm.ring->size;
+		fds[0] = shm.mem_fd;
+		fds[1] = shm.event_fd;
+
+		/* descriptors are duplicated into the client by the kernel,
+		 * not possible while earlier output still waits for it */
+		if (!btt_daemon_client_send_fds(socket_remote, &rsp, sizeof(rsp),
+				fds, 2)) {
+			BTT_LOG_W("%s:Shared ring not passed, socket=%d\n",
+					__FUNCTION__, socket_remote);
+			btt_shm_close(&shm);
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		if (!btt_daemon_registry_attach_shm(socket_remote, &shm)) {
+			BTT_LOG_W("No room for shared ring of socket=%d\n",
+					socket_remote);
+			btt_shm_close(&shm);
+		}
+
+		return;
+	}
+	case BTT_CMD_DAEMON_CAPTURE: {
+		struct btt_msg_cmd_daemon_capture *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		msg->path[BTT_CAPTURE_PATH_LEN - 1] = '\0';
+
+		if (!msg->start)
+			btt_daemon_capture_stop();
+		else if (!btt_daemon_capture_start(msg->path))
+			btt_rsp.command = BTT_RSP_ERROR;
+
+		break;
+	}
+	case BTT_CMD_DAEMON_RECORD: {
+		struct btt_msg_cmd_daemon_record *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		msg->path[BTT_CAPTURE_PATH_LEN - 1] = '\0';
+
+		if (!msg->start)
+			btt_daemon_record_stop();
+		else if (!btt_daemon_record_start(msg->path, msg->size_mb,
+				msg->sync_ms))
+			btt_rsp.command = BTT_RSP_ERROR;
+
+		break;
+	}
+	case BTT_CMD_DAEMON_REPLAY: {
+		struct btt_msg_cmd_daemon_replay *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		msg->path[BTT_CAPTURE_PATH_LEN - 1] = '\0';
+
+		if (!btt_daemon_replay_start(msg->path, msg->max_speed ? TRUE : FALSE,
+				socket_remote, btt_msg))
+			btt_rsp.command = BTT_RSP_ERROR;
+
+		break;
+	}
+	case BTT_CMD_DAEMON_ECHO: {
+		struct btt_msg_cmd_daemon_echo rsp;
+
+		if (!MSG_COPY_TRAILER(&rsp, btt_msg, data)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		/* request_id and data stay */
+		rsp.hdr.command = BTT_RSP_DAEMON_ECHO;
+
+		if (!btt_daemon_client_send(socket_remote, &rsp, MSG_SIZE(rsp)))
+			BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+
+		return;
+	}
+	case BTT_CMD_DAEMON_INJECT: {
+		struct btt_msg_cmd_daemon_inject *msg;
+
+		if (!MSG_CAST(msg, btt_msg)) {
+			BTT_LOG_E("Error: incorrect size of received structure.\n");
+			btt_rsp.command = BTT_RSP_ERROR;
+			break;
+		}
+
+		if (!btt_daemon_inject_start(msg, socket_remote))
+			btt_rsp.command = BTT_RSP_ERROR;
+
+		break;
+	}
+	default:
+		btt_rsp.command = BTT_RSP_ERROR_UNKNOWN_COMMAND;
+		break;
+	}
+
+	if (!btt_daemon_client_send(socket_remote, &btt_rsp,
+			sizeof(struct btt_message)))
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
+
+static void dispatch_message(struct btt_message *btt_msg, int socket_client)
+{
+	BTT_LOG_D("RECEIVE command=%u length=%u\n",
+			btt_msg->command, btt_msg->length);
+
+	/*start to handle different command here.*/
+	if (btt_msg->command > BTT_DAEMON_CMD_RSP_START &&
+			btt_msg->command < BTT_DAEMON_CMD_RSP_END) {
+		handle_daemon_cmd(btt_msg, socket_client);
+	} else if (btt_msg->command > BTT_ADAPTER_CMD_RSP_START &&
+			btt_msg->command < BTT_ADAPTER_CMD_RSP_END) {
+		handle_adapter_cmd(btt_msg, socket_client);
+	} else if (btt_msg->command > BTT_MISC_CMD_RSP_START &&
+			btt_msg->command < BTT_MISC_CMD_RSP_END) {
+		handle_adapter_cmd(btt_msg, socket_client);
+	} else if (btt_msg->command > BTT_GATT_CLIENT_CMD_RSP_START &&
+			btt_msg->command < BTT_GATT_CLIENT_CMD_RSP_END) {
+		handle_gatt_client_cmd(btt_msg, socket_client);
+	} else if (btt_msg->command > BTT_GATT_SERVER_CMD_RSP_START &&
+			btt_msg->command < BTT_GATT_SERVER_CMD_RSP_END) {
+		handle_gatt_server_cmd(btt_msg, socket_client);
+	} else {
+		struct btt_message btt_rsp;
+
+		BTT_LOG_W("Unknown command=%u with length=%u\n",
+				btt_msg->command, btt_msg->length);
+		btt_rsp.command = BTT_RSP_ERROR_UNKNOWN_COMMAND;
+		btt_rsp.length  = 0;
+		btt_rsp.request_id = btt_msg->request_id;
+
+		if (!btt_daemon_client_send(socket_client, &btt_rsp,
+				sizeof(struct btt_message)))
+			BTT_LOG_E("%s:System Socket Error 4\n", __FUNCTION__);
+	}
+}
+
+static void serve_client(int epoll_fd, int socket_server,
+		struct btt_daemon_client *client)
+{
+	struct btt_message *btt_msg;
+	uint64_t start_ns;
+
+	/* one read per wakeup, epoll is level triggered */
+	btt_framing_fill(&client->rx, MSG_DONTWAIT);
+
+	while ((btt_msg = btt_framing_next(&client->rx)) != NULL) {
+		if (btt_msg->command == BTT_CMD_DAEMON_STOP) {
+			btt_daemon_capture_stop();
+			btt_daemon_record_stop();
+			btt_daemon_clients_close_all();
+			close(epoll_fd);
+			close(socket_server);
+			exit(EXIT_SUCCESS);
+		}
+
+		start_ns = monotonic_ns();
+		dispatch_message(btt_msg, client->socket);
+		btt_daemon_client_done(client, monotonic_ns() - start_ns);
+	}
+
+	if (client->rx.closed) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->socket, NULL);
+		btt_daemon_client_remove(client);
+	}
+}
+
 void run_daemon_start(int argc, char **argv)
 {
 	int pid;
 	int sid;
 	int socket_server;
+	int epoll_fd;
 	struct sockaddr_un local;
-	struct sockaddr remote;
 	socklen_t len;
 	struct btt_message btt_msg;
-	struct btt_message *btt_rsp;
-	int length;
+	struct epoll_event ev;
+	struct epoll_event events[DAEMON_MAX_EVENTS];
+	int i_event;
+	int events_num;
 	bool nodetach = FALSE;
+	unsigned int ring_capacity = BTT_DAEMON_EVENTS_DEFAULT_CAPACITY;
+	unsigned int batch_events = BTT_DAEMON_BATCH_DEFAULT_EVENTS;
+	unsigned int batch_delay_us = BTT_DAEMON_BATCH_DEFAULT_DELAY_US;
 	char buff[256];
 	int fd[2];
 	char temp[3];
-
-	if (argc == 2 && strcmp("nodetach", argv[1]) == 0) {
-		nodetach = TRUE;
-	} else if (argc == 2) {
-		BTT_LOG_S("Error: Unknown argument <%s>\n", argv[1]);
-		return;
+	int i_arg;
+
+	for (i_arg = 1; i_arg < argc; i_arg++) {
+		if (strcmp("nodetach", argv[i_arg]) == 0) {
+			nodetach = TRUE;
+		} else if ((sscanf(argv[i_arg], "ring=%u", &ring_capacity) != 1 ||
+				ring_capacity == 0) &&
+				(sscanf(argv[i_arg], "batch=%u", &batch_events) != 1 ||
+				batch_events == 0) &&
+				sscanf(argv[i_arg], "delay=%u", &batch_delay_us) != 1) {
+			BTT_LOG_S("Error: Unknown argument <%s>\n", argv[i_arg]);
+			return;
+		}
 	}
 
 	btt_msg.command = BTT_CMD_DAEMON_CHECK;
 	btt_msg.length  = 0;
+	btt_msg.request_id = 0;
 
 	if (!nodetach) {
 
@@ -306,7 +620,7 @@ void run_daemon_start(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
-	if (listen(socket_server, 1) == -1) {
+	if (listen(socket_server, BTT_DAEMON_MAX_CLIENTS) == -1) {
 		BTT_LOG_E("Starting BTT daemon: FAIL (5)\n");
 		close(socket_server);
 
@@ -318,9 +632,32 @@ void run_daemon_start(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
-	len = sizeof(struct sockaddr_un);
+	fcntl(socket_server, F_SETFL,
+			fcntl(socket_server, F_GETFL) | O_NONBLOCK);
+	btt_daemon_registry_init();
+	epoll_fd = epoll_create(BTT_DAEMON_MAX_CLIENTS + 1);
+	btt_daemon_clients_init(epoll_fd);
+
+	/* data.ptr == NULL marks the listening socket */
+	ev.events   = EPOLLIN;
+	ev.data.ptr = NULL;
 
-	if (start_bluedroid_hal()) {
+	if (epoll_fd == -1 ||
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_server, &ev) == -1) {
+		BTT_LOG_E("Starting BTT daemon: FAIL (7)\n");
+		close(socket_server);
+
+		if (!nodetach) {
+			send(fd[0], ER, 3, 0);
+			close(fd[0]);
+		}
+
+		exit(EXIT_FAILURE);
+	}
+
+	/* callbacks may come as soon as the HAL is initialized */
+	if (!btt_daemon_events_init(ring_capacity, batch_events, batch_delay_us) ||
+			start_bluedroid_hal()) {
 		BTT_LOG_E("Starting BTT daemon: FAIL (6)\n");
 
 		if (!nodetach) {
@@ -340,64 +677,37 @@ void run_daemon_start(int argc, char **argv)
 	}
 
 	while (1) {
-		errno = 0;
 		BTT_LOG_D("Waiting for btt_messages\n");
-		socket_remote = accept(socket_server, &remote, &len);
+		events_num = epoll_wait(epoll_fd, events, DAEMON_MAX_EVENTS, -1);
 
-		while (1) {
-			BTT_LOG_D("Receving btt_message\n");
+		if (events_num == -1) {
+			if (errno == EINTR)
+				continue;
 
-			length = (int) recv(socket_remote, &btt_msg,
-					sizeof(struct btt_message), MSG_PEEK);
-			send(socket_remote, NULL, 0, MSG_NOSIGNAL);
+			BTT_LOG_E("%s:epoll_wait error\n", __FUNCTION__);
+			break;
+		}
 
-			if (errno == EPIPE)
-				break;
+		for (i_event = 0; i_event < events_num; i_event++) {
+			struct btt_daemon_client *client = events[i_event].data.ptr;
 
-			if (length <= 0) {
-				BTT_LOG_E("Received invalid btt_message\n");
-				break;
+			if (!client) {
+				accept_clients(epoll_fd, socket_server);
+				continue;
 			}
 
-			BTT_LOG_D("RECEIVE command=%u length=%i\n",
-					btt_msg.command, length);
+			if (events[i_event].events & EPOLLOUT)
+				btt_daemon_client_flush(client);
 
-			if (btt_msg.command == BTT_CMD_DAEMON_STOP) {
-				close(socket_remote);
-				close(socket_server);
-				exit(EXIT_SUCCESS);
-			}
-
-			/*start to handle different command here.*/
-			if (btt_msg.command > BTT_ADAPTER_CMD_RSP_START &&
-					btt_msg.command < BTT_ADAPTER_CMD_RSP_END) {
-				handle_adapter_cmd(&btt_msg, socket_remote);
-			} else if (btt_msg.command > BTT_GATT_CLIENT_CMD_RSP_START &&
-					btt_msg.command < BTT_GATT_CLIENT_CMD_RSP_END) {
-				list = list_clear(list, free);
-				handle_gatt_client_cmd(&btt_msg, socket_remote);
-			} else if (btt_msg.command > BTT_GATT_SERVER_CMD_RSP_START &&
-					btt_msg.command < BTT_GATT_SERVER_CMD_RSP_END) {
-				handle_gatt_server_cmd(&btt_msg, socket_remote);
-			} else {
-				BTT_LOG_W("Unknown command=%u with length=%u\n",
-						btt_msg.command, btt_msg.length);
-				btt_msg.command = BTT_RSP_ERROR_UNKNOWN_COMMAND;
-				btt_msg.length  = 0;
-				if (send(socket_remote, (const char *)&btt_msg,
-						sizeof(struct btt_message), 0) == -1) {
-					BTT_LOG_E("%s:System Socket Error 4\n", __FUNCTION__);
-				}
-				continue;
-			}
+			if (events[i_event].events & ~EPOLLOUT)
+				serve_client(epoll_fd, socket_server, client);
 		}
-		/*
-		 * Do NOT close socket here.
-		 * handle_l2cap_cmd(), handle_adapter_cmd() and handle_misc_cmd()
-		 * call asynchronous methods to handle their commands. Their
-		 * callback functions will use the socket and close it.
-		 */
 	}
+
+	btt_daemon_clients_close_all();
+	close(epoll_fd);
+	close(socket_server);
+	exit(EXIT_FAILURE);
 }
 
 void run_daemon_stop(int argc, char **argv)
@@ -407,18 +717,208 @@ void run_daemon_stop(int argc, char **argv)
 
 	btt_msg.command = BTT_CMD_DAEMON_STOP;
 	btt_msg.length = 0;
+	btt_msg.request_id = 0;
 
 	if (send(app_socket, (const char *)&btt_msg,
 			sizeof(struct btt_message), 0) == -1) {
 		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
 	}
 
-	/*free list*/
-	list_clear(list, free);
 	wait(&status);
 	unlink(SOCK_PATH);
 }
 
+static void run_daemon_stats(int argc, char **argv)
+{
+	struct btt_message btt_msg;
+
+	btt_msg.command = BTT_CMD_DAEMON_STATS;
+	btt_msg.length = 0;
+
+	if (send_request(app_socket, &btt_msg, sizeof(btt_msg)) == -1)
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
+
+/* move scan results and notifications to a shared ring */
+static void run_daemon_shm(int argc, char **argv)
+{
+	struct btt_msg_cmd_daemon_shm_open btt_msg;
+
+	btt_msg.hdr.command = BTT_CMD_DAEMON_SHM_OPEN;
+	btt_msg.hdr.length = sizeof(btt_msg) - sizeof(struct btt_message);
+	btt_msg.size = argc > 1 ? atoi(argv[1]) : 0;
+
+	if (send_request(app_socket, &btt_msg, sizeof(btt_msg)) == -1)
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
+
+/* daemon runs in /, relative path is taken from the current directory */
+static bool capture_path(const char *file, char *path)
+{
+	char cwd[BTT_CAPTURE_PATH_LEN];
+	int len;
+
+	if (file[0] == '/')
+		len = snprintf(path, BTT_CAPTURE_PATH_LEN, "%s", file);
+	else if (getcwd(cwd, sizeof(cwd)))
+		len = snprintf(path, BTT_CAPTURE_PATH_LEN, "%s/%s", cwd, file);
+	else
+		len = -1;
+
+	if (len < 0 || len >= BTT_CAPTURE_PATH_LEN) {
+		BTT_LOG_S("Error: path too long\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void run_daemon_capture(int argc, char **argv)
+{
+	struct btt_msg_cmd_daemon_capture btt_msg;
+
+	memset(&btt_msg, 0, sizeof(btt_msg));
+	btt_msg.hdr.command = BTT_CMD_DAEMON_CAPTURE;
+	btt_msg.hdr.length = sizeof(btt_msg) - sizeof(struct btt_message);
+	btt_msg.start = strcmp(argv[1], "stop") ? 1 : 0;
+
+	if (btt_msg.start && !capture_path(argv[1], btt_msg.path))
+		return;
+
+	if (send_request(app_socket, &btt_msg, sizeof(btt_msg)) == -1)
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
+
+static void run_daemon_record(int argc, char **argv)
+{
+	struct btt_msg_cmd_daemon_record btt_msg;
+
+	memset(&btt_msg, 0, sizeof(btt_msg));
+	btt_msg.hdr.command = BTT_CMD_DAEMON_RECORD;
+	btt_msg.hdr.length = sizeof(btt_msg) - sizeof(struct btt_message);
+	btt_msg.start = strcmp(argv[1], "stop") ? 1 : 0;
+
+	if (btt_msg.start && !capture_path(argv[1], btt_msg.path))
+		return;
+
+	if (argc > 2)
+		sscanf(argv[2], "%u", &btt_msg.size_mb);
+
+	if (argc > 3)
+		sscanf(argv[3], "%u", &btt_msg.sync_ms);
+
+	if (send_request(app_socket, &btt_msg, sizeof(btt_msg)) == -1)
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
+
+/* "max" replays as fast as the daemon takes it */
+static void run_daemon_replay(int argc, char **argv)
+{
+	struct btt_msg_cmd_daemon_replay btt_msg;
+
+	memset(&btt_msg, 0, sizeof(btt_msg));
+	btt_msg.hdr.command = BTT_CMD_DAEMON_REPLAY;
+	btt_msg.hdr.length = sizeof(btt_msg) - sizeof(struct btt_message);
+
+	if (argc > 2) {
+		if (strcmp(argv[2], "max")) {
+			BTT_LOG_S("Error: Unknown argument <%s>\n", argv[2]);
+			return;
+		}
+
+		btt_msg.max_speed = 1;
+	}
+
+	if (!capture_path(argv[1], btt_msg.path))
+		return;
+
+	if (send_request(app_socket, &btt_msg, sizeof(btt_msg)) == -1)
+		BTT_LOG_E("%s:System Socket Error\n", __FUNCTION__);
+}
+
+void handle_daemon_cb(const struct btt_message *btt_cb)
+{
+	switch (btt_cb->command) {
+	case BTT_RSP_DAEMON_STATS: {
+		struct btt_msg_rsp_daemon_stats stats;
+
+		if (!MSG_COPY(&stats, btt_cb)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		BTT_LOG_S("\nDAEMON: events=%" PRIu64 " dropped=%" PRIu64
+				" messages=%" PRIu64 " writes=%" PRIu64
+				" (%" PRIu64 ".%02" PRIu64 " messages per write)\n",
+				stats.events, stats.dropped, stats.messages, stats.writes,
+				stats.writes ? stats.messages / stats.writes : 0,
+				stats.writes ? stats.messages * 100 / stats.writes % 100 : 0);
+		BTT_LOG_S("DAEMON: shared=%" PRIu64 "\n", stats.shared);
+		BTT_LOG_S("DAEMON: ring=%u batch=%u delay=%uus\n", stats.capacity,
+				stats.batch_events, stats.batch_delay_us);
+		break;
+	}
+	case BTT_RSP_DAEMON_SHM_OPEN: {
+		struct btt_msg_rsp_daemon_shm_open rsp;
+		int mem_fd;
+		int event_fd;
+
+		if (!MSG_COPY(&rsp, btt_cb)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		mem_fd = btt_framing_take_fd(&app_rx);
+		event_fd = btt_framing_take_fd(&app_rx);
+		btt_shm_close(&app_shm);
+
+		if (!btt_shm_attach(&app_shm, mem_fd, event_fd)) {
+			BTT_LOG_S("\nDAEMON: cannot map shared ring\n");
+			return;
+		}
+
+		/* drained and armed by the main loop */
+		BTT_LOG_S("\nDAEMON: shared ring of %u bytes\n", rsp.size);
+		break;
+	}
+	case BTT_RSP_DAEMON_RECORD: {
+		struct btt_msg_rsp_daemon_record rsp;
+
+		if (!MSG_COPY(&rsp, btt_cb)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		if (rsp.stopped)
+			BTT_LOG_S("\nDAEMON: recording stopped, ");
+		else
+			BTT_LOG_S("\nDAEMON: recording %u/s, ", rsp.rate);
+
+		BTT_LOG_S("%" PRIu64 " notifications, %" PRIu64 " lost, %" PRIu64
+				" bytes\n", rsp.records, rsp.dropped, rsp.bytes);
+		break;
+	}
+	case BTT_RSP_DAEMON_REPLAY: {
+		struct btt_msg_rsp_daemon_replay rsp;
+		uint64_t ms;
+
+		if (!MSG_COPY(&rsp, btt_cb)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		ms = rsp.duration_ns / 1000000;
+		BTT_LOG_S("\nDAEMON: replayed %" PRIu64 " callbacks (%" PRIu64
+				" skipped) in %" PRIu64 " ms, %" PRIu64 " per second\n",
+				rsp.records, rsp.skipped, ms, rsp.duration_ns ?
+				rsp.records * 1000000000 / rsp.duration_ns : 0);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
 void run_daemon_restart(int argc, char **argv)
 {
 	run_daemon_stop(argc, argv);
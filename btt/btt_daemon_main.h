@@ -21,4 +21,5 @@
 
 extern void run_daemon(int argc, char **argv);
 extern int btt_daemon_get_number_of_commands(void);
+extern void handle_daemon_cb(const struct btt_message *btt_cb);
 
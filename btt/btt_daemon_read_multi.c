@@ -0,0 +1,320 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_utils.h"
+#include "btt_gatt_client.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_connections.h"
+#include "btt_daemon_read_multi.h"
+
+extern const btgatt_client_interface_t *gatt_client_if;
+
+/* read_multi: characteristics of the request are read in order, the
+ * callback of one read makes the next one, so the connection is never
+ * idle waiting for the client. Values are kept packed as they are sent
+ * and the whole batch is delivered at the end. Like in discover_all,
+ * a callback coming during the HAL call only marks the next read
+ * pending, it is made by the loop in run_read_multi. */
+
+#define READ_MULTI_SESSIONS 8
+
+struct read_multi {
+	bool active;
+	int conn_id;
+	int auth_req;
+	struct btt_gatt_read_multi_entry entry[BTT_GATT_READ_MULTI_MAX];
+	unsigned int num;
+	/* entry being read */
+	unsigned int cursor;
+	/* its read was sent, the callback is still to come */
+	bool reading;
+	unsigned int failed;
+	uint8_t *values;
+	size_t len;
+	uint64_t start_ns;
+	bool in_call;
+	bool pending;
+};
+
+static pthread_mutex_t read_multi_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct read_multi sessions[READ_MULTI_SESSIONS];
+/* connections of the finished sessions, held until the lock is left */
+static int finished[READ_MULTI_SESSIONS];
+static unsigned int finished_num;
+
+/* must be called under read_multi_lock */
+static struct read_multi *find_session(int conn_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < READ_MULTI_SESSIONS; i++)
+		if (sessions[i].active && sessions[i].conn_id == conn_id)
+			return &sessions[i];
+
+	return NULL;
+}
+
+/* Connections of the sessions finished under the lock are given back
+ * after it is left, operations queued on them are sent then and their
+ * callbacks may come before the HAL call returns. */
+static void unlock_and_release(void)
+{
+	int conn_ids[READ_MULTI_SESSIONS];
+	unsigned int num = finished_num;
+	unsigned int i;
+
+	memcpy(conn_ids, finished, num * sizeof(conn_ids[0]));
+	finished_num = 0;
+	pthread_mutex_unlock(&read_multi_lock);
+
+	for (i = 0; i < num; i++)
+		btt_daemon_connections_release(conn_ids[i]);
+}
+
+static bool same_read(const struct btt_gatt_read_multi_entry *entry,
+		const btgatt_read_params_t *p_data)
+{
+	return !memcmp(&entry->char_id, &p_data->char_id,
+			sizeof(p_data->char_id)) &&
+			!memcmp(&entry->srvc_id, &p_data->srvc_id,
+					sizeof(p_data->srvc_id));
+}
+
+/* result of the entry under cursor, moves the cursor */
+static void add_value(struct read_multi *session, int status,
+		uint16_t value_type, const uint8_t *value, uint16_t len)
+{
+	struct btt_gatt_read_multi_value header;
+
+	if (status != BT_STATUS_SUCCESS) {
+		session->failed++;
+		len = 0;
+	}
+
+	header.index = session->cursor++;
+	header.value_type = value_type;
+	header.len = len;
+	header.status = status;
+	header.reserved = 0;
+
+	memcpy(session->values + session->len, &header, sizeof(header));
+	memcpy(session->values + session->len + sizeof(header), value, len);
+	session->len += sizeof(header) + len;
+}
+
+static void send_part(struct btt_gatt_client_cb_read_multi *cb)
+{
+	TRIM_TRAILER(*cb, data, cb->len);
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			cb->conn_id, cb, MSG_SIZE(*cb));
+	cb->num = 0;
+	cb->len = 0;
+}
+
+/* must be called under read_multi_lock, sends the values and frees
+ * the session */
+static void finish(struct read_multi *session, int status)
+{
+	struct btt_gatt_client_cb_read_multi cb;
+	struct btt_gatt_client_cb_read_multi_complete complete;
+	struct btt_gatt_read_multi_value header;
+	size_t offset;
+	size_t len;
+
+	FILL_HDR(cb, BTT_GATT_CLIENT_CB_READ_MULTI);
+	cb.conn_id = session->conn_id;
+	cb.num = 0;
+	cb.len = 0;
+
+	/* values are never split between parts */
+	for (offset = 0; offset < session->len; offset += len) {
+		memcpy(&header, session->values + offset, sizeof(header));
+		len = sizeof(header) + header.len;
+
+		if (cb.len + len > BTT_GATT_READ_MULTI_DATA_LEN)
+			send_part(&cb);
+
+		memcpy(cb.data + cb.len, session->values + offset, len);
+		cb.len += len;
+		cb.num++;
+	}
+
+	if (cb.num)
+		send_part(&cb);
+
+	FILL_HDR(complete, BTT_GATT_CLIENT_CB_READ_MULTI_COMPLETE);
+	complete.conn_id = session->conn_id;
+	complete.status = status;
+	complete.num = session->cursor;
+	complete.failed = session->failed;
+	complete.duration_ms = (monotonic_ns() - session->start_ns) / 1000000;
+
+	BTT_LOG_I("Read %u characteristics of conn_id=%d in %u ms, "
+			"%u failed, status=%d\n", complete.num, session->conn_id,
+			complete.duration_ms, complete.failed, status);
+
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			session->conn_id, &complete, sizeof(complete));
+
+	if (finished_num < READ_MULTI_SESSIONS)
+		finished[finished_num++] = session->conn_id;
+
+	free(session->values);
+	memset(session, 0, sizeof(*session));
+}
+
+/* Must be called under read_multi_lock, the lock is released during
+ * the HAL call. Reads made pending meanwhile are made here too. */
+static void run_read_multi(struct read_multi *session)
+{
+	struct btt_gatt_read_multi_entry entry;
+	int conn_id = session->conn_id;
+	int auth_req = session->auth_req;
+	bt_status_t status;
+
+	do {
+		session->pending = FALSE;
+
+		if (session->cursor == session->num) {
+			finish(session, BT_STATUS_SUCCESS);
+			return;
+		}
+
+		entry = session->entry[session->cursor];
+		session->reading = TRUE;
+		session->in_call = TRUE;
+		pthread_mutex_unlock(&read_multi_lock);
+
+		status = gatt_client_if->read_characteristic(conn_id,
+				&entry.srvc_id, &entry.char_id, auth_req);
+
+		pthread_mutex_lock(&read_multi_lock);
+
+		/* disconnected meanwhile */
+		if (!session->active || session->conn_id != conn_id)
+			return;
+
+		session->in_call = FALSE;
+
+		/* no callback comes, the next one is read */
+		if (status != BT_STATUS_SUCCESS && session->reading) {
+			session->reading = FALSE;
+			add_value(session, status, 0, NULL, 0);
+			session->pending = TRUE;
+		}
+	} while (session->pending);
+}
+
+bt_status_t btt_daemon_read_multi_start(
+		const struct btt_gatt_client_read_multi *msg)
+{
+	struct read_multi *session = NULL;
+	unsigned int i;
+	bt_status_t status;
+
+	if (!msg->num || msg->num > BTT_GATT_READ_MULTI_MAX)
+		return BT_STATUS_PARM_INVALID;
+
+	/* operations of clients wait until the values are sent */
+	status = btt_daemon_connections_hold(msg->conn_id);
+
+	if (status != BT_STATUS_SUCCESS)
+		return status;
+
+	pthread_mutex_lock(&read_multi_lock);
+
+	if (find_session(msg->conn_id)) {
+		pthread_mutex_unlock(&read_multi_lock);
+		btt_daemon_connections_release(msg->conn_id);
+		BTT_LOG_W("Read multi of conn_id=%d is running already\n",
+				msg->conn_id);
+		return BT_STATUS_BUSY;
+	}
+
+	for (i = 0; i < READ_MULTI_SESSIONS && !session; i++)
+		if (!sessions[i].active)
+			session = &sessions[i];
+
+	if (!session || !(session->values = malloc(msg->num *
+			(sizeof(struct btt_gatt_read_multi_value) +
+			BTGATT_MAX_ATTR_LEN)))) {
+		pthread_mutex_unlock(&read_multi_lock);
+		btt_daemon_connections_release(msg->conn_id);
+		return BT_STATUS_NOMEM;
+	}
+
+	session->active = TRUE;
+	session->conn_id = msg->conn_id;
+	session->auth_req = msg->auth_req;
+	session->num = msg->num;
+	memcpy(session->entry, msg->entry, msg->num * sizeof(msg->entry[0]));
+	session->start_ns = monotonic_ns();
+	run_read_multi(session);
+
+	unlock_and_release();
+
+	return BT_STATUS_SUCCESS;
+}
+
+bool btt_daemon_read_multi_read(int conn_id, int status,
+		const btgatt_read_params_t *p_data)
+{
+	struct read_multi *session;
+	uint16_t len = p_data->value.len;
+
+	pthread_mutex_lock(&read_multi_lock);
+
+	session = find_session(conn_id);
+
+	/* not the read in flight, e.g. one of a client */
+	if (!session || !session->reading || !same_read(
+			&session->entry[session->cursor], p_data)) {
+		unlock_and_release();
+		return FALSE;
+	}
+
+	session->reading = FALSE;
+
+	if (len > BTGATT_MAX_ATTR_LEN)
+		len = BTGATT_MAX_ATTR_LEN;
+
+	add_value(session, status, p_data->value_type, p_data->value.value,
+			len);
+
+	if (session->in_call)
+		session->pending = TRUE;
+	else
+		run_read_multi(session);
+
+	unlock_and_release();
+
+	return TRUE;
+}
+
+/* values read so far are sent with the error */
+void btt_daemon_read_multi_disconnect(int conn_id)
+{
+	struct read_multi *session;
+
+	pthread_mutex_lock(&read_multi_lock);
+
+	if ((session = find_session(conn_id)) != NULL)
+		finish(session, BT_STATUS_FAIL);
+
+	unlock_and_release();
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_READ_MULTI_H
+#error Included twice
+#endif
+#define BTT_DAEMON_READ_MULTI_H
+
+/* requires btt_gatt_client.h */
+
+extern bt_status_t btt_daemon_read_multi_start(
+		const struct btt_gatt_client_read_multi *msg);
+
+/* Called by the HAL callback, return TRUE if the read belongs
+ * to a read_multi and must not be delivered to clients. */
+extern bool btt_daemon_read_multi_read(int conn_id, int status,
+		const btgatt_read_params_t *p_data);
+extern void btt_daemon_read_multi_disconnect(int conn_id);
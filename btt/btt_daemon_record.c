@@ -0,0 +1,368 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/mman.h>
+#include <hardware/bt_gatt.h>
+
+#include "btt_utils.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_record.h"
+
+/* Recording: notifications are copied straight into the file mapped
+ * in memory, preallocated when the recording starts, so notify_cb
+ * never waits for the disk or for a client. The sync thread flushes
+ * the new pages every sync_ms and reports the rate and the losses
+ * instead of the notifications. Full file drops the rest. */
+
+/* attributes numbered by the recording, the rest gets handle 0 */
+#define RECORD_MAX_ATTRIBUTES 1024
+#define RECORD_ALIGN(len) (((len) + 7) & ~((size_t) 7))
+
+struct record_attribute {
+	int conn_id;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+};
+
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+/* wakes the sync thread up, uses CLOCK_MONOTONIC */
+static pthread_cond_t record_cond;
+static pthread_t record_thread;
+/* start and stop come from the main thread only */
+static int record_fd = -1;
+static bool recording;
+static bool record_stopping;
+static uint8_t *map;
+static size_t map_len;
+static struct btt_record_header *header;
+static unsigned int sync_ms;
+static struct record_attribute attributes[RECORD_MAX_ATTRIBUTES];
+static unsigned int attributes_num;
+static unsigned int last_handle;
+
+static void report(uint64_t records, uint64_t dropped, uint64_t bytes,
+		uint32_t rate, bool stopped)
+{
+	struct btt_msg_rsp_daemon_record rsp;
+
+	FILL_HDR(rsp, BTT_RSP_DAEMON_RECORD);
+	rsp.records = records;
+	rsp.dropped = dropped;
+	rsp.bytes = bytes;
+	rsp.rate = rate;
+	rsp.stopped = stopped;
+
+	/* to whoever would get the notifications */
+	btt_daemon_deliver(BTT_EVENT_GATTC, BTT_DAEMON_KEY_GATTC_CONN_ID,
+			BTT_DAEMON_ANY_ID, &rsp, sizeof(rsp));
+}
+
+static void *record_sync(void *arg)
+{
+	struct timespec deadline;
+	uint64_t wake_ns;
+	uint64_t last_ns = monotonic_ns();
+	uint64_t last_records = 0;
+	uint64_t now_ns;
+	uint64_t records;
+	uint64_t dropped;
+	size_t page_mask = ~((size_t) sysconf(_SC_PAGESIZE) - 1);
+	size_t synced = 0;
+	size_t end;
+	bool stopping;
+
+	pthread_mutex_lock(&record_lock);
+
+	do {
+		wake_ns = monotonic_ns() + sync_ms * 1000000ull;
+		deadline.tv_sec = wake_ns / 1000000000;
+		deadline.tv_nsec = wake_ns % 1000000000;
+
+		while (!record_stopping && pthread_cond_timedwait(&record_cond,
+				&record_lock, &deadline) != ETIMEDOUT)
+			;
+
+		stopping = record_stopping;
+		end = header->end;
+		records = header->records;
+		dropped = header->dropped;
+
+		pthread_mutex_unlock(&record_lock);
+
+		/* from the page with the previous end, header included */
+		if (msync(map, sizeof(*header), MS_ASYNC) == -1 ||
+				(end > synced && msync(map + (synced & page_mask),
+				end - (synced & page_mask), MS_ASYNC) == -1))
+			BTT_LOG_E("%s: msync error %s\n", __FUNCTION__, strerror(errno));
+
+		synced = end;
+		now_ns = monotonic_ns();
+
+		if (!stopping)
+			report(records, dropped, end, (records - last_records) *
+					1000000000 / (now_ns - last_ns + 1), FALSE);
+
+		last_ns = now_ns;
+		last_records = records;
+
+		pthread_mutex_lock(&record_lock);
+	} while (!stopping);
+
+	pthread_mutex_unlock(&record_lock);
+
+	return arg;
+}
+
+/* Previous recording is stopped. The file is truncated and allocated
+ * in full, path has to be absolute as the daemon runs in /. */
+bool btt_daemon_record_start(const char *path, unsigned int size_mb,
+		unsigned int sync)
+{
+	pthread_condattr_t attr;
+	struct stat st;
+	uint64_t bytes;
+	size_t len;
+	int fd;
+	int err;
+
+	btt_daemon_record_stop();
+
+	if (!size_mb)
+		size_mb = BTT_RECORD_DEFAULT_SIZE_MB;
+
+	/* in 64 bits, size_t and off_t of a 32-bit daemon must hold it */
+	bytes = (uint64_t) size_mb * 1024 * 1024;
+	len = bytes;
+
+	if (size_mb > BTT_RECORD_MAX_SIZE_MB || len != bytes ||
+			(off_t) bytes < 0 || (uint64_t) (off_t) bytes != bytes) {
+		BTT_LOG_E("Recording can have at most %u MB\n",
+				BTT_RECORD_MAX_SIZE_MB);
+		return FALSE;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd == -1) {
+		BTT_LOG_E("Cannot create recording %s: %s\n", path, strerror(errno));
+		return FALSE;
+	}
+
+	/* Not every file system can allocate, a sparse file is used then.
+	 * Any other error, e.g. no space, would be SIGBUS in the map. */
+	if ((err = posix_fallocate(fd, 0, len)) == EOPNOTSUPP ||
+			err == EINVAL) {
+		BTT_LOG_W("Recording %s is sparse: %s\n", path, strerror(err));
+		err = ftruncate(fd, len) == -1 ? errno : 0;
+	}
+
+	if (!err && (fstat(fd, &st) == -1 || (size_t) st.st_size < len))
+		err = EIO;
+
+	if (err) {
+		BTT_LOG_E("Cannot allocate %u MB for %s: %s\n", size_mb, path,
+				strerror(err));
+		close(fd);
+		unlink(path);
+		return FALSE;
+	}
+
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (map == MAP_FAILED) {
+		BTT_LOG_E("Cannot map recording %s: %s\n", path, strerror(errno));
+		close(fd);
+		unlink(path);
+		return FALSE;
+	}
+
+	map_len = len;
+	header = (struct btt_record_header *) map;
+	header->magic = BTT_RECORD_MAGIC;
+	header->version = BTT_RECORD_VERSION;
+	header->size = len;
+	header->end = sizeof(*header);
+	header->records = 0;
+	header->dropped = 0;
+	header->start_ns = monotonic_ns();
+
+	sync_ms = sync ? sync : BTT_RECORD_DEFAULT_SYNC_MS;
+	attributes_num = 0;
+	last_handle = 0;
+	record_stopping = FALSE;
+	record_fd = fd;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&record_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&record_thread, NULL, record_sync, NULL)) {
+		BTT_LOG_E("Cannot start recording sync thread\n");
+		pthread_cond_destroy(&record_cond);
+		munmap(map, map_len);
+		close(fd);
+		unlink(path);
+		record_fd = -1;
+		return FALSE;
+	}
+
+	__atomic_store_n(&recording, TRUE, __ATOMIC_RELEASE);
+	BTT_LOG_I("Recording notifications into %s, %u MB\n", path, size_mb);
+
+	return TRUE;
+}
+
+/* the file is synced and cut after the last record */
+void btt_daemon_record_stop(void)
+{
+	uint64_t records;
+	uint64_t dropped;
+	uint64_t end;
+
+	if (record_fd == -1)
+		return;
+
+	pthread_mutex_lock(&record_lock);
+	__atomic_store_n(&recording, FALSE, __ATOMIC_RELAXED);
+	record_stopping = TRUE;
+	pthread_cond_signal(&record_cond);
+	pthread_mutex_unlock(&record_lock);
+
+	pthread_join(record_thread, NULL);
+	pthread_cond_destroy(&record_cond);
+
+	end = header->end;
+	records = header->records;
+	dropped = header->dropped;
+	header->size = end;
+
+	if (msync(map, map_len, MS_SYNC) == -1 || ftruncate(record_fd, end) == -1)
+		BTT_LOG_E("%s: %s\n", __FUNCTION__, strerror(errno));
+
+	munmap(map, map_len);
+	close(record_fd);
+	record_fd = -1;
+	map = NULL;
+	header = NULL;
+
+	report(records, dropped, end, 0, TRUE);
+
+	BTT_LOG_I("Recording stopped, %" PRIu64 " records, %" PRIu64
+			" dropped\n", records, dropped);
+}
+
+/* must be called under record_lock, FALSE if the file is full */
+static bool put_record(int conn_id, unsigned int handle,
+		enum btt_record_type type, const void *value, uint16_t len,
+		uint64_t time_ns)
+{
+	struct btt_record *record;
+	size_t end = header->end;
+
+	if (end + RECORD_ALIGN(sizeof(*record) + len) > map_len)
+		return FALSE;
+
+	record = (struct btt_record *) (map + end);
+	record->time_ns = time_ns;
+	record->conn_id = conn_id;
+	record->handle = handle;
+	record->len = len;
+	record->type = type;
+	record->reserved = 0;
+	memcpy(record + 1, value, len);
+
+	__atomic_store_n(&header->end, end + RECORD_ALIGN(sizeof(*record) + len),
+			__ATOMIC_RELEASE);
+
+	return TRUE;
+}
+
+/* Must be called under record_lock. New attribute is defined by its
+ * record first, 0 if there is no room for it. */
+static unsigned int attribute_handle(int conn_id,
+		const btgatt_notify_params_t *p_data, uint64_t time_ns)
+{
+	struct record_attribute *attribute;
+	struct btt_record_attribute definition;
+	unsigned int i;
+
+	/* notifications mostly come from the same attribute in a row */
+	for (i = 0; i < attributes_num; i++) {
+		attribute = &attributes[(last_handle + i) % attributes_num];
+
+		if (attribute->conn_id == conn_id &&
+				!memcmp(&attribute->char_id, &p_data->char_id,
+						sizeof(p_data->char_id)) &&
+				!memcmp(&attribute->srvc_id, &p_data->srvc_id,
+						sizeof(p_data->srvc_id))) {
+			last_handle = (last_handle + i) % attributes_num;
+			return last_handle + 1;
+		}
+	}
+
+	if (attributes_num == RECORD_MAX_ATTRIBUTES)
+		return 0;
+
+	definition.bda = p_data->bda;
+	definition.srvc_id = p_data->srvc_id;
+	definition.char_id = p_data->char_id;
+
+	if (!put_record(conn_id, attributes_num + 1, BTT_RECORD_ATTRIBUTE,
+			&definition, sizeof(definition), time_ns))
+		return 0;
+
+	attribute = &attributes[attributes_num];
+	attribute->conn_id = conn_id;
+	attribute->srvc_id = p_data->srvc_id;
+	attribute->char_id = p_data->char_id;
+	last_handle = attributes_num++;
+
+	return last_handle + 1;
+}
+
+bool btt_daemon_record_notify(int conn_id,
+		const btgatt_notify_params_t *p_data)
+{
+	uint64_t time_ns;
+	unsigned int handle;
+
+	if (!__atomic_load_n(&recording, __ATOMIC_RELAXED))
+		return FALSE;
+
+	time_ns = monotonic_ns();
+
+	pthread_mutex_lock(&record_lock);
+
+	if (!recording) {
+		pthread_mutex_unlock(&record_lock);
+		return FALSE;
+	}
+
+	handle = attribute_handle(conn_id, p_data, time_ns);
+
+	if (put_record(conn_id, handle, p_data->is_notify ? BTT_RECORD_NOTIFY :
+			BTT_RECORD_INDICATE, p_data->value, p_data->len, time_ns))
+		header->records++;
+	else
+		header->dropped++;
+
+	pthread_mutex_unlock(&record_lock);
+
+	return TRUE;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_RECORD_H
+#error Included twice
+#endif
+#define BTT_DAEMON_RECORD_H
+
+/* requires hardware/bt_gatt.h */
+
+/* "BNRC", file starts with btt_record_header, records follow */
+#define BTT_RECORD_MAGIC 0x43524E42
+#define BTT_RECORD_VERSION 1
+#define BTT_RECORD_DEFAULT_SIZE_MB 64
+/* the whole file is mapped, a 32-bit daemon has to find room for it */
+#define BTT_RECORD_MAX_SIZE_MB 512
+#define BTT_RECORD_DEFAULT_SYNC_MS 1000
+
+enum btt_record_type {
+	BTT_RECORD_NOTIFY = 1,
+	BTT_RECORD_INDICATE,
+	BTT_RECORD_ATTRIBUTE
+};
+
+/* end is stored after every record, the file can be followed
+ * while it is written */
+struct btt_record_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	uint64_t end;
+	uint64_t records;
+	uint64_t dropped;
+	/* CLOCK_MONOTONIC of the start */
+	uint64_t start_ns;
+};
+
+/* followed by len bytes of the value, records are 8 bytes aligned */
+struct btt_record {
+	uint64_t time_ns;
+	uint16_t conn_id;
+	/* numbered by the recording, see BTT_RECORD_ATTRIBUTE */
+	uint16_t handle;
+	uint16_t len;
+	uint8_t type;
+	uint8_t reserved;
+};
+
+/* Value of BTT_RECORD_ATTRIBUTE, written before the first notification
+ * of the attribute. HAL does not tell the attribute handles. */
+struct btt_record_attribute {
+	bt_bdaddr_t bda;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+};
+
+extern bool btt_daemon_record_start(const char *path, unsigned int size_mb,
+		unsigned int sync_ms);
+extern void btt_daemon_record_stop(void);
+
+/* Called by notify_cb, return TRUE if the notification is recorded
+ * (or lost) and must not be delivered to clients. */
+extern bool btt_daemon_record_notify(int conn_id,
+		const btgatt_notify_params_t *p_data);
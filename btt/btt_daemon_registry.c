@@ -0,0 +1,506 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/uio.h>
+
+#include "btt_utils.h"
+#include "btt_framing.h"
+#include "btt_shm.h"
+#include "btt_daemon_clients.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+
+/* Commands are handled on the main thread, HAL callbacks run on the stack
+ * threads and events are sent from the event writer thread, so every
+ * access to the tables below is done under the lock. No socket is written
+ * under it, a client which does not read can not block the HAL.
+ * Sockets are closed only after btt_daemon_registry_drop under the lock
+ * of the clients, which the event writer holds while it writes, so an
+ * event is never written to a descriptor which was already reused. */
+
+struct btt_daemon_watcher {
+	int socket;
+	unsigned int events;
+};
+
+struct btt_daemon_subscription {
+	int socket;
+	enum btt_daemon_key key;
+	int id;
+	bt_uuid_t uuid;
+};
+
+/* events of one batch going to one client */
+struct btt_daemon_outbox {
+	int socket;
+	int iovcnt;
+	size_t length;
+	struct iovec iov[BTT_DAEMON_BATCH_IOV];
+};
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct btt_daemon_watcher watchers[BTT_DAEMON_MAX_CLIENTS];
+static struct btt_daemon_subscription subscriptions[BTT_DAEMON_MAX_SUBSCRIPTIONS];
+/* shared ring of a client, see BTT_CMD_DAEMON_SHM_OPEN */
+struct btt_daemon_channel {
+	int socket;
+	bool dirty;
+	struct btt_shm shm;
+};
+
+static struct btt_daemon_channel channels[BTT_DAEMON_MAX_CLIENTS];
+static uint64_t shared;
+/* used by the event writer thread only */
+static struct btt_daemon_outbox outboxes[BTT_DAEMON_MAX_CLIENTS];
+static unsigned int outboxes_num;
+static uint64_t messages;
+static uint64_t writes;
+
+void btt_daemon_registry_init(void)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&registry_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+		watchers[i].socket = -1;
+		watchers[i].events = 0;
+	}
+
+	for (i = 0; i < BTT_DAEMON_MAX_SUBSCRIPTIONS; i++) {
+		subscriptions[i].socket = -1;
+		subscriptions[i].key = BTT_DAEMON_KEY_NONE;
+	}
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+		channels[i].socket = -1;
+		btt_shm_init(&channels[i].shm);
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/* must be called under registry_lock */
+static struct btt_daemon_watcher *find_watcher(int socket, bool create)
+{
+	struct btt_daemon_watcher *free_watcher = NULL;
+	unsigned int i;
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+		if (watchers[i].socket == socket)
+			return &watchers[i];
+
+		if (watchers[i].socket == -1 && !free_watcher)
+			free_watcher = &watchers[i];
+	}
+
+	if (create && free_watcher) {
+		free_watcher->socket = socket;
+		free_watcher->events = 0;
+		return free_watcher;
+	}
+
+	return NULL;
+}
+
+void btt_daemon_registry_watch(int socket, unsigned int events)
+{
+	struct btt_daemon_watcher *watcher;
+
+	pthread_mutex_lock(&registry_lock);
+	watcher = find_watcher(socket, TRUE);
+
+	if (watcher)
+		watcher->events |= events;
+	else
+		BTT_LOG_W("No room to watch events for socket=%d\n", socket);
+
+	pthread_mutex_unlock(&registry_lock);
+}
+
+void btt_daemon_registry_unwatch(int socket, unsigned int events)
+{
+	struct btt_daemon_watcher *watcher;
+
+	pthread_mutex_lock(&registry_lock);
+	watcher = find_watcher(socket, FALSE);
+
+	if (watcher) {
+		watcher->events &= ~events;
+
+		if (!watcher->events)
+			watcher->socket = -1;
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/* must be called under registry_lock */
+static struct btt_daemon_subscription *add_subscription(int socket,
+		enum btt_daemon_key key, int id, const bt_uuid_t *uuid)
+{
+	struct btt_daemon_subscription *free_subscription = NULL;
+	unsigned int i;
+
+	for (i = 0; i < BTT_DAEMON_MAX_SUBSCRIPTIONS; i++) {
+		struct btt_daemon_subscription *sub = &subscriptions[i];
+
+		if (sub->socket == -1) {
+			if (!free_subscription)
+				free_subscription = sub;
+
+			continue;
+		}
+
+		if (sub->socket == socket && sub->key == key && sub->id == id &&
+				(!uuid || !memcmp(&sub->uuid, uuid, sizeof(*uuid))))
+			return sub;
+	}
+
+	if (!free_subscription) {
+		BTT_LOG_W("Too many subscriptions, socket=%d key=%d id=%d\n",
+				socket, key, id);
+		return NULL;
+	}
+
+	free_subscription->socket = socket;
+	free_subscription->key = key;
+	free_subscription->id = id;
+
+	if (uuid)
+		free_subscription->uuid = *uuid;
+
+	return free_subscription;
+}
+
+void btt_daemon_registry_claim(int socket, enum btt_daemon_key key, int id)
+{
+	pthread_mutex_lock(&registry_lock);
+	add_subscription(socket, key, id, NULL);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+void btt_daemon_registry_claim_uuid(int socket, enum btt_daemon_key key,
+		const bt_uuid_t *uuid)
+{
+	pthread_mutex_lock(&registry_lock);
+	add_subscription(socket, key, 0, uuid);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/* registration finished: who asked for uuid now owns the given id */
+void btt_daemon_registry_bind_uuid(enum btt_daemon_key uuid_key,
+		const bt_uuid_t *uuid, enum btt_daemon_key key, int id)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&registry_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_SUBSCRIPTIONS; i++) {
+		struct btt_daemon_subscription *sub = &subscriptions[i];
+
+		if (sub->socket == -1 || sub->key != uuid_key ||
+				memcmp(&sub->uuid, uuid, sizeof(*uuid)))
+			continue;
+
+		sub->key = key;
+		sub->id = id;
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/* every owner of parent becomes an owner of key/id too,
+ * e.g. connection is owned by owners of its client_if */
+void btt_daemon_registry_inherit(enum btt_daemon_key key, int id,
+		enum btt_daemon_key parent_key, int parent_id)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&registry_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_SUBSCRIPTIONS; i++) {
+		struct btt_daemon_subscription *sub = &subscriptions[i];
+
+		if (sub->socket != -1 && sub->key == parent_key &&
+				sub->id == parent_id)
+			add_subscription(sub->socket, key, id, NULL);
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+}
+
+void btt_daemon_registry_forget(enum btt_daemon_key key, int id)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&registry_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_SUBSCRIPTIONS; i++) {
+		if (subscriptions[i].key == key && subscriptions[i].id == id)
+			subscriptions[i].socket = -1;
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/* must be called under registry_lock */
+static struct btt_daemon_channel *find_channel(int socket)
+{
+	unsigned int i;
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+		if (channels[i].socket == socket)
+			return &channels[i];
+	}
+
+	return NULL;
+}
+
+/* stream events for socket go to shm from now on, registry owns it */
+bool btt_daemon_registry_attach_shm(int socket, const struct btt_shm *shm)
+{
+	struct btt_daemon_channel *channel;
+
+	pthread_mutex_lock(&registry_lock);
+
+	channel = find_channel(socket);
+
+	if (channel)
+		btt_shm_close(&channel->shm);
+	else
+		channel = find_channel(-1);
+
+	if (channel) {
+		channel->socket = socket;
+		channel->dirty = FALSE;
+		channel->shm = *shm;
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+
+	return channel != NULL;
+}
+
+/* client is going away, must be called before its socket is closed */
+void btt_daemon_registry_drop(int socket)
+{
+	struct btt_daemon_channel *channel;
+	unsigned int i;
+
+	pthread_mutex_lock(&registry_lock);
+
+	channel = find_channel(socket);
+
+	if (channel) {
+		btt_shm_close(&channel->shm);
+		channel->socket = -1;
+	}
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+		if (watchers[i].socket == socket)
+			watchers[i].socket = -1;
+	}
+
+	for (i = 0; i < BTT_DAEMON_MAX_SUBSCRIPTIONS; i++) {
+		if (subscriptions[i].socket == socket)
+			subscriptions[i].socket = -1;
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+}
+
+static void add_target(int *targets, unsigned int *targets_num, int socket)
+{
+	unsigned int i;
+
+	for (i = 0; i < *targets_num; i++) {
+		if (targets[i] == socket)
+			return;
+	}
+
+	if (*targets_num < BTT_DAEMON_MAX_CLIENTS)
+		targets[(*targets_num)++] = socket;
+}
+
+/* must be called under the lock of the clients, not under registry_lock */
+static void flush_outbox(struct btt_daemon_outbox *outbox)
+{
+	if (!outbox->iovcnt)
+		return;
+
+	btt_daemon_client_sendv_locked(outbox->socket, outbox->iov,
+			outbox->iovcnt);
+
+	__atomic_add_fetch(&writes, 1, __ATOMIC_RELAXED);
+	outbox->iovcnt = 0;
+	outbox->length = 0;
+}
+
+static void add_iov(struct btt_daemon_outbox *outbox, const void *base,
+		size_t len)
+{
+	outbox->iov[outbox->iovcnt].iov_base = (void *) base;
+	outbox->iov[outbox->iovcnt].iov_len = len;
+	outbox->iovcnt += 1;
+	outbox->length += len;
+}
+
+/* request_id is private to the client which sent the request,
+ * only origin gets the event with it, the others see 0 */
+static void post_event(int socket, const struct btt_daemon_event *event)
+{
+	struct btt_daemon_outbox *outbox = NULL;
+	struct btt_daemon_channel *channel;
+	unsigned int i;
+
+	/* origin needs its request_id, which only the socket path stamps */
+	if ((event->events & BTT_DAEMON_EVENT_STREAM) && socket != event->origin &&
+			(channel = find_channel(socket)) != NULL) {
+		if (btt_shm_put(&channel->shm, event->data, event->length)) {
+			channel->dirty = TRUE;
+			__atomic_add_fetch(&shared, 1, __ATOMIC_RELAXED);
+		}
+
+		return;
+	}
+
+	for (i = 0; i < outboxes_num; i++) {
+		if (outboxes[i].socket == socket) {
+			outbox = &outboxes[i];
+			break;
+		}
+	}
+
+	if (!outbox) {
+		if (outboxes_num == BTT_DAEMON_MAX_CLIENTS)
+			return;
+
+		outbox = &outboxes[outboxes_num++];
+		outbox->socket = socket;
+		outbox->iovcnt = 0;
+		outbox->length = 0;
+	}
+
+	if (socket == event->origin && event->origin_hdr.request_id) {
+		add_iov(outbox, &event->origin_hdr, sizeof(event->origin_hdr));
+		add_iov(outbox, event->data + sizeof(event->origin_hdr),
+				event->length - sizeof(event->origin_hdr));
+	} else {
+		add_iov(outbox, event->data, event->length);
+	}
+
+	__atomic_add_fetch(&messages, 1, __ATOMIC_RELAXED);
+}
+
+/* must be called under registry_lock */
+static bool outboxes_full(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < outboxes_num; i++)
+		if (outboxes[i].iovcnt + 2 > BTT_DAEMON_BATCH_IOV)
+			return TRUE;
+
+	return FALSE;
+}
+
+/* Send a batch of already encoded events, each one to watchers of its
+ * events, to owners of its key/id and to the origin of the request it
+ * completes. Every client gets an event at most once and the whole
+ * batch in one write, unless it does not fit into its iovecs. Runs on
+ * the event writer thread. */
+void btt_daemon_registry_deliver(struct btt_daemon_event **batch,
+		unsigned int num)
+{
+	int targets[BTT_DAEMON_MAX_CLIENTS];
+	unsigned int targets_num;
+	unsigned int i;
+	unsigned int n = 0;
+
+	btt_daemon_clients_lock();
+
+next_part:
+	pthread_mutex_lock(&registry_lock);
+
+	outboxes_num = 0;
+
+	for (; n < num && !outboxes_full(); n++) {
+		const struct btt_daemon_event *event = batch[n];
+
+		targets_num = 0;
+
+		if (event->origin != -1)
+			add_target(targets, &targets_num, event->origin);
+
+		for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+			if (watchers[i].socket != -1 &&
+					(watchers[i].events & event->events))
+				add_target(targets, &targets_num, watchers[i].socket);
+		}
+
+		for (i = 0; event->key != BTT_DAEMON_KEY_NONE &&
+				i < BTT_DAEMON_MAX_SUBSCRIPTIONS; i++) {
+			struct btt_daemon_subscription *sub = &subscriptions[i];
+
+			if (sub->socket != -1 && sub->key == event->key &&
+					(event->id == BTT_DAEMON_ANY_ID ||
+					sub->id == event->id))
+				add_target(targets, &targets_num, sub->socket);
+		}
+
+		if (!targets_num)
+			BTT_LOG_D("No subscriber for command=%u\n",
+					((const struct btt_message *) event->data)->command);
+
+		for (i = 0; i < targets_num; i++)
+			post_event(targets[i], event);
+	}
+
+	for (i = 0; i < BTT_DAEMON_MAX_CLIENTS; i++) {
+		if (channels[i].socket != -1 && channels[i].dirty) {
+			btt_shm_signal(&channels[i].shm);
+			channels[i].dirty = FALSE;
+		}
+	}
+
+	pthread_mutex_unlock(&registry_lock);
+
+	for (i = 0; i < outboxes_num; i++)
+		flush_outbox(&outboxes[i]);
+
+	if (n < num)
+		goto next_part;
+
+	btt_daemon_clients_unlock();
+}
+
+/* ratio of messages to writes tells how well events are batched */
+uint64_t btt_daemon_registry_messages(void)
+{
+	return __atomic_load_n(&messages, __ATOMIC_RELAXED);
+}
+
+uint64_t btt_daemon_registry_writes(void)
+{
+	return __atomic_load_n(&writes, __ATOMIC_RELAXED);
+}
+
+uint64_t btt_daemon_registry_shared(void)
+{
+	return __atomic_load_n(&shared, __ATOMIC_RELAXED);
+}
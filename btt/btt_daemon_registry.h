@@ -0,0 +1,61 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_REGISTRY_H
+#error Included twice
+#endif
+#define BTT_DAEMON_REGISTRY_H
+
+#define BTT_DAEMON_MAX_SUBSCRIPTIONS 64
+/* iovecs gathered for one client before they have to be written */
+#define BTT_DAEMON_BATCH_IOV 64
+/* matches every id of the given key in btt_daemon_deliver */
+#define BTT_DAEMON_ANY_ID -1
+
+enum btt_daemon_key {
+	BTT_DAEMON_KEY_NONE,
+	BTT_DAEMON_KEY_CLIENT_IF,
+	BTT_DAEMON_KEY_SERVER_IF,
+	BTT_DAEMON_KEY_GATTC_CONN_ID,
+	BTT_DAEMON_KEY_GATTS_CONN_ID,
+	/* waiting for register_client_cb/register_server_cb */
+	BTT_DAEMON_KEY_CLIENT_UUID,
+	BTT_DAEMON_KEY_SERVER_UUID
+};
+
+struct btt_daemon_event;
+struct btt_shm;
+
+extern void btt_daemon_registry_init(void);
+extern void btt_daemon_registry_watch(int socket, unsigned int events);
+extern void btt_daemon_registry_unwatch(int socket, unsigned int events);
+extern void btt_daemon_registry_claim(int socket, enum btt_daemon_key key,
+		int id);
+extern void btt_daemon_registry_claim_uuid(int socket,
+		enum btt_daemon_key key, const bt_uuid_t *uuid);
+extern void btt_daemon_registry_bind_uuid(enum btt_daemon_key uuid_key,
+		const bt_uuid_t *uuid, enum btt_daemon_key key, int id);
+extern void btt_daemon_registry_inherit(enum btt_daemon_key key, int id,
+		enum btt_daemon_key parent_key, int parent_id);
+extern void btt_daemon_registry_forget(enum btt_daemon_key key, int id);
+extern void btt_daemon_registry_drop(int socket);
+extern void btt_daemon_registry_deliver(struct btt_daemon_event **batch,
+		unsigned int num);
+extern bool btt_daemon_registry_attach_shm(int socket,
+		const struct btt_shm *shm);
+extern uint64_t btt_daemon_registry_messages(void);
+extern uint64_t btt_daemon_registry_shared(void);
+extern uint64_t btt_daemon_registry_writes(void);
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_utils.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_requests.h"
+
+/* Outstanding requests waiting for their completion callback.
+ * HAL completes operations of one key/id in order, so the oldest request
+ * expecting the given callback command is the one being completed.
+ * The entry is recorded before the HAL is called, the callback may come
+ * before the HAL call returns. */
+
+struct btt_daemon_request {
+	int socket;
+	unsigned int request_id;
+	enum btt_daemon_key key;
+	int id;
+	bt_uuid_t uuid;
+	unsigned int command;
+	/* age, the lowest one is completed first */
+	unsigned long seq;
+};
+
+static pthread_mutex_t requests_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct btt_daemon_request requests[BTT_DAEMON_MAX_REQUESTS];
+static unsigned long next_seq;
+/* lets HAL callbacks skip the lock while nothing is outstanding */
+static unsigned int pending;
+
+/* must be called under requests_lock */
+static struct btt_daemon_request *new_request(void)
+{
+	struct btt_daemon_request *oldest = &requests[0];
+	unsigned int i;
+
+	for (i = 0; i < BTT_DAEMON_MAX_REQUESTS; i++) {
+		if (!requests[i].request_id) {
+			__atomic_add_fetch(&pending, 1, __ATOMIC_RELAXED);
+			return &requests[i];
+		}
+
+		if (requests[i].seq < oldest->seq)
+			oldest = &requests[i];
+	}
+
+	/* HAL never answered it, its completion will not be correlated */
+	BTT_LOG_W("Too many outstanding requests, forgetting request_id=%u\n",
+			oldest->request_id);
+	return oldest;
+}
+
+static void add_request(int socket, const struct btt_message *msg,
+		enum btt_daemon_key key, int id, const bt_uuid_t *uuid,
+		unsigned int command)
+{
+	struct btt_daemon_request *request;
+
+	/* client does not correlate its requests */
+	if (!msg->request_id)
+		return;
+
+	pthread_mutex_lock(&requests_lock);
+
+	request = new_request();
+	request->socket = socket;
+	request->request_id = msg->request_id;
+	request->key = key;
+	request->id = id;
+	request->command = command;
+	request->seq = next_seq++;
+
+	if (uuid)
+		request->uuid = *uuid;
+
+	pthread_mutex_unlock(&requests_lock);
+}
+
+/* must be called under requests_lock */
+static void remove_request(struct btt_daemon_request *request)
+{
+	request->request_id = 0;
+	__atomic_sub_fetch(&pending, 1, __ATOMIC_RELAXED);
+}
+
+void btt_daemon_requests_expect(int socket, const struct btt_message *msg,
+		enum btt_daemon_key key, int id, unsigned int command)
+{
+	add_request(socket, msg, key, id, NULL, command);
+}
+
+void btt_daemon_requests_expect_uuid(int socket,
+		const struct btt_message *msg, enum btt_daemon_key key,
+		const bt_uuid_t *uuid, unsigned int command)
+{
+	add_request(socket, msg, key, 0, uuid, command);
+}
+
+/* HAL refused the request, no completion will come */
+void btt_daemon_requests_cancel(int socket, const struct btt_message *msg)
+{
+	unsigned int i;
+
+	if (!msg->request_id)
+		return;
+
+	pthread_mutex_lock(&requests_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_REQUESTS; i++) {
+		if (requests[i].request_id == msg->request_id &&
+				requests[i].socket == socket)
+			remove_request(&requests[i]);
+	}
+
+	pthread_mutex_unlock(&requests_lock);
+}
+
+/* same as btt_daemon_registry_bind_uuid */
+void btt_daemon_requests_bind_uuid(enum btt_daemon_key uuid_key,
+		const bt_uuid_t *uuid, enum btt_daemon_key key, int id)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&requests_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_REQUESTS; i++) {
+		struct btt_daemon_request *request = &requests[i];
+
+		if (!request->request_id || request->key != uuid_key ||
+				memcmp(&request->uuid, uuid, sizeof(*uuid)))
+			continue;
+
+		request->key = key;
+		request->id = id;
+	}
+
+	pthread_mutex_unlock(&requests_lock);
+}
+
+/* callback command on key/id would complete a request */
+bool btt_daemon_requests_expected(enum btt_daemon_key key, int id,
+		unsigned int command)
+{
+	bool found = FALSE;
+	unsigned int i;
+
+	if (!__atomic_load_n(&pending, __ATOMIC_RELAXED))
+		return FALSE;
+
+	pthread_mutex_lock(&requests_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_REQUESTS && !found; i++)
+		found = requests[i].request_id && requests[i].command == command &&
+				requests[i].key == key && requests[i].id == id;
+
+	pthread_mutex_unlock(&requests_lock);
+
+	return found;
+}
+
+/* Return request_id of the request completed by the callback command
+ * on key/id and the socket which sent it, 0 if there is none. */
+unsigned int btt_daemon_requests_complete(enum btt_daemon_key key, int id,
+		unsigned int command, int *socket)
+{
+	struct btt_daemon_request *found = NULL;
+	unsigned int request_id;
+	unsigned int i;
+
+	if (!__atomic_load_n(&pending, __ATOMIC_RELAXED))
+		return 0;
+
+	pthread_mutex_lock(&requests_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_REQUESTS; i++) {
+		struct btt_daemon_request *request = &requests[i];
+
+		if (!request->request_id || request->command != command ||
+				request->key != key || request->id != id)
+			continue;
+
+		if (!found || request->seq < found->seq)
+			found = request;
+	}
+
+	if (!found) {
+		pthread_mutex_unlock(&requests_lock);
+		return 0;
+	}
+
+	request_id = found->request_id;
+	*socket = found->socket;
+	remove_request(found);
+
+	pthread_mutex_unlock(&requests_lock);
+
+	return request_id;
+}
+
+void btt_daemon_requests_forget(enum btt_daemon_key key, int id)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&requests_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_REQUESTS; i++) {
+		if (requests[i].request_id && requests[i].key == key &&
+				requests[i].id == id)
+			remove_request(&requests[i]);
+	}
+
+	pthread_mutex_unlock(&requests_lock);
+}
+
+/* client is going away */
+void btt_daemon_requests_drop(int socket)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&requests_lock);
+
+	for (i = 0; i < BTT_DAEMON_MAX_REQUESTS; i++) {
+		if (requests[i].request_id && requests[i].socket == socket)
+			remove_request(&requests[i]);
+	}
+
+	pthread_mutex_unlock(&requests_lock);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_REQUESTS_H
+#error Included twice
+#endif
+#define BTT_DAEMON_REQUESTS_H
+
+/* requires btt_daemon_registry.h */
+
+#define BTT_DAEMON_MAX_REQUESTS 64
+
+extern void btt_daemon_requests_expect(int socket,
+		const struct btt_message *msg, enum btt_daemon_key key, int id,
+		unsigned int command);
+extern void btt_daemon_requests_expect_uuid(int socket,
+		const struct btt_message *msg, enum btt_daemon_key key,
+		const bt_uuid_t *uuid, unsigned int command);
+extern void btt_daemon_requests_cancel(int socket,
+		const struct btt_message *msg);
+extern void btt_daemon_requests_bind_uuid(enum btt_daemon_key uuid_key,
+		const bt_uuid_t *uuid, enum btt_daemon_key key, int id);
+extern bool btt_daemon_requests_expected(enum btt_daemon_key key, int id,
+		unsigned int command);
+extern unsigned int btt_daemon_requests_complete(enum btt_daemon_key key,
+		int id, unsigned int command, int *socket);
+extern void btt_daemon_requests_forget(enum btt_daemon_key key, int id);
+extern void btt_daemon_requests_drop(int socket);
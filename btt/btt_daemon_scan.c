@@ -0,0 +1,618 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_utils.h"
+#include "btt_gatt_client.h"
+#include "btt_ad_parser.h"
+#include "btt_scan_filter.h"
+#include "btt_timer_wheel.h"
+#include "btt_daemon_registry.h"
+#include "btt_daemon_events.h"
+#include "btt_daemon_scan.h"
+
+/* Scan session lasts from the first scan start to scan stop. Every
+ * advertisement which passes the scan filter updates the entry of its
+ * device in the session table. The first one is reported as a scan
+ * result, later ones only as the report policy asks: when the report
+ * interval has passed, or on payload or RSSI change. A change coming
+ * sooner than the interval after the last report is reported when
+ * the interval ends, by a timer of the device. Devices changed since
+ * the last snapshot are sent as compact deltas at most once per snapshot
+ * interval. Other GATT client commands do not touch the session. */
+
+/* HCI reports this when RSSI is not available */
+#define RSSI_UNKNOWN 127
+/* weight of the newest sample in moving averages is 1 / 8 */
+#define EMA_SHIFT 3
+/* RSSI average is kept in 1/16 dBm */
+#define RSSI_SCALE 16
+/* granularity of delayed reports */
+#define REPORT_TICK_NS 10000000ull
+
+struct btt_scan_device {
+	uint8_t bd_addr[BD_ADDR_LEN];
+	bool dirty;
+	int8_t rssi;
+	int8_t rssi_min;
+	int8_t rssi_max;
+	uint16_t payload_changes;
+	int32_t rssi_avg;
+	uint32_t count;
+	uint32_t payload_hash;
+	uint64_t first_seen_ns;
+	uint64_t last_seen_ns;
+	/* includes advertisements we missed */
+	uint64_t interval_ns;
+	/* state at the last report */
+	uint64_t reported_ns;
+	uint32_t reported_hash;
+	int8_t reported_rssi;
+	/* delayed report */
+	struct btt_timer timer;
+	uint8_t adv_data[BTT_AD_DATA_LEN];
+};
+
+/* see btt_gatt_client_scan_report */
+struct btt_scan_report_policy {
+	uint64_t interval_ns;
+	unsigned int rssi_delta;
+	bool payload;
+};
+
+struct btt_scan_session {
+	bool active;
+	int client_if;
+	uint64_t start_ns;
+	/* addresses seen in this session, slot is index to devices */
+	struct bdaddr_set scanned;
+	/* slots of devices changed since the last snapshot */
+	unsigned int dirty_num;
+	uint16_t dirty[1 << BTT_DAEMON_SCAN_BITS];
+	uint64_t snapshot_interval_ns;
+	uint64_t snapshot_ns;
+	/* advertisements which did not pass the filter */
+	unsigned long filtered;
+	struct btt_timer_wheel reports;
+};
+
+static uint64_t scanned_pool[1 << BTT_DAEMON_SCAN_BITS];
+static struct btt_scan_device devices[1 << BTT_DAEMON_SCAN_BITS];
+static struct btt_scan_session session = {
+	.scanned = BDADDR_SET_INITIALIZER(scanned_pool, BTT_DAEMON_SCAN_BITS),
+};
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+/* survive sessions, changed only by the client which set the first
+ * rule, others are refused until it clears the filter */
+static struct btt_scan_filter filter;
+static int filter_owner = -1;
+/* same for the report policy, the default one is nobody's */
+static struct btt_scan_report_policy policy;
+static int policy_owner = -1;
+/* wakes report_thread up, uses CLOCK_MONOTONIC */
+static pthread_cond_t reports_cond;
+static bool report_thread_running;
+
+/* FNV-1a, only tells that the payload changed */
+static uint32_t payload_hash(const uint8_t *data, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static uint32_t session_ms(uint64_t ns)
+{
+	return (ns - session.start_ns) / 1000000;
+}
+
+/* must be called under session_lock */
+static void send_snapshot(uint64_t now)
+{
+	struct btt_gatt_client_cb_scan_snapshot btt_cb;
+	unsigned int i = 0;
+
+	session.snapshot_ns = now;
+
+	while (i < session.dirty_num) {
+		FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_SCAN_SNAPSHOT);
+		btt_cb.devices = session.scanned.count;
+		btt_cb.num = 0;
+
+		for (; i < session.dirty_num &&
+				btt_cb.num < BTT_SCAN_SNAPSHOT_MAX_DEVICES; i++) {
+			struct btt_scan_device *device = &devices[session.dirty[i]];
+			struct btt_gatt_client_scan_device *delta;
+
+			delta = &btt_cb.device[btt_cb.num++];
+			memcpy(delta->bd_addr, device->bd_addr, BD_ADDR_LEN);
+			delta->rssi = device->rssi;
+			delta->rssi_min = RSSI_UNKNOWN;
+			delta->rssi_max = RSSI_UNKNOWN;
+			delta->rssi_avg = RSSI_UNKNOWN;
+
+			if (device->rssi != RSSI_UNKNOWN) {
+				delta->rssi_min = device->rssi_min;
+				delta->rssi_max = device->rssi_max;
+				delta->rssi_avg = device->rssi_avg / RSSI_SCALE;
+			}
+
+			delta->payload_changes = device->payload_changes;
+			delta->count = device->count;
+			delta->first_seen_ms = session_ms(device->first_seen_ns);
+			delta->last_seen_ms = session_ms(device->last_seen_ns);
+			delta->interval_ms = device->interval_ns / 1000000;
+			delta->payload_hash = device->payload_hash;
+			device->dirty = FALSE;
+		}
+
+		btt_cb.more = i < session.dirty_num;
+		TRIM_TRAILER(btt_cb, device,
+				btt_cb.num * sizeof(struct btt_gatt_client_scan_device));
+
+		btt_daemon_deliver(BTT_EVENT_SCAN_SNAPSHOT | BTT_DAEMON_EVENT_STREAM,
+				BTT_DAEMON_KEY_NONE, 0, &btt_cb, MSG_SIZE(btt_cb));
+	}
+
+	session.dirty_num = 0;
+}
+
+/* scan result from the last advertisement of the device */
+static void send_report(const uint8_t *bda, int rssi,
+		const uint8_t *adv_data)
+{
+	struct btt_gatt_client_cb_scan_result btt_cb;
+	struct btt_ad ad;
+	const char *name;
+	uint8_t name_len;
+	uint8_t flags;
+	bool complete;
+
+	memset(&btt_cb, 0, sizeof(btt_cb));
+	FILL_HDR(btt_cb, BTT_GATT_CLIENT_CB_SCAN_RESULT);
+	memcpy(btt_cb.bd_addr, bda, BD_ADDR_LEN);
+	btt_cb.rssi = rssi;
+
+	if (!btt_ad_parse(&ad, adv_data, BTT_AD_DATA_LEN))
+		BTT_LOG_W("%s: malformed advertising data\n", __FUNCTION__);
+
+	/* at most BTT_AD_DATA_LEN bytes, stays terminated */
+	if (btt_ad_name(&ad, &name, &name_len, &complete))
+		memcpy(btt_cb.name, name, name_len);
+
+	if (btt_ad_flags(&ad, &flags))
+		btt_cb.discoverable_mode = flags & 0x03;
+
+	btt_daemon_deliver(BTT_EVENT_SCAN | BTT_DAEMON_EVENT_STREAM,
+			BTT_DAEMON_KEY_NONE, 0, &btt_cb, sizeof(btt_cb));
+}
+
+/* must be called under session_lock */
+static void report_device(struct btt_scan_device *device, uint64_t now)
+{
+	btt_timer_del(&session.reports, &device->timer);
+	device->reported_ns = now;
+	device->reported_hash = device->payload_hash;
+	device->reported_rssi = device->rssi;
+	send_report(device->bd_addr, device->rssi, device->adv_data);
+}
+
+/* timer callback, called under session_lock */
+static void report_expired(struct btt_timer *timer)
+{
+	struct btt_scan_device *device = (struct btt_scan_device *)
+			((uint8_t *) timer - offsetof(struct btt_scan_device, timer));
+
+	report_device(device, monotonic_ns());
+}
+
+/* must be called under session_lock */
+static void clear_session(void)
+{
+	bdaddr_set_clear(&session.scanned);
+	session.dirty_num = 0;
+	session.filtered = 0;
+	session.start_ns = monotonic_ns();
+	session.snapshot_ns = session.start_ns;
+	/* pending timers are forgotten with their devices */
+	btt_timer_wheel_init(&session.reports, REPORT_TICK_NS, session.start_ns);
+}
+
+/* scan of another client joins the running session */
+void btt_daemon_scan_start(int client_if)
+{
+	pthread_mutex_lock(&session_lock);
+
+	if (!session.active) {
+		clear_session();
+		session.active = TRUE;
+		session.client_if = client_if;
+	}
+
+	pthread_mutex_unlock(&session_lock);
+}
+
+/* snapshot subscribers get the last changes */
+void btt_daemon_scan_stop(void)
+{
+	pthread_mutex_lock(&session_lock);
+
+	if (session.active) {
+		BTT_LOG_D("Scan session of client_if=%d ended, %u devices, "
+				"%lu advertisements filtered out\n", session.client_if,
+				session.scanned.count, session.filtered);
+
+		if (session.snapshot_interval_ns)
+			send_snapshot(monotonic_ns());
+	}
+
+	session.active = FALSE;
+	clear_session();
+
+	pthread_mutex_unlock(&session_lock);
+}
+
+/* devices are reported again as if seen for the first time */
+bt_status_t btt_daemon_scan_reset(int client_if)
+{
+	bt_status_t status = BT_STATUS_SUCCESS;
+
+	pthread_mutex_lock(&session_lock);
+
+	if (!session.active) {
+		status = BT_STATUS_NOT_READY;
+	} else {
+		BTT_LOG_D("Scan session reset by client_if=%d\n", client_if);
+		clear_session();
+	}
+
+	pthread_mutex_unlock(&session_lock);
+
+	return status;
+}
+
+/* 0 stops snapshots */
+void btt_daemon_scan_snapshots(unsigned int interval_ms)
+{
+	pthread_mutex_lock(&session_lock);
+	session.snapshot_interval_ns = (uint64_t) interval_ms * 1000000;
+	pthread_mutex_unlock(&session_lock);
+}
+
+/* Fires delayed reports, so they do not wait for another advertisement.
+ * Sleeps until the earliest timer or until a new timer is added. */
+static void *report_thread(void *arg)
+{
+	struct timespec deadline;
+	uint64_t now;
+	uint64_t wake_ns;
+	int timeout;
+
+	pthread_mutex_lock(&session_lock);
+
+	while (1) {
+		/* wheel is set up by the first scan */
+		if (!session.active) {
+			pthread_cond_wait(&reports_cond, &session_lock);
+			continue;
+		}
+
+		now = monotonic_ns();
+		btt_timer_wheel_advance(&session.reports, now, report_expired);
+		timeout = btt_timer_wheel_timeout_ms(&session.reports, now);
+
+		if (timeout < 0) {
+			pthread_cond_wait(&reports_cond, &session_lock);
+			continue;
+		}
+
+		wake_ns = now + (uint64_t) timeout * 1000000;
+		deadline.tv_sec = wake_ns / 1000000000;
+		deadline.tv_nsec = wake_ns % 1000000000;
+		pthread_cond_timedwait(&reports_cond, &session_lock, &deadline);
+	}
+
+	return arg;
+}
+
+/* must be called under session_lock */
+static bool start_report_thread(void)
+{
+	pthread_condattr_t attr;
+	pthread_t thread;
+
+	if (report_thread_running)
+		return TRUE;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&reports_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&thread, NULL, report_thread, NULL)) {
+		BTT_LOG_E("Cannot start scan report thread\n");
+		pthread_cond_destroy(&reports_cond);
+		return FALSE;
+	}
+
+	pthread_detach(thread);
+	report_thread_running = TRUE;
+	return TRUE;
+}
+
+/* zeroes keep the default, every device is reported once */
+bt_status_t btt_daemon_scan_report(int client_if, unsigned int interval_ms,
+		unsigned int rssi_delta, bool payload)
+{
+	bool set = interval_ms || rssi_delta || payload;
+	bt_status_t status = BT_STATUS_SUCCESS;
+
+	pthread_mutex_lock(&session_lock);
+
+	if (policy_owner != -1 && policy_owner != client_if) {
+		BTT_LOG_W("Scan report policy is set by client_if=%d\n",
+				policy_owner);
+		status = BT_STATUS_BUSY;
+	} else if (set && !start_report_thread()) {
+		status = BT_STATUS_NOMEM;
+	} else {
+		policy.interval_ns = (uint64_t) interval_ms * 1000000;
+		policy.rssi_delta = rssi_delta;
+		policy.payload = payload;
+		policy_owner = set ? client_if : -1;
+	}
+
+	pthread_mutex_unlock(&session_lock);
+
+	return status;
+}
+
+/* new rules apply to following advertisements, devices reported
+ * already stay in the session */
+bt_status_t btt_daemon_scan_filter(
+		const struct btt_gatt_client_scan_filter *rule)
+{
+	bool added = TRUE;
+
+	if (rule->len > BTT_SCAN_FILTER_MAX_DATA)
+		return BT_STATUS_PARM_INVALID;
+
+	pthread_mutex_lock(&session_lock);
+
+	if (filter_owner != -1 && filter_owner != rule->client_if) {
+		pthread_mutex_unlock(&session_lock);
+		BTT_LOG_W("Scan filter is set by client_if=%d\n", filter_owner);
+		return BT_STATUS_BUSY;
+	}
+
+	if (!filter.allow.slots || rule->type == BTT_SCAN_FILTER_CLEAR)
+		btt_scan_filter_init(&filter);
+
+	switch (rule->type) {
+	case BTT_SCAN_FILTER_CLEAR:
+		break;
+	case BTT_SCAN_FILTER_UUID:
+		added = btt_scan_filter_add_uuid(&filter, &rule->uuid);
+		break;
+	case BTT_SCAN_FILTER_NAME:
+		added = btt_scan_filter_add_name(&filter, rule->data, rule->len);
+		break;
+	case BTT_SCAN_FILTER_MANUFACTURER:
+		added = btt_scan_filter_add_manufacturer(&filter, rule->company,
+				rule->data, rule->mask, rule->len);
+		break;
+	case BTT_SCAN_FILTER_RSSI:
+		btt_scan_filter_set_rssi(&filter, rule->rssi);
+		break;
+	case BTT_SCAN_FILTER_ALLOW:
+		added = btt_scan_filter_allow(&filter, rule->bda.address);
+		break;
+	case BTT_SCAN_FILTER_DENY:
+		added = btt_scan_filter_deny(&filter, rule->bda.address);
+		break;
+	default:
+		pthread_mutex_unlock(&session_lock);
+		return BT_STATUS_PARM_INVALID;
+	}
+
+	filter_owner = rule->type == BTT_SCAN_FILTER_CLEAR ? -1 :
+			rule->client_if;
+
+	pthread_mutex_unlock(&session_lock);
+
+	return added ? BT_STATUS_SUCCESS : BT_STATUS_NOMEM;
+}
+
+/* client is unregistered, its filter and policy go with it */
+void btt_daemon_scan_forget_client(int client_if)
+{
+	pthread_mutex_lock(&session_lock);
+
+	if (filter_owner == client_if) {
+		btt_scan_filter_init(&filter);
+		filter_owner = -1;
+	}
+
+	if (policy_owner == client_if) {
+		memset(&policy, 0, sizeof(policy));
+		policy_owner = -1;
+	}
+
+	pthread_mutex_unlock(&session_lock);
+}
+
+/* must be called under session_lock */
+static bool pass_filter(const uint8_t *bda, int rssi,
+		const uint8_t *adv_data)
+{
+	struct btt_ad ad;
+
+	if (!filter.checks)
+		return TRUE;
+
+	if (!btt_scan_filter_match_addr(&filter, bda, rssi))
+		return FALSE;
+
+	if (!(filter.checks & BTT_SCAN_CHECKS_AD))
+		return TRUE;
+
+	btt_ad_parse(&ad, adv_data, BTT_AD_DATA_LEN);
+
+	return btt_scan_filter_match_ad(&filter, &ad);
+}
+
+/* must be called under session_lock */
+static void update_device(struct btt_scan_device *device, bool added,
+		int rssi, const uint8_t *adv_data, uint64_t now)
+{
+	uint32_t hash = payload_hash(adv_data, BTT_AD_DATA_LEN);
+
+	if (added) {
+		memset(device, 0, sizeof(*device));
+		btt_timer_init(&device->timer);
+		device->first_seen_ns = now;
+		device->rssi = RSSI_UNKNOWN;
+		device->rssi_min = RSSI_UNKNOWN;
+		device->rssi_max = -RSSI_UNKNOWN;
+		device->payload_hash = hash;
+	} else {
+		int64_t interval = now - device->last_seen_ns;
+
+		if (device->count == 1)
+			device->interval_ns = interval;
+		else
+			device->interval_ns += (interval -
+					(int64_t) device->interval_ns) >> EMA_SHIFT;
+	}
+
+	if (hash != device->payload_hash) {
+		device->payload_hash = hash;
+		device->payload_changes++;
+	}
+
+	if (rssi != RSSI_UNKNOWN) {
+		if (device->rssi == RSSI_UNKNOWN)
+			device->rssi_avg = rssi * RSSI_SCALE;
+		else
+			device->rssi_avg += (rssi * RSSI_SCALE -
+					device->rssi_avg) >> EMA_SHIFT;
+
+		device->rssi = rssi;
+
+		if (rssi < device->rssi_min)
+			device->rssi_min = rssi;
+
+		if (rssi > device->rssi_max)
+			device->rssi_max = rssi;
+	}
+
+	device->count++;
+	device->last_seen_ns = now;
+	memcpy(device->adv_data, adv_data, BTT_AD_DATA_LEN);
+}
+
+/* must be called under session_lock */
+static void apply_policy(struct btt_scan_device *device, uint64_t now)
+{
+	bool changed = FALSE;
+	int rssi_change;
+
+	if (btt_timer_pending(&device->timer))
+		return;
+
+	if (policy.payload && device->payload_hash != device->reported_hash)
+		changed = TRUE;
+
+	rssi_change = abs(device->rssi - device->reported_rssi);
+
+	if (policy.rssi_delta && device->rssi != RSSI_UNKNOWN &&
+			(device->reported_rssi == RSSI_UNKNOWN ||
+			rssi_change >= (int) policy.rssi_delta))
+		changed = TRUE;
+
+	/* interval bounds the report rate, changes are not lost */
+	if (policy.interval_ns && now - device->reported_ns < policy.interval_ns) {
+		if (changed) {
+			btt_timer_add(&session.reports, &device->timer,
+					device->reported_ns + policy.interval_ns);
+			pthread_cond_signal(&reports_cond);
+		}
+
+		return;
+	}
+
+	if (changed || policy.interval_ns)
+		report_device(device, now);
+}
+
+/* Account advertisement of bda and report it as the policy asks */
+void btt_daemon_scan_seen(const uint8_t *bda, int rssi,
+		const uint8_t *adv_data)
+{
+	uint64_t now = monotonic_ns();
+	bool added;
+	int slot;
+
+	pthread_mutex_lock(&session_lock);
+
+	/* late result of a stopped scan, its session is already cleared */
+	if (!session.active) {
+		pthread_mutex_unlock(&session_lock);
+		return;
+	}
+
+	if (!pass_filter(bda, rssi, adv_data)) {
+		session.filtered++;
+		pthread_mutex_unlock(&session_lock);
+		return;
+	}
+
+	slot = bdaddr_set_insert(&session.scanned, bda, &added);
+
+	/* table is full, device is reported every time but not tracked */
+	if (slot < 0) {
+		pthread_mutex_unlock(&session_lock);
+		send_report(bda, rssi, adv_data);
+		return;
+	}
+
+	update_device(&devices[slot], added, rssi, adv_data, now);
+
+	if (added) {
+		memcpy(devices[slot].bd_addr, bda, BD_ADDR_LEN);
+		report_device(&devices[slot], now);
+	} else {
+		btt_timer_wheel_advance(&session.reports, now, report_expired);
+		apply_policy(&devices[slot], now);
+	}
+
+	if (!devices[slot].dirty) {
+		devices[slot].dirty = TRUE;
+		session.dirty[session.dirty_num++] = slot;
+	}
+
+	if (session.snapshot_interval_ns &&
+			now - session.snapshot_ns >= session.snapshot_interval_ns)
+		send_snapshot(now);
+
+	pthread_mutex_unlock(&session_lock);
+}
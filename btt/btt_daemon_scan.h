@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_DAEMON_SCAN_H
+#error Included twice
+#endif
+#define BTT_DAEMON_SCAN_H
+
+/* device table has 1 << BTT_DAEMON_SCAN_BITS slots, up to 6144 devices */
+#define BTT_DAEMON_SCAN_BITS 13
+
+struct btt_gatt_client_scan_filter;
+
+extern void btt_daemon_scan_start(int client_if);
+extern void btt_daemon_scan_stop(void);
+extern bt_status_t btt_daemon_scan_reset(int client_if);
+extern void btt_daemon_scan_snapshots(unsigned int interval_ms);
+extern bt_status_t btt_daemon_scan_filter(
+		const struct btt_gatt_client_scan_filter *rule);
+extern void btt_daemon_scan_forget_client(int client_if);
+extern bt_status_t btt_daemon_scan_report(int client_if,
+		unsigned int interval_ms, unsigned int rssi_delta, bool payload);
+extern void btt_daemon_scan_seen(const uint8_t *bda, int rssi,
+		const uint8_t *adv_data);
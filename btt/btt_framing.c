@@ -0,0 +1,157 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_framing.h"
+
+/* messages are handed out in place, keep them aligned for the structures */
+#define FRAMING_ALIGN 8
+
+void btt_framing_init(struct btt_framing *framing, int socket)
+{
+	framing->socket = socket;
+	framing->closed = FALSE;
+	framing->start = 0;
+	framing->end = 0;
+	framing->fds_num = 0;
+}
+
+void btt_framing_close_fds(struct btt_framing *framing)
+{
+	while (framing->fds_num)
+		close(framing->fds[--framing->fds_num]);
+}
+
+/* Return descriptors in the order they were sent, -1 when there is none.
+ * Taken descriptor belongs to the caller, the others are closed by
+ * the next fill. */
+int btt_framing_take_fd(struct btt_framing *framing)
+{
+	int fd;
+
+	if (!framing->fds_num)
+		return -1;
+
+	fd = framing->fds[0];
+	framing->fds_num -= 1;
+	memmove(framing->fds, framing->fds + 1,
+			framing->fds_num * sizeof(framing->fds[0]));
+
+	return fd;
+}
+
+static void keep_fds(struct btt_framing *framing, struct msghdr *msg)
+{
+	struct cmsghdr *cmsg;
+	unsigned int num;
+	unsigned int i;
+	int *fds;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		fds = (int *) CMSG_DATA(cmsg);
+		num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+		for (i = 0; i < num; i++) {
+			if (framing->fds_num < BTT_FRAMING_MAX_FDS)
+				framing->fds[framing->fds_num++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+}
+
+static void compact(struct btt_framing *framing)
+{
+	if (!framing->start)
+		return;
+
+	memmove(framing->buf, framing->buf + framing->start,
+			framing->end - framing->start);
+	framing->end -= framing->start;
+	framing->start = 0;
+}
+
+/* One recv into the free space of the buffer. Return its result,
+ * the framing is marked as closed on disconnection or socket error. */
+ssize_t btt_framing_fill(struct btt_framing *framing, int flags)
+{
+	uint8_t control[CMSG_SPACE(BTT_FRAMING_MAX_FDS * sizeof(int))];
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t length;
+
+	compact(framing);
+	btt_framing_close_fds(framing);
+
+	iov.iov_base = framing->buf + framing->end;
+	iov.iov_len = BTT_FRAMING_BUF_LEN - framing->end;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	do {
+		length = recvmsg(framing->socket, &msg, flags);
+	} while (length < 0 && errno == EINTR);
+
+	if (length > 0) {
+		framing->end += length;
+		keep_fds(framing, &msg);
+	} else if (length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+		framing->closed = TRUE;
+
+	return length;
+}
+
+/* Return next complete message or NULL if more data are needed.
+ * Message stays valid until the next call of any btt_framing function. */
+struct btt_message *btt_framing_next(struct btt_framing *framing)
+{
+	struct btt_message *msg;
+	size_t available = framing->end - framing->start;
+	size_t total;
+
+	if (framing->closed || available < sizeof(struct btt_message))
+		return NULL;
+
+	if (framing->start % FRAMING_ALIGN)
+		compact(framing);
+
+	msg = (struct btt_message *) (framing->buf + framing->start);
+
+	if (msg->length > BTT_FRAMING_BUF_LEN - sizeof(struct btt_message)) {
+		BTT_LOG_E("Received invalid btt_message length=%u\n", msg->length);
+		framing->closed = TRUE;
+		return NULL;
+	}
+
+	total = sizeof(struct btt_message) + msg->length;
+
+	if (available < total)
+		return NULL;
+
+	framing->start += total;
+
+	if (framing->start == framing->end)
+		framing->start = framing->end = 0;
+
+	return msg;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_FRAMING_H
+#error Included twice
+#endif
+#define BTT_FRAMING_H
+
+/* must hold the biggest message */
+#define BTT_FRAMING_BUF_LEN 8192
+/* descriptors passed with one message, see btt_framing_take_fd */
+#define BTT_FRAMING_MAX_FDS 2
+
+/* Receive buffer of one stream socket: data are read in big chunks and
+ * split into complete btt_messages without another copy. */
+struct btt_framing {
+	int socket;
+	bool closed;
+
+	/* unconsumed data are buf[start..end) */
+	size_t start;
+	size_t end;
+
+	/* received by the last fill (SCM_RIGHTS) and not taken yet */
+	int fds[BTT_FRAMING_MAX_FDS];
+	unsigned int fds_num;
+	uint8_t buf[BTT_FRAMING_BUF_LEN] __attribute__((aligned(8)));
+};
+
+extern void btt_framing_init(struct btt_framing *framing, int socket);
+extern ssize_t btt_framing_fill(struct btt_framing *framing, int flags);
+extern struct btt_message *btt_framing_next(struct btt_framing *framing);
+extern int btt_framing_take_fd(struct btt_framing *framing);
+extern void btt_framing_close_fds(struct btt_framing *framing);
@@ -18,53 +18,74 @@
 #include "btt.h"
 #include "btt_utils.h"
 
-#define DEFAULT_TIME_SEC 3
-#define LONG_TIME_SEC 10
-
 extern int app_socket;
 
+/* discover_all tree comes in parts, numbered until it completes */
+static unsigned int discover_numbers[BTT_GATT_CACHE_DESCRIPTOR];
+
 static void run_gatt_client_help(int argc, char **argv);
 static void run_gatt_client_scan(int argc, char **argv);
+static void run_gatt_client_scan_reset(int argc, char **argv);
+static void run_gatt_client_scan_snapshots(int argc, char **argv);
+static void run_gatt_client_scan_filter(int argc, char **argv);
+static void run_gatt_client_scan_report(int argc, char **argv);
 static void run_gatt_client_register_client(int argc, char **argv);
 static void run_gatt_client_un_register_client(int argc, char **argv);
 static void run_gatt_client_connect(int argc, char **argv);
 static void run_gatt_client_disconnect(int argc, char **argv);
+static void run_gatt_client_connections(int argc, char **argv);
+static void run_gatt_client_auto_reconnect(int argc, char **argv);
 static void run_gatt_client_read_remote_rssi(int argc, char **argv);
 static void run_gatt_client_listen(int argc, char **argv);
 static void run_gatt_client_set_adv_data_basic(int argc, char **argv);
 static void run_gatt_client_set_adv_data(int argc, char **argv);
 static void run_gatt_client_get_device_type(int argc, char **argv);
 static void run_gatt_client_refresh(int argc, char **argv);
+static void run_gatt_client_cache(int argc, char **argv);
+static void run_gatt_client_discover_all(int argc, char **argv);
 static void run_gatt_client_search_service(int argc, char **argv);
 static void run_gatt_client_get_included_service(int argc, char **argv);
 static void run_gatt_client_get_characteristic(int argc, char **argv);
 static void run_gatt_client_get_descriptor(int argc, char **argv);
 static void run_gatt_client_read_characteristic(int argc, char **argv);
 static void run_gatt_client_read_descriptor(int argc, char **argv);
+static void run_gatt_client_read_multi(int argc, char **argv);
 static void run_gatt_client_write_characteristic(int argc, char **argv);
 static void run_gatt_client_execute_write(int argc, char **argv);
+static void run_gatt_client_long_write(int argc, char **argv);
 static void run_gatt_client_write_descriptor(int argc, char **argv);
 static void run_gatt_client_reg_for_notification(int argc, char **argv);
 static void run_gatt_client_dereg_for_notification(int argc, char **argv);
+static void run_gatt_client_read_handle(int argc, char **argv);
+static void run_gatt_client_write_handle(int argc, char **argv);
+static void run_gatt_client_notify_handle(int argc, char **argv);
 static void run_gatt_client_test_command(int argc, char **argv);
-static void set_sock_rcv_time(unsigned int sec, unsigned int usec,
-		int server_sock);
-static bool send_by_socket(int server_sock, void *data, size_t len, int flags);
+static bool send_by_socket(int server_sock, void *data, size_t len);
 static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		int server_sock);
 static void printf_service(btgatt_srvc_id_t srv);
 static void printf_characteristic(btgatt_gatt_id_t cha, int char_prop);
+static void printf_cache_entry(struct btt_gatt_cache_entry *entry,
+		unsigned int *numbers);
 static bool process_UUID_sscanf(char *src, uint8_t *dest);
 
 static const struct extended_command gatt_client_commands[] = {
 		{{ "help",							"",							run_gatt_client_help}, 1, MAX_ARGC},
 		{{ "scan",							"<client_if> <start>", run_gatt_client_scan}, 3, 3},
+		{{ "scan_reset",					"<client_if>", run_gatt_client_scan_reset}, 2, 2},
+		{{ "scan_snapshots",				"<client_if> <interval_ms>", run_gatt_client_scan_snapshots}, 3, 3},
+		{{ "scan_filter",					"<client_if> clear | uuid <UUID> | name <prefix> | manufacturer <company_id> [hex_data] [hex_mask] | rssi <min_dBm> | allow <BD_ADDR> | deny <BD_ADDR>", run_gatt_client_scan_filter}, 3, 6},
+		{{ "scan_report",					"<client_if> <interval_ms> [rssi_delta] [payload]", run_gatt_client_scan_report}, 3, 5},
 		{{ "register_client",				"<16-bits UUID>", run_gatt_client_register_client}, 2, 2},
 		{{ "unregister_client",				"<client_if>", run_gatt_client_un_register_client}, 2, 2},
 		{{ "connect",						"<client_if> <BD_ADDR> <is_direct>", run_gatt_client_connect}, 4, 4},
 		{{ "disconnect",					"<client_if> <BD_ADDR> <conn_id>", run_gatt_client_disconnect}, 4, 4},
+		{{ "connections",					"", run_gatt_client_connections}, 1, 1},
+		{{ "auto_reconnect",				"<client_if> <BD_ADDR> <max_attempts>", run_gatt_client_auto_reconnect}, 4, 4},
 		{{ "listen",						"<client_if> <start>", run_gatt_client_listen}, 3, 3},
 		{{ "refresh",						"<client_if> <BD_ADDR>", run_gatt_client_refresh}, 3, 3},
+		{{ "cache",							"<BD_ADDR>", run_gatt_client_cache}, 2, 2},
+		{{ "discover_all",					"<conn_id>", run_gatt_client_discover_all}, 2, 2},
 		{{ "search_service",				"<conn_id> [UUID_filter]", run_gatt_client_search_service}, 2, 3},
 		{{ "get_included_service",			"<conn_id> <UUID> <is_primary> <inst_id> [<UUID> <is_primary> <inst_id>]", run_gatt_client_get_included_service}, 5, 8},
 		{{ "get_characteristic",			"<conn_id> <UUID> <is_primary> <inst_id> [<UUID> <inst_id>]", run_gatt_client_get_characteristic}, 5, 7},
@@ -72,10 +93,15 @@ static const struct extended_command gatt_client_commands[] = {
 		{{ "read_characteristic",			"<conn_id> <UUID> <is_primary> <inst_id> <UUID> <inst_id> <auth_req>", run_gatt_client_read_characteristic}, 8, 8},
 		{{ "write_characteristic",			"<conn_id> <UUID> <is_primary> <inst_id> <UUID> <inst_id> <write_type> <auth_req> <hex_value>", run_gatt_client_write_characteristic}, 10, 10},
 		{{ "read_descriptor",				"<conn_id> <UUID> <is_primary> <inst_id> <UUID> <inst_id> <UUID> <inst_id> <auth_req>", run_gatt_client_read_descriptor}, 10, 10},
+		{{ "read_multi",					"<conn_id> <auth_req> <UUID>:<is_primary>:<inst_id>:<UUID>:<inst_id>... | @file", run_gatt_client_read_multi}, 4, BTT_GATT_READ_MULTI_MAX + 3},
 		{{ "write_descriptor",				"<conn_id> <UUID> <is_primary> <inst_id> <UUID> <inst_id> <UUID> <inst_id> <write_type> <auth_req> <hex_value>", run_gatt_client_write_descriptor}, 12, 12},
+		{{ "long_write",					"<conn_id> <UUID> <is_primary> <inst_id> <UUID> <inst_id> <write_type> <auth_req> <hex_value | @file | pattern:<len>> [chunk] [window]", run_gatt_client_long_write}, 10, 12},
 		{{ "execute_write",					"<conn_id> <execute>", run_gatt_client_execute_write}, 3, 3},
 		{{ "register_for_notification",		"<client_if> <BD_ADDR> <UUID> <is_primary> <inst_id> <UUID> <inst_id>", run_gatt_client_reg_for_notification}, 8, 8},
 		{{ "deregister_for_notification",	"<client_if> <BD_ADDR> <UUID> <is_primary> <inst_id> <UUID> <inst_id>", run_gatt_client_dereg_for_notification}, 8, 8},
+		{{ "read_handle",					"<conn_id> <handle> <auth_req>", run_gatt_client_read_handle}, 4, 4},
+		{{ "write_handle",					"<conn_id> <handle> <write_type> <auth_req> <hex_value>", run_gatt_client_write_handle}, 6, 6},
+		{{ "notify_handle",					"<client_if> <conn_id> <handle> <registered>", run_gatt_client_notify_handle}, 5, 5},
 		{{ "read_remote_rssi",				"<BD_ADDR> <client_if>", run_gatt_client_read_remote_rssi}, 3, 3},
 		{{ "get_device_type",				"<BD_ADDR>", run_gatt_client_get_device_type}, 2, 2},
 		{{ "set_adv_data_basic",			"<client_if> <set_scan_rsp> <include_name> <include_txpower> <min_interval> <max_interval> <appearance>", run_gatt_client_set_adv_data_basic}, 8, 8},
@@ -91,15 +117,12 @@ void run_gatt_client_help(int argc, char **argv)
 			GATT_CLIENT_SUPPORTED_COMMANDS);
 }
 
-static void process_request(enum btt_gatt_client_req_t type, void *data,
-		unsigned int recv_time_sec)
+/* does not wait for the reply, status and completion callbacks
+ * carry request_id of the request and are printed when they come */
+static void process_request(enum btt_gatt_client_req_t type, void *data)
 {
-	int client_if = -1;
-
 	errno = 0;
 
-	set_sock_rcv_time(recv_time_sec, 0, app_socket);
-
 	process_send_to_daemon(type, data, app_socket);
 }
 
@@ -116,23 +139,121 @@ static void run_gatt_client_scan(int argc, char **argv)
 	sscanf(argv[1], "%d", &req.client_if);
 	sscanf(argv[2], "%u", &req.start);
 
-	process_request(BTT_GATT_CLIENT_REQ_SCAN, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_SCAN, &req);
 }
 
-static void set_sock_rcv_time(unsigned int sec, unsigned int usec,
-		int server_sock)
+static void run_gatt_client_scan_reset(int argc, char **argv)
+{
+	struct btt_gatt_client_scan_reset req;
+
+	sscanf(argv[1], "%d", &req.client_if);
+
+	process_request(BTT_GATT_CLIENT_REQ_SCAN_RESET, &req);
+}
+
+static void run_gatt_client_scan_snapshots(int argc, char **argv)
+{
+	struct btt_gatt_client_scan_snapshots req;
+
+	sscanf(argv[1], "%d", &req.client_if);
+	sscanf(argv[2], "%u", &req.interval_ms);
+
+	process_request(BTT_GATT_CLIENT_REQ_SCAN_SNAPSHOTS, &req);
+}
+
+/* hex string into at most BTT_SCAN_FILTER_MAX_DATA bytes, -1 on error */
+static int scan_filter_hex(char *src, uint8_t *dest)
+{
+	if (strlen(src) > 2 * BTT_SCAN_FILTER_MAX_DATA) {
+		BTT_LOG_S("Error: at most %u bytes\n", BTT_SCAN_FILTER_MAX_DATA);
+		return -1;
+	}
+
+	return string_to_hex(src, dest);
+}
+
+static void run_gatt_client_scan_filter(int argc, char **argv)
+{
+	struct btt_gatt_client_scan_filter req;
+	int len;
+
+	memset(&req, 0, sizeof(req));
+	sscanf(argv[1], "%d", &req.client_if);
+
+	if (!strcmp(argv[2], "clear") && argc == 3) {
+		req.type = BTT_SCAN_FILTER_CLEAR;
+	} else if (!strcmp(argv[2], "uuid") && argc == 4) {
+		req.type = BTT_SCAN_FILTER_UUID;
+
+		if (!process_UUID_sscanf(argv[3], req.uuid.uu))
+			return;
+	} else if (!strcmp(argv[2], "name") && argc == 4) {
+		req.type = BTT_SCAN_FILTER_NAME;
+		req.len = strlen(argv[3]);
+
+		if (strlen(argv[3]) > BTT_SCAN_FILTER_MAX_DATA) {
+			BTT_LOG_S("Error: prefix too long\n");
+			return;
+		}
+
+		memcpy(req.data, argv[3], req.len);
+	} else if (!strcmp(argv[2], "manufacturer") && argc >= 4) {
+		req.type = BTT_SCAN_FILTER_MANUFACTURER;
+		req.company = strtoul(argv[3], NULL, 0);
+		memset(req.mask, 0xFF, sizeof(req.mask));
+
+		if (argc > 4) {
+			if ((len = scan_filter_hex(argv[4], req.data)) < 0)
+				return;
+
+			req.len = len;
+		}
+
+		if (argc > 5 && scan_filter_hex(argv[5], req.mask) != req.len) {
+			BTT_LOG_S("Error: mask length differs from data\n");
+			return;
+		}
+	} else if (!strcmp(argv[2], "rssi") && argc == 4) {
+		req.type = BTT_SCAN_FILTER_RSSI;
+		sscanf(argv[3], "%d", &req.rssi);
+	} else if ((!strcmp(argv[2], "allow") || !strcmp(argv[2], "deny")) &&
+			argc == 4) {
+		req.type = !strcmp(argv[2], "allow") ? BTT_SCAN_FILTER_ALLOW :
+				BTT_SCAN_FILTER_DENY;
+
+		if (!sscanf_bdaddr(argv[3], req.bda.address)) {
+			BTT_LOG_S("Error: Incorrect address\n");
+			return;
+		}
+	} else {
+		BTT_LOG_S("Error: unknown filter rule\n");
+		return;
+	}
+
+	process_request(BTT_GATT_CLIENT_REQ_SCAN_FILTER, &req);
+}
+
+static void run_gatt_client_scan_report(int argc, char **argv)
 {
-	struct timeval tv;
+	struct btt_gatt_client_scan_report req;
+
+	req.rssi_delta = 0;
+	req.payload = 0;
+	sscanf(argv[1], "%d", &req.client_if);
+	sscanf(argv[2], "%u", &req.interval_ms);
 
-	tv.tv_sec = sec;
-	tv.tv_usec = usec;
-	setsockopt(server_sock, SOL_SOCKET, SO_RCVTIMEO,
-			(char *) &tv, sizeof(struct timeval));
+	if (argc > 3)
+		sscanf(argv[3], "%u", &req.rssi_delta);
+
+	if (argc > 4)
+		sscanf(argv[4], "%u", &req.payload);
+
+	process_request(BTT_GATT_CLIENT_REQ_SCAN_REPORT, &req);
 }
 
-static bool send_by_socket(int server_sock, void *data, size_t len, int flags)
+static bool send_by_socket(int server_sock, void *data, size_t len)
 {
-	if (send(server_sock, data, len, flags) == -1)
+	if (send_request(server_sock, data, len) == -1)
 		return FALSE;
 
 	return TRUE;
@@ -150,7 +271,55 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, cmd_scan, BTT_CMD_GATT_CLIENT_SCAN);
 
 		if (!send_by_socket(server_sock, cmd_scan,
-				sizeof(struct btt_gatt_client_scan), 0))
+				sizeof(struct btt_gatt_client_scan)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_SCAN_RESET:
+	{
+		struct btt_gatt_client_scan_reset *scan_reset;
+
+		FILL_MSG_P(data, scan_reset, BTT_CMD_GATT_CLIENT_SCAN_RESET);
+
+		if (!send_by_socket(server_sock, scan_reset,
+				sizeof(struct btt_gatt_client_scan_reset)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_SCAN_SNAPSHOTS:
+	{
+		struct btt_gatt_client_scan_snapshots *scan_snapshots;
+
+		FILL_MSG_P(data, scan_snapshots, BTT_CMD_GATT_CLIENT_SCAN_SNAPSHOTS);
+
+		if (!send_by_socket(server_sock, scan_snapshots,
+				sizeof(struct btt_gatt_client_scan_snapshots)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_SCAN_FILTER:
+	{
+		struct btt_gatt_client_scan_filter *scan_filter;
+
+		FILL_MSG_P(data, scan_filter, BTT_CMD_GATT_CLIENT_SCAN_FILTER);
+
+		if (!send_by_socket(server_sock, scan_filter,
+				sizeof(struct btt_gatt_client_scan_filter)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_SCAN_REPORT:
+	{
+		struct btt_gatt_client_scan_report *scan_report;
+
+		FILL_MSG_P(data, scan_report, BTT_CMD_GATT_CLIENT_SCAN_REPORT);
+
+		if (!send_by_socket(server_sock, scan_report,
+				sizeof(struct btt_gatt_client_scan_report)))
 			return FALSE;
 
 		break;
@@ -162,7 +331,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, register_client, BTT_CMD_GATT_CLIENT_REGISTER_CLIENT);
 
 		if (!send_by_socket(server_sock, register_client,
-				sizeof(struct btt_gatt_client_register_client), 0))
+				sizeof(struct btt_gatt_client_register_client)))
 			return FALSE;
 
 		break;
@@ -174,7 +343,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, unregister_client, BTT_CMD_GATT_CLIENT_UNREGISTER_CLIENT);
 
 		if (!send_by_socket(server_sock, unregister_client,
-				sizeof(struct btt_gatt_client_unregister_client), 0))
+				sizeof(struct btt_gatt_client_unregister_client)))
 			return FALSE;
 
 		break;
@@ -186,7 +355,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, connect, BTT_CMD_GATT_CLIENT_CONNECT);
 
 		if (!send_by_socket(server_sock, connect,
-				sizeof(struct btt_gatt_client_connect), 0))
+				sizeof(struct btt_gatt_client_connect)))
 			return FALSE;
 
 		break;
@@ -198,7 +367,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, disconnect, BTT_CMD_GATT_CLIENT_DISCONNECT);
 
 		if (!send_by_socket(server_sock, disconnect,
-				sizeof(struct btt_gatt_client_disconnect), 0))
+				sizeof(struct btt_gatt_client_disconnect)))
 			return FALSE;
 
 		break;
@@ -210,7 +379,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, read_rssi, BTT_CMD_GATT_CLIENT_READ_REMOTE_RSSI);
 
 		if (!send_by_socket(server_sock, read_rssi,
-				sizeof(struct btt_gatt_client_read_remote_rssi), 0))
+				sizeof(struct btt_gatt_client_read_remote_rssi)))
 			return FALSE;
 
 		break;
@@ -222,7 +391,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, listen, BTT_CMD_GATT_CLIENT_LISTEN);
 
 		if (!send_by_socket(server_sock, listen,
-				sizeof(struct btt_gatt_client_listen), 0))
+				sizeof(struct btt_gatt_client_listen)))
 			return FALSE;
 
 		break;
@@ -234,7 +403,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, adv, BTT_CMD_GATT_CLIENT_SET_ADV_DATA);
 
 		if (!send_by_socket(server_sock, adv,
-				sizeof(struct btt_gatt_client_set_adv_data), 0))
+				sizeof(struct btt_gatt_client_set_adv_data)))
 			return FALSE;
 
 		break;
@@ -246,7 +415,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, get, BTT_CMD_GATT_CLIENT_GET_DEVICE_TYPE);
 
 		if (!send_by_socket(server_sock, get,
-				sizeof(struct btt_gatt_client_listen), 0))
+				sizeof(struct btt_gatt_client_get_device_type)))
 			return FALSE;
 
 		break;
@@ -258,7 +427,96 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, refresh, BTT_CMD_GATT_CLIENT_REFRESH);
 
 		if (!send_by_socket(server_sock, refresh,
-				sizeof(struct btt_gatt_client_refresh), 0))
+				sizeof(struct btt_gatt_client_refresh)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_CONNECTIONS:
+	{
+		struct btt_gatt_client_connections *connections;
+
+		FILL_MSG_P(data, connections, BTT_CMD_GATT_CLIENT_CONNECTIONS);
+
+		if (!send_by_socket(server_sock, connections,
+				sizeof(struct btt_gatt_client_connections)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_AUTO_RECONNECT:
+	{
+		struct btt_gatt_client_auto_reconnect *auto_reconnect;
+
+		FILL_MSG_P(data, auto_reconnect,
+				BTT_CMD_GATT_CLIENT_AUTO_RECONNECT);
+
+		if (!send_by_socket(server_sock, auto_reconnect,
+				sizeof(struct btt_gatt_client_auto_reconnect)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_CACHE:
+	{
+		struct btt_gatt_client_cache *cache;
+
+		FILL_MSG_P(data, cache, BTT_CMD_GATT_CLIENT_CACHE);
+
+		if (!send_by_socket(server_sock, cache,
+				sizeof(struct btt_gatt_client_cache)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_DISCOVER_ALL:
+	{
+		struct btt_gatt_client_discover_all *discover_all;
+
+		FILL_MSG_P(data, discover_all, BTT_CMD_GATT_CLIENT_DISCOVER_ALL);
+
+		if (!send_by_socket(server_sock, discover_all,
+				sizeof(struct btt_gatt_client_discover_all)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_READ_MULTI:
+	{
+		struct btt_gatt_client_read_multi *read_multi;
+
+		FILL_MSG_P(data, read_multi, BTT_CMD_GATT_CLIENT_READ_MULTI);
+		TRIM_TRAILER(*read_multi, entry,
+				read_multi->num * sizeof(read_multi->entry[0]));
+
+		if (!send_by_socket(server_sock, read_multi,
+				MSG_SIZE(*read_multi)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_LONG_WRITE:
+	{
+		struct btt_gatt_client_long_write *long_write;
+
+		FILL_MSG_P(data, long_write, BTT_CMD_GATT_CLIENT_LONG_WRITE);
+
+		if (!send_by_socket(server_sock, long_write,
+				sizeof(struct btt_gatt_client_long_write)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_LONG_WRITE_DATA:
+	{
+		struct btt_gatt_client_long_write_data *long_write_data;
+
+		FILL_MSG_P(data, long_write_data,
+				BTT_CMD_GATT_CLIENT_LONG_WRITE_DATA);
+		TRIM_TRAILER(*long_write_data, data, long_write_data->len);
+
+		if (!send_by_socket(server_sock, long_write_data,
+				MSG_SIZE(*long_write_data)))
 			return FALSE;
 
 		break;
@@ -270,7 +528,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, search, BTT_CMD_GATT_CLIENT_SEARCH_SERVICE);
 
 		if (!send_by_socket(server_sock, search,
-				sizeof(struct btt_gatt_client_search_service), 0))
+				sizeof(struct btt_gatt_client_search_service)))
 			return FALSE;
 
 		break;
@@ -282,7 +540,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, get, BTT_CMD_GATT_CLIENT_GET_INCLUDE_SERVICE);
 
 		if (!send_by_socket(server_sock, get,
-				sizeof(struct btt_gatt_client_get_included_service), 0))
+				sizeof(struct btt_gatt_client_get_included_service)))
 			return FALSE;
 
 		break;
@@ -294,7 +552,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, get, BTT_CMD_GATT_CLIENT_GET_CHARACTERISTIC);
 
 		if (!send_by_socket(server_sock, get,
-				sizeof(struct btt_gatt_client_get_characteristic), 0))
+				sizeof(struct btt_gatt_client_get_characteristic)))
 			return FALSE;
 
 		break;
@@ -306,7 +564,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, get, BTT_CMD_GATT_CLIENT_GET_DESCRIPTOR);
 
 		if (!send_by_socket(server_sock, get,
-				sizeof(struct btt_gatt_client_get_descriptor), 0))
+				sizeof(struct btt_gatt_client_get_descriptor)))
 			return FALSE;
 
 		break;
@@ -318,7 +576,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, read, BTT_CMD_GATT_CLIENT_READ_CHARACTERISTIC);
 
 		if (!send_by_socket(server_sock, read,
-				sizeof(struct btt_gatt_client_read_characteristic), 0))
+				sizeof(struct btt_gatt_client_read_characteristic)))
 			return FALSE;
 
 		break;
@@ -330,7 +588,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, read, BTT_CMD_GATT_CLIENT_READ_DESCRIPTOR);
 
 		if (!send_by_socket(server_sock, read,
-				sizeof(struct btt_gatt_client_read_descriptor), 0))
+				sizeof(struct btt_gatt_client_read_descriptor)))
 			return FALSE;
 
 		break;
@@ -340,9 +598,46 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		struct btt_gatt_client_write_characteristic *write;
 
 		FILL_MSG_P(data, write, BTT_CMD_GATT_CLIENT_WRITE_CHARACTERISTIC);
+		TRIM_TRAILER(*write, p_value, write->len);
+
+		if (!send_by_socket(server_sock, write, MSG_SIZE(*write)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_READ_HANDLE:
+	{
+		struct btt_gatt_client_read_handle *read_handle;
+
+		FILL_MSG_P(data, read_handle, BTT_CMD_GATT_CLIENT_READ_HANDLE);
+
+		if (!send_by_socket(server_sock, read_handle,
+				sizeof(struct btt_gatt_client_read_handle)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_WRITE_HANDLE:
+	{
+		struct btt_gatt_client_write_handle *write_handle;
+
+		FILL_MSG_P(data, write_handle, BTT_CMD_GATT_CLIENT_WRITE_HANDLE);
+		TRIM_TRAILER(*write_handle, value, write_handle->len);
+
+		if (!send_by_socket(server_sock, write_handle,
+				MSG_SIZE(*write_handle)))
+			return FALSE;
+
+		break;
+	}
+	case BTT_GATT_CLIENT_REQ_NOTIFY_HANDLE:
+	{
+		struct btt_gatt_client_notify_handle *notify_handle;
+
+		FILL_MSG_P(data, notify_handle, BTT_CMD_GATT_CLIENT_NOTIFY_HANDLE);
 
-		if (!send_by_socket(server_sock, write,
-				sizeof(struct btt_gatt_client_write_characteristic), 0))
+		if (!send_by_socket(server_sock, notify_handle,
+				sizeof(struct btt_gatt_client_notify_handle)))
 			return FALSE;
 
 		break;
@@ -354,7 +649,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, exe, BTT_CMD_GATT_CLIENT_EXECUTE_WRITE);
 
 		if (!send_by_socket(server_sock, exe,
-				sizeof(struct btt_gatt_client_execute_write), 0))
+				sizeof(struct btt_gatt_client_execute_write)))
 			return FALSE;
 
 		break;
@@ -364,9 +659,9 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		struct btt_gatt_client_write_descriptor *write;
 
 		FILL_MSG_P(data, write, BTT_CMD_GATT_CLIENT_WRITE_DESCRIPTOR);
+		TRIM_TRAILER(*write, p_value, write->len);
 
-		if (!send_by_socket(server_sock, write,
-				sizeof(struct btt_gatt_client_write_descriptor), 0))
+		if (!send_by_socket(server_sock, write, MSG_SIZE(*write)))
 			return FALSE;
 
 		break;
@@ -378,7 +673,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, reg, BTT_CMD_GATT_CLIENT_REGISTER_FOR_NOTIFICATION);
 
 		if (!send_by_socket(server_sock, reg,
-				sizeof(struct btt_gatt_client_reg_for_notification), 0))
+				sizeof(struct btt_gatt_client_reg_for_notification)))
 			return FALSE;
 
 		break;
@@ -391,7 +686,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 				BTT_CMD_GATT_CLIENT_DEREGISTER_FOR_NOTIFICATION);
 
 		if (!send_by_socket(server_sock, dereg,
-				sizeof(struct btt_gatt_client_dereg_for_notification), 0))
+				sizeof(struct btt_gatt_client_dereg_for_notification)))
 			return FALSE;
 
 		break;
@@ -403,7 +698,7 @@ static bool process_send_to_daemon(enum btt_gatt_client_req_t type, void *data,
 		FILL_MSG_P(data, test, BTT_CMD_GATT_CLIENT_TEST_COMMAND);
 
 		if (!send_by_socket(server_sock, test,
-				sizeof(struct btt_gatt_client_test_command), 0))
+				sizeof(struct btt_gatt_client_test_command)))
 			return FALSE;
 
 		break;
@@ -420,7 +715,6 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 {
 	unsigned int i;
 	uint8_t empty_BD_ADDR[BD_ADDR_LEN];
-	char *buffer;
 
 	errno = 0;
 	memset(empty_BD_ADDR, 0, BD_ADDR_LEN);
@@ -430,7 +724,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_bt_status stat;
 
-		if (!RECV(&stat, app_socket)) {
+		if (!MSG_COPY(&stat, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -444,7 +738,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_scan_result device;
 
-		if (!RECV(&device, app_socket)) {
+		if (!MSG_COPY(&device, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -463,7 +757,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_register_client cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -479,7 +773,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_connect cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -497,7 +791,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_disconnect cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -515,7 +809,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_read_remote_rssi cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -533,7 +827,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_listen cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -548,7 +842,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_get_device_type cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -576,7 +870,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_search_result cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -592,7 +886,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_search_complete cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -607,7 +901,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_get_included_service cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -630,7 +924,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_get_characteristic cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -652,7 +946,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_get_descriptor cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -676,7 +970,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_read_characteristic cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -705,7 +999,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_read_descriptor cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -736,7 +1030,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_write_characteristic cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -759,7 +1053,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_execute_write cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -774,7 +1068,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_write_descriptor cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -798,7 +1092,7 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_reg_for_notification cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -822,7 +1116,8 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_client_cb_notify cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY_TRAILER(&cb, btt_cb, value) ||
+				cb.len != TRAILER_LEN(cb, value)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -830,31 +1125,276 @@ void handle_gattc_cb(const struct btt_message *btt_cb)
 		BTT_LOG_S("\nGATTC: Notify.\n");
 		BTT_LOG_S("Connection Id: %d.\n", cb.conn_id);
 		BTT_LOG_S("\nAddress: ");
-		print_bdaddr(cb.p_data.bda.address);
+		print_bdaddr(cb.bda.address);
 		BTT_LOG_S("\nSERVICE: \n");
-		printf_service(cb.p_data.srvc_id);
+		printf_service(cb.srvc_id);
 		BTT_LOG_S("\nCHARACTERISTIC: \n");
-		printf_characteristic(cb.p_data.char_id, 0);
+		printf_characteristic(cb.char_id, 0);
 		BTT_LOG_S("Value: \n\t");
 
-		for (i = 0; i < cb.p_data.len; i++)
-			BTT_LOG_S("%.2X", cb.p_data.value[i]);
+		for (i = 0; i < cb.len; i++)
+			BTT_LOG_S("%.2X", cb.value[i]);
 
-		BTT_LOG_S("\nNotify: %s\n", (cb.p_data.is_notify) ? "TRUE" : "FALSE");
+		BTT_LOG_S("\nNotify: %s\n", (cb.is_notify) ? "TRUE" : "FALSE");
 		break;
 	}
-	default:
-		buffer = malloc(btt_cb->length);
+	case BTT_GATT_CLIENT_CB_SCAN_SNAPSHOT:
+	{
+		struct btt_gatt_client_cb_scan_snapshot cb;
+
+		if (!MSG_COPY_TRAILER(&cb, btt_cb, device) ||
+				cb.num > BTT_SCAN_SNAPSHOT_MAX_DEVICES ||
+				cb.num * sizeof(cb.device[0]) != TRAILER_LEN(cb, device)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		BTT_LOG_S("\nGATTC: Scan snapshot, %u of %u devices changed%s\n",
+				cb.num, cb.devices, cb.more ? ", more follow" : "");
+
+		for (i = 0; i < cb.num; i++) {
+			struct btt_gatt_client_scan_device *dev = &cb.device[i];
+
+			print_bdaddr(dev->bd_addr);
+			BTT_LOG_S(" count=%u rssi=%d min=%d max=%d avg=%d "
+					"interval=%ums seen=%u..%ums payload=%08X/%u\n",
+					dev->count, dev->rssi, dev->rssi_min, dev->rssi_max,
+					dev->rssi_avg, dev->interval_ms, dev->first_seen_ms,
+					dev->last_seen_ms, dev->payload_hash,
+					dev->payload_changes);
+		}
+
+		break;
+	}
+	case BTT_GATT_CLIENT_CB_CONNECTIONS:
+	{
+		struct btt_gatt_client_cb_connections cb;
+		struct btt_gatt_connection_info *info;
+		static const char *const states[] = { "", "connecting", "connected",
+				"disconnecting", "backoff" };
+
+		if (!MSG_COPY_TRAILER(&cb, btt_cb, entry) ||
+				cb.num > BTT_GATT_MAX_CONNECTIONS ||
+				cb.num * sizeof(cb.entry[0]) != TRAILER_LEN(cb, entry)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
 
-		if (buffer) {
-			recv(app_socket, buffer, btt_cb->length, 0);
-			free(buffer);
+		BTT_LOG_S("\nGATTC: %u connections\n", cb.num);
+
+		for (i = 0; i < cb.num; i++) {
+			info = &cb.entry[i];
+
+			print_bdaddr(info->addr.address);
+			BTT_LOG_S(" %-13s client_if=%d conn_id=%d mtu=%u bonded=%u "
+					"in_flight=%u queued=%u operations=%u reconnects=%u "
+					"connected_ms=%u\n", info->state <
+					sizeof(states) / sizeof(states[0]) ?
+					states[info->state] : "?", info->client_if,
+					info->conn_id, info->mtu, info->bonded, info->in_flight,
+					info->queued, info->operations, info->reconnects,
+					info->connected_ms);
+		}
+
+		break;
+	}
+	case BTT_GATT_CLIENT_CB_CACHE:
+	{
+		struct btt_gatt_client_cb_cache cb;
+		/* entries are numbered across all parts */
+		static unsigned int numbers[BTT_GATT_CACHE_DESCRIPTOR];
+
+		if (!MSG_COPY_TRAILER(&cb, btt_cb, entry) ||
+				cb.num > BTT_GATT_CACHE_MSG_ENTRIES ||
+				cb.num * sizeof(cb.entry[0]) != TRAILER_LEN(cb, entry)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		if (!cb.found) {
+			BTT_LOG_S("\nGATTC: Nothing cached for ");
+			print_bdaddr(cb.addr.address);
+			BTT_LOG_S("\n");
+			break;
+		}
+
+		if (!numbers[0] && !numbers[1] && !numbers[2]) {
+			BTT_LOG_S("\nGATTC: Cache of ");
+			print_bdaddr(cb.addr.address);
+			BTT_LOG_S("\n");
+		}
+
+		for (i = 0; i < cb.num; i++)
+			printf_cache_entry(&cb.entry[i], numbers);
+
+		if (!cb.more) {
+			BTT_LOG_S("GATTC: Cached %u services, %u characteristics, "
+					"%u descriptors of ", numbers[0], numbers[1],
+					numbers[2]);
+			print_bdaddr(cb.addr.address);
+			BTT_LOG_S("\n");
+			memset(numbers, 0, sizeof(numbers));
+		}
+
+		break;
+	}
+	case BTT_GATT_CLIENT_CB_DISCOVER_ALL:
+	{
+		struct btt_gatt_client_cb_discover_all cb;
+
+		if (!MSG_COPY_TRAILER(&cb, btt_cb, entry) ||
+				cb.num > BTT_GATT_DISCOVER_MSG_ENTRIES ||
+				cb.num * sizeof(cb.entry[0]) != TRAILER_LEN(cb, entry)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		if (!discover_numbers[0] && !discover_numbers[1] &&
+				!discover_numbers[2])
+			BTT_LOG_S("\nGATTC: Discovered attributes of connection %d\n",
+					cb.conn_id);
+
+		for (i = 0; i < cb.num; i++)
+			printf_cache_entry(&cb.entry[i], discover_numbers);
+
+		break;
+	}
+	case BTT_GATT_CLIENT_CB_DISCOVER_ALL_COMPLETE:
+	{
+		struct btt_gatt_client_cb_discover_all_complete cb;
+
+		if (!MSG_COPY(&cb, btt_cb)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
 		}
 
+		BTT_LOG_S("\nGATTC: Discover all complete.\n");
+		BTT_LOG_S("Status: %s\n", (!cb.status) ? "OK" : "ERROR");
+		BTT_LOG_S("Connection Id: %d.\n", cb.conn_id);
+		BTT_LOG_S("%u services, %u characteristics, %u descriptors "
+				"in %u ms\n", cb.services, cb.characteristics,
+				cb.descriptors, cb.duration_ms);
+		memset(discover_numbers, 0, sizeof(discover_numbers));
+		break;
+	}
+	case BTT_GATT_CLIENT_CB_READ_MULTI:
+	{
+		struct btt_gatt_client_cb_read_multi cb;
+		struct btt_gatt_read_multi_value value;
+		unsigned int offset = 0;
+
+		if (!MSG_COPY_TRAILER(&cb, btt_cb, data) ||
+				cb.len != TRAILER_LEN(cb, data)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		while (offset + sizeof(value) <= cb.len) {
+			memcpy(&value, cb.data + offset, sizeof(value));
+			offset += sizeof(value);
+
+			if (offset + value.len > cb.len)
+				break;
+
+			BTT_LOG_S("%u. ", value.index);
+
+			if (value.status) {
+				BTT_LOG_S("ERROR %d\n", value.status);
+				continue;
+			}
+
+			BTT_LOG_S("Value type: %.4X Unformatted value: ",
+					value.value_type);
+
+			for (i = 0; i < value.len; i++)
+				BTT_LOG_S("%.2X", cb.data[offset + i]);
+
+			BTT_LOG_S("\n");
+			offset += value.len;
+		}
+
+		break;
+	}
+	case BTT_GATT_CLIENT_CB_READ_MULTI_COMPLETE:
+	{
+		struct btt_gatt_client_cb_read_multi_complete cb;
+
+		if (!MSG_COPY(&cb, btt_cb)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		BTT_LOG_S("\nGATTC: Read multi complete.\n");
+		BTT_LOG_S("Status: %s\n", (!cb.status) ? "OK" : "ERROR");
+		BTT_LOG_S("Connection Id: %d.\n", cb.conn_id);
+		BTT_LOG_S("%u reads, %u failed, %u ms", cb.num, cb.failed,
+				cb.duration_ms);
+
+		if (cb.duration_ms)
+			BTT_LOG_S(", %u reads/s", cb.num * 1000 / cb.duration_ms);
+
+		BTT_LOG_S("\n\n");
+		break;
+	}
+	case BTT_GATT_CLIENT_CB_LONG_WRITE:
+	{
+		struct btt_gatt_client_cb_long_write cb;
+
+		if (!MSG_COPY(&cb, btt_cb)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		BTT_LOG_S("\nGATTC: Long write.\n");
+		BTT_LOG_S("Status: %s\n", (!cb.status) ? "OK" : "ERROR");
+		BTT_LOG_S("Connection Id: %d.\n", cb.conn_id);
+		BTT_LOG_S("%u bytes in %u writes, %u ms", cb.len, cb.writes,
+				cb.duration_ms);
+
+		if (cb.duration_ms)
+			BTT_LOG_S(", %llu bytes/s", (unsigned long long) cb.len *
+					1000 / cb.duration_ms);
+
+		BTT_LOG_S("\nWrite latency: p50 %u us, p90 %u us, p99 %u us, "
+				"max %u us\n", cb.latency_p50_us, cb.latency_p90_us,
+				cb.latency_p99_us, cb.latency_max_us);
+		BTT_LOG_S("Stalls: %u, %u ms without credit, %u busy retries\n\n",
+				cb.stalls, cb.stall_ms, cb.busy);
+		break;
+	}
+	default:
 		break;
 	}
 }
 
+/* entries are numbered by type across all parts of the message */
+static void printf_cache_entry(struct btt_gatt_cache_entry *entry,
+		unsigned int *numbers)
+{
+	switch (entry->type) {
+	case BTT_GATT_CACHE_SERVICE:
+		BTT_LOG_S("Service %u: %s inst_id=%u ", numbers[0]++,
+				entry->flags ? "primary" : "secondary", entry->id.inst_id);
+		break;
+	case BTT_GATT_CACHE_CHARACTERISTIC:
+		BTT_LOG_S("  Characteristic %u of service %u: inst_id=%u "
+				"properties=0x%02X ", numbers[1]++, entry->parent,
+				entry->id.inst_id, entry->flags);
+		break;
+	case BTT_GATT_CACHE_DESCRIPTOR:
+		BTT_LOG_S("    Descriptor %u of characteristic %u: inst_id=%u ",
+				numbers[2]++, entry->parent, entry->id.inst_id);
+		break;
+	default:
+		return;
+	}
+
+	if (entry->handle)
+		BTT_LOG_S("handle=0x%04X ", entry->handle);
+
+	printf_UUID_128(entry->id.uuid.uu, TRUE, FALSE);
+}
+
 static void printf_service(btgatt_srvc_id_t srv)
 {
 	BTT_LOG_S("Service is %s.\n", (srv.is_primary ?
@@ -910,8 +1450,7 @@ static void run_gatt_client_register_client(int argc, char **argv)
 		return;
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_REGISTER_CLIENT, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_REGISTER_CLIENT, &req);
 }
 
 static void run_gatt_client_un_register_client(int argc, char **argv)
@@ -919,8 +1458,7 @@ static void run_gatt_client_un_register_client(int argc, char **argv)
 	struct btt_gatt_client_unregister_client req;
 
 	sscanf(argv[1], "%d", &req.client_if);
-	process_request(BTT_GATT_CLIENT_REQ_UNREGISTER_CLIENT, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_UNREGISTER_CLIENT, &req);
 }
 
 static void run_gatt_client_connect(int argc, char **argv)
@@ -936,7 +1474,7 @@ static void run_gatt_client_connect(int argc, char **argv)
 
 	sscanf(argv[3], "%d", &req.is_direct);
 
-	process_request(BTT_GATT_CLIENT_REQ_CONNECT, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_CONNECT, &req);
 }
 
 static void run_gatt_client_disconnect(int argc, char **argv)
@@ -952,7 +1490,7 @@ static void run_gatt_client_disconnect(int argc, char **argv)
 
 	sscanf(argv[3], "%d", &req.conn_id);
 
-	process_request(BTT_GATT_CLIENT_REQ_DISCONNECT, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_DISCONNECT, &req);
 }
 
 static void run_gatt_client_read_remote_rssi(int argc, char **argv)
@@ -965,8 +1503,7 @@ static void run_gatt_client_read_remote_rssi(int argc, char **argv)
 	}
 
 	sscanf(argv[2], "%d", &req.client_if);
-	process_request(BTT_GATT_CLIENT_REQ_READ_REMOTE_RSSI, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_READ_REMOTE_RSSI, &req);
 }
 
 static void run_gatt_client_listen(int argc, char **argv)
@@ -975,7 +1512,7 @@ static void run_gatt_client_listen(int argc, char **argv)
 
 	sscanf(argv[1], "%d", &req.client_if);
 	sscanf(argv[2], "%d", &req.start);
-	process_request(BTT_GATT_CLIENT_REQ_LISTEN, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_LISTEN, &req);
 }
 
 static void run_gatt_client_set_adv_data_basic(int argc, char **argv)
@@ -993,7 +1530,19 @@ static void run_gatt_client_set_adv_data_basic(int argc, char **argv)
 	req.service_data_len = 0;
 	req.manufacturer_len = 0;
 	req.service_uuid_len = 0;
-	process_request(BTT_GATT_CLIENT_REQ_SET_ADV_DATA, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_SET_ADV_DATA, &req);
+}
+
+/* hex string into at most BTGATT_MAX_ATTR_LEN bytes, -1 on error */
+static int attr_value_hex(char *src, uint8_t *dest)
+{
+	if (strlen(src) > 2 * BTGATT_MAX_ATTR_LEN) {
+		BTT_LOG_S("Error: at most %u bytes, use long_write\n",
+				BTGATT_MAX_ATTR_LEN);
+		return -1;
+	}
+
+	return string_to_hex(src, dest);
 }
 
 /* default settings of advertisement data taken:
@@ -1035,7 +1584,7 @@ static void run_gatt_client_set_adv_data(int argc, char **argv)
 	req.max_interval = 0;
 	req.set_scan_rsp = 1;
 
-	process_request(BTT_GATT_CLIENT_REQ_SET_ADV_DATA, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_SET_ADV_DATA, &req);
 }
 
 static void run_gatt_client_get_device_type(int argc, char **argv)
@@ -1047,7 +1596,7 @@ static void run_gatt_client_get_device_type(int argc, char **argv)
 		return;
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_GET_DEVICE_TYPE, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_GET_DEVICE_TYPE, &req);
 }
 
 static void run_gatt_client_refresh(int argc, char **argv)
@@ -1061,7 +1610,51 @@ static void run_gatt_client_refresh(int argc, char **argv)
 		return;
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_REFRESH, &req, DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_REFRESH, &req);
+}
+
+static void run_gatt_client_connections(int argc, char **argv)
+{
+	struct btt_gatt_client_connections req;
+
+	process_request(BTT_GATT_CLIENT_REQ_CONNECTIONS, &req);
+}
+
+static void run_gatt_client_auto_reconnect(int argc, char **argv)
+{
+	struct btt_gatt_client_auto_reconnect req;
+
+	sscanf(argv[1], "%d", &req.client_if);
+
+	if (!sscanf_bdaddr(argv[2], req.addr.address)) {
+		BTT_LOG_S("Error: Incorrect address\n");
+		return;
+	}
+
+	sscanf(argv[3], "%u", &req.max_attempts);
+
+	process_request(BTT_GATT_CLIENT_REQ_AUTO_RECONNECT, &req);
+}
+
+static void run_gatt_client_cache(int argc, char **argv)
+{
+	struct btt_gatt_client_cache req;
+
+	if (!sscanf_bdaddr(argv[1], req.addr.address)) {
+		BTT_LOG_S("Error: Incorrect address\n");
+		return;
+	}
+
+	process_request(BTT_GATT_CLIENT_REQ_CACHE, &req);
+}
+
+static void run_gatt_client_discover_all(int argc, char **argv)
+{
+	struct btt_gatt_client_discover_all req;
+
+	sscanf(argv[1], "%d", &req.conn_id);
+
+	process_request(BTT_GATT_CLIENT_REQ_DISCOVER_ALL, &req);
 }
 
 static bool process_UUID_sscanf(char *src, uint8_t *dest)
@@ -1101,7 +1694,7 @@ static void run_gatt_client_search_service(int argc, char **argv)
 		req.is_filter = 0;
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_SEARCH_SERVICE, &req, LONG_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_SEARCH_SERVICE, &req);
 }
 
 static void run_gatt_client_get_included_service(int argc, char **argv)
@@ -1137,8 +1730,7 @@ static void run_gatt_client_get_included_service(int argc, char **argv)
 		sscanf(argv[7], "%"SCNd8, &req.start_incl_srvc_id.id.inst_id);
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_GET_INCLUDED_SERVICE, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_GET_INCLUDED_SERVICE, &req);
 }
 
 static void run_gatt_client_get_characteristic(int argc, char **argv)
@@ -1173,8 +1765,7 @@ static void run_gatt_client_get_characteristic(int argc, char **argv)
 		sscanf(argv[6], "%"SCNd8"", &req.start_char_id.inst_id);
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_GET_CHARACTERISTIC, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_GET_CHARACTERISTIC, &req);
 }
 
 static void run_gatt_client_get_descriptor(int argc, char **argv)
@@ -1216,8 +1807,7 @@ static void run_gatt_client_get_descriptor(int argc, char **argv)
 		sscanf(argv[8], "%"SCNd8"", &req.start_descr_id.inst_id);
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_GET_DESCRIPTOR, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_GET_DESCRIPTOR, &req);
 }
 
 static void run_gatt_client_read_characteristic(int argc, char **argv)
@@ -1246,8 +1836,7 @@ static void run_gatt_client_read_characteristic(int argc, char **argv)
 	 * 2 - AUTHENTICATION (MITM) */
 	sscanf(argv[7], "%d", &req.auth_req);
 
-	process_request(BTT_GATT_CLIENT_REQ_READ_CHARACTERISTIC, &req,
-			LONG_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_READ_CHARACTERISTIC, &req);
 }
 
 static void run_gatt_client_read_descriptor(int argc, char **argv)
@@ -1279,8 +1868,74 @@ static void run_gatt_client_read_descriptor(int argc, char **argv)
 	sscanf(argv[8], "%"SCNd8"", &req.descr_id.inst_id);
 	sscanf(argv[9], "%d", &req.auth_req);
 
-	process_request(BTT_GATT_CLIENT_REQ_READ_DESCRIPTOR, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_READ_DESCRIPTOR, &req);
+}
+
+/* <UUID>:<is_primary>:<inst_id>:<UUID>:<inst_id> */
+static bool read_multi_entry(char *src, struct btt_gatt_read_multi_entry *entry)
+{
+	char srvc_uuid[37];
+	char char_uuid[37];
+	char end;
+
+	if (sscanf(src, "%36[^:]:%"SCNu8":%"SCNu8":%36[^:]:%"SCNu8"%c",
+			srvc_uuid, &entry->srvc_id.is_primary,
+			&entry->srvc_id.id.inst_id, char_uuid,
+			&entry->char_id.inst_id, &end) != 5) {
+		BTT_LOG_S("Error: Incorrect characteristic %s\n", src);
+		return FALSE;
+	}
+
+	return process_UUID_sscanf(srvc_uuid, entry->srvc_id.id.uuid.uu) &&
+			process_UUID_sscanf(char_uuid, entry->char_id.uuid.uu);
+}
+
+/* characteristics from the arguments (up to BTT_GATT_READ_MULTI_MAX,
+ * more than MAX_ARGC allows for other commands) or separated by white
+ * space in the file after @ */
+static void run_gatt_client_read_multi(int argc, char **argv)
+{
+	struct btt_gatt_client_read_multi req;
+	char word[128];
+	FILE *file;
+	int i;
+
+	sscanf(argv[1], "%d", &req.conn_id);
+	sscanf(argv[2], "%d", &req.auth_req);
+	req.num = 0;
+
+	if (argv[3][0] != '@') {
+		for (i = 3; i < argc; i++)
+			if (!read_multi_entry(argv[i], &req.entry[req.num++]))
+				return;
+
+		process_request(BTT_GATT_CLIENT_REQ_READ_MULTI, &req);
+		return;
+	}
+
+	if (!(file = fopen(argv[3] + 1, "r"))) {
+		BTT_LOG_S("Error: Cannot open %s\n", argv[3] + 1);
+		return;
+	}
+
+	while (fscanf(file, "%127s", word) == 1) {
+		if (req.num == BTT_GATT_READ_MULTI_MAX) {
+			BTT_LOG_S("Error: at most %u characteristics\n",
+					BTT_GATT_READ_MULTI_MAX);
+			fclose(file);
+			return;
+		}
+
+		if (!read_multi_entry(word, &req.entry[req.num++])) {
+			fclose(file);
+			return;
+		}
+	}
+
+	fclose(file);
+
+	if (req.num)
+		process_request(BTT_GATT_CLIENT_REQ_READ_MULTI, &req);
 }
 
 static void run_gatt_client_write_characteristic(int argc, char **argv)
@@ -1308,16 +1963,14 @@ static void run_gatt_client_write_characteristic(int argc, char **argv)
 	 * 1 - ENCRIPTION
 	 * 2 - AUTHENTICATION (MITM) */
 	sscanf(argv[8], "%d", &req.auth_req);
-	sscanf(argv[9], "%s", input);
-	req.len = string_to_hex(input, (uint8_t *) &req.p_value);
+	req.len = attr_value_hex(argv[9], (uint8_t *) &req.p_value);
 
 	if (req.len < 0) {
 		BTT_LOG_S("Error: Incorrect hex value.\n");
 		return;
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_WRITE_CHARACTERISTIC, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_WRITE_CHARACTERISTIC, &req);
 }
 
 static void run_gatt_client_execute_write(int argc, char **argv)
@@ -1328,8 +1981,189 @@ static void run_gatt_client_execute_write(int argc, char **argv)
 	sscanf(argv[1], "%d", &req.conn_id);
 	sscanf(argv[2], "%d", &req.execute);
 
-	process_request(BTT_GATT_CLIENT_REQ_EXECUTE_WRITE, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_EXECUTE_WRITE, &req);
+}
+
+/* Value after @ is sent as it is read, so the file may be a pipe (FIFO)
+ * fed by another program. Its length is not known in advance, an empty
+ * message ends it. The file is read by the main loop next to the daemon
+ * socket, one chunk whenever it is readable, so events keep coming. */
+static struct {
+	int fd;
+	uint64_t total;
+	struct btt_gatt_client_long_write_data data;
+} stream = { .fd = -1 };
+
+static void stream_end(void)
+{
+	stream.data.len = 0;
+	process_request(BTT_GATT_CLIENT_REQ_LONG_WRITE_DATA, &stream.data);
+
+	close(stream.fd);
+	stream.fd = -1;
+}
+
+/* file of the running long_write stream, -1 if there is none */
+int gatt_client_stream_fd(void)
+{
+	return stream.fd;
+}
+
+void gatt_client_stream_ready(void)
+{
+	ssize_t got;
+
+	if (stream.fd == -1)
+		return;
+
+	got = read(stream.fd, stream.data.data, BTT_GATT_LONG_WRITE_DATA_LEN);
+
+	if (got == -1 && (errno == EINTR || errno == EAGAIN)) {
+		errno = 0;
+		return;
+	}
+
+	if (got == -1)
+		BTT_LOG_S("Error: Cannot read the value\n");
+
+	if (got <= 0) {
+		stream_end();
+		return;
+	}
+
+	stream.data.len = got;
+	process_request(BTT_GATT_CLIENT_REQ_LONG_WRITE_DATA, &stream.data);
+
+	if (errno == EPIPE) {
+		close(stream.fd);
+		stream.fd = -1;
+		return;
+	}
+
+	/* the daemon refuses the value already */
+	if ((stream.total += got) > BTT_GATT_LONG_WRITE_MAX_LEN) {
+		BTT_LOG_S("Error: Value must have at most %u bytes\n",
+				BTT_GATT_LONG_WRITE_MAX_LEN);
+		stream_end();
+	}
+}
+
+/* Value is streamed to the daemon, which writes it in chunks, see
+ * struct btt_gatt_client_long_write. Chunks of no response writes
+ * can be pipelined with window > 1 credits. */
+static void run_gatt_client_long_write(int argc, char **argv)
+{
+	struct btt_gatt_client_long_write req;
+	struct btt_gatt_client_long_write_data data;
+	unsigned int chunk = 0;
+	unsigned int window = 0;
+	uint8_t *value;
+	uint32_t offset;
+	int hex_len;
+	int fd;
+
+	sscanf(argv[1], "%d", &req.conn_id);
+
+	if (!process_UUID_sscanf(argv[2], req.srvc_id.id.uuid.uu))
+		return;
+
+	sscanf(argv[3], "%"SCNd8"", &req.srvc_id.is_primary);
+	sscanf(argv[4], "%"SCNd8"", &req.srvc_id.id.inst_id);
+
+	if (!process_UUID_sscanf(argv[5], req.char_id.uuid.uu))
+		return;
+
+	sscanf(argv[6], "%"SCNd8"", &req.char_id.inst_id);
+	sscanf(argv[7], "%d", &req.write_type);
+	sscanf(argv[8], "%d", &req.auth_req);
+
+	if (argc > 10)
+		sscanf(argv[10], "%u", &chunk);
+
+	if (argc > 11)
+		sscanf(argv[11], "%u", &window);
+
+	if (chunk > BTGATT_MAX_ATTR_LEN ||
+			window > BTT_GATT_LONG_WRITE_MAX_WINDOW) {
+		BTT_LOG_S("Error: chunk is at most %u, window at most %u\n",
+				BTGATT_MAX_ATTR_LEN, BTT_GATT_LONG_WRITE_MAX_WINDOW);
+		return;
+	}
+
+	req.chunk = chunk;
+	req.window = window;
+
+	/* written by the daemon at the full rate, nothing is streamed */
+	if (!strncmp(argv[9], "pattern:", 8)) {
+		req.pattern = 1;
+
+		if (sscanf(argv[9] + 8, "%"SCNu32, &req.len) != 1 || !req.len) {
+			BTT_LOG_S("Error: Incorrect pattern length\n");
+			return;
+		}
+
+		process_request(BTT_GATT_CLIENT_REQ_LONG_WRITE, &req);
+		return;
+	}
+
+	req.pattern = 0;
+	data.conn_id = req.conn_id;
+
+	if (argv[9][0] == '@') {
+		if (stream.fd != -1) {
+			BTT_LOG_S("Error: Another value is being streamed\n");
+			return;
+		}
+
+		/* FIFO is opened when its writer comes, then it must not block */
+		if ((fd = open(argv[9] + 1, O_RDONLY)) == -1 ||
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+			BTT_LOG_S("Error: Cannot open %s\n", argv[9] + 1);
+
+			if (fd != -1)
+				close(fd);
+
+			return;
+		}
+
+		/* length is known when the file ends */
+		req.len = 0;
+		process_request(BTT_GATT_CLIENT_REQ_LONG_WRITE, &req);
+
+		if (errno == EPIPE) {
+			close(fd);
+			return;
+		}
+
+		stream.fd = fd;
+		stream.total = 0;
+		stream.data.conn_id = req.conn_id;
+		return;
+	}
+
+	if (!(value = malloc(strlen(argv[9]) / 2 + 1)))
+		return;
+
+	if ((hex_len = string_to_hex(argv[9], value)) <= 0) {
+		BTT_LOG_S("Error: Incorrect hex value.\n");
+		free(value);
+		return;
+	}
+
+	req.len = hex_len;
+	process_request(BTT_GATT_CLIENT_REQ_LONG_WRITE, &req);
+
+	for (offset = 0; offset < req.len; offset += data.len) {
+		data.len = req.len - offset;
+
+		if (data.len > BTT_GATT_LONG_WRITE_DATA_LEN)
+			data.len = BTT_GATT_LONG_WRITE_DATA_LEN;
+
+		memcpy(data.data, value + offset, data.len);
+		process_request(BTT_GATT_CLIENT_REQ_LONG_WRITE_DATA, &data);
+	}
+
+	free(value);
 }
 
 static void run_gatt_client_write_descriptor(int argc, char **argv)
@@ -1363,16 +2197,14 @@ static void run_gatt_client_write_descriptor(int argc, char **argv)
 	 * 1 - ENCRIPTION
 	 * 2 - AUTHENTICATION (MITM) */
 	sscanf(argv[10], "%d", &req.auth_req);
-	sscanf(argv[11], "%s", input);
-	req.len = string_to_hex(input, (uint8_t *) &req.p_value);
+	req.len = attr_value_hex(argv[11], (uint8_t *) &req.p_value);
 
 	if (req.len < 0) {
 		BTT_LOG_S("Error: Incorrect hex value.\n");
 		return;
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_WRITE_DESCRIPTOR, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_WRITE_DESCRIPTOR, &req);
 }
 
 static void run_gatt_client_reg_for_notification(int argc, char **argv)
@@ -1401,8 +2233,7 @@ static void run_gatt_client_reg_for_notification(int argc, char **argv)
 
 	sscanf(argv[7], "%"SCNd8"", &req.char_id.inst_id);
 
-	process_request(BTT_GATT_CLIENT_REQ_REGISTER_FOR_NOTIFICATION, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_REGISTER_FOR_NOTIFICATION, &req);
 }
 
 static void run_gatt_client_dereg_for_notification(int argc, char **argv)
@@ -1431,8 +2262,77 @@ static void run_gatt_client_dereg_for_notification(int argc, char **argv)
 
 	sscanf(argv[7], "%"SCNd8"", &req.char_id.inst_id);
 
-	process_request(BTT_GATT_CLIENT_REQ_DEREGISTER_FOR_NOTIFICATION, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_DEREGISTER_FOR_NOTIFICATION, &req);
+}
+
+/* handle printed by cache or discover_all, decimal or 0x prefixed */
+static bool handle_sscanf(char *src, uint16_t *handle)
+{
+	unsigned long value;
+	char *end;
+
+	value = strtoul(src, &end, 0);
+
+	if (*end || !value || value > 0xFFFF) {
+		BTT_LOG_S("Error: Incorrect handle\n");
+		return FALSE;
+	}
+
+	*handle = value;
+	return TRUE;
+}
+
+static void run_gatt_client_read_handle(int argc, char **argv)
+{
+	struct btt_gatt_client_read_handle req;
+
+	sscanf(argv[1], "%"SCNd32"", &req.conn_id);
+
+	if (!handle_sscanf(argv[2], &req.handle))
+		return;
+
+	sscanf(argv[3], "%"SCNu8"", &req.auth_req);
+
+	process_request(BTT_GATT_CLIENT_REQ_READ_HANDLE, &req);
+}
+
+static void run_gatt_client_write_handle(int argc, char **argv)
+{
+	struct btt_gatt_client_write_handle req;
+	int len;
+
+	sscanf(argv[1], "%"SCNd32"", &req.conn_id);
+
+	if (!handle_sscanf(argv[2], &req.handle))
+		return;
+
+	sscanf(argv[3], "%"SCNu8"", &req.write_type);
+	sscanf(argv[4], "%"SCNu8"", &req.auth_req);
+	len = attr_value_hex(argv[5], req.value);
+
+	if (len < 0) {
+		BTT_LOG_S("Error: Incorrect hex value.\n");
+		return;
+	}
+
+	req.len = len;
+
+	process_request(BTT_GATT_CLIENT_REQ_WRITE_HANDLE, &req);
+}
+
+static void run_gatt_client_notify_handle(int argc, char **argv)
+{
+	struct btt_gatt_client_notify_handle req;
+
+	sscanf(argv[1], "%"SCNd32"", &req.client_if);
+	sscanf(argv[2], "%"SCNd32"", &req.conn_id);
+
+	if (!handle_sscanf(argv[3], &req.handle))
+		return;
+
+	sscanf(argv[4], "%"SCNu8"", &req.registered);
+
+	process_request(BTT_GATT_CLIENT_REQ_NOTIFY_HANDLE, &req);
 }
 
 static void run_gatt_client_test_command(int argc, char **argv)
@@ -1471,6 +2371,5 @@ static void run_gatt_client_test_command(int argc, char **argv)
 		}
 	}
 
-	process_request(BTT_GATT_CLIENT_REQ_TEST_COMMAND, &req,
-			DEFAULT_TIME_SEC);
+	process_request(BTT_GATT_CLIENT_REQ_TEST_COMMAND, &req);
 }
@@ -48,6 +48,20 @@ enum btt_gatt_client_req_t {
 	BTT_GATT_CLIENT_REQ_GET_DEVICE_TYPE,
 	BTT_GATT_CLIENT_REQ_SET_ADV_DATA,
 	BTT_GATT_CLIENT_REQ_TEST_COMMAND,
+	BTT_GATT_CLIENT_REQ_SCAN_RESET,
+	BTT_GATT_CLIENT_REQ_SCAN_SNAPSHOTS,
+	BTT_GATT_CLIENT_REQ_SCAN_FILTER,
+	BTT_GATT_CLIENT_REQ_SCAN_REPORT,
+	BTT_GATT_CLIENT_REQ_CACHE,
+	BTT_GATT_CLIENT_REQ_DISCOVER_ALL,
+	BTT_GATT_CLIENT_REQ_LONG_WRITE,
+	BTT_GATT_CLIENT_REQ_LONG_WRITE_DATA,
+	BTT_GATT_CLIENT_REQ_READ_MULTI,
+	BTT_GATT_CLIENT_REQ_CONNECTIONS,
+	BTT_GATT_CLIENT_REQ_AUTO_RECONNECT,
+	BTT_GATT_CLIENT_REQ_READ_HANDLE,
+	BTT_GATT_CLIENT_REQ_WRITE_HANDLE,
+	BTT_GATT_CLIENT_REQ_NOTIFY_HANDLE,
 	BTT_GATT_CLIENT_REQ_END
 };
 
@@ -58,6 +72,142 @@ struct btt_gatt_client_scan {
 	unsigned int start;
 };
 
+/* report devices of the running scan again */
+struct btt_gatt_client_scan_reset {
+	struct btt_message hdr;
+
+	int client_if;
+};
+
+/* devices changed during the scan are sent as BTT_EVENT_SCAN_SNAPSHOT
+ * every interval_ms, 0 stops it */
+struct btt_gatt_client_scan_snapshots {
+	struct btt_message hdr;
+
+	int client_if;
+	unsigned int interval_ms;
+};
+
+/* name prefix or manufacturer data after the company ID */
+#define BTT_SCAN_FILTER_MAX_DATA 29
+
+enum btt_scan_filter_type {
+	/* remove all rules, every device passes */
+	BTT_SCAN_FILTER_CLEAR,
+	BTT_SCAN_FILTER_UUID,
+	BTT_SCAN_FILTER_NAME,
+	BTT_SCAN_FILTER_MANUFACTURER,
+	BTT_SCAN_FILTER_RSSI,
+	BTT_SCAN_FILTER_ALLOW,
+	BTT_SCAN_FILTER_DENY
+};
+
+/* Add one rule to the scan filter of the daemon, devices which do not
+ * pass it are neither reported nor tracked. Fields used by the type:
+ * UUID uuid, NAME and MANUFACTURER data (and company, mask),
+ * RSSI rssi, ALLOW and DENY bda. The filter belongs to the client_if
+ * which set it, rules of others are refused as busy until it is cleared
+ * or the client is unregistered. */
+struct btt_gatt_client_scan_filter {
+	struct btt_message hdr;
+
+	int client_if;
+	unsigned int type;
+	int rssi;
+	bt_bdaddr_t bda;
+	bt_uuid_t uuid;
+	uint16_t company;
+	uint8_t len;
+	uint8_t data[BTT_SCAN_FILTER_MAX_DATA];
+	uint8_t mask[BTT_SCAN_FILTER_MAX_DATA];
+};
+
+/* Report a known device again when interval_ms passed since its last
+ * report, or when its RSSI moved by rssi_delta dBm or payload changed.
+ * Changes are reported at most once per interval_ms. All zero reports
+ * every device once per scan. Like the scan filter, the policy belongs
+ * to the client_if which set it until it is set to all zero. */
+struct btt_gatt_client_scan_report {
+	struct btt_message hdr;
+
+	int client_if;
+	unsigned int interval_ms;
+	unsigned int rssi_delta;
+	unsigned int payload;
+};
+
+/* attribute database of the device remembered by the daemon,
+ * answered by BTT_GATT_CLIENT_CB_CACHE */
+struct btt_gatt_client_cache {
+	struct btt_message hdr;
+
+	bt_bdaddr_t addr;
+};
+
+/* connections known to the daemon, answered by
+ * BTT_GATT_CLIENT_CB_CONNECTIONS */
+struct btt_gatt_client_connections {
+	struct btt_message hdr;
+};
+
+/* Connection of client_if to addr is opened again when it is lost
+ * without being asked for, at most max_attempts times in a row with
+ * a growing delay. 0 turns it off. */
+struct btt_gatt_client_auto_reconnect {
+	struct btt_message hdr;
+
+	int client_if;
+	bt_bdaddr_t addr;
+	uint32_t max_attempts;
+};
+
+/* Handle of an attribute remembered in the GATT cache of the device:
+ * type of the entry in the top bits, its number below. It stays valid
+ * until the cache of the device is invalidated, 0 is no handle. */
+#define BTT_GATT_HANDLE(type, number) ((uint16_t) ((type) << 12 | (number)))
+#define BTT_GATT_HANDLE_TYPE(handle) ((handle) >> 12)
+#define BTT_GATT_HANDLE_NUMBER(handle) ((handle) & 0x0FFF)
+
+/* Handle addressed variants of read_characteristic/read_descriptor,
+ * write_characteristic/write_descriptor and (de)register_for_notification,
+ * answered by the same callbacks. */
+struct btt_gatt_client_read_handle {
+	struct btt_message hdr;
+
+	int32_t conn_id;
+	uint16_t handle;
+	uint8_t auth_req;
+};
+
+struct btt_gatt_client_write_handle {
+	struct btt_message hdr;
+
+	int32_t conn_id;
+	uint16_t handle;
+	uint8_t write_type;
+	uint8_t auth_req;
+	uint16_t len;
+	/* trailer, only len bytes of it are sent */
+	uint8_t value[BTGATT_MAX_ATTR_LEN];
+};
+
+struct btt_gatt_client_notify_handle {
+	struct btt_message hdr;
+
+	int32_t client_if;
+	int32_t conn_id;
+	uint16_t handle;
+	uint8_t registered;
+};
+
+/* services, characteristics and descriptors of the connection found
+ * by the daemon, see BTT_GATT_CLIENT_CB_DISCOVER_ALL */
+struct btt_gatt_client_discover_all {
+	struct btt_message hdr;
+
+	int conn_id;
+};
+
 struct btt_gatt_client_register_client {
 	struct btt_message hdr;
 
@@ -196,9 +346,74 @@ struct btt_gatt_client_write_characteristic {
 	int write_type;
 	int len;
 	int auth_req;
+	/* trailer, only len bytes of it are sent */
 	char p_value[BTGATT_MAX_ATTR_LEN];
 };
 
+/* value of any length written in chunks by the daemon */
+#define BTT_GATT_LONG_WRITE_MAX_LEN  (16 * 1024 * 1024)
+#define BTT_GATT_LONG_WRITE_DATA_LEN 4096
+/* ATT_MTU 23 minus the write request header */
+#define BTT_GATT_LONG_WRITE_DEFAULT_CHUNK 20
+#define BTT_GATT_LONG_WRITE_MAX_WINDOW    64
+
+/* Starts the long write of len bytes, the value follows in
+ * btt_gatt_client_long_write_data messages. With len 0 the length is
+ * not known, the value ends with an empty data message. Chunks are
+ * written with write_type, window is the number of credits: a write
+ * takes one, its callback returns it. The prepare type is refused,
+ * a value up to BTGATT_MAX_ATTR_LEN written with response and the
+ * default chunk goes in one write which the stack prepares and
+ * executes itself.
+ * Answered by BTT_GATT_CLIENT_CB_LONG_WRITE. */
+struct btt_gatt_client_long_write {
+	struct btt_message hdr;
+
+	int conn_id;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+	int write_type;
+	int auth_req;
+	uint32_t len;
+	/* 0 means the default */
+	uint16_t chunk;
+	uint16_t window;
+	/* value is not sent, the daemon writes bytes 00, 01 .. FF, 00 ..,
+	 * len is not limited then */
+	uint8_t pattern;
+};
+
+/* only the first error of the value is answered with the request
+ * status */
+struct btt_gatt_client_long_write_data {
+	struct btt_message hdr;
+
+	int conn_id;
+	uint32_t len;
+	/* trailer, only len bytes of it are sent */
+	uint8_t data[BTT_GATT_LONG_WRITE_DATA_LEN];
+};
+
+#define BTT_GATT_READ_MULTI_MAX 64
+
+struct btt_gatt_read_multi_entry {
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+};
+
+/* Characteristics read one after another by the daemon, the next read
+ * is made by the callback of the previous one. Values come in
+ * BTT_GATT_CLIENT_CB_READ_MULTI parts when all are read. */
+struct btt_gatt_client_read_multi {
+	struct btt_message hdr;
+
+	int conn_id;
+	int auth_req;
+	uint16_t num;
+	/* trailer, only num entries are sent */
+	struct btt_gatt_read_multi_entry entry[BTT_GATT_READ_MULTI_MAX];
+};
+
 struct btt_gatt_client_execute_write {
 	struct btt_message hdr;
 
@@ -216,6 +431,7 @@ struct btt_gatt_client_write_descriptor {
 	int write_type;
 	int len;
 	int auth_req;
+	/* trailer, only len bytes of it are sent */
 	char p_value[BTGATT_MAX_ATTR_LEN];
 };
 
@@ -263,6 +479,185 @@ struct btt_gatt_client_cb_scan_result {
 	uint8_t discoverable_mode;
 };
 
+/* state of one device in the scan session, RSSI in dBm, 127 if unknown,
+ * times in ms since the session started */
+struct btt_gatt_client_scan_device {
+	uint8_t bd_addr[BD_ADDR_LEN];
+	int8_t rssi;
+	int8_t rssi_min;
+	int8_t rssi_max;
+	/* moving average */
+	int8_t rssi_avg;
+	uint16_t payload_changes;
+	uint32_t count;
+	uint32_t first_seen_ms;
+	uint32_t last_seen_ms;
+	/* estimated advertising interval */
+	uint32_t interval_ms;
+	uint32_t payload_hash;
+};
+
+#define BTT_SCAN_SNAPSHOT_MAX_DEVICES 30
+
+/* devices changed since the previous snapshot, a snapshot with more
+ * changes than fit is split, more is set on all parts but the last */
+struct btt_gatt_client_cb_scan_snapshot {
+	struct btt_message hdr;
+
+	/* in the session */
+	uint32_t devices;
+	uint16_t num;
+	uint16_t more;
+	struct btt_gatt_client_scan_device device[BTT_SCAN_SNAPSHOT_MAX_DEVICES];
+};
+
+enum btt_gatt_cache_type {
+	BTT_GATT_CACHE_SERVICE = 1,
+	BTT_GATT_CACHE_CHARACTERISTIC,
+	BTT_GATT_CACHE_DESCRIPTOR
+};
+
+/* One cached attribute. Entries of each type are numbered from 0 in
+ * the order they come, parent of a characteristic is the number of its
+ * service, parent of a descriptor the number of its characteristic. */
+struct btt_gatt_cache_entry {
+	uint8_t type;
+	/* is_primary of a service, properties of a characteristic */
+	uint8_t flags;
+	uint16_t parent;
+	/* see BTT_GATT_HANDLE */
+	uint16_t handle;
+	btgatt_gatt_id_t id;
+};
+
+#define BTT_GATT_CACHE_MSG_ENTRIES 128
+
+/* services, then characteristics, then descriptors, split into parts,
+ * more is set on all parts but the last */
+struct btt_gatt_client_cb_cache {
+	struct btt_message hdr;
+
+	bt_bdaddr_t addr;
+	uint8_t found;
+	uint8_t more;
+	uint16_t num;
+	struct btt_gatt_cache_entry entry[BTT_GATT_CACHE_MSG_ENTRIES];
+};
+
+/* parts fit into one daemon event */
+#define BTT_GATT_DISCOVER_MSG_ENTRIES 40
+
+/* Tree found by discover_all, numbered like btt_gatt_cache_entry.
+ * Parts come in order, BTT_GATT_CLIENT_CB_DISCOVER_ALL_COMPLETE
+ * follows the last one. */
+struct btt_gatt_client_cb_discover_all {
+	struct btt_message hdr;
+
+	int conn_id;
+	uint16_t num;
+	struct btt_gatt_cache_entry entry[BTT_GATT_DISCOVER_MSG_ENTRIES];
+};
+
+struct btt_gatt_client_cb_discover_all_complete {
+	struct btt_message hdr;
+
+	int conn_id;
+	int status;
+	uint16_t services;
+	uint16_t characteristics;
+	uint16_t descriptors;
+	uint32_t duration_ms;
+};
+
+/* len is the number of bytes acknowledged by the remote device,
+ * latency is from the write to its callback, stalls are the times
+ * a chunk was ready but no credit was left */
+struct btt_gatt_client_cb_long_write {
+	struct btt_message hdr;
+
+	int conn_id;
+	int status;
+	uint32_t len;
+	uint32_t writes;
+	uint32_t duration_ms;
+	uint32_t latency_p50_us;
+	uint32_t latency_p90_us;
+	uint32_t latency_p99_us;
+	uint32_t latency_max_us;
+	uint32_t stalls;
+	uint32_t stall_ms;
+	/* writes refused by the full HAL queue and retried */
+	uint32_t busy;
+};
+
+/* parts fit into one daemon event */
+#define BTT_GATT_READ_MULTI_DATA_LEN 960
+
+/* header of the value in btt_gatt_client_cb_read_multi,
+ * len bytes of the value follow it */
+struct btt_gatt_read_multi_value {
+	uint16_t index;
+	uint16_t value_type;
+	uint16_t len;
+	uint8_t status;
+	uint8_t reserved;
+};
+
+/* Values of read_multi in the order of the request, packed into data.
+ * Parts come in order, BTT_GATT_CLIENT_CB_READ_MULTI_COMPLETE follows
+ * the last one. */
+struct btt_gatt_client_cb_read_multi {
+	struct btt_message hdr;
+
+	int conn_id;
+	uint16_t num;
+	uint16_t len;
+	/* trailer, only len bytes of it are sent */
+	uint8_t data[BTT_GATT_READ_MULTI_DATA_LEN];
+};
+
+struct btt_gatt_client_cb_read_multi_complete {
+	struct btt_message hdr;
+
+	int conn_id;
+	int status;
+	uint16_t num;
+	uint16_t failed;
+	uint32_t duration_ms;
+};
+
+#define BTT_GATT_MAX_CONNECTIONS 16
+
+enum btt_gatt_connection_state {
+	BTT_GATT_CONNECTION_CONNECTING = 1,
+	BTT_GATT_CONNECTION_CONNECTED,
+	BTT_GATT_CONNECTION_DISCONNECTING,
+	/* waiting to reconnect */
+	BTT_GATT_CONNECTION_BACKOFF
+};
+
+struct btt_gatt_connection_info {
+	bt_bdaddr_t addr;
+	uint8_t state;
+	uint8_t bonded;
+	int32_t client_if;
+	int32_t conn_id;
+	uint16_t mtu;
+	/* ATT operations of clients, sent to the HAL and waiting for it */
+	uint16_t in_flight;
+	uint16_t queued;
+	uint16_t reconnects;
+	uint32_t operations;
+	uint32_t connected_ms;
+};
+
+struct btt_gatt_client_cb_connections {
+	struct btt_message hdr;
+
+	uint16_t num;
+	struct btt_gatt_connection_info entry[BTT_GATT_MAX_CONNECTIONS];
+};
+
 static const char *discoverable_mode[3] = {
 		"Undiscoverable",
 		"LE Limited",
@@ -424,12 +819,20 @@ struct btt_gatt_client_cb_reg_for_notification {
 	btgatt_gatt_id_t char_id;
 };
 
+/* value is a trailer, only len bytes of it are sent */
 struct btt_gatt_client_cb_notify {
 	struct btt_message hdr;
 
 	int conn_id;
-	btgatt_notify_params_t p_data;
+	bt_bdaddr_t bda;
+	btgatt_srvc_id_t srvc_id;
+	btgatt_gatt_id_t char_id;
+	uint8_t is_notify;
+	uint16_t len;
+	uint8_t value[BTGATT_MAX_ATTR_LEN];
 };
 
 extern void handle_gattc_cb(const struct btt_message *btt_cb);
 extern void run_gatt_client(int argc, char **argv);
+extern int gatt_client_stream_fd(void);
+extern void gatt_client_stream_ready(void);
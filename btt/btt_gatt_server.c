@@ -84,8 +84,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, register_server, BTT_GATT_SERVER_CMD_REGISTER_SERVER);
 
-		if (send(app_socket, register_server,
-				sizeof(struct btt_gatt_server_reg), 0) == -1)
+		if (send_request(app_socket, register_server,
+				sizeof(struct btt_gatt_server_reg)) == -1)
 			return;
 
 		break;
@@ -97,8 +97,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 		FILL_MSG_P(data, unregister_server,
 				BTT_GATT_SERVER_CMD_UNREGISTER_SERVER);
 
-		if (send(app_socket, unregister_server,
-				sizeof(struct btt_gatt_server_unreg), 0) == -1)
+		if (send_request(app_socket, unregister_server,
+				sizeof(struct btt_gatt_server_unreg)) == -1)
 			return;
 
 		break;
@@ -109,8 +109,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, connect, BTT_GATT_SERVER_CMD_CONNECT);
 
-		if (send(app_socket, connect,
-				sizeof(struct btt_gatt_server_connect), 0) == -1)
+		if (send_request(app_socket, connect,
+				sizeof(struct btt_gatt_server_connect)) == -1)
 			return;
 
 		break;
@@ -121,8 +121,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, disconnect, BTT_GATT_SERVER_CMD_DISCONNECT);
 
-		if (send(app_socket, disconnect,
-				sizeof(struct btt_gatt_server_disconnect), 0) == -1)
+		if (send_request(app_socket, disconnect,
+				sizeof(struct btt_gatt_server_disconnect)) == -1)
 			return;
 
 		break;
@@ -133,8 +133,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, add_service, BTT_GATT_SERVER_CMD_ADD_SERVICE);
 
-		if (send(app_socket, add_service,
-				sizeof(struct btt_gatt_server_add_service), 0) == -1)
+		if (send_request(app_socket, add_service,
+				sizeof(struct btt_gatt_server_add_service)) == -1)
 			return;
 
 		break;
@@ -145,8 +145,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, add, BTT_GATT_SERVER_CMD_ADD_INCLUDED_SERVICE);
 
-		if (send(app_socket, add,
-				sizeof(struct btt_gatt_server_add_included_srvc), 0) == -1)
+		if (send_request(app_socket, add,
+				sizeof(struct btt_gatt_server_add_included_srvc)) == -1)
 			return;
 
 		break;
@@ -157,8 +157,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, add, BTT_GATT_SERVER_CMD_ADD_CHARACTERISTIC);
 
-		if (send(app_socket, add,
-				sizeof(struct btt_gatt_server_add_characteristic), 0) == -1)
+		if (send_request(app_socket, add,
+				sizeof(struct btt_gatt_server_add_characteristic)) == -1)
 			return;
 
 		break;
@@ -169,8 +169,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, add, BTT_GATT_SERVER_CMD_ADD_DESCRIPTOR);
 
-		if (send(app_socket, add,
-				sizeof(struct btt_gatt_server_add_descriptor), 0) == -1)
+		if (send_request(app_socket, add,
+				sizeof(struct btt_gatt_server_add_descriptor)) == -1)
 			return;
 
 		break;
@@ -181,8 +181,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, start, BTT_GATT_SERVER_CMD_START_SERVICE);
 
-		if (send(app_socket, start,
-				sizeof(struct btt_gatt_server_start_service), 0) == -1)
+		if (send_request(app_socket, start,
+				sizeof(struct btt_gatt_server_start_service)) == -1)
 			return;
 
 		break;
@@ -193,8 +193,8 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 		FILL_MSG_P(data, stop_service, BTT_GATT_SERVER_CMD_STOP_SERVICE);
 
-		if (send(app_socket, stop_service,
-				sizeof(struct btt_gatt_server_stop_service), 0) == -1)
+		if (send_request(app_socket, stop_service,
+				sizeof(struct btt_gatt_server_stop_service)) == -1)
 			return;
 
 		break;
@@ -228,9 +228,9 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 		struct btt_gatt_server_send_indication *send_ind;
 
 		FILL_MSG_P(data, send_ind, BTT_GATT_SERVER_CMD_SEND_INDICATION);
+		TRIM_TRAILER(*send_ind, p_value, send_ind->len);
 
-		if (send(app_socket, send_ind,
-				sizeof(struct btt_gatt_server_send_indication),0) == -1)
+		if (send_request(app_socket, send_ind, MSG_SIZE(*send_ind)) == -1)
 			return;
 
 		break;
@@ -242,14 +242,12 @@ static void process_request(enum btt_gatt_server_req_t type, void *data)
 
 void handle_gatts_cb(const struct btt_message *btt_cb)
 {
-	char *buffer;
-
 	switch (btt_cb->command) {
 	case BTT_GATT_SERVER_CB_BT_STATUS:
 	{
 		struct btt_gatt_server_cb_bt_status cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -263,7 +261,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_reg_result cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -280,7 +278,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_connect cb;
 
-		if (!RECV(&cb,app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -294,11 +292,39 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 
 		break;
 	}
+	case BTT_GATT_SERVER_CB_REQUEST_WRITE:
+	{
+		struct btt_gatt_server_cb_request_write cb;
+		int i;
+
+		if (!MSG_COPY_TRAILER(&cb, btt_cb, value) || cb.length < 0 ||
+				(size_t) cb.length != TRAILER_LEN(cb, value)) {
+			BTT_LOG_S("Error: incorrect size of received structure.\n");
+			return;
+		}
+
+		BTT_LOG_S("\nGATTS: Request write.\n");
+		BTT_LOG_S("Address: ");
+		print_bdaddr(cb.bda.address);
+		BTT_LOG_S("\nConnection ID: %d\n", cb.conn_id);
+		BTT_LOG_S("Transaction ID: %d\n", cb.trans_id);
+		BTT_LOG_S("Attribute handle: %d\n", cb.attr_handle);
+		BTT_LOG_S("Offset: %d\n", cb.offset);
+		BTT_LOG_S("Need response: %s\n", cb.need_rsp ? "TRUE" : "FALSE");
+		BTT_LOG_S("Prepared: %s\n", cb.is_prep ? "TRUE" : "FALSE");
+		BTT_LOG_S("Value: ");
+
+		for (i = 0; i < cb.length; i++)
+			BTT_LOG_S("%.2X", cb.value[i]);
+
+		BTT_LOG_S("\n\n");
+		break;
+	}
 	case BTT_GATT_SERVER_CB_ADD_SERVICE:
 	{
 		struct btt_gatt_server_cb_add_service cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -318,7 +344,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_add_included_srvc cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -336,7 +362,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_add_characteristic cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -354,7 +380,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_add_descriptor cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -372,7 +398,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_start_service cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -388,7 +414,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_stop_service cb;
 
-		if (!RECV(&cb,app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -404,7 +430,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_delete_service cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -420,7 +446,7 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 	{
 		struct btt_gatt_server_cb_response_confirmation cb;
 
-		if (!RECV(&cb, app_socket)) {
+		if (!MSG_COPY(&cb, btt_cb)) {
 			BTT_LOG_S("Error: incorrect size of received structure.\n");
 			return;
 		}
@@ -432,13 +458,6 @@ void handle_gatts_cb(const struct btt_message *btt_cb)
 		break;
 	}
 	default:
-		buffer = malloc(btt_cb->length);
-
-		if (buffer) {
-			recv(app_socket, buffer, btt_cb->length, 0);
-			free(buffer);
-		}
-
 		break;
 	}
 }
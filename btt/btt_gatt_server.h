@@ -135,6 +135,7 @@ struct btt_gatt_server_send_indication {
 	int conn_id;
 	int len;
 	int confirm;
+	/* trailer, only len bytes of it are sent */
 	char p_value[BTGATT_MAX_ATTR_LEN];
 };
 
@@ -250,6 +251,7 @@ struct btt_gatt_server_cb_request_write {
 	int length;
 	int need_rsp;
 	int is_prep;
+	/* trailer, only length bytes of it are sent */
 	uint8_t value[BTGATT_MAX_ATTR_LEN];
 };
 
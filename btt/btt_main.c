@@ -26,11 +26,16 @@
 
 #include "btt_daemon_main.h"
 #include "btt_utils.h"
+#include "btt_framing.h"
+#include "btt_shm.h"
 
 static void run_help(int argc, char **argv);
 static void run_exit(int argc, char **argv);
 
 int app_socket = -1;
+struct btt_framing app_rx = { .socket = -1 };
+/* optional ring for scan results and notifications, see "daemon shm" */
+struct btt_shm app_shm = { .mem_fd = -1, .event_fd = -1 };
 
 static struct command commands[] = {
 		{ "help",    "", run_help    },
@@ -120,6 +125,39 @@ static void signal_init(void)
 	signal(SIGPIPE, SIG_IGN);
 }
 
+static void dispatch_cb(const struct btt_message *btt_cb)
+{
+	/* status or completion of our own request */
+	if (btt_cb->request_id)
+		BTT_LOG_S("\n[request %u]", btt_cb->request_id);
+
+	if (btt_cb->command > BTT_DAEMON_CMD_RSP_START &&
+			btt_cb->command < BTT_DAEMON_CMD_RSP_END)
+		handle_daemon_cb(btt_cb);
+	else if (btt_cb->command >= BTT_ADAPTER_CB_START &&
+			btt_cb->command <= BTT_ADAPTER_CB_END)
+		handle_adapter_cb(btt_cb);
+	else if (btt_cb->command >= BTT_GATT_CLIENT_CB_START &&
+			btt_cb->command <= BTT_GATT_CLIENT_CB_END)
+		handle_gattc_cb(btt_cb);
+	else if (btt_cb->command >= BTT_GATT_SERVER_CB_START &&
+			btt_cb->command <= BTT_GATT_SERVER_CB_END)
+		handle_gatts_cb(btt_cb);
+}
+
+/* consume whole ring, then ask daemon for a wakeup */
+static void drain_shm(void)
+{
+	struct btt_message *btt_cb;
+
+	do {
+		while ((btt_cb = btt_shm_next(&app_shm)) != NULL) {
+			dispatch_cb(btt_cb);
+			btt_shm_consume(&app_shm, btt_cb);
+		}
+	} while (!btt_shm_arm(&app_shm));
+}
+
 static void run_exit(int argc, char **argv)
 {
 	free_argv(argv, argc + 1);
@@ -131,11 +169,12 @@ static void run_exit(int argc, char **argv)
 int main(int argc, char **argv)
 {
 	unsigned int i;
-	int length = 0;
 	int argc2, tmp;
-	char buff[BUFSIZ], **argv2, *buffer;
+	char buff[BUFSIZ], **argv2;
 	fd_set set;
-	struct btt_message btt_cb;
+	int max_fd;
+	int stream_fd;
+	struct btt_message *btt_cb;
 
 	FD_ZERO(&set);
 	FD_SET(fileno(stdin), &set);
@@ -150,11 +189,26 @@ int main(int argc, char **argv)
 		FD_ZERO(&set);
 		FD_SET(fileno(stdin), &set);
 
-		if (app_socket > 0)
+		max_fd = fileno(stdin);
+
+		if (app_socket > 0) {
 			FD_SET(app_socket, &set);
+			max_fd = app_socket > max_fd ? app_socket : max_fd;
+		}
 
-		if (select((app_socket > 0 ? app_socket : fileno(stdin)) + 1, &set,
-				NULL, NULL, NULL) == -1) {
+		if (app_shm.ring) {
+			drain_shm();
+			FD_SET(app_shm.event_fd, &set);
+			max_fd = app_shm.event_fd > max_fd ? app_shm.event_fd : max_fd;
+		}
+
+		/* value of a long write read from a file or a pipe */
+		if ((stream_fd = gatt_client_stream_fd()) != -1) {
+			FD_SET(stream_fd, &set);
+			max_fd = stream_fd > max_fd ? stream_fd : max_fd;
+		}
+
+		if (select(max_fd + 1, &set, NULL, NULL, NULL) == -1) {
 			BTT_LOG_E("ERROR: Select error. ");
 			return 1;
 		}
@@ -208,40 +262,28 @@ int main(int argc, char **argv)
 		}
 
 		if (app_socket > 0 && FD_ISSET(app_socket, &set)) {
-			length = (int) recv(app_socket, &btt_cb,
-					sizeof(struct btt_message), MSG_PEEK);
+			if (app_rx.socket != app_socket)
+				btt_framing_init(&app_rx, app_socket);
 
-			if ((length == 0 || errno)) {
-				buffer = malloc(btt_cb.length);
+			btt_framing_fill(&app_rx, 0);
 
-				if (buffer) {
-					recv(app_socket, buffer, 256, 0);
-					free(buffer);
-				}
+			while ((btt_cb = btt_framing_next(&app_rx)) != NULL)
+				dispatch_cb(btt_cb);
 
+			if (app_rx.closed) {
+				btt_framing_close_fds(&app_rx);
+				btt_shm_close(&app_shm);
+				close(app_socket);
 				app_socket = -1;
 				errno = 0;
-				continue;
 			}
+		}
 
-			if (btt_cb.command >= BTT_ADAPTER_CB_START &&
-					btt_cb.command <= BTT_ADAPTER_CB_END) {
-				handle_adapter_cb(&btt_cb);
-			} else if (btt_cb.command >= BTT_GATT_CLIENT_CB_START &&
-					btt_cb.command <= BTT_GATT_CLIENT_CB_END) {
-				handle_gattc_cb(&btt_cb);
-			} else if (btt_cb.command >= BTT_GATT_SERVER_CB_START &&
-					btt_cb.command <= BTT_GATT_SERVER_CB_END) {
-				handle_gatts_cb(&btt_cb);
-			} else {
-				buffer = malloc(btt_cb.length);
+		if (app_shm.ring && FD_ISSET(app_shm.event_fd, &set))
+			btt_shm_clear_wakeup(&app_shm);
 
-				if (buffer) {
-					recv(app_socket, buffer, btt_cb.length, 0);
-					free(buffer);
-				}
-			}
-		}
+		if (stream_fd != -1 && FD_ISSET(stream_fd, &set))
+			gatt_client_stream_ready();
 
 	}
 
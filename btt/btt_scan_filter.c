@@ -0,0 +1,285 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_utils.h"
+#include "btt_gatt_client.h"
+#include "btt_eir_data_types.h"
+#include "btt_ad_parser.h"
+#include "btt_scan_filter.h"
+
+/* BASE_UUID without its short part, see btt_ad_parser.c */
+static const uint8_t base_uuid[12] = { 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00,
+		0x00, 0x80, 0x00, 0x10, 0x00, 0x00 };
+
+void btt_scan_filter_init(struct btt_scan_filter *filter)
+{
+	filter->checks = 0;
+	filter->rssi_min = 0;
+	filter->uuids_num = 0;
+	filter->names_num = 0;
+	filter->manufacturers_num = 0;
+
+	filter->allow.slots = filter->allow_pool;
+	filter->allow.bits = BTT_SCAN_FILTER_ADDR_BITS;
+	bdaddr_set_clear(&filter->allow);
+
+	filter->deny.slots = filter->deny_pool;
+	filter->deny.bits = BTT_SCAN_FILTER_ADDR_BITS;
+	bdaddr_set_clear(&filter->deny);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+bool btt_scan_filter_add_uuid(struct btt_scan_filter *filter,
+		const bt_uuid_t *uuid)
+{
+	struct btt_scan_filter_uuid *rule;
+
+	if (filter->uuids_num >= BTT_SCAN_FILTER_MAX_UUIDS)
+		return FALSE;
+
+	rule = &filter->uuids[filter->uuids_num++];
+	rule->uuid = *uuid;
+	rule->is_short = !memcmp(uuid->uu, base_uuid, sizeof(base_uuid));
+	rule->short_uuid = get_le32(&uuid->uu[12]);
+	filter->checks |= BTT_SCAN_CHECK_UUID;
+
+	return TRUE;
+}
+
+bool btt_scan_filter_add_name(struct btt_scan_filter *filter,
+		const uint8_t *prefix, uint8_t len)
+{
+	struct btt_scan_filter_bytes *rule;
+
+	if (filter->names_num >= BTT_SCAN_FILTER_MAX_NAMES ||
+			len > BTT_SCAN_FILTER_MAX_DATA)
+		return FALSE;
+
+	rule = &filter->names[filter->names_num++];
+	rule->len = len;
+	memcpy(rule->data, prefix, len);
+	filter->checks |= BTT_SCAN_CHECK_NAME;
+
+	return TRUE;
+}
+
+/* data after the company ID has to match under mask, NULL mask
+ * compares all bits */
+bool btt_scan_filter_add_manufacturer(struct btt_scan_filter *filter,
+		uint16_t company, const uint8_t *data, const uint8_t *mask,
+		uint8_t len)
+{
+	struct btt_scan_filter_bytes *rule;
+	unsigned int i;
+
+	if (filter->manufacturers_num >= BTT_SCAN_FILTER_MAX_MANUFACTURERS ||
+			len > BTT_SCAN_FILTER_MAX_DATA)
+		return FALSE;
+
+	rule = &filter->manufacturers[filter->manufacturers_num++];
+	rule->company = company;
+	rule->len = len;
+
+	/* data are kept masked, so matching is one AND and compare */
+	for (i = 0; i < len; i++) {
+		rule->mask[i] = mask ? mask[i] : 0xFF;
+		rule->data[i] = data[i] & rule->mask[i];
+	}
+
+	filter->checks |= BTT_SCAN_CHECK_MANUFACTURER;
+
+	return TRUE;
+}
+
+void btt_scan_filter_set_rssi(struct btt_scan_filter *filter, int rssi_min)
+{
+	filter->rssi_min = rssi_min;
+	filter->checks |= BTT_SCAN_CHECK_RSSI;
+}
+
+bool btt_scan_filter_allow(struct btt_scan_filter *filter, const uint8_t *bda)
+{
+	bool added;
+
+	if (bdaddr_set_insert(&filter->allow, bda, &added) < 0)
+		return FALSE;
+
+	filter->checks |= BTT_SCAN_CHECK_ALLOW;
+	return TRUE;
+}
+
+bool btt_scan_filter_deny(struct btt_scan_filter *filter, const uint8_t *bda)
+{
+	bool added;
+
+	if (bdaddr_set_insert(&filter->deny, bda, &added) < 0)
+		return FALSE;
+
+	filter->checks |= BTT_SCAN_CHECK_DENY;
+	return TRUE;
+}
+
+/* checks which need no advertising data */
+bool btt_scan_filter_match_addr(const struct btt_scan_filter *filter,
+		const uint8_t *bda, int rssi)
+{
+	unsigned int checks = filter->checks;
+
+	if ((checks & BTT_SCAN_CHECK_DENY) &&
+			bdaddr_set_contains(&filter->deny, bda))
+		return FALSE;
+
+	if ((checks & BTT_SCAN_CHECK_ALLOW) &&
+			!bdaddr_set_contains(&filter->allow, bda))
+		return FALSE;
+
+	if ((checks & BTT_SCAN_CHECK_RSSI) && rssi < filter->rssi_min)
+		return FALSE;
+
+	return TRUE;
+}
+
+static bool match_uuid(const struct btt_scan_filter *filter,
+		const uint8_t *data, unsigned int width)
+{
+	uint32_t short_uuid = 0;
+	unsigned int i;
+
+	if (width == 2)
+		short_uuid = data[0] | (data[1] << 8);
+	else if (width == 4)
+		short_uuid = get_le32(data);
+
+	for (i = 0; i < filter->uuids_num; i++) {
+		const struct btt_scan_filter_uuid *rule = &filter->uuids[i];
+
+		if (width == 16) {
+			if (!memcmp(rule->uuid.uu, data, 16))
+				return TRUE;
+		} else if (rule->is_short && rule->short_uuid == short_uuid) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* any UUID list or service data carrying one of the UUIDs */
+static bool match_uuids(const struct btt_scan_filter *filter,
+		const struct btt_ad *ad)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < ad->fields_num; i++) {
+		const struct btt_ad_field *field = &ad->fields[i];
+		unsigned int width = btt_ad_uuid_width(field->type);
+		unsigned int count = btt_ad_uuid_count(field);
+
+		/* service data has a single UUID followed by data */
+		if (count && (field->type == SERVICE_DATA_16_BIT_UUID ||
+				field->type == SERVICE_DATA_32_BIT_UUID ||
+				field->type == SERVICE_DATA_128_BIT_UUID))
+			count = 1;
+
+		for (j = 0; j < count; j++) {
+			if (match_uuid(filter, field->data + j * width, width))
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static bool match_names(const struct btt_scan_filter *filter,
+		const struct btt_ad *ad)
+{
+	const char *name;
+	uint8_t len;
+	bool complete;
+	unsigned int i;
+
+	if (!btt_ad_name(ad, &name, &len, &complete))
+		return FALSE;
+
+	for (i = 0; i < filter->names_num; i++) {
+		const struct btt_scan_filter_bytes *rule = &filter->names[i];
+
+		if (rule->len <= len && !memcmp(name, rule->data, rule->len))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static bool match_manufacturers(const struct btt_scan_filter *filter,
+		const struct btt_ad *ad)
+{
+	const struct btt_ad_field *field;
+	unsigned int i, j;
+
+	field = btt_ad_find(ad, MANUFACTURER_SPECIFIC_DATA);
+
+	for (; field; field = btt_ad_next(ad, field)) {
+		uint16_t company;
+
+		if (field->len < 2)
+			continue;
+
+		company = field->data[0] | (field->data[1] << 8);
+
+		for (i = 0; i < filter->manufacturers_num; i++) {
+			const struct btt_scan_filter_bytes *rule =
+					&filter->manufacturers[i];
+
+			if (rule->company != company || rule->len > field->len - 2)
+				continue;
+
+			for (j = 0; j < rule->len; j++) {
+				if ((field->data[2 + j] & rule->mask[j]) != rule->data[j])
+					break;
+			}
+
+			if (j == rule->len)
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* checks which need parsed advertising data */
+bool btt_scan_filter_match_ad(const struct btt_scan_filter *filter,
+		const struct btt_ad *ad)
+{
+	unsigned int checks = filter->checks;
+
+	if ((checks & BTT_SCAN_CHECK_UUID) && !match_uuids(filter, ad))
+		return FALSE;
+
+	if ((checks & BTT_SCAN_CHECK_NAME) && !match_names(filter, ad))
+		return FALSE;
+
+	if ((checks & BTT_SCAN_CHECK_MANUFACTURER) &&
+			!match_manufacturers(filter, ad))
+		return FALSE;
+
+	return TRUE;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_SCAN_FILTER_H
+#error Included twice
+#endif
+#define BTT_SCAN_FILTER_H
+
+/* requires btt_utils.h, btt_gatt_client.h and btt_ad_parser.h */
+
+#define BTT_SCAN_FILTER_MAX_UUIDS         8
+#define BTT_SCAN_FILTER_MAX_NAMES         4
+#define BTT_SCAN_FILTER_MAX_MANUFACTURERS 4
+/* allow and deny lists take up to 48 addresses each */
+#define BTT_SCAN_FILTER_ADDR_BITS         6
+
+/* what a device has to pass, cheapest checks go first */
+#define BTT_SCAN_CHECK_DENY         (1 << 0)
+#define BTT_SCAN_CHECK_ALLOW        (1 << 1)
+#define BTT_SCAN_CHECK_RSSI         (1 << 2)
+#define BTT_SCAN_CHECK_UUID         (1 << 3)
+#define BTT_SCAN_CHECK_NAME         (1 << 4)
+#define BTT_SCAN_CHECK_MANUFACTURER (1 << 5)
+/* checks which need parsed advertising data */
+#define BTT_SCAN_CHECKS_AD (BTT_SCAN_CHECK_UUID | BTT_SCAN_CHECK_NAME | \
+		BTT_SCAN_CHECK_MANUFACTURER)
+
+struct btt_scan_filter_uuid {
+	bt_uuid_t uuid;
+	/* derived from BASE_UUID, 16 and 32-bit forms compare short */
+	bool is_short;
+	uint32_t short_uuid;
+};
+
+struct btt_scan_filter_bytes {
+	uint16_t company;
+	uint8_t len;
+	uint8_t data[BTT_SCAN_FILTER_MAX_DATA];
+	uint8_t mask[BTT_SCAN_FILTER_MAX_DATA];
+};
+
+/* Rules of every type must match (device passes if it matches any
+ * of the UUIDs, any of the names...), types without rules are not
+ * checked at all. */
+struct btt_scan_filter {
+	unsigned int checks;
+	int rssi_min;
+	unsigned int uuids_num;
+	struct btt_scan_filter_uuid uuids[BTT_SCAN_FILTER_MAX_UUIDS];
+	unsigned int names_num;
+	struct btt_scan_filter_bytes names[BTT_SCAN_FILTER_MAX_NAMES];
+	unsigned int manufacturers_num;
+	struct btt_scan_filter_bytes
+			manufacturers[BTT_SCAN_FILTER_MAX_MANUFACTURERS];
+	uint64_t allow_pool[1 << BTT_SCAN_FILTER_ADDR_BITS];
+	uint64_t deny_pool[1 << BTT_SCAN_FILTER_ADDR_BITS];
+	struct bdaddr_set allow;
+	struct bdaddr_set deny;
+};
+
+extern void btt_scan_filter_init(struct btt_scan_filter *filter);
+extern bool btt_scan_filter_add_uuid(struct btt_scan_filter *filter,
+		const bt_uuid_t *uuid);
+extern bool btt_scan_filter_add_name(struct btt_scan_filter *filter,
+		const uint8_t *prefix, uint8_t len);
+extern bool btt_scan_filter_add_manufacturer(struct btt_scan_filter *filter,
+		uint16_t company, const uint8_t *data, const uint8_t *mask,
+		uint8_t len);
+extern void btt_scan_filter_set_rssi(struct btt_scan_filter *filter,
+		int rssi_min);
+extern bool btt_scan_filter_allow(struct btt_scan_filter *filter,
+		const uint8_t *bda);
+extern bool btt_scan_filter_deny(struct btt_scan_filter *filter,
+		const uint8_t *bda);
+
+extern bool btt_scan_filter_match_addr(const struct btt_scan_filter *filter,
+		const uint8_t *bda, int rssi);
+extern bool btt_scan_filter_match_ad(const struct btt_scan_filter *filter,
+		const struct btt_ad *ad);
@@ -0,0 +1,258 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+#include "btt_shm.h"
+
+/* messages are read in place, keep them aligned for the structures */
+#define SHM_ALIGN(len) (((len) + 7) & ~((size_t) 7))
+/* rest of the lap is unused, next message starts at offset 0 */
+#define SHM_PAD_COMMAND 0
+
+void btt_shm_init(struct btt_shm *shm)
+{
+	shm->mem_fd = -1;
+	shm->event_fd = -1;
+	shm->map_len = 0;
+	shm->ring = NULL;
+}
+
+/* anonymous memory which can be passed to another process */
+static int create_mem_fd(void)
+{
+	char path[] = BTT_DIRECTORY"/shm-XXXXXX";
+	int fd;
+
+#ifdef __NR_memfd_create
+	fd = syscall(__NR_memfd_create, "btt", 0);
+
+	if (fd != -1)
+		return fd;
+#endif
+
+	/* kernels older than 3.17: unlinked file does the same */
+	fd = mkstemp(path);
+
+	if (fd != -1)
+		unlink(path);
+
+	return fd;
+}
+
+static bool map_ring(struct btt_shm *shm)
+{
+	void *map;
+
+	map = mmap(NULL, shm->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			shm->mem_fd, 0);
+
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	shm->ring = map;
+	return TRUE;
+}
+
+/* size of the data is rounded up to the power of two */
+bool btt_shm_create(struct btt_shm *shm, unsigned int size)
+{
+	uint32_t data_size = BTT_SHM_MIN_SIZE;
+
+	btt_shm_init(shm);
+
+	while (data_size < size && data_size < BTT_SHM_MAX_SIZE)
+		data_size <<= 1;
+
+	shm->map_len = sizeof(struct btt_shm_ring) + data_size;
+	shm->mem_fd = create_mem_fd();
+	shm->event_fd = eventfd(0, 0);
+
+	if (shm->mem_fd == -1 || shm->event_fd == -1 ||
+			ftruncate(shm->mem_fd, shm->map_len) == -1 ||
+			!map_ring(shm)) {
+		BTT_LOG_E("Cannot create shared ring of %u bytes\n", data_size);
+		btt_shm_close(shm);
+		return FALSE;
+	}
+
+	memset(shm->ring, 0, sizeof(struct btt_shm_ring));
+	shm->ring->size = data_size;
+
+	return TRUE;
+}
+
+/* takes ownership of both descriptors */
+bool btt_shm_attach(struct btt_shm *shm, int mem_fd, int event_fd)
+{
+	struct stat st;
+	uint32_t size;
+
+	btt_shm_init(shm);
+	shm->mem_fd = mem_fd;
+	shm->event_fd = event_fd;
+
+	if (mem_fd == -1 || event_fd == -1 || fstat(mem_fd, &st) == -1 ||
+			(size_t) st.st_size < sizeof(struct btt_shm_ring))
+		goto error;
+
+	shm->map_len = st.st_size;
+
+	if (!map_ring(shm))
+		goto error;
+
+	size = shm->ring->size;
+
+	if (size < BTT_SHM_MIN_SIZE || (size & (size - 1)) ||
+			sizeof(struct btt_shm_ring) + size > shm->map_len)
+		goto error;
+
+	return TRUE;
+
+error:
+	BTT_LOG_E("Invalid shared ring\n");
+	btt_shm_close(shm);
+	return FALSE;
+}
+
+void btt_shm_close(struct btt_shm *shm)
+{
+	if (shm->ring)
+		munmap(shm->ring, shm->map_len);
+
+	if (shm->mem_fd != -1)
+		close(shm->mem_fd);
+
+	if (shm->event_fd != -1)
+		close(shm->event_fd);
+
+	btt_shm_init(shm);
+}
+
+/* Copy message into the ring, return FALSE and count it as dropped
+ * if there is no room. Offsets are masked, so a broken tail written by
+ * the consumer can not make the producer write outside of the ring. */
+bool btt_shm_put(struct btt_shm *shm, const void *data, size_t length)
+{
+	struct btt_shm_ring *ring = shm->ring;
+	struct btt_message *pad;
+	uint64_t head;
+	uint64_t tail;
+	size_t need = SHM_ALIGN(length);
+	size_t offset;
+	size_t skip = 0;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	offset = head & (ring->size - 1);
+
+	if (ring->size - offset < need)
+		skip = ring->size - offset;
+
+	if (need > ring->size || head + skip + need - tail > ring->size) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return FALSE;
+	}
+
+	if (skip >= sizeof(struct btt_message)) {
+		pad = (struct btt_message *) (ring->data + offset);
+		pad->command = SHM_PAD_COMMAND;
+		pad->length = skip - sizeof(struct btt_message);
+		pad->request_id = 0;
+	}
+
+	memcpy(ring->data + ((head + skip) & (ring->size - 1)), data, length);
+	__atomic_store_n(&ring->head, head + skip + need, __ATOMIC_RELEASE);
+
+	return TRUE;
+}
+
+/* wake the consumer up after a batch of puts, only if it sleeps */
+void btt_shm_signal(struct btt_shm *shm)
+{
+	uint64_t one = 1;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_exchange_n(&shm->ring->waiting, 0, __ATOMIC_SEQ_CST))
+		if (write(shm->event_fd, &one, sizeof(one)) == -1)
+			BTT_LOG_E("%s:eventfd write error\n", __FUNCTION__);
+}
+
+/* Return the oldest message in place or NULL if the ring is empty,
+ * it stays valid until btt_shm_consume. */
+struct btt_message *btt_shm_next(struct btt_shm *shm)
+{
+	struct btt_shm_ring *ring = shm->ring;
+	struct btt_message *msg;
+	uint64_t head;
+	uint64_t tail;
+	size_t offset;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+	while (tail != head) {
+		offset = tail & (ring->size - 1);
+		msg = (struct btt_message *) (ring->data + offset);
+
+		if (ring->size - offset >= sizeof(struct btt_message) &&
+				msg->command != SHM_PAD_COMMAND)
+			return msg;
+
+		tail += ring->size - offset;
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+void btt_shm_consume(struct btt_shm *shm, const struct btt_message *msg)
+{
+	struct btt_shm_ring *ring = shm->ring;
+
+	__atomic_store_n(&ring->tail, ring->tail +
+			SHM_ALIGN(sizeof(struct btt_message) + msg->length),
+			__ATOMIC_RELEASE);
+}
+
+/* Ask for a wakeup before sleeping on event_fd. Return FALSE if messages
+ * came meanwhile, they have to be consumed first. */
+bool btt_shm_arm(struct btt_shm *shm)
+{
+	struct btt_shm_ring *ring = shm->ring;
+
+	__atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail) {
+		__atomic_store_n(&ring->waiting, 0, __ATOMIC_SEQ_CST);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void btt_shm_clear_wakeup(struct btt_shm *shm)
+{
+	uint64_t counter;
+
+	if (read(shm->event_fd, &counter, sizeof(counter)) == -1)
+		BTT_LOG_E("%s:eventfd read error\n", __FUNCTION__);
+}
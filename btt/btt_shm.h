@@ -0,0 +1,61 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_SHM_H
+#error Included twice
+#endif
+#define BTT_SHM_H
+
+#define BTT_SHM_DEFAULT_SIZE (256 * 1024)
+/* must hold a few of the biggest events */
+#define BTT_SHM_MIN_SIZE     (16 * 1024)
+#define BTT_SHM_MAX_SIZE     (16 * 1024 * 1024)
+
+/* Single producer (daemon), single consumer (client) ring of btt_messages
+ * living in memory shared by both processes. head and tail only grow,
+ * offset in data is taken modulo size. */
+struct btt_shm_ring {
+	uint32_t size;
+	/* consumer sleeps on the eventfd and wants to be woken up */
+	uint32_t waiting;
+	/* messages which did not fit, counted by the producer */
+	uint64_t dropped;
+	uint64_t head __attribute__((aligned(64)));
+	uint64_t tail __attribute__((aligned(64)));
+	uint8_t data[] __attribute__((aligned(64)));
+};
+
+struct btt_shm {
+	int mem_fd;
+	int event_fd;
+	size_t map_len;
+	struct btt_shm_ring *ring;
+};
+
+extern void btt_shm_init(struct btt_shm *shm);
+extern bool btt_shm_create(struct btt_shm *shm, unsigned int size);
+extern bool btt_shm_attach(struct btt_shm *shm, int mem_fd, int event_fd);
+extern void btt_shm_close(struct btt_shm *shm);
+
+/* producer */
+extern bool btt_shm_put(struct btt_shm *shm, const void *data, size_t length);
+extern void btt_shm_signal(struct btt_shm *shm);
+
+/* consumer */
+extern struct btt_message *btt_shm_next(struct btt_shm *shm);
+extern void btt_shm_consume(struct btt_shm *shm, const struct btt_message *msg);
+extern bool btt_shm_arm(struct btt_shm *shm);
+extern void btt_shm_clear_wakeup(struct btt_shm *shm);
@@ -0,0 +1,1178 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+
+#ifdef WITHOUT_STACK
+
+#include <hardware/bt_gatt.h>
+
+#include "btt_utils.h"
+#include "btt_ad_parser.h"
+#include "btt_sim_hal.h"
+
+/* Requests are completed by calling their callback before the request
+ * returns, the daemon records what it expects before calling the HAL. */
+
+#define SIM_MAX_CONNECTIONS 16
+#define SIM_MAX_NOTIFICATIONS 64
+#define SIM_MAX_SERVICES 16
+#define SIM_MAX_CHARACTERISTICS 32
+/* generator wakes up this often ... */
+#define SIM_TICK_NS 1000000ull
+/* ... and skips what it cannot catch up with */
+#define SIM_MAX_BURST 10000
+#define SIM_DISCOVERY_DEVICES 5
+
+#define SIM_SERVICE_UUID 0xA000
+/* characteristic c of service s is SIM_CHAR_UUID + s * 32 + c */
+#define SIM_CHAR_UUID 0xB000
+#define SIM_CCC_UUID 0x2902
+/* what Bluedroid reports when a search runs out of attributes */
+#define SIM_GATT_ERROR 0x85
+
+struct sim_config {
+	unsigned int devices;
+	unsigned int adv_rate;
+	unsigned int services;
+	unsigned int characteristics;
+	unsigned int value_len;
+	unsigned int notify_rate;
+};
+
+struct sim_connection {
+	bool used;
+	bool server;
+	/* client_if or server_if */
+	int app_if;
+	bt_bdaddr_t bda;
+};
+
+struct sim_notification {
+	bool used;
+	int conn_id;
+	unsigned int service;
+	unsigned int characteristic;
+	uint64_t next_ns;
+	uint32_t counter;
+};
+
+struct sim_value {
+	uint16_t len;
+	uint8_t data[BTGATT_MAX_ATTR_LEN];
+};
+
+/* BASE_UUID, little endian, see btt_ad_parser.c */
+static const uint8_t base_uuid[16] = { 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00,
+		0x00, 0x80, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+/* wakes the idle generator up */
+static pthread_cond_t sim_cond = PTHREAD_COND_INITIALIZER;
+static struct sim_config config;
+static bt_callbacks_t *adapter_cbs;
+static const btgatt_client_callbacks_t *client_cbs;
+static const btgatt_server_callbacks_t *server_cbs;
+static bt_bdname_t adapter_name;
+static bt_scan_mode_t scan_mode = BT_SCAN_MODE_NONE;
+static int next_app_if = 1;
+static int next_handle = 1;
+static bool scanning;
+static uint64_t scan_start_ns;
+static uint64_t adv_sent;
+static struct sim_connection connections[SIM_MAX_CONNECTIONS];
+static struct sim_notification notifications[SIM_MAX_NOTIFICATIONS];
+static unsigned int notifications_num;
+static struct sim_value *values;
+
+static unsigned int config_env(const char *name, unsigned int def,
+		unsigned int max)
+{
+	const char *env = getenv(name);
+	unsigned int value;
+
+	if (!env || sscanf(env, "%u", &value) != 1)
+		return def;
+
+	return value < max ? value : max;
+}
+
+static void sim_uuid(bt_uuid_t *uuid, uint16_t short_uuid)
+{
+	memcpy(uuid->uu, base_uuid, sizeof(base_uuid));
+	uuid->uu[12] = short_uuid & 0xFF;
+	uuid->uu[13] = short_uuid >> 8;
+}
+
+/* -1 if the UUID is not derived from BASE_UUID */
+static int sim_short_uuid(const bt_uuid_t *uuid)
+{
+	if (memcmp(uuid->uu, base_uuid, 12) || uuid->uu[14] || uuid->uu[15])
+		return -1;
+
+	return uuid->uu[12] | uuid->uu[13] << 8;
+}
+
+static void sim_service_id(btgatt_srvc_id_t *srvc_id, unsigned int s)
+{
+	memset(srvc_id, 0, sizeof(*srvc_id));
+	sim_uuid(&srvc_id->id.uuid, SIM_SERVICE_UUID + s);
+	srvc_id->is_primary = 1;
+}
+
+static void sim_char_id(btgatt_gatt_id_t *char_id, unsigned int s,
+		unsigned int c)
+{
+	memset(char_id, 0, sizeof(*char_id));
+	sim_uuid(&char_id->uuid, SIM_CHAR_UUID + s * SIM_MAX_CHARACTERISTICS + c);
+}
+
+/* index of the service, -1 if there is none */
+static int sim_service(const btgatt_srvc_id_t *srvc_id)
+{
+	int s = sim_short_uuid(&srvc_id->id.uuid) - SIM_SERVICE_UUID;
+
+	if (s < 0 || s >= (int) config.services || srvc_id->id.inst_id)
+		return -1;
+
+	return s;
+}
+
+/* index of the characteristic within service s, -1 if there is none */
+static int sim_char(int s, const btgatt_gatt_id_t *char_id)
+{
+	int c = sim_short_uuid(&char_id->uuid) - SIM_CHAR_UUID -
+			s * SIM_MAX_CHARACTERISTICS;
+
+	if (s < 0 || c < 0 || c >= (int) config.characteristics ||
+			char_id->inst_id)
+		return -1;
+
+	return c;
+}
+
+static struct sim_value *sim_value(int s, int c)
+{
+	return &values[s * config.characteristics + c];
+}
+
+static void sim_device_bda(bt_bdaddr_t *bda, unsigned int device)
+{
+	/* static random address */
+	bda->address[0] = 0xC0;
+	bda->address[1] = 0x5E;
+	bda->address[2] = 0x00;
+	bda->address[3] = device >> 16;
+	bda->address[4] = device >> 8;
+	bda->address[5] = device;
+}
+
+/* must be called under sim_lock, 0 if there is no room */
+static int add_connection(bool server, int app_if, const bt_bdaddr_t *bda)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_CONNECTIONS; i++) {
+		if (connections[i].used)
+			continue;
+
+		connections[i].used = TRUE;
+		connections[i].server = server;
+		connections[i].app_if = app_if;
+		connections[i].bda = *bda;
+		return i + 1;
+	}
+
+	return 0;
+}
+
+/* must be called under sim_lock */
+static struct sim_connection *find_connection(int conn_id)
+{
+	if (conn_id < 1 || conn_id > SIM_MAX_CONNECTIONS ||
+			!connections[conn_id - 1].used)
+		return NULL;
+
+	return &connections[conn_id - 1];
+}
+
+/* must be called under sim_lock, 0 if there is none */
+static int find_conn_id(bool server, int app_if, const bt_bdaddr_t *bda)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_CONNECTIONS; i++) {
+		if (connections[i].used && connections[i].server == server &&
+				connections[i].app_if == app_if &&
+				!memcmp(&connections[i].bda, bda, sizeof(*bda)))
+			return i + 1;
+	}
+
+	return 0;
+}
+
+/* must be called under sim_lock */
+static void remove_connection(int conn_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < SIM_MAX_NOTIFICATIONS; i++) {
+		if (notifications[i].used && notifications[i].conn_id == conn_id) {
+			notifications[i].used = FALSE;
+			notifications_num--;
+		}
+	}
+
+	connections[conn_id - 1].used = FALSE;
+}
+
+/* n-th advertisement of the flood, the devices take turns */
+static void send_adv(uint64_t n)
+{
+	uint8_t adv_data[BTT_AD_DATA_LEN];
+	unsigned int device = n % config.devices;
+	uint64_t sighting = n / config.devices;
+	/* payload changes every 8th sighting */
+	uint16_t version = sighting / 8;
+	bt_bdaddr_t bda;
+	int len;
+
+	memset(adv_data, 0, sizeof(adv_data));
+	adv_data[0] = 2;
+	adv_data[1] = 0x01;
+	adv_data[2] = 0x06;
+	len = snprintf((char *) adv_data + 5, 16, "sim-%u", device);
+	adv_data[3] = len + 1;
+	adv_data[4] = 0x09;
+	len += 5;
+	adv_data[len++] = 5;
+	adv_data[len++] = 0xFF;
+	/* company ID reserved for testing */
+	adv_data[len++] = 0xFF;
+	adv_data[len++] = 0xFF;
+	adv_data[len++] = version & 0xFF;
+	adv_data[len++] = version >> 8;
+
+	sim_device_bda(&bda, device);
+	client_cbs->scan_result_cb(&bda,
+			-40 - (int) ((device * 7 + sighting * 13) % 50), adv_data);
+}
+
+static void send_notification(const struct sim_notification *notification,
+		const bt_bdaddr_t *bda)
+{
+	btgatt_notify_params_t params;
+	unsigned int i;
+
+	sim_service_id(&params.srvc_id, notification->service);
+	sim_char_id(&params.char_id, notification->service,
+			notification->characteristic);
+	params.bda = *bda;
+	params.is_notify = 1;
+	params.len = config.value_len;
+
+	/* counter first, so the receiver sees lost notifications */
+	for (i = 0; i < config.value_len; i++)
+		params.value[i] = i < 4 ? notification->counter >> (8 * i) : i;
+
+	client_cbs->notify_cb(notification->conn_id, &params);
+}
+
+static void *sim_thread(void *arg)
+{
+	struct sim_notification due[SIM_MAX_NOTIFICATIONS];
+	bt_bdaddr_t due_bda[SIM_MAX_NOTIFICATIONS];
+	uint64_t period_ns = 0;
+	uint64_t wake_ns;
+	uint64_t target;
+	uint64_t adv;
+	uint64_t now;
+	unsigned int due_num;
+	unsigned int i;
+	struct timespec at;
+
+	pthread_mutex_lock(&sim_lock);
+
+	if (config.notify_rate)
+		period_ns = 1000000000ull / config.notify_rate;
+
+	wake_ns = monotonic_ns();
+
+	while (1) {
+		if (!scanning && (!notifications_num || !period_ns)) {
+			pthread_cond_wait(&sim_cond, &sim_lock);
+			wake_ns = monotonic_ns();
+			continue;
+		}
+
+		now = monotonic_ns();
+		adv = adv_sent;
+		target = adv;
+
+		if (scanning)
+			target = (now - scan_start_ns) / 1000 * config.adv_rate / 1000000;
+
+		if (target - adv > SIM_MAX_BURST)
+			adv = target - SIM_MAX_BURST;
+
+		adv_sent = target;
+		due_num = 0;
+
+		for (i = 0; period_ns && i < SIM_MAX_NOTIFICATIONS; i++) {
+			struct sim_notification *notification = &notifications[i];
+
+			if (!notification->used || notification->next_ns > now)
+				continue;
+
+			due_bda[due_num] =
+					connections[notification->conn_id - 1].bda;
+			due[due_num++] = *notification;
+			notification->counter++;
+			notification->next_ns += period_ns;
+
+			if (notification->next_ns <= now)
+				notification->next_ns = now + period_ns;
+		}
+
+		pthread_mutex_unlock(&sim_lock);
+
+		for (; adv < target; adv++)
+			send_adv(adv);
+
+		for (i = 0; i < due_num; i++)
+			send_notification(&due[i], &due_bda[i]);
+
+		wake_ns += SIM_TICK_NS;
+
+		if (wake_ns < now)
+			wake_ns = now + SIM_TICK_NS;
+
+		at.tv_sec = wake_ns / 1000000000;
+		at.tv_nsec = wake_ns % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &at, NULL);
+
+		pthread_mutex_lock(&sim_lock);
+	}
+
+	return arg;
+}
+
+/* Bluetooth interface */
+
+static void send_adapter_property(bt_property_type_t type)
+{
+	bt_property_t property;
+	bt_bdaddr_t bda;
+
+	property.type = type;
+
+	switch (type) {
+	case BT_PROPERTY_BDNAME:
+		property.len = strlen((char *) adapter_name.name);
+		property.val = adapter_name.name;
+		break;
+	case BT_PROPERTY_BDADDR:
+		memcpy(bda.address, "\x00\x5E\x51\x4D\x00\x01", BD_ADDR_LEN);
+		property.len = sizeof(bda);
+		property.val = &bda;
+		break;
+	case BT_PROPERTY_ADAPTER_SCAN_MODE:
+		property.len = sizeof(scan_mode);
+		property.val = &scan_mode;
+		break;
+	default:
+		adapter_cbs->adapter_properties_cb(BT_STATUS_UNSUPPORTED, 0, NULL);
+		return;
+	}
+
+	adapter_cbs->adapter_properties_cb(BT_STATUS_SUCCESS, 1, &property);
+}
+
+static int sim_init(bt_callbacks_t *callbacks)
+{
+	pthread_t thread;
+	unsigned int i;
+
+	config.devices = config_env("BTT_SIM_DEVICES", 1000, 1 << 24);
+	config.adv_rate = config_env("BTT_SIM_ADV_RATE", 1000, 10000000);
+	config.services = config_env("BTT_SIM_SERVICES", 3, SIM_MAX_SERVICES);
+	config.characteristics = config_env("BTT_SIM_CHARACTERISTICS", 4,
+			SIM_MAX_CHARACTERISTICS);
+	config.value_len = config_env("BTT_SIM_VALUE_LEN", 20,
+			BTGATT_MAX_ATTR_LEN);
+	config.notify_rate = config_env("BTT_SIM_NOTIFY_RATE", 10, 1000000);
+
+	if (!config.devices)
+		config.devices = 1;
+
+	values = calloc(config.services * config.characteristics + 1,
+			sizeof(*values));
+
+	if (!values)
+		return BT_STATUS_NOMEM;
+
+	for (i = 0; i < config.services * config.characteristics; i++) {
+		values[i].len = config.value_len;
+		memset(values[i].data, i, config.value_len);
+	}
+
+	adapter_cbs = callbacks;
+	strcpy((char *) adapter_name.name, "btt-sim");
+
+	if (pthread_create(&thread, NULL, sim_thread, NULL))
+		return BT_STATUS_FAIL;
+
+	pthread_detach(thread);
+
+	BTT_LOG_I("Simulated HAL: devices=%u adv_rate=%u services=%u "
+			"characteristics=%u value_len=%u notify_rate=%u\n",
+			config.devices, config.adv_rate, config.services,
+			config.characteristics, config.value_len, config.notify_rate);
+
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_enable(void)
+{
+	adapter_cbs->adapter_state_changed_cb(BT_STATE_ON);
+	send_adapter_property(BT_PROPERTY_BDNAME);
+	send_adapter_property(BT_PROPERTY_BDADDR);
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_disable(void)
+{
+	adapter_cbs->adapter_state_changed_cb(BT_STATE_OFF);
+	return BT_STATUS_SUCCESS;
+}
+
+static void sim_cleanup(void)
+{
+}
+
+static int sim_get_adapter_property(bt_property_type_t type)
+{
+	send_adapter_property(type);
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_set_adapter_property(const bt_property_t *property)
+{
+	switch (property->type) {
+	case BT_PROPERTY_BDNAME:
+		memset(&adapter_name, 0, sizeof(adapter_name));
+		memcpy(adapter_name.name, property->val,
+				property->len < (int) sizeof(adapter_name) ?
+				property->len : (int) sizeof(adapter_name) - 1);
+		break;
+	case BT_PROPERTY_ADAPTER_SCAN_MODE:
+		scan_mode = *(bt_scan_mode_t *) property->val;
+		break;
+	default:
+		return BT_STATUS_UNSUPPORTED;
+	}
+
+	send_adapter_property(property->type);
+	return BT_STATUS_SUCCESS;
+}
+
+/* first devices of the scan flood, as classic inquiry results */
+static int sim_start_discovery(void)
+{
+	bt_property_t properties[3];
+	bt_device_type_t type = BT_DEVICE_DEVTYPE_BLE;
+	char name[16];
+	bt_bdaddr_t bda;
+	unsigned int i;
+
+	adapter_cbs->discovery_state_changed_cb(BT_DISCOVERY_STARTED);
+
+	for (i = 0; i < SIM_DISCOVERY_DEVICES && i < config.devices; i++) {
+		sim_device_bda(&bda, i);
+		snprintf(name, sizeof(name), "sim-%u", i);
+
+		properties[0].type = BT_PROPERTY_BDNAME;
+		properties[0].len = strlen(name);
+		properties[0].val = name;
+		properties[1].type = BT_PROPERTY_BDADDR;
+		properties[1].len = sizeof(bda);
+		properties[1].val = &bda;
+		properties[2].type = BT_PROPERTY_TYPE_OF_DEVICE;
+		properties[2].len = sizeof(type);
+		properties[2].val = &type;
+
+		adapter_cbs->device_found_cb(3, properties);
+	}
+
+	adapter_cbs->discovery_state_changed_cb(BT_DISCOVERY_STOPPED);
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_create_bond(const bt_bdaddr_t *bd_addr)
+{
+	bt_bdaddr_t bda = *bd_addr;
+
+	adapter_cbs->bond_state_changed_cb(BT_STATUS_SUCCESS, &bda,
+			BT_BOND_STATE_BONDING);
+	adapter_cbs->bond_state_changed_cb(BT_STATUS_SUCCESS, &bda,
+			BT_BOND_STATE_BONDED);
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_remove_bond(const bt_bdaddr_t *bd_addr)
+{
+	bt_bdaddr_t bda = *bd_addr;
+
+	adapter_cbs->bond_state_changed_cb(BT_STATUS_SUCCESS, &bda,
+			BT_BOND_STATE_NONE);
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_pin_reply(const bt_bdaddr_t *bd_addr, uint8_t accept,
+		uint8_t pin_len, bt_pin_code_t *pin_code)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_ssp_reply(const bt_bdaddr_t *bd_addr,
+		bt_ssp_variant_t variant, uint8_t accept, uint32_t passkey)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static const void *sim_get_profile_interface(const char *profile_id);
+
+static const bt_interface_t sim_bluetooth_interface = {
+	.size = sizeof(bt_interface_t),
+	.init = sim_init,
+	.enable = sim_enable,
+	.disable = sim_disable,
+	.cleanup = sim_cleanup,
+	.get_adapter_property = sim_get_adapter_property,
+	.set_adapter_property = sim_set_adapter_property,
+	.start_discovery = sim_start_discovery,
+	.create_bond = sim_create_bond,
+	.remove_bond = sim_remove_bond,
+	.pin_reply = sim_pin_reply,
+	.ssp_reply = sim_ssp_reply,
+	.get_profile_interface = sim_get_profile_interface,
+};
+
+/* GATT client interface */
+
+static bt_status_t sim_register_client(bt_uuid_t *uuid)
+{
+	int client_if;
+
+	pthread_mutex_lock(&sim_lock);
+	client_if = next_app_if++;
+	pthread_mutex_unlock(&sim_lock);
+
+	client_cbs->register_client_cb(0, client_if, uuid);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_unregister_client(int client_if)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_scan(int client_if, bool start)
+{
+	pthread_mutex_lock(&sim_lock);
+
+	if (start && !scanning) {
+		scan_start_ns = monotonic_ns();
+		adv_sent = 0;
+		pthread_cond_signal(&sim_cond);
+	}
+
+	scanning = start;
+	pthread_mutex_unlock(&sim_lock);
+
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_client_connect(int client_if,
+		const bt_bdaddr_t *bd_addr, bool is_direct)
+{
+	bt_bdaddr_t bda = *bd_addr;
+	int conn_id;
+
+	pthread_mutex_lock(&sim_lock);
+	conn_id = find_conn_id(FALSE, client_if, bd_addr);
+
+	if (!conn_id)
+		conn_id = add_connection(FALSE, client_if, bd_addr);
+
+	pthread_mutex_unlock(&sim_lock);
+
+	client_cbs->open_cb(conn_id, conn_id ? 0 : SIM_GATT_ERROR, client_if,
+			&bda);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_client_disconnect(int client_if,
+		const bt_bdaddr_t *bd_addr, int conn_id)
+{
+	bt_bdaddr_t bda = *bd_addr;
+	struct sim_connection *connection;
+
+	pthread_mutex_lock(&sim_lock);
+	connection = find_connection(conn_id);
+
+	if (!connection || connection->server) {
+		pthread_mutex_unlock(&sim_lock);
+		return BT_STATUS_PARM_INVALID;
+	}
+
+	remove_connection(conn_id);
+	pthread_mutex_unlock(&sim_lock);
+
+	client_cbs->close_cb(conn_id, 0, client_if, &bda);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_listen(int client_if, bool start)
+{
+	client_cbs->listen_cb(0, client_if);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_refresh(int client_if, const bt_bdaddr_t *bd_addr)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static bool is_client_connection(int conn_id)
+{
+	struct sim_connection *connection;
+
+	pthread_mutex_lock(&sim_lock);
+	connection = find_connection(conn_id);
+	pthread_mutex_unlock(&sim_lock);
+
+	return connection && !connection->server;
+}
+
+static bt_status_t sim_search_service(int conn_id, bt_uuid_t *filter_uuid)
+{
+	btgatt_srvc_id_t srvc_id;
+	unsigned int s;
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	for (s = 0; s < config.services; s++) {
+		sim_service_id(&srvc_id, s);
+
+		if (!filter_uuid || !memcmp(filter_uuid, &srvc_id.id.uuid,
+				sizeof(bt_uuid_t)))
+			client_cbs->search_result_cb(conn_id, &srvc_id);
+	}
+
+	client_cbs->search_complete_cb(conn_id, 0);
+	return BT_STATUS_SUCCESS;
+}
+
+/* there are no included services */
+static bt_status_t sim_get_included_service(int conn_id,
+		btgatt_srvc_id_t *srvc_id, btgatt_srvc_id_t *start_incl_srvc_id)
+{
+	btgatt_srvc_id_t none;
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	memset(&none, 0, sizeof(none));
+	client_cbs->get_included_service_cb(conn_id, SIM_GATT_ERROR, srvc_id,
+			&none);
+	return BT_STATUS_SUCCESS;
+}
+
+/* one after start_char_id, the first one without it */
+static bt_status_t sim_get_characteristic(int conn_id,
+		btgatt_srvc_id_t *srvc_id, btgatt_gatt_id_t *start_char_id)
+{
+	btgatt_gatt_id_t char_id;
+	int s = sim_service(srvc_id);
+	int c = 0;
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	/* unknown start ends the search as well */
+	if (start_char_id && (c = sim_char(s, start_char_id)) >= 0)
+		c++;
+
+	if (s < 0 || c < 0 || c >= (int) config.characteristics) {
+		memset(&char_id, 0, sizeof(char_id));
+		client_cbs->get_characteristic_cb(conn_id, SIM_GATT_ERROR, srvc_id,
+				&char_id, 0);
+		return BT_STATUS_SUCCESS;
+	}
+
+	sim_char_id(&char_id, s, c);
+	/* read, write, notify */
+	client_cbs->get_characteristic_cb(conn_id, 0, srvc_id, &char_id,
+			0x02 | 0x08 | 0x10);
+	return BT_STATUS_SUCCESS;
+}
+
+/* every characteristic has only its CCC descriptor */
+static bt_status_t sim_get_descriptor(int conn_id, btgatt_srvc_id_t *srvc_id,
+		btgatt_gatt_id_t *char_id, btgatt_gatt_id_t *start_descr_id)
+{
+	btgatt_gatt_id_t descr_id;
+	int status = 0;
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	memset(&descr_id, 0, sizeof(descr_id));
+
+	if (start_descr_id || sim_char(sim_service(srvc_id), char_id) < 0)
+		status = SIM_GATT_ERROR;
+	else
+		sim_uuid(&descr_id.uuid, SIM_CCC_UUID);
+
+	client_cbs->get_descriptor_cb(conn_id, status, srvc_id, char_id,
+			&descr_id);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_read_characteristic(int conn_id,
+		btgatt_srvc_id_t *srvc_id, btgatt_gatt_id_t *char_id, int auth_req)
+{
+	btgatt_read_params_t params;
+	int s = sim_service(srvc_id);
+	int c = sim_char(s, char_id);
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	memset(&params, 0, sizeof(params));
+	params.srvc_id = *srvc_id;
+	params.char_id = *char_id;
+
+	if (c < 0) {
+		params.status = SIM_GATT_ERROR;
+	} else {
+		pthread_mutex_lock(&sim_lock);
+		params.value.len = sim_value(s, c)->len;
+		memcpy(params.value.value, sim_value(s, c)->data, params.value.len);
+		pthread_mutex_unlock(&sim_lock);
+	}
+
+	client_cbs->read_characteristic_cb(conn_id, params.status, &params);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_write_characteristic(int conn_id,
+		btgatt_srvc_id_t *srvc_id, btgatt_gatt_id_t *char_id,
+		int write_type, int len, int auth_req, char *p_value)
+{
+	btgatt_write_params_t params;
+	int s = sim_service(srvc_id);
+	int c = sim_char(s, char_id);
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	memset(&params, 0, sizeof(params));
+	params.srvc_id = *srvc_id;
+	params.char_id = *char_id;
+
+	if (c < 0 || len < 0 || len > BTGATT_MAX_ATTR_LEN) {
+		params.status = SIM_GATT_ERROR;
+	} else {
+		pthread_mutex_lock(&sim_lock);
+		sim_value(s, c)->len = len;
+		memcpy(sim_value(s, c)->data, p_value, len);
+		pthread_mutex_unlock(&sim_lock);
+	}
+
+	client_cbs->write_characteristic_cb(conn_id, params.status, &params);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_read_descriptor(int conn_id, btgatt_srvc_id_t *srvc_id,
+		btgatt_gatt_id_t *char_id, btgatt_gatt_id_t *descr_id, int auth_req)
+{
+	btgatt_read_params_t params;
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	memset(&params, 0, sizeof(params));
+	params.srvc_id = *srvc_id;
+	params.char_id = *char_id;
+	params.descr_id = *descr_id;
+
+	if (sim_char(sim_service(srvc_id), char_id) < 0 ||
+			sim_short_uuid(&descr_id->uuid) != SIM_CCC_UUID)
+		params.status = SIM_GATT_ERROR;
+	else
+		params.value.len = 2;
+
+	client_cbs->read_descriptor_cb(conn_id, params.status, &params);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_write_descriptor(int conn_id, btgatt_srvc_id_t *srvc_id,
+		btgatt_gatt_id_t *char_id, btgatt_gatt_id_t *descr_id,
+		int write_type, int len, int auth_req, char *p_value)
+{
+	btgatt_write_params_t params;
+
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	memset(&params, 0, sizeof(params));
+	params.srvc_id = *srvc_id;
+	params.char_id = *char_id;
+	params.descr_id = *descr_id;
+
+	if (sim_char(sim_service(srvc_id), char_id) < 0 ||
+			sim_short_uuid(&descr_id->uuid) != SIM_CCC_UUID)
+		params.status = SIM_GATT_ERROR;
+
+	client_cbs->write_descriptor_cb(conn_id, params.status, &params);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_execute_write(int conn_id, int execute)
+{
+	if (!is_client_connection(conn_id))
+		return BT_STATUS_PARM_INVALID;
+
+	client_cbs->execute_write_cb(conn_id, 0);
+	return BT_STATUS_SUCCESS;
+}
+
+/* notifications start right away, CCC is not written by Bluedroid */
+static bt_status_t sim_register_for_notification(int client_if,
+		const bt_bdaddr_t *bd_addr, btgatt_srvc_id_t *srvc_id,
+		btgatt_gatt_id_t *char_id)
+{
+	int s = sim_service(srvc_id);
+	int c = sim_char(s, char_id);
+	int status = SIM_GATT_ERROR;
+	int conn_id;
+	unsigned int i;
+
+	pthread_mutex_lock(&sim_lock);
+	conn_id = find_conn_id(FALSE, client_if, bd_addr);
+
+	for (i = 0; conn_id && c >= 0 && i < SIM_MAX_NOTIFICATIONS; i++) {
+		if (notifications[i].used)
+			continue;
+
+		notifications[i].used = TRUE;
+		notifications[i].conn_id = conn_id;
+		notifications[i].service = s;
+		notifications[i].characteristic = c;
+		notifications[i].next_ns = monotonic_ns();
+		notifications[i].counter = 0;
+		notifications_num++;
+		pthread_cond_signal(&sim_cond);
+		status = 0;
+		break;
+	}
+
+	pthread_mutex_unlock(&sim_lock);
+
+	if (!conn_id)
+		return BT_STATUS_PARM_INVALID;
+
+	client_cbs->register_for_notification_cb(conn_id, 1, status, srvc_id,
+			char_id);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_deregister_for_notification(int client_if,
+		const bt_bdaddr_t *bd_addr, btgatt_srvc_id_t *srvc_id,
+		btgatt_gatt_id_t *char_id)
+{
+	int s = sim_service(srvc_id);
+	int c = sim_char(s, char_id);
+	int conn_id;
+	unsigned int i;
+
+	pthread_mutex_lock(&sim_lock);
+	conn_id = find_conn_id(FALSE, client_if, bd_addr);
+
+	for (i = 0; conn_id && i < SIM_MAX_NOTIFICATIONS; i++) {
+		if (notifications[i].used && notifications[i].conn_id == conn_id &&
+				(int) notifications[i].service == s &&
+				(int) notifications[i].characteristic == c) {
+			notifications[i].used = FALSE;
+			notifications_num--;
+		}
+	}
+
+	pthread_mutex_unlock(&sim_lock);
+
+	if (!conn_id)
+		return BT_STATUS_PARM_INVALID;
+
+	client_cbs->register_for_notification_cb(conn_id, 0, 0, srvc_id,
+			char_id);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_read_remote_rssi(int client_if,
+		const bt_bdaddr_t *bd_addr)
+{
+	bt_bdaddr_t bda = *bd_addr;
+
+	client_cbs->read_remote_rssi_cb(client_if, &bda, -60, 0);
+	return BT_STATUS_SUCCESS;
+}
+
+static int sim_get_device_type(const bt_bdaddr_t *bd_addr)
+{
+	return BT_DEVICE_DEVTYPE_BLE;
+}
+
+static bt_status_t sim_set_adv_data(int server_if, bool set_scan_rsp,
+		bool include_name, bool include_txpower, int min_interval,
+		int max_interval, int appearance, uint16_t manufacturer_len,
+		char *manufacturer_data, uint16_t service_data_len,
+		char *service_data, uint16_t service_uuid_len, char *service_uuid)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_test_command(int command, btgatt_test_params_t *params)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static const btgatt_client_interface_t sim_client_interface = {
+	.register_client = sim_register_client,
+	.unregister_client = sim_unregister_client,
+	.scan = sim_scan,
+	.connect = sim_client_connect,
+	.disconnect = sim_client_disconnect,
+	.listen = sim_listen,
+	.refresh = sim_refresh,
+	.search_service = sim_search_service,
+	.get_included_service = sim_get_included_service,
+	.get_characteristic = sim_get_characteristic,
+	.get_descriptor = sim_get_descriptor,
+	.read_characteristic = sim_read_characteristic,
+	.write_characteristic = sim_write_characteristic,
+	.read_descriptor = sim_read_descriptor,
+	.write_descriptor = sim_write_descriptor,
+	.execute_write = sim_execute_write,
+	.register_for_notification = sim_register_for_notification,
+	.deregister_for_notification = sim_deregister_for_notification,
+	.read_remote_rssi = sim_read_remote_rssi,
+	.get_device_type = sim_get_device_type,
+	.set_adv_data = sim_set_adv_data,
+	.test_command = sim_test_command,
+};
+
+/* GATT server interface, attribute handles are only counted */
+
+static bt_status_t sim_register_server(bt_uuid_t *uuid)
+{
+	int server_if;
+
+	pthread_mutex_lock(&sim_lock);
+	server_if = next_app_if++;
+	pthread_mutex_unlock(&sim_lock);
+
+	server_cbs->register_server_cb(0, server_if, uuid);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_unregister_server(int server_if)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_server_connect(int server_if,
+		const bt_bdaddr_t *bd_addr, bool is_direct)
+{
+	bt_bdaddr_t bda = *bd_addr;
+	int conn_id;
+
+	pthread_mutex_lock(&sim_lock);
+	conn_id = find_conn_id(TRUE, server_if, bd_addr);
+
+	if (!conn_id)
+		conn_id = add_connection(TRUE, server_if, bd_addr);
+
+	pthread_mutex_unlock(&sim_lock);
+
+	if (!conn_id)
+		return BT_STATUS_NOMEM;
+
+	server_cbs->connection_cb(conn_id, server_if, 1, &bda);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_server_disconnect(int server_if,
+		const bt_bdaddr_t *bd_addr, int conn_id)
+{
+	bt_bdaddr_t bda = *bd_addr;
+	struct sim_connection *connection;
+
+	pthread_mutex_lock(&sim_lock);
+	connection = find_connection(conn_id);
+
+	if (!connection || !connection->server) {
+		pthread_mutex_unlock(&sim_lock);
+		return BT_STATUS_PARM_INVALID;
+	}
+
+	remove_connection(conn_id);
+	pthread_mutex_unlock(&sim_lock);
+
+	server_cbs->connection_cb(conn_id, server_if, 0, &bda);
+	return BT_STATUS_SUCCESS;
+}
+
+static int new_handles(int num)
+{
+	int handle;
+
+	pthread_mutex_lock(&sim_lock);
+	handle = next_handle;
+	next_handle += num > 0 ? num : 1;
+	pthread_mutex_unlock(&sim_lock);
+
+	return handle;
+}
+
+static bt_status_t sim_add_service(int server_if, btgatt_srvc_id_t *srvc_id,
+		int num_handles)
+{
+	server_cbs->service_added_cb(0, server_if, srvc_id,
+			new_handles(num_handles));
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_add_included_service(int server_if,
+		int service_handle, int included_handle)
+{
+	server_cbs->included_service_added_cb(0, server_if, service_handle,
+			new_handles(1));
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_add_characteristic(int server_if, int service_handle,
+		bt_uuid_t *uuid, int properties, int permissions)
+{
+	/* declaration and value */
+	server_cbs->characteristic_added_cb(0, server_if, uuid, service_handle,
+			new_handles(2) + 1);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_add_descriptor(int server_if, int service_handle,
+		bt_uuid_t *uuid, int permissions)
+{
+	server_cbs->descriptor_added_cb(0, server_if, uuid, service_handle,
+			new_handles(1));
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_start_service(int server_if, int service_handle,
+		int transport)
+{
+	server_cbs->service_started_cb(0, server_if, service_handle);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_stop_service(int server_if, int service_handle)
+{
+	server_cbs->service_stopped_cb(0, server_if, service_handle);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_delete_service(int server_if, int service_handle)
+{
+	server_cbs->service_deleted_cb(0, server_if, service_handle);
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_send_indication(int server_if, int attribute_handle,
+		int conn_id, int len, int confirm, char *p_value)
+{
+	return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t sim_send_response(int conn_id, int trans_id, int status,
+		btgatt_response_t *response)
+{
+	server_cbs->response_confirmation_cb(0, response->attr_value.handle);
+	return BT_STATUS_SUCCESS;
+}
+
+static const btgatt_server_interface_t sim_server_interface = {
+	.register_server = sim_register_server,
+	.unregister_server = sim_unregister_server,
+	.connect = sim_server_connect,
+	.disconnect = sim_server_disconnect,
+	.add_service = sim_add_service,
+	.add_included_service = sim_add_included_service,
+	.add_characteristic = sim_add_characteristic,
+	.add_descriptor = sim_add_descriptor,
+	.start_service = sim_start_service,
+	.stop_service = sim_stop_service,
+	.delete_service = sim_delete_service,
+	.send_indication = sim_send_indication,
+	.send_response = sim_send_response,
+};
+
+/* GATT interface */
+
+static bt_status_t sim_gatt_init(const btgatt_callbacks_t *callbacks)
+{
+	client_cbs = callbacks->client;
+	server_cbs = callbacks->server;
+	return BT_STATUS_SUCCESS;
+}
+
+static void sim_gatt_cleanup(void)
+{
+}
+
+static const btgatt_interface_t sim_gatt_interface = {
+	.size = sizeof(btgatt_interface_t),
+	.init = sim_gatt_init,
+	.cleanup = sim_gatt_cleanup,
+	.client = &sim_client_interface,
+	.server = &sim_server_interface,
+};
+
+static const void *sim_get_profile_interface(const char *profile_id)
+{
+	if (!strcmp(profile_id, BT_PROFILE_GATT_ID))
+		return &sim_gatt_interface;
+
+	return NULL;
+}
+
+const bt_interface_t *btt_sim_hal_interface(void)
+{
+	return &sim_bluetooth_interface;
+}
+
+#endif
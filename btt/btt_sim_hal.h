@@ -0,0 +1,34 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_SIM_HAL_H
+#error Included twice
+#endif
+#define BTT_SIM_HAL_H
+
+/* Simulated Bluedroid for host builds (WITHOUT_STACK). Every remote
+ * device has the same GATT database, notifications of registered
+ * characteristics and the scan flood come from a generator thread.
+ * Tuned by environment of the daemon, defaults in parentheses:
+ *   BTT_SIM_DEVICES          advertisers in the scan flood (1000)
+ *   BTT_SIM_ADV_RATE         scan results per second (1000)
+ *   BTT_SIM_SERVICES         primary services, at most 16 (3)
+ *   BTT_SIM_CHARACTERISTICS  per service, at most 32 (4)
+ *   BTT_SIM_VALUE_LEN        characteristic value length (20)
+ *   BTT_SIM_NOTIFY_RATE      notifications per second of every
+ *                            registered characteristic (10) */
+
+extern const bt_interface_t *btt_sim_hal_interface(void);
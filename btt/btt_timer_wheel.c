@@ -0,0 +1,145 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "btt.h"
+#include "btt_timer_wheel.h"
+
+#define SLOT_MASK (BTT_TIMER_WHEEL_SLOTS - 1)
+
+void btt_timer_wheel_init(struct btt_timer_wheel *wheel, uint64_t tick_ns,
+		uint64_t now_ns)
+{
+	unsigned int i;
+
+	wheel->tick_ns = tick_ns;
+	wheel->now = now_ns / tick_ns;
+	wheel->count = 0;
+
+	/* slot heads are empty circular lists */
+	for (i = 0; i < BTT_TIMER_WHEEL_SLOTS; i++) {
+		wheel->slots[i].next = &wheel->slots[i];
+		wheel->slots[i].prev = &wheel->slots[i];
+	}
+}
+
+void btt_timer_init(struct btt_timer *timer)
+{
+	timer->next = NULL;
+	timer->prev = NULL;
+}
+
+bool btt_timer_pending(const struct btt_timer *timer)
+{
+	return timer->next != NULL;
+}
+
+/* timer which is pending already is moved, expiry is rounded up
+ * to a whole tick */
+void btt_timer_add(struct btt_timer_wheel *wheel, struct btt_timer *timer,
+		uint64_t expires_ns)
+{
+	struct btt_timer *head;
+
+	if (btt_timer_pending(timer))
+		btt_timer_del(wheel, timer);
+
+	timer->expires = (expires_ns + wheel->tick_ns - 1) / wheel->tick_ns;
+
+	if (timer->expires <= wheel->now)
+		timer->expires = wheel->now + 1;
+
+	head = &wheel->slots[timer->expires & SLOT_MASK];
+	timer->next = head;
+	timer->prev = head->prev;
+	head->prev->next = timer;
+	head->prev = timer;
+	wheel->count++;
+}
+
+void btt_timer_del(struct btt_timer_wheel *wheel, struct btt_timer *timer)
+{
+	if (!btt_timer_pending(timer))
+		return;
+
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	btt_timer_init(timer);
+	wheel->count--;
+}
+
+/* Call expire for every timer due by now_ns, the timer is not pending
+ * any more then and may be added again. */
+void btt_timer_wheel_advance(struct btt_timer_wheel *wheel, uint64_t now_ns,
+		void (*expire)(struct btt_timer *timer))
+{
+	uint64_t now = now_ns / wheel->tick_ns;
+
+	/* after a long sleep a single revolution visits every slot */
+	if (wheel->count && now - wheel->now > BTT_TIMER_WHEEL_SLOTS)
+		wheel->now = now - BTT_TIMER_WHEEL_SLOTS;
+
+	while (wheel->now < now) {
+		struct btt_timer *head;
+		struct btt_timer *timer;
+		struct btt_timer *next;
+
+		wheel->now++;
+
+		if (!wheel->count) {
+			wheel->now = now;
+			break;
+		}
+
+		head = &wheel->slots[wheel->now & SLOT_MASK];
+
+		for (timer = head->next; timer != head; timer = next) {
+			next = timer->next;
+
+			if (timer->expires > now)
+				continue;
+
+			btt_timer_del(wheel, timer);
+			expire(timer);
+		}
+	}
+}
+
+/* time to the first non-empty slot, -1 if no timer is pending */
+int btt_timer_wheel_timeout_ms(const struct btt_timer_wheel *wheel,
+		uint64_t now_ns)
+{
+	uint64_t tick;
+	unsigned int i;
+
+	if (!wheel->count)
+		return -1;
+
+	for (i = 1; i <= BTT_TIMER_WHEEL_SLOTS; i++) {
+		const struct btt_timer *head;
+
+		head = &wheel->slots[(wheel->now + i) & SLOT_MASK];
+
+		if (head->next != head)
+			break;
+	}
+
+	tick = wheel->now + i;
+
+	if (tick * wheel->tick_ns <= now_ns)
+		return 0;
+
+	return (tick * wheel->tick_ns - now_ns + 999999) / 1000000;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2014 Tieto Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef BTT_TIMER_WHEEL_H
+#error Included twice
+#endif
+#define BTT_TIMER_WHEEL_H
+
+/* one revolution is BTT_TIMER_WHEEL_SLOTS ticks, later timers wait
+ * in their slot for more revolutions */
+#define BTT_TIMER_WHEEL_SLOTS 256
+
+/* embedded in the owner, which is found by offsetof in the callback */
+struct btt_timer {
+	struct btt_timer *next;
+	struct btt_timer *prev;
+	uint64_t expires;
+};
+
+/* Hashed timing wheel: add, delete and expiry of a timer are O(1),
+ * advancing costs one slot per elapsed tick. Not thread safe. */
+struct btt_timer_wheel {
+	uint64_t tick_ns;
+	/* all timers of ticks below it have expired */
+	uint64_t now;
+	unsigned int count;
+	struct btt_timer slots[BTT_TIMER_WHEEL_SLOTS];
+};
+
+extern void btt_timer_wheel_init(struct btt_timer_wheel *wheel,
+		uint64_t tick_ns, uint64_t now_ns);
+extern void btt_timer_init(struct btt_timer *timer);
+extern bool btt_timer_pending(const struct btt_timer *timer);
+extern void btt_timer_add(struct btt_timer_wheel *wheel,
+		struct btt_timer *timer, uint64_t expires_ns);
+extern void btt_timer_del(struct btt_timer_wheel *wheel,
+		struct btt_timer *timer);
+extern void btt_timer_wheel_advance(struct btt_timer_wheel *wheel,
+		uint64_t now_ns, void (*expire)(struct btt_timer *timer));
+extern int btt_timer_wheel_timeout_ms(const struct btt_timer_wheel *wheel,
+		uint64_t now_ns);
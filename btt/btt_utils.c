@@ -16,6 +16,7 @@
 
 #include "btt.h"
 #include "btt_utils.h"
+#include "btt_framing.h"
 #include "btt_daemon_main.h"
 
 void print_commands(const struct command *commands, unsigned int cmds_num)
@@ -203,6 +204,91 @@ struct list_element *list_clear(struct list_element *list,
 	return NULL;
 }
 
+/* load is kept under 3/4, so probes stay short */
+#define BDADDR_SET_MAX_COUNT(set) ((3u << (set)->bits) / 4)
+
+static uint64_t bdaddr_key(const uint8_t *bda)
+{
+	uint64_t key = 1ull << 48;
+	unsigned int i;
+
+	for (i = 0; i < BD_ADDR_LEN; i++)
+		key |= (uint64_t) bda[i] << (8 * i);
+
+	return key;
+}
+
+static uint64_t bdaddr_hash(const struct bdaddr_set *set, uint64_t key)
+{
+	/* Fibonacci hashing, vendor part of addresses is poorly spread */
+	return (key * 0x9E3779B97F4A7C15ull) >> (64 - set->bits);
+}
+
+bool bdaddr_set_contains(const struct bdaddr_set *set, const uint8_t *bda)
+{
+	uint64_t key = bdaddr_key(bda);
+	uint64_t mask = (1ull << set->bits) - 1;
+	uint64_t i;
+
+	for (i = bdaddr_hash(set, key); set->slots[i]; i = (i + 1) & mask) {
+		if (set->slots[i] == key)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/* Return slot of bda, which stays the same until the set is cleared,
+ * so callers can keep per address data in an array of the same size.
+ * added tells if bda was not in the set yet. Return -1 if the set is
+ * full, the address is then counted as overflow. */
+int bdaddr_set_insert(struct bdaddr_set *set, const uint8_t *bda,
+		bool *added)
+{
+	uint64_t key = bdaddr_key(bda);
+	uint64_t mask = (1ull << set->bits) - 1;
+	uint64_t i;
+
+	for (i = bdaddr_hash(set, key); set->slots[i]; i = (i + 1) & mask) {
+		if (set->slots[i] == key) {
+			*added = FALSE;
+			return i;
+		}
+	}
+
+	if (set->count >= BDADDR_SET_MAX_COUNT(set)) {
+		if (!set->overflows++)
+			BTT_LOG_W("Address set full, %u addresses\n", set->count);
+
+		*added = TRUE;
+		return -1;
+	}
+
+	set->slots[i] = key;
+	set->count++;
+	*added = TRUE;
+
+	return i;
+}
+
+/* Return TRUE if bda was not in the set yet. When the set is full,
+ * new addresses are reported as new. */
+bool bdaddr_set_add(struct bdaddr_set *set, const uint8_t *bda)
+{
+	bool added;
+
+	bdaddr_set_insert(set, bda, &added);
+
+	return added;
+}
+
+void bdaddr_set_clear(struct bdaddr_set *set)
+{
+	memset(set->slots, 0, sizeof(uint64_t) << set->bits);
+	set->count = 0;
+	set->overflows = 0;
+}
+
 bool sscanf_bdaddr(char *src, uint8_t *dest)
 {
 	if(sscanf(src, "%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8":%"SCNx8,
@@ -437,3 +523,81 @@ int connect_to_daemon_socket(void)
 
 	return server_sock;
 }
+
+/* monotonic time in nanoseconds, for measuring intervals only */
+uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool msg_trailer_fits(size_t size, size_t trailer_offset,
+		const struct btt_message *msg)
+{
+	size_t total = msg->length + sizeof(struct btt_message);
+
+	return total >= trailer_offset && total <= size;
+}
+
+bool msg_copy_trailer(void *dest, size_t size, size_t trailer_offset,
+		const struct btt_message *msg)
+{
+	if (!msg_trailer_fits(size, trailer_offset, msg))
+		return FALSE;
+
+	memcpy(dest, msg, msg->length + sizeof(struct btt_message));
+	return TRUE;
+}
+
+/* Send message to the daemon under the next request_id, so status and
+ * completion callbacks of the request can be told apart from others
+ * still in flight. Return value is the same as for send. */
+ssize_t send_request(int sock, void *msg, size_t length)
+{
+	static unsigned int last_request_id;
+
+	/* 0 is reserved for uncorrelated messages */
+	if (++last_request_id == 0)
+		last_request_id = 1;
+
+	((struct btt_message *) msg)->request_id = last_request_id;
+
+	return send(sock, msg, length, 0);
+}
+
+/* Send message together with descriptors (SCM_RIGHTS), the receiver
+ * takes them with btt_framing_take_fd. */
+ssize_t send_with_fds(int sock, const void *msg, size_t length,
+		const int *fds, unsigned int fds_num)
+{
+	char control[CMSG_SPACE(BTT_FRAMING_MAX_FDS * sizeof(int))];
+	struct iovec iov;
+	struct msghdr hdr;
+	struct cmsghdr *cmsg;
+
+	if (fds_num > BTT_FRAMING_MAX_FDS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	iov.iov_base = (void *) msg;
+	iov.iov_len = length;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memset(control, 0, sizeof(control));
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control;
+	hdr.msg_controllen = CMSG_SPACE(fds_num * sizeof(int));
+
+	cmsg = CMSG_FIRSTHDR(&hdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(fds_num * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, fds_num * sizeof(int));
+
+	return sendmsg(sock, &hdr, 0);
+}
@@ -42,6 +42,26 @@ extern bool list_contains(struct list_element *list, void *data,
 extern struct list_element *list_append(struct list_element *list,void *data);
 struct list_element *list_clear(struct list_element *list,
 		void (*data_destroy)(void *));
+
+/* Open addressing set of BD_ADDRs over a caller provided pool of
+ * 1 << bits slots, never allocates. An empty slot is 0, an address is
+ * stored as its 48 bits with bit 48 set. */
+struct bdaddr_set {
+	uint64_t *slots;
+	unsigned int bits;
+	unsigned int count;
+	/* addresses which did not fit */
+	unsigned int overflows;
+};
+
+#define BDADDR_SET_INITIALIZER(pool, pool_bits) { (pool), (pool_bits), 0, 0 }
+
+extern int bdaddr_set_insert(struct bdaddr_set *set, const uint8_t *bda,
+		bool *added);
+extern bool bdaddr_set_add(struct bdaddr_set *set, const uint8_t *bda);
+extern bool bdaddr_set_contains(const struct bdaddr_set *set,
+		const uint8_t *bda);
+extern void bdaddr_set_clear(struct bdaddr_set *set);
 extern void print_bdaddr(uint8_t *source);
 extern bool sscanf_bdaddr(char *src, uint8_t *dest);
 extern void byte_swap(uint8_t *src, uint8_t *dest);
@@ -55,21 +75,61 @@ extern bool sscanf_UUID_128(char *src, uint8_t *dest, bool invert,
 int get_hexlines_length(int i_arg, int argc, char **argv);
 int hexlines_to_data(int i_arg, int argc, char **argv, unsigned char *data);
 int connect_to_daemon_socket(void);
+extern uint64_t monotonic_ns(void);
+extern ssize_t send_request(int sock, void *msg, size_t length);
+extern ssize_t send_with_fds(int sock, const void *msg, size_t length,
+		const int *fds, unsigned int fds_num);
+extern bool msg_trailer_fits(size_t size, size_t trailer_offset,
+		const struct btt_message *msg);
+extern bool msg_copy_trailer(void *dest, size_t size, size_t trailer_offset,
+		const struct btt_message *msg);
+
+/* return FALSE if length of complete message is different
+ * from expected length, otherwise copy it into structure */
+#define MSG_COPY(ptr, msg) \
+		((((msg)->length + sizeof(struct btt_message)) != \
+		(sizeof(*(ptr)))) ? FALSE : \
+		(memcpy((ptr), (msg), sizeof(*(ptr))), TRUE))
 
-/* return FALSE if length of received structure is different
- * from expected length */
-#define RECV(ptr, sock) (((recv((sock), (ptr), \
-		sizeof(*(ptr)), 0)) != (sizeof(*(ptr)))) ? FALSE : TRUE)
+/* like MSG_COPY, but ptr is pointed to the message in place */
+#define MSG_CAST(ptr, msg) \
+		((((msg)->length + sizeof(struct btt_message)) != \
+		(sizeof(*(ptr)))) ? FALSE : \
+		((ptr) = (typeof(ptr)) (msg), TRUE))
 
 #define FILL_HDR(str, comm) \
 	{ \
 		(((str).hdr.command) = (comm)); \
 		(((str).hdr.length) = (sizeof((str)) - \
 				sizeof(struct btt_message))); \
+		(((str).hdr.request_id) = 0); \
 	}
 
 #define FILL_HDR_P(ptr, comm) FILL_HDR((*ptr), comm)
 
+/* Messages ending with a payload array (the trailer) may be sent without
+ * its unused part, hdr.length then covers only len bytes of the array. */
+#define TRIM_TRAILER(str, member, len) \
+	(((str).hdr.length) = (offsetof(typeof(str), member) + (len) - \
+			sizeof(struct btt_message)))
+
+#define TRAILER_LEN(str, member) \
+	((str).hdr.length + sizeof(struct btt_message) - \
+			offsetof(typeof(str), member))
+
+#define MSG_SIZE(str) ((str).hdr.length + sizeof(struct btt_message))
+
+/* MSG_COPY for messages with a trailer, only received bytes are copied */
+#define MSG_COPY_TRAILER(ptr, msg, member) \
+		msg_copy_trailer((ptr), sizeof(*(ptr)), \
+				offsetof(typeof(*(ptr)), member), (msg))
+
+/* MSG_CAST for messages with a trailer */
+#define MSG_CAST_TRAILER(ptr, msg, member) \
+		(msg_trailer_fits(sizeof(*(ptr)), \
+				offsetof(typeof(*(ptr)), member), (msg)) ? \
+		((ptr) = (typeof(ptr)) (msg), TRUE) : FALSE)
+
 #define FILL_MSG_P(p_data, ptr, comm) \
 	{ \
 		((ptr) = (typeof((ptr))) (p_data)); \